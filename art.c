@@ -0,0 +1,434 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "art.h"
+
+typedef enum
+{
+    ART_NODE4,
+    ART_NODE16,
+    ART_NODE48,
+    ART_NODE256
+} ArtNodeType;
+
+static const uint32_t NODE_CAPACITY[] = {4, 16, 48, 256};
+
+// Values per arena block; a block is allocated whenever the last one fills
+static const uint32_t ARENA_BLOCK_VALUES = 4096;
+
+struct ArtNode
+{
+    uint8_t type;
+    uint16_t num_children;
+};
+
+/* Children are nodes, or in the last level values in the arena */
+typedef struct
+{
+    ArtNode header;
+    uint8_t keys[4]; // sorted
+    void *children[4];
+} ArtNode4;
+
+typedef struct
+{
+    ArtNode header;
+    uint8_t keys[16]; // sorted
+    void *children[16];
+} ArtNode16;
+
+typedef struct
+{
+    ArtNode header;
+    uint8_t child_index[256]; // slot in children + 1 for each key byte, 0 if absent
+    void *children[48];
+} ArtNode48;
+
+typedef struct
+{
+    ArtNode header;
+    void *children[256]; // NULL if absent
+} ArtNode256;
+
+static const size_t NODE_SIZE[] = {sizeof(ArtNode4), sizeof(ArtNode16), sizeof(ArtNode48), sizeof(ArtNode256)};
+
+struct Art
+{
+    ArtNode *root;
+    uint32_t value_size;
+    uint32_t count;
+    uint64_t node_bytes;
+
+    uint8_t **blocks; // the arena
+    uint32_t num_blocks;
+    uint32_t blocks_capacity;
+    uint32_t block_used; // values handed out from the last block
+};
+
+static uint8_t key_byte(uint32_t key, uint32_t level)
+{
+    return key >> (8 * (ART_KEY_BYTES - 1 - level));
+}
+
+static ArtNode *new_node(Art *art, ArtNodeType type)
+{
+    ArtNode *node = calloc(1, NODE_SIZE[type]);
+    node->type = type;
+    art->node_bytes += NODE_SIZE[type];
+    return node;
+}
+
+Art *new_art(uint32_t value_size)
+{
+    Art *art = calloc(1, sizeof(Art));
+    art->value_size = value_size;
+    art->root = new_node(art, ART_NODE4);
+    return art;
+}
+
+uint32_t art_count(Art *art)
+{
+    return art->count;
+}
+
+/* Bytes held by nodes and by the arena's blocks */
+uint64_t art_memory_bytes(Art *art)
+{
+    return art->node_bytes + (uint64_t)art->num_blocks * ARENA_BLOCK_VALUES * art->value_size;
+}
+
+static void *arena_alloc(Art *art)
+{
+    if (art->num_blocks == 0 || art->block_used == ARENA_BLOCK_VALUES)
+    {
+        if (art->num_blocks == art->blocks_capacity)
+        {
+            art->blocks_capacity = art->blocks_capacity ? 2 * art->blocks_capacity : 16;
+            art->blocks = realloc(art->blocks, art->blocks_capacity * sizeof(uint8_t *));
+        }
+        art->blocks[art->num_blocks++] = malloc((size_t)ARENA_BLOCK_VALUES * art->value_size);
+        art->block_used = 0;
+    }
+    return art->blocks[art->num_blocks - 1] + (size_t)art->block_used++ * art->value_size;
+}
+
+/* The slot holding the child for byte, or NULL if there is none */
+static void **find_child(ArtNode *node, uint8_t byte)
+{
+    switch (node->type)
+    {
+    case ART_NODE4:
+    {
+        ArtNode4 *node4 = (ArtNode4 *)node;
+        for (uint32_t i = 0; i < node->num_children; i++)
+        {
+            if (node4->keys[i] == byte)
+            {
+                return &node4->children[i];
+            }
+        }
+        return NULL;
+    }
+    case ART_NODE16:
+    {
+        ArtNode16 *node16 = (ArtNode16 *)node;
+#ifdef __SSE2__
+        // all 16 key bytes are compared at once; bits past num_children are masked off
+        __m128i equal = _mm_cmpeq_epi8(_mm_set1_epi8(byte), _mm_loadu_si128((const __m128i *)node16->keys));
+        uint32_t matches = (uint32_t)_mm_movemask_epi8(equal) & ((1u << node->num_children) - 1);
+        return matches ? &node16->children[__builtin_ctz(matches)] : NULL;
+#else
+        for (uint32_t i = 0; i < node->num_children; i++)
+        {
+            if (node16->keys[i] == byte)
+            {
+                return &node16->children[i];
+            }
+        }
+        return NULL;
+#endif
+    }
+    case ART_NODE48:
+    {
+        ArtNode48 *node48 = (ArtNode48 *)node;
+        uint8_t slot = node48->child_index[byte];
+        return slot ? &node48->children[slot - 1] : NULL;
+    }
+    case ART_NODE256:
+    {
+        ArtNode256 *node256 = (ArtNode256 *)node;
+        return node256->children[byte] ? &node256->children[byte] : NULL;
+    }
+    }
+    return NULL;
+}
+
+/* The child with the smallest key byte >= byte, whose key byte is stored in found; NULL if none */
+static void *child_at_or_after(ArtNode *node, uint32_t byte, uint8_t *found)
+{
+    const uint8_t *keys = NULL;
+    void **children = NULL;
+    switch (node->type)
+    {
+    case ART_NODE4:
+        keys = ((ArtNode4 *)node)->keys;
+        children = ((ArtNode4 *)node)->children;
+        break;
+    case ART_NODE16:
+        keys = ((ArtNode16 *)node)->keys;
+        children = ((ArtNode16 *)node)->children;
+        break;
+    case ART_NODE48:
+        for (; byte < 256; byte++)
+        {
+            uint8_t slot = ((ArtNode48 *)node)->child_index[byte];
+            if (slot)
+            {
+                *found = byte;
+                return ((ArtNode48 *)node)->children[slot - 1];
+            }
+        }
+        return NULL;
+    case ART_NODE256:
+        for (; byte < 256; byte++)
+        {
+            if (((ArtNode256 *)node)->children[byte])
+            {
+                *found = byte;
+                return ((ArtNode256 *)node)->children[byte];
+            }
+        }
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < node->num_children; i++)
+    {
+        if (keys[i] >= byte)
+        {
+            *found = keys[i];
+            return children[i];
+        }
+    }
+    return NULL;
+}
+
+static void free_node(ArtNode *node, uint32_t level)
+{
+    if (level + 1 < ART_KEY_BYTES)
+    {
+        // below the last level every child is a node
+        uint8_t found;
+        void *child;
+        for (uint32_t byte = 0; (child = child_at_or_after(node, byte, &found)); byte = found + 1)
+        {
+            free_node(child, level + 1);
+        }
+    }
+    free(node);
+}
+
+void free_art(Art *art)
+{
+    free_node(art->root, 0);
+    for (uint32_t i = 0; i < art->num_blocks; i++)
+    {
+        free(art->blocks[i]);
+    }
+    free(art->blocks);
+    free(art);
+}
+
+/* Moves the children of a full node into one of the next size up, freeing the old node */
+static ArtNode *grow(Art *art, ArtNode *node)
+{
+    ArtNode *bigger = new_node(art, node->type + 1);
+    bigger->num_children = node->num_children;
+    switch (node->type)
+    {
+    case ART_NODE4:
+        memcpy(((ArtNode16 *)bigger)->keys, ((ArtNode4 *)node)->keys, 4);
+        memcpy(((ArtNode16 *)bigger)->children, ((ArtNode4 *)node)->children, 4 * sizeof(void *));
+        break;
+    case ART_NODE16:
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            ((ArtNode48 *)bigger)->child_index[((ArtNode16 *)node)->keys[i]] = i + 1;
+        }
+        memcpy(((ArtNode48 *)bigger)->children, ((ArtNode16 *)node)->children, 16 * sizeof(void *));
+        break;
+    case ART_NODE48:
+        for (uint32_t byte = 0; byte < 256; byte++)
+        {
+            uint8_t slot = ((ArtNode48 *)node)->child_index[byte];
+            if (slot)
+            {
+                ((ArtNode256 *)bigger)->children[byte] = ((ArtNode48 *)node)->children[slot - 1];
+            }
+        }
+        break;
+    }
+    art->node_bytes -= NODE_SIZE[node->type];
+    free(node);
+    return bigger;
+}
+
+/* Adds an empty child for byte, which must be absent, to the node at ref, growing it if it is full */
+static void **add_child(Art *art, void **ref, uint8_t byte)
+{
+    ArtNode *node = *ref;
+    if (node->num_children == NODE_CAPACITY[node->type])
+    {
+        node = *ref = grow(art, node);
+    }
+
+    uint8_t *keys;
+    void **children;
+    switch (node->type)
+    {
+    case ART_NODE4:
+        keys = ((ArtNode4 *)node)->keys;
+        children = ((ArtNode4 *)node)->children;
+        break;
+    case ART_NODE16:
+        keys = ((ArtNode16 *)node)->keys;
+        children = ((ArtNode16 *)node)->children;
+        break;
+    case ART_NODE48:
+        // nothing is removed, so the slots in use are always the first num_children
+        ((ArtNode48 *)node)->child_index[byte] = node->num_children + 1;
+        return &((ArtNode48 *)node)->children[node->num_children++];
+    default:
+        node->num_children++;
+        return &((ArtNode256 *)node)->children[byte];
+    }
+
+    // keep the key bytes sorted, so in-order walks need no sorting
+    uint32_t position = node->num_children;
+    while (position > 0 && keys[position - 1] > byte)
+    {
+        position--;
+    }
+    memmove(keys + position + 1, keys + position, node->num_children - position);
+    memmove(children + position + 1, children + position, (node->num_children - position) * sizeof(void *));
+    keys[position] = byte;
+    children[position] = NULL;
+    node->num_children++;
+    return &children[position];
+}
+
+/* Returns the value stored under key, or NULL */
+void *art_find(Art *art, uint32_t key)
+{
+    void *node = art->root;
+    for (uint32_t level = 0; level < ART_KEY_BYTES; level++)
+    {
+        void **slot = find_child(node, key_byte(key, level));
+        if (slot == NULL)
+        {
+            return NULL;
+        }
+        node = *slot;
+    }
+    return node;
+}
+
+/*
+Returns the value stored under key, adding it if absent. inserted says which:
+a new value is uninitialized and the caller fills in its value_size bytes
+*/
+void *art_insert(Art *art, uint32_t key, bool *inserted)
+{
+    void **ref = (void **)&art->root;
+    *inserted = false;
+    for (uint32_t level = 0; level < ART_KEY_BYTES; level++)
+    {
+        uint8_t byte = key_byte(key, level);
+        void **slot = find_child(*ref, byte);
+        if (slot == NULL)
+        {
+            slot = add_child(art, ref, byte);
+            *slot = level + 1 < ART_KEY_BYTES ? (void *)new_node(art, ART_NODE4) : arena_alloc(art);
+            *inserted = level + 1 == ART_KEY_BYTES;
+        }
+        ref = slot;
+    }
+    art->count += *inserted;
+    return *ref;
+}
+
+/* Index of the most significant byte where a and b differ; they must differ */
+static uint32_t first_differing_byte(uint32_t a, uint32_t b)
+{
+    return __builtin_clz(a ^ b) / 8;
+}
+
+/*
+Walks down from iterator->nodes[level], reached by the first level bytes of
+key, to the first value whose key is at least key. A subtree with nothing
+left moves the search on to the next prefix, starting again from the level
+where that prefix first differs
+*/
+static void *seek_from(ArtIterator *iterator, uint32_t level, uint32_t key)
+{
+    while (true)
+    {
+        uint8_t found;
+        void *child = child_at_or_after(iterator->nodes[level], key_byte(key, level), &found);
+        if (child == NULL)
+        {
+            uint32_t prefix_bits = 8 * level;
+            uint32_t prefix = level ? key >> (32 - prefix_bits) : 0;
+            if (level == 0 || prefix == (1u << prefix_bits) - 1)
+            {
+                iterator->end = true;
+                return NULL;
+            }
+            uint32_t next = (prefix + 1) << (32 - prefix_bits);
+            level = first_differing_byte(key, next);
+            key = next;
+            continue;
+        }
+
+        if (found != key_byte(key, level))
+        {
+            // a larger byte here: the smallest key under it has zeros below
+            uint32_t shift = 8 * (ART_KEY_BYTES - 1 - level);
+            uint32_t prefix_mask = level ? ~0u << (32 - 8 * level) : 0;
+            key = (key & prefix_mask) | (uint32_t)found << shift;
+        }
+        if (level + 1 == ART_KEY_BYTES)
+        {
+            iterator->key = key;
+            return child;
+        }
+        iterator->nodes[++level] = child;
+    }
+}
+
+/*
+Starts an in-order walk at the first key >= key and returns its value, or NULL
+if there is none; iterator->key holds the key. The tree must not change while
+the walk goes on
+*/
+void *art_seek(ArtIterator *iterator, Art *art, uint32_t key)
+{
+    iterator->art = art;
+    iterator->nodes[0] = art->root;
+    iterator->end = false;
+    return seek_from(iterator, 0, key);
+}
+
+/* Returns the value after the last one returned, or NULL at the end. Mostly a step within the last node */
+void *art_next(ArtIterator *iterator)
+{
+    if (iterator->end || iterator->key == UINT32_MAX)
+    {
+        iterator->end = true;
+        return NULL;
+    }
+    uint32_t next = iterator->key + 1;
+    return seek_from(iterator, first_differing_byte(iterator->key, next), next);
+}
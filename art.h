@@ -0,0 +1,46 @@
+#ifndef ART_H
+#define ART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Adaptive radix tree mapping uint32 keys to fixed-size values, for DB_OPEN_IN_MEMORY
+
+Each level of the tree consumes one byte of the key, most significant first,
+so lookups take at most four steps and keys come out in order. A node is as
+small as its children allow: up to 4 or 16 children are kept as sorted key
+bytes, up to 48 behind a 256-entry byte index, and beyond that in a direct
+array (Leis et al., "The Adaptive Radix Tree"). Keys are all four bytes long,
+so no path compression is needed to bound the depth.
+
+Values live in an arena next to the tree, allocated in blocks and never moved,
+so pointers to them stay valid until the tree is freed. Nothing is removed.
+*/
+
+#define ART_KEY_BYTES 4
+
+typedef struct Art Art;
+typedef struct ArtNode ArtNode;
+
+/* Position of an in-order walk; see art_seek */
+typedef struct
+{
+    Art *art;
+    ArtNode *nodes[ART_KEY_BYTES]; // nodes[i] is the node reached by the first i bytes of key
+    uint32_t key;                  // key of the value last returned
+    bool end;
+} ArtIterator;
+
+Art *new_art(uint32_t value_size);
+void free_art(Art *art);
+
+uint32_t art_count(Art *art);
+uint64_t art_memory_bytes(Art *art);
+void *art_find(Art *art, uint32_t key);
+void *art_insert(Art *art, uint32_t key, bool *inserted);
+
+void *art_seek(ArtIterator *iterator, Art *art, uint32_t key);
+void *art_next(ArtIterator *iterator);
+
+#endif
@@ -0,0 +1,1365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btree.h"
+#include "trace.h"
+
+/*
+Allocates a Table describing the tree rooted at root_page_idx
+Leaf cells hold key then value; internal cells hold child page, row count, then key
+*/
+Table *new_table(Pager *pager, uint32_t root_page_idx, KeyType key_type, uint32_t key_size, uint32_t value_size)
+{
+    Table *table = (Table *)malloc(sizeof(Table));
+    table->root_page_idx = root_page_idx;
+    table->pager = pager;
+    table->key_type = key_type;
+    table->key_size = key_size;
+    table->value_size = value_size;
+    table->leaf_cell_size = key_size + value_size;
+    table->leaf_max_cells = LEAF_NODE_AVAILABLE_CELL_SPACE / table->leaf_cell_size;
+    table->internal_cell_size = INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_COUNT_SIZE + key_size;
+    table->internal_max_cells = INTERNAL_NODE_AVAILABLE_CELL_SPACE / table->internal_cell_size;
+    if (table->internal_max_cells > INTERNAL_NODE_MAX_CELLS)
+    {
+        table->internal_max_cells = INTERNAL_NODE_MAX_CELLS;
+    }
+    memset(&table->stats, 0, sizeof(table->stats));
+    return table;
+}
+
+/* Orders keys of table: negative, zero or positive as a is below, equal to or above b */
+int compare_keys(Table *table, const void *a, const void *b)
+{
+    uint32_t id_a, id_b;
+    uint32_t id_offset = table->key_size - ID_SIZE; // the row id is the last field of every key
+
+    if (table->key_type == KEY_COLUMN_AND_ID)
+    {
+        int result = memcmp(a, b, id_offset);
+        if (result != 0)
+        {
+            return result;
+        }
+    }
+
+    memcpy(&id_a, a + id_offset, ID_SIZE);
+    memcpy(&id_b, b + id_offset, ID_SIZE);
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+void print_constants()
+{
+    printf("ROW_SIZE: %d\n", ROW_SIZE);
+    printf("COMMON_NODE_HEADER_SIZE: %d\n", COMMON_NODE_HEADER_SIZE);
+    printf("LEAF_NODE_HEADER_SIZE: %d\n", LEAF_NODE_HEADER_SIZE);
+    printf("LEAF_NODE_CELL_SIZE: %d\n", LEAF_NODE_CELL_SIZE);
+    printf("LEAF_NODE_AVAILABLE_CELL_SPACE: %d\n", LEAF_NODE_AVAILABLE_CELL_SPACE);
+    printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELLS);
+    printf("INTERNAL_NODE_CELL_SIZE: %d\n", INTERNAL_NODE_CELL_SIZE);
+    printf("INTERNAL_NODE_MAX_CELLS: %d\n", INTERNAL_NODE_MAX_CELLS);
+}
+
+/* Returns pointer to num cells in a leaf node */
+uint32_t *leaf_node_num_cells(void *node)
+{
+    return node + LEAF_NODE_NUM_CELLS_OFFSET;
+}
+
+/* Returns pointer to cell at cell_idx of leaf node */
+void *leaf_node_cell(Table *table, void *node, uint32_t cell_idx)
+{
+    return node + LEAF_NODE_HEADER_SIZE + cell_idx * table->leaf_cell_size;
+}
+
+/* Returns pointer to key at cell_idx of leaf node */
+void *leaf_node_key(Table *table, void *node, uint32_t cell_idx)
+{
+    return leaf_node_cell(table, node, cell_idx);
+}
+
+/* Returns pointer to value at cell_idx of leaf node */
+void *leaf_node_value(Table *table, void *node, uint32_t cell_idx)
+{
+    return leaf_node_cell(table, node, cell_idx) + table->key_size;
+}
+
+uint32_t *leaf_node_next_leaf(void *node)
+{
+    return node + LEAF_NODE_NEXT_LEAF_OFFSET;
+}
+
+uint32_t *internal_node_cell(Table *table, void *node, uint32_t cell_idx)
+{
+    return (uint32_t *)(node + INTERNAL_NODE_HEADER_SIZE + cell_idx * table->internal_cell_size);
+}
+
+void *internal_node_key(Table *table, void *node, uint32_t cell_idx)
+{
+    return (void *)internal_node_cell(table, node, cell_idx) + INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_COUNT_SIZE;
+}
+
+/* Returns pointer to num keys for internal node */
+uint32_t *internal_node_num_keys(void *node)
+{
+    return (uint32_t *)(node + INTERNAL_NODE_NUM_KEYS_OFFSET);
+}
+
+/* Returns pointer to page index of right child of internal node */
+uint32_t *internal_node_right_child(void *node)
+{
+    return (uint32_t *)(node + INTERNAL_NODE_RIGHT_CHILD_OFFSET);
+}
+
+/* Returns pointer to page index of internal node i'th child */
+uint32_t *internal_node_child(Table *table, void *node, uint32_t child_idx)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+    if (child_idx > num_keys)
+    {
+        fprintf(stderr, "Tried to access child idx (%d) when there are only (%d) keys\n", child_idx, num_keys);
+        exit(EXIT_FAILURE);
+    }
+
+    if (child_idx == num_keys)
+    {
+        if (*internal_node_right_child(node) == INVALID_PAGE_IDX)
+        {
+            fprintf(stderr, "Tried to access right child of node when it is empty\n");
+            exit(EXIT_FAILURE);
+        }
+        return internal_node_right_child(node);
+    }
+
+    uint32_t *child = internal_node_cell(table, node, child_idx);
+    if (*child == INVALID_PAGE_IDX)
+    {
+        fprintf(stderr, "Tried to access child %d of node, but was invalid page\n", child_idx);
+        exit(EXIT_FAILURE);
+    }
+
+    return child;
+}
+
+/* Returns pointer to the number of rows under the right child of internal node */
+uint32_t *internal_node_right_count(void *node)
+{
+    return (uint32_t *)(node + INTERNAL_NODE_RIGHT_COUNT_OFFSET);
+}
+
+/* Returns pointer to the number of rows under internal node's i'th child */
+uint32_t *internal_node_child_count(Table *table, void *node, uint32_t child_idx)
+{
+    if (child_idx == *internal_node_num_keys(node))
+    {
+        return internal_node_right_count(node);
+    }
+    return internal_node_cell(table, node, child_idx) + 1;
+}
+
+NodeType get_node_type(void *node)
+{
+    uint8_t value = *((uint8_t *)node + NODE_TYPE_OFFSET);
+    return (NodeType)value;
+}
+
+void set_node_type(void *node, NodeType type)
+{
+    uint8_t value = (uint8_t)type;
+    *(uint8_t *)(node + NODE_TYPE_OFFSET) = value;
+}
+
+bool is_node_root(void *node)
+{
+    uint8_t is_root = *(uint8_t *)(node + IS_ROOT_OFFSET);
+    return (bool)is_root;
+}
+
+void set_node_root(void *node, bool is_root)
+{
+    uint8_t value = (uint8_t)is_root;
+    *(uint8_t *)(node + IS_ROOT_OFFSET) = value;
+}
+
+void initialize_leaf_node(void *node)
+{
+    *leaf_node_num_cells(node) = 0;
+    *leaf_node_next_leaf(node) = 0; // 0 represents no sibling
+    set_node_type(node, NODE_LEAF);
+    set_node_root(node, false);
+}
+
+void initialize_internal_node(void *node)
+{
+    set_node_type(node, NODE_INTERNAL);
+    set_node_root(node, false);
+    *internal_node_num_keys(node) = 0;
+    *internal_node_right_child(node) = INVALID_PAGE_IDX; // empty node has no right child
+    *internal_node_right_count(node) = 0;
+}
+
+uint32_t *node_parent(void *node)
+{
+    return node + PARENT_POINTER_OFFSET;
+}
+
+/*
+Returns a pointer to the largest key under node
+It points into a page, so copy it before modifying the tree
+*/
+void *get_node_max_key(Table *table, void *node)
+{
+    if (get_node_type(node) == NODE_LEAF)
+    {
+        // max key will be the last key in the node
+        return leaf_node_key(table, node, *leaf_node_num_cells(node) - 1);
+    }
+
+    // internal node, recursively get the max key of the right child
+    void *right_child = get_page(table->pager, *internal_node_right_child(node));
+    return get_node_max_key(table, right_child);
+}
+
+/* Returns the number of rows (leaf cells) under node */
+uint32_t node_row_count(Table *table, void *node)
+{
+    if (get_node_type(node) == NODE_LEAF)
+    {
+        return *leaf_node_num_cells(node);
+    }
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i <= *internal_node_num_keys(node); i++)
+    {
+        count += *internal_node_child_count(table, node, i);
+    }
+    return count;
+}
+
+void indent(uint32_t level)
+{
+    for (uint32_t i = 0; i < level; i++)
+    {
+        printf("  ");
+    }
+}
+
+void print_key(Table *table, const void *key)
+{
+    uint32_t id;
+    uint32_t id_offset = table->key_size - ID_SIZE;
+    memcpy(&id, key + id_offset, ID_SIZE);
+
+    if (table->key_type == KEY_COLUMN_AND_ID)
+    {
+        printf("%.*s (%d)", (int)strnlen(key, id_offset), (const char *)key, id);
+    }
+    else
+    {
+        printf("%d", id);
+    }
+}
+
+void print_tree(Table *table, uint32_t page_idx, uint32_t indentation_level)
+{
+    Pager *pager = table->pager;
+    void *node = get_page(pager, page_idx);
+    uint32_t num_keys, child;
+
+    switch (get_node_type(node))
+    {
+    case (NODE_LEAF):
+        num_keys = *leaf_node_num_cells(node);
+        indent(indentation_level);
+        printf("- leaf (size %d)\n", num_keys);
+
+        for (uint32_t i = 0; i < num_keys; i++)
+        {
+            indent(indentation_level + 1);
+            printf("- ");
+            print_key(table, leaf_node_key(table, node, i));
+            printf("\n");
+        }
+
+        break;
+    case (NODE_INTERNAL):
+        num_keys = *internal_node_num_keys(node);
+        indent(indentation_level);
+        printf("- internal (size %d)\n", num_keys);
+
+        for (uint32_t i = 0; i < num_keys; i++)
+        {
+            child = *internal_node_child(table, node, i);
+            print_tree(table, child, indentation_level + 1);
+            indent(indentation_level + 1);
+            printf("- key ");
+            print_key(table, internal_node_key(table, node, i));
+            printf("\n");
+        }
+
+        child = *internal_node_right_child(node);
+        print_tree(table, child, indentation_level + 1);
+        break;
+    }
+}
+
+/* Adds up nodes and cells per level of the tree below page_idx, level 0 being the root */
+static void count_levels(Table *table, uint32_t page_idx, uint32_t level, uint32_t *nodes, uint32_t *cells)
+{
+    void *node = get_page(table->pager, page_idx);
+    nodes[level]++;
+    if (get_node_type(node) == NODE_LEAF)
+    {
+        cells[level] += *leaf_node_num_cells(node);
+        return;
+    }
+
+    uint32_t num_keys = *internal_node_num_keys(node);
+    cells[level] += num_keys;
+    for (uint32_t i = 0; i <= num_keys; i++)
+    {
+        count_levels(table, *internal_node_child(table, node, i), level + 1, nodes, cells);
+    }
+}
+
+/*
+Prints the shape of the tree: how full each level is, and how the leaf chain
+is laid out in the file. A hop to the next page is sequential; forward jumps
+and backward hops turn an in-order scan into random reads
+*/
+void print_tree_analysis(Table *table)
+{
+    uint32_t depth = table_depth(table);
+    uint32_t *nodes = calloc(depth, sizeof(uint32_t));
+    uint32_t *cells = calloc(depth, sizeof(uint32_t));
+    count_levels(table, table->root_page_idx, 0, nodes, cells);
+
+    printf("depth %d, %d rows\n", depth, table_count(table));
+    for (uint32_t level = 0; level < depth; level++)
+    {
+        bool leaves = level + 1 == depth;
+        uint32_t max_cells = leaves ? table->leaf_max_cells : table->internal_max_cells;
+        printf("  level %d: %d %s, %d %s, %.1f%% full\n", level, nodes[level], leaves ? "leaves" : "internal",
+               cells[level], leaves ? "cells" : "keys", 100.0 * cells[level] / ((double)nodes[level] * max_cells));
+    }
+
+    uint32_t sequential = 0, forward = 0, backward = 0;
+    Cursor *cursor = init_cursor_table_start(table);
+    uint32_t page_idx = cursor->page_idx;
+    free(cursor);
+    for (uint32_t next; (next = *leaf_node_next_leaf(get_page(table->pager, page_idx))) != 0; page_idx = next)
+    {
+        sequential += next == page_idx + 1;
+        forward += next > page_idx + 1;
+        backward += next < page_idx;
+    }
+    printf("  leaf chain: %d sequential, %d forward jumps, %d backward\n", sequential, forward, backward);
+
+    free(nodes);
+    free(cells);
+}
+
+/*
+Serialize row by copying row contents into destination byte array
+*/
+void serialize_row(const Row *source, void *destination)
+{
+    memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
+    memcpy(destination + USERNAME_OFFSET, source->username, USERNAME_SIZE);
+    memcpy(destination + EMAIL_OFFSET, source->email, EMAIL_SIZE);
+}
+
+/*
+Deserialize row by copying destination byte array contents into Row struct
+*/
+void deserialize_row(void *source, Row *destination)
+{
+    memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
+    memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE);
+    memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);
+    destination->username[USERNAME_SIZE] = 0;
+    destination->email[EMAIL_SIZE] = 0;
+}
+
+/*
+Convert cursor object to memory address described by cursor
+*/
+void *cursor_value(Cursor *cursor)
+{
+    Table *table = cursor->table;
+
+    // Get node address //
+    void *node = get_page(table->pager, cursor->page_idx);
+
+    return leaf_node_value(table, node, cursor->cell_idx);
+}
+
+/* Key of the cell under the cursor, read without touching the row body */
+void *cursor_key(Cursor *cursor)
+{
+    void *node = get_page(cursor->table->pager, cursor->page_idx);
+
+    return leaf_node_key(cursor->table, node, cursor->cell_idx);
+}
+
+/* Advance cursor to next cell */
+uint32_t internal_node_find_child(Table *table, void *node, const void *key);
+uint32_t internal_node_child_index(Table *table, void *node, uint32_t child_page_idx);
+
+/*
+Starts reading the leaves that follow leaf_page_idx in its parent, so a scan
+finds them in memory by the time it gets there. The lookahead stops at the
+parent's last child; the next parent's leaves are requested on its first leaf.
+*/
+void prefetch_next_leaves(Table *table, uint32_t leaf_page_idx)
+{
+    void *leaf = get_page(table->pager, leaf_page_idx);
+    if (is_node_root(leaf))
+    {
+        return;
+    }
+    void *parent = get_page(table->pager, *node_parent(leaf));
+    uint32_t num_keys = *internal_node_num_keys(parent);
+
+    // find the leaf's slot by its largest key, falling back to a search by page for an empty leaf
+    uint32_t num_cells = *leaf_node_num_cells(leaf);
+    uint32_t child_idx = num_cells > 0 ? internal_node_find_child(table, parent, leaf_node_key(table, leaf, num_cells - 1))
+                                       : num_keys + 1;
+    if (child_idx > num_keys || *internal_node_child(table, parent, child_idx) != leaf_page_idx)
+    {
+        child_idx = internal_node_child_index(table, parent, leaf_page_idx);
+    }
+
+    for (uint32_t i = child_idx + 1; i <= num_keys && i <= child_idx + SCAN_READAHEAD_LEAVES; i++)
+    {
+        pager_prefetch(table->pager, *internal_node_child(table, parent, i));
+    }
+}
+
+void advance_cursor(Cursor *cursor)
+{
+    uint32_t page_idx = cursor->page_idx;
+    void *node = get_page(cursor->table->pager, page_idx);
+    cursor->cell_idx += 1;
+
+    uint32_t num_cells = *leaf_node_num_cells(node);
+
+    if (cursor->cell_idx >= num_cells)
+    {
+        // go to next leaf node
+        uint32_t next_leaf_idx = *leaf_node_next_leaf(node);
+
+        if (next_leaf_idx == 0)
+        {
+            // no more leaf nodes, set end of table to true
+            cursor->end_of_table = true;
+        }
+        else
+        {
+            prefetch_next_leaves(cursor->table, page_idx);
+            cursor->page_idx = next_leaf_idx;
+            cursor->cell_idx = 0;
+        }
+    }
+}
+
+void create_root_node(Table *table, uint32_t right_child_page_idx)
+{
+    table->stats.root_splits++;
+    // so at this point, the root has been split up and the right child has been made
+    // now we need to create the left child, copy the contents of the root into it, and then
+    // re-init the old root as the new root
+
+    // why table and right child index as an argument?
+    // table is identified by page idx of root, so we need to update that after creating the root
+    // we also need to update the parent pointer of the right child
+
+    /*
+    Handle splitting the root.
+    Old root copied to new page, becomes left child.
+    Address of right child passed in.
+    Re-initialize root page to contain the new root node.
+    New root node points to two children.
+    */
+
+    // get current root
+    void *root = get_page(table->pager, table->root_page_idx);
+    void *right_child = get_page(table->pager, right_child_page_idx);
+
+    // init a left child node
+    uint32_t left_child_page_idx = get_unused_page_idx(table->pager);
+    void *left_child = get_page(table->pager, left_child_page_idx);
+
+    mark_page_dirty(table->pager, table->root_page_idx);
+    mark_page_dirty(table->pager, right_child_page_idx);
+    mark_page_dirty(table->pager, left_child_page_idx);
+
+    if (get_node_type(root) == NODE_INTERNAL)
+    {
+        initialize_internal_node(right_child);
+        initialize_internal_node(left_child);
+    }
+
+    /* Left child has data copied from old root */
+    memcpy(left_child, root, PAGE_SIZE);
+    set_node_root(left_child, false);
+
+    if (get_node_type(left_child) == NODE_INTERNAL)
+    {
+        /*
+        This code is necessary because:
+        When we move the old root to become the left child, its page index changes
+        (it's no longer at the root page index)
+
+        All the children of this node still have their parent pointers
+        pointing to the old root's page index
+
+        We need to update all these children to point to the
+        new page index of their parent
+        */
+
+        void *child;
+        for (int i = 0; i < *internal_node_num_keys(left_child); i++)
+        {
+            uint32_t child_page_idx = *internal_node_child(table, left_child, i);
+            child = get_page(table->pager, child_page_idx);
+            mark_page_dirty(table->pager, child_page_idx);
+            *node_parent(child) = left_child_page_idx;
+        }
+        child = get_page(table->pager, *internal_node_right_child(left_child));
+        mark_page_dirty(table->pager, *internal_node_right_child(left_child));
+        *node_parent(child) = left_child_page_idx;
+    }
+
+    /* Root node is a new internal node with one key and two children */
+    initialize_internal_node(root);
+    set_node_root(root, true);
+    *internal_node_num_keys(root) = 1;
+
+    // set the left child pointer, count and key
+    *internal_node_child(table, root, 0) = left_child_page_idx;
+    *internal_node_child_count(table, root, 0) = node_row_count(table, left_child);
+    void *left_child_max_key = get_node_max_key(table, left_child);
+    memcpy(internal_node_key(table, root, 0), left_child_max_key, table->key_size);
+
+    // set the right child pointer and count
+    *internal_node_right_child(root) = right_child_page_idx;
+    *internal_node_right_count(root) = node_row_count(table, right_child);
+
+    // set parent of left and right child to root
+    *node_parent(left_child) = table->root_page_idx;
+    *node_parent(right_child) = table->root_page_idx;
+}
+
+Cursor *leaf_node_find(Table *table, uint32_t page_idx, const void *key)
+{
+    // get leaf node
+    void *node = get_page(table->pager, page_idx);
+
+    // get num cells in leaf node
+    uint32_t num_cells = *leaf_node_num_cells(node);
+
+    // init two pointers, one at first cell and one past last cell
+    int32_t min_idx = 0;
+    int32_t max_idx = num_cells;
+
+    // perform binary search to find the correct cell idx to insert key
+    // printf("DEBUG: Performing binary search with min_idx (%d) and max_idx (%d) initial\n", min_idx, max_idx);
+    while (min_idx < max_idx)
+    {
+        uint32_t index = (min_idx + max_idx) / 2;
+        int comparison = compare_keys(table, key, leaf_node_key(table, node, index));
+        if (comparison == 0)
+        {
+            min_idx = index;
+            break;
+        }
+        if (comparison > 0)
+        {
+            min_idx = index + 1;
+        }
+        else
+        {
+            max_idx = index;
+        }
+    }
+
+    // printf("DEBUG: Insert key at idx %d\n", min_index);
+    Cursor *cursor = (Cursor *)malloc(sizeof(Cursor));
+    cursor->table = table;
+    cursor->cell_idx = min_idx;
+    cursor->page_idx = page_idx;
+    cursor->end_of_table = (min_idx == num_cells);
+
+    return cursor;
+}
+
+/*
+Return the index of the child within node `which should contain the given key.
+*/
+uint32_t internal_node_find_child(Table *table, void *node, const void *key)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+
+    uint32_t min_index = 0;
+    uint32_t max_index = num_keys; /* there is one more child than key */
+    while (min_index < max_index)
+    {
+        uint32_t index = (min_index + max_index) / 2;
+        void *key_to_right = internal_node_key(table, node, index);
+
+        if (compare_keys(table, key_to_right, key) >= 0)
+        {
+            max_index = index;
+        }
+        else
+        {
+
+            min_index = index + 1;
+        }
+    }
+
+    return min_index;
+}
+
+/* Update key inside internal node */
+void update_internal_node_key(Table *table, void *node, const void *old_key, const void *new_key)
+{
+    // find the index inside node where old_key is
+    uint32_t old_child_index = internal_node_find_child(table, node, old_key);
+
+    if (old_child_index == *internal_node_num_keys(node))
+    {
+        // updating key associated with right child
+        return;
+    }
+
+    // update its value
+    memcpy(internal_node_key(table, node, old_child_index), new_key, table->key_size);
+}
+
+void internal_node_split_and_insert(Table *table, uint32_t parent_idx, uint32_t child_idx);
+
+/* Returns the index among node's children of the child stored in child_page_idx */
+uint32_t internal_node_child_index(Table *table, void *node, uint32_t child_page_idx)
+{
+    uint32_t num_keys = *internal_node_num_keys(node);
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        if (*internal_node_cell(table, node, i) == child_page_idx)
+        {
+            return i;
+        }
+    }
+    return num_keys;
+}
+
+/*
+Recomputes the count stored for the node at page_idx in its parent, then the
+parent's in its own parent, up to the root. Splits call this for the nodes they
+change, since they move children and their rows between nodes
+*/
+void refresh_counts_to_root(Table *table, uint32_t page_idx)
+{
+    void *node = get_page(table->pager, page_idx);
+    while (!is_node_root(node))
+    {
+        uint32_t parent_idx = *node_parent(node);
+        void *parent = get_page(table->pager, parent_idx);
+        mark_page_dirty(table->pager, parent_idx);
+        uint32_t child_idx = internal_node_child_index(table, parent, page_idx);
+        *internal_node_child_count(table, parent, child_idx) = node_row_count(table, node);
+
+        page_idx = parent_idx;
+        node = parent;
+    }
+}
+
+/* Adds num_rows to the counts on the path from the root to the leaf at page_idx, which just received key */
+void add_counts_to_root(Table *table, uint32_t page_idx, const void *key, uint32_t num_rows)
+{
+    void *node = get_page(table->pager, page_idx);
+    while (!is_node_root(node))
+    {
+        // the leaf was found by descending with key, so key picks the same child on the way back up
+        uint32_t parent_idx = *node_parent(node);
+        void *parent = get_page(table->pager, parent_idx);
+        mark_page_dirty(table->pager, parent_idx);
+        *internal_node_child_count(table, parent, internal_node_find_child(table, parent, key)) += num_rows;
+
+        node = parent;
+    }
+}
+
+/*
+Add a new child/key pair to parent that corresponds to child
+note: parent_idx and child_idx are nodes represented by page indexes
+*/
+void internal_node_insert(Table *table, uint32_t parent_idx, uint32_t child_idx)
+{
+    // get parent and child node
+    void *parent = get_page(table->pager, parent_idx);
+    void *child = get_page(table->pager, child_idx);
+    mark_page_dirty(table->pager, parent_idx);
+
+    uint32_t original_num_keys = *internal_node_num_keys(parent);
+
+    /* Case 1: internal node is full */
+    if (original_num_keys >= table->internal_max_cells)
+    {
+        internal_node_split_and_insert(table, parent_idx, child_idx);
+        return;
+    }
+
+    /* Case 2: internal node is empty */
+    uint32_t right_child_idx = *internal_node_right_child(parent);
+    if (right_child_idx == INVALID_PAGE_IDX)
+    {
+        // internal node is empty, set the right child
+        *internal_node_right_child(parent) = child_idx;
+        *internal_node_right_count(parent) = node_row_count(table, child);
+        return;
+    }
+
+    /* Case 3: Internal node is neither empty nor full */
+
+    // get max key of child (this will be inserted as the key)
+    void *max_key = get_node_max_key(table, child);
+
+    // determine where to insert key in parent node
+    uint32_t idx_to_insert = internal_node_find_child(table, parent, max_key);
+
+    void *right_child = get_page(table->pager, right_child_idx);
+    void *right_child_max_key = get_node_max_key(table, right_child);
+
+    uint32_t right_child_count = *internal_node_right_count(parent);
+    uint32_t child_count = node_row_count(table, child);
+
+    // update number of keys
+    *internal_node_num_keys(parent) = original_num_keys + 1;
+
+    if (compare_keys(table, max_key, right_child_max_key) > 0)
+    {
+        // replace right child
+        // move right child/key pair to last child index (original_num_keys)
+        *internal_node_child(table, parent, original_num_keys) = right_child_idx;
+        *internal_node_child_count(table, parent, original_num_keys) = right_child_count;
+        memcpy(internal_node_key(table, parent, original_num_keys), right_child_max_key, table->key_size);
+
+        // set new right child
+        *internal_node_right_child(parent) = child_idx;
+        *internal_node_right_count(parent) = child_count;
+    }
+    else
+    {
+        // make room for new cell
+        for (uint32_t i = original_num_keys; i > idx_to_insert; i--)
+        {
+            void *dest = internal_node_cell(table, parent, i);
+            void *src = internal_node_cell(table, parent, i - 1);
+            memcpy(dest, src, table->internal_cell_size);
+        }
+
+        // insert cell (child, count and key)
+        *internal_node_child(table, parent, idx_to_insert) = child_idx;
+        *internal_node_child_count(table, parent, idx_to_insert) = child_count;
+        memcpy(internal_node_key(table, parent, idx_to_insert), max_key, table->key_size);
+    }
+}
+
+/*
+Splits node represented by parent_pg_idx
+Then inserts child node into left or right sibling, depending on its max key
+*/
+void internal_node_split_and_insert(Table *table, uint32_t parent_pg_idx, uint32_t child_pg_idx)
+{
+    TRACE_BEGIN(span);
+    table->stats.internal_splits++;
+    // track the node to be split
+    uint32_t old_page_idx = parent_pg_idx;
+    void *old_node = get_page(table->pager, parent_pg_idx);
+    mark_page_dirty(table->pager, old_page_idx);
+    // this key will be updated in the parent after the split
+    uint8_t old_max[MAX_KEY_SIZE];
+    memcpy(old_max, get_node_max_key(table, old_node), table->key_size);
+
+    // find the key to add into the node
+    void *child_node = get_page(table->pager, child_pg_idx);
+    mark_page_dirty(table->pager, child_pg_idx);
+    uint8_t child_max_key[MAX_KEY_SIZE];
+    memcpy(child_max_key, get_node_max_key(table, child_node), table->key_size);
+
+    // allocate memory for a new node (right sibling)
+    uint32_t new_page_idx = get_unused_page_idx(table->pager);
+
+    uint32_t splitting_root = is_node_root(old_node);
+
+    void *parent;
+    void *new_node;
+    if (splitting_root)
+    {
+        // Handle splitting root
+        create_root_node(table, new_page_idx);
+        parent = get_page(table->pager, table->root_page_idx);
+        // at this point, right child of new root should be empty
+
+        // the page index of the node to split will change if it was originally the root
+        // so get the updated values
+        old_page_idx = *internal_node_child(table, parent, 0);
+        old_node = get_page(table->pager, old_page_idx);
+        mark_page_dirty(table->pager, old_page_idx);
+    }
+    else
+    {
+        /* if we are not splitting the root, we cannot insert our
+        newly created sibling node into the old node’s parent right away,
+        because it does not yet contain any keys and therefore will
+        not be placed at the right index among the other key/child pairs
+        which may or may not already be present in the parent node.
+        need to move keys into the sibling node before inserting into the parent. */
+
+        // parent of the newly split nodes will either be the new root, or the parent of the old node
+        parent = get_page(table->pager, *node_parent(old_node));
+        mark_page_dirty(table->pager, *node_parent(old_node));
+
+        // why are the two lines below not needed if the old_node is the root?
+        // create_root_node calls get_page on the new_page_idx
+        // create_root_node also calls initialize_internal_node
+        new_node = get_page(table->pager, new_page_idx);
+        mark_page_dirty(table->pager, new_page_idx);
+        initialize_internal_node(new_node);
+    }
+
+    /* Move the right child + half the keys from old node to sibling node */
+    uint32_t *old_num_keys = internal_node_num_keys(old_node);
+
+    // Move the old node's right child to sibling node
+    uint32_t cur_page_idx = *internal_node_right_child(old_node);
+    void *cur = get_page(table->pager, cur_page_idx);
+    mark_page_dirty(table->pager, cur_page_idx);
+    internal_node_insert(table, new_page_idx, cur_page_idx);
+    *node_parent(cur) = new_page_idx;
+    *internal_node_right_child(old_node) = INVALID_PAGE_IDX;
+
+    // Move half the keys
+    for (uint32_t i = table->internal_max_cells - 1; i > table->internal_max_cells / 2; i--)
+    {
+        uint32_t cur_idx = *internal_node_child(table, old_node, i);
+        void *cur_node = get_page(table->pager, cur_idx);
+        mark_page_dirty(table->pager, cur_idx);
+
+        // insert pair into sibling
+        internal_node_insert(table, new_page_idx, cur_idx);
+
+        // update child's parent value to point to sibling
+        *node_parent(cur_node) = new_page_idx;
+
+        // decrement old node's number of keys
+        // this effectively erases the cells, but without freeing memory
+        (*old_num_keys)--;
+    }
+
+    // set the highest key of old node as its right child
+    uint32_t new_right_child_idx = *internal_node_child(table, old_node, *old_num_keys - 1);
+    *internal_node_right_child(old_node) = new_right_child_idx;
+    *internal_node_right_count(old_node) = *internal_node_child_count(table, old_node, *old_num_keys - 1);
+    (*old_num_keys)--;
+
+    // Insert child node in old node or sibling node depending on value of its max key
+    void *max_after_split = get_node_max_key(table, old_node);
+    uint32_t destination_idx = compare_keys(table, child_max_key, max_after_split) < 0 ? old_page_idx : new_page_idx;
+
+    internal_node_insert(table, destination_idx, child_pg_idx);
+
+    *node_parent(child_node) = destination_idx;
+
+    // Update original node's key in parent to reflect its new max after the split
+    update_internal_node_key(table, parent, old_max, get_node_max_key(table, old_node));
+
+    if (!splitting_root)
+    {
+        // add the sibling to the old node's parent. Its parent pointer is set first
+        // because the insert may split that parent and move the sibling again
+        *node_parent(new_node) = *node_parent(old_node);
+        internal_node_insert(table, *node_parent(old_node), new_page_idx);
+    }
+
+    // children moved between the two halves, so their counts up the tree are stale
+    refresh_counts_to_root(table, old_page_idx);
+    refresh_counts_to_root(table, new_page_idx);
+    TRACE_END(span, "internal_node_split_and_insert");
+}
+
+/*
+Returns a cursor that points to where a key is
+If the key doesn't exist, it points to where it should be inserted
+
+page_idx refers to the internal node to search
+*/
+Cursor *internal_node_find(Table *table, uint32_t page_idx, const void *key)
+{
+    void *node = get_page(table->pager, page_idx);
+
+    // find which child of node will contain key
+    uint32_t child_idx = internal_node_find_child(table, node, key);
+
+    // convert child index to page index, then use pg index to get pointer to child
+    uint32_t child_page_idx = *internal_node_child(table, node, child_idx);
+    void *child = get_page(table->pager, child_page_idx);
+
+    if (get_node_type(child) == NODE_INTERNAL)
+    {
+        return internal_node_find(table, child_page_idx, key);
+    }
+    else
+    {
+        return leaf_node_find(table, child_page_idx, key);
+    }
+}
+
+/*
+Create new node and move half the cells over
+Insert value into one of the two nodes
+Update parent or create a new parent
+*/
+void leaf_node_split_and_insert(Cursor *cursor, const void *key, const void *value)
+{
+    // printf("DEBUG: Splitting leaf node\n");
+    TRACE_BEGIN(span);
+    Table *table = cursor->table;
+    table->stats.leaf_splits++;
+    void *old_node = get_page(table->pager, cursor->page_idx);
+    uint8_t old_max[MAX_KEY_SIZE];
+    memcpy(old_max, get_node_max_key(table, old_node), table->key_size);
+
+    // create new leaf node
+    uint32_t new_page_idx = get_unused_page_idx(cursor->table->pager);
+    void *new_node = get_page(cursor->table->pager, new_page_idx);
+    // note that get_page will increment num_pages
+
+    mark_page_dirty(cursor->table->pager, cursor->page_idx);
+    mark_page_dirty(cursor->table->pager, new_page_idx);
+
+    initialize_leaf_node(new_node);
+    *node_parent(new_node) = *node_parent(old_node); // set parent of new node to be same as old node
+
+    // update next leaf
+    // have right node point to what left node used to point to
+    *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
+    // have left node point to right node
+    *leaf_node_next_leaf(old_node) = new_page_idx;
+
+    /*
+    Migrate half the values from old node to new node
+
+    All existing keys plus new key should be divided
+    evenly between old (left) and new (right) nodes.
+
+    Starting from the right, move each key to correct position.
+    Keys to the right of the new key will be shifted right to make room for it
+    */
+    uint32_t right_split_count = (table->leaf_max_cells + 1) / 2;
+    uint32_t left_split_count = (table->leaf_max_cells + 1) - right_split_count;
+    for (int32_t i = table->leaf_max_cells; i >= 0; i--)
+    {
+        // Determine which node to put cell in
+        void *destination_node;
+        if (i < left_split_count)
+        {
+            destination_node = old_node;
+        }
+        else
+        {
+            destination_node = new_node;
+        }
+
+        uint32_t index_within_node = i % left_split_count;
+        void *destination = leaf_node_cell(table, destination_node, index_within_node);
+        if (i == cursor->cell_idx)
+        {
+            // insert new key and value (row) at cell_idx
+            memcpy(leaf_node_key(table, destination_node, index_within_node), key, table->key_size);
+            memcpy(leaf_node_value(table, destination_node, index_within_node), value, table->value_size);
+        }
+        else if (i > cursor->cell_idx)
+        {
+            // shift cells to the right to make room for insert
+            memcpy(destination, leaf_node_cell(table, old_node, i - 1), table->leaf_cell_size);
+        }
+        else
+        {
+            memcpy(destination, leaf_node_cell(table, old_node, i), table->leaf_cell_size);
+        }
+    }
+
+    // update cell counts
+    *leaf_node_num_cells(old_node) = left_split_count;
+    *leaf_node_num_cells(new_node) = right_split_count;
+
+    // update parents
+    if (is_node_root(old_node))
+    {
+        // old node was root and did not have parent node
+        // create parent node and set as new root
+        create_root_node(cursor->table, new_page_idx);
+    }
+    else
+    {
+        // update key in parent to be new max after split
+        uint32_t parent_idx = *node_parent(old_node);
+        void *new_max = get_node_max_key(table, old_node);
+        void *parent_node = get_page(table->pager, parent_idx);
+        mark_page_dirty(table->pager, parent_idx);
+        update_internal_node_key(table, parent_node, old_max, new_max);
+
+        // insert key/child pointer of new node into internal node
+        internal_node_insert(cursor->table, parent_idx, new_page_idx);
+
+        refresh_counts_to_root(table, cursor->page_idx);
+        refresh_counts_to_root(table, new_page_idx);
+    }
+    TRACE_END(span, "leaf_node_split_and_insert");
+}
+
+/*
+Inserts a key value pair at position represented by cursor into a leaf node
+*/
+void leaf_node_insert_cell(Cursor *cursor, const void *key, const void *value)
+{
+    // get address of node pointed by cursor
+    Table *table = cursor->table;
+    Pager *pager = table->pager;
+    void *node = get_page(pager, cursor->page_idx);
+
+    // get number of cells currently in leaf node
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (num_cells >= table->leaf_max_cells)
+    {
+        // leaf node is full, need to split node
+        leaf_node_split_and_insert(cursor, key, value);
+        return;
+    }
+
+    mark_page_dirty(pager, cursor->page_idx);
+
+    // shift cells over if not inserting at end of node
+    if (cursor->cell_idx < num_cells)
+    {
+        table->stats.cells_shifted += num_cells - cursor->cell_idx;
+        for (uint32_t i = num_cells; i > cursor->cell_idx; i--)
+        {
+            // copy cell[i-1] into cell[i]
+            memcpy(leaf_node_cell(table, node, i), leaf_node_cell(table, node, i - 1), table->leaf_cell_size); // dest, src, num bytes
+        }
+    }
+
+    // insert key and value into cell
+    memcpy(leaf_node_key(table, node, cursor->cell_idx), key, table->key_size);
+    memcpy(leaf_node_value(table, node, cursor->cell_idx), value, table->value_size);
+    // printf("DEBUG: inserted key (%d) and row (%s)\n", key, value->username);
+
+    // increment num cells in leaf node
+    *(leaf_node_num_cells(node)) += 1;
+    add_counts_to_root(table, cursor->page_idx, key, 1);
+}
+
+/*
+Inserts num_new cells with sorted keys, none already present, into the leaf at
+page_idx. They must all belong in this leaf and fit in it. The merge runs from
+the back, so each existing cell moves at most once, and the counts up to the
+root are updated once. The cell index each key lands at is stored in cell_idxs
+*/
+void leaf_node_merge_cells(Table *table, uint32_t page_idx, const void *keys, const void *values, uint32_t num_new,
+                           uint32_t *cell_idxs)
+{
+    Pager *pager = table->pager;
+    void *node = get_page(pager, page_idx);
+    mark_page_dirty(pager, page_idx);
+
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    uint32_t old_left = num_cells; // existing cells not yet placed
+    uint32_t new_left = num_new;
+    for (uint32_t dest = num_cells + num_new; new_left > 0;)
+    {
+        dest--;
+        const void *key = keys + (new_left - 1) * table->key_size;
+        if (old_left == 0 || compare_keys(table, key, leaf_node_key(table, node, old_left - 1)) > 0)
+        {
+            new_left--;
+            memcpy(leaf_node_key(table, node, dest), key, table->key_size);
+            memcpy(leaf_node_value(table, node, dest), values + new_left * table->value_size, table->value_size);
+            cell_idxs[new_left] = dest;
+        }
+        else
+        {
+            old_left--;
+            memcpy(leaf_node_cell(table, node, dest), leaf_node_cell(table, node, old_left), table->leaf_cell_size);
+            table->stats.cells_shifted++;
+        }
+    }
+
+    *leaf_node_num_cells(node) += num_new;
+    add_counts_to_root(table, page_idx, keys, num_new);
+}
+
+/*
+Returns a cursor pointing to position of key
+If key does not exist, return position where it should be inserted
+*/
+Cursor *table_find(Table *table, const void *key)
+{
+    TRACE_BEGIN(span);
+    table->stats.descents++;
+    // get root node
+    void *node = get_page(table->pager, table->root_page_idx);
+
+    Cursor *cursor;
+    if (get_node_type(node) == NODE_INTERNAL)
+    {
+        cursor = internal_node_find(table, table->root_page_idx, key);
+    }
+    else
+    {
+        cursor = leaf_node_find(table, table->root_page_idx, key);
+    }
+    TRACE_END(span, "table_find");
+    return cursor;
+}
+
+/* Returns the number of levels in the tree; a lone root leaf has depth 1 */
+uint32_t table_depth(Table *table)
+{
+    uint32_t depth = 1;
+    void *node = get_page(table->pager, table->root_page_idx);
+    while (get_node_type(node) == NODE_INTERNAL)
+    {
+        node = get_page(table->pager, *internal_node_child(table, node, 0));
+        depth++;
+    }
+    return depth;
+}
+
+/* Initializes a cursor pointing to start of a table */
+Cursor *init_cursor_table_start(Table *table)
+{
+    // the smallest possible key (all zero bytes) finds the leftmost leaf node
+    uint8_t smallest_key[MAX_KEY_SIZE] = {0};
+    Cursor *cursor = table_find(table, smallest_key);
+    void *node = get_page(table->pager, cursor->page_idx);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    cursor->end_of_table = (num_cells == 0); // start is also end of table if there are no cells
+
+    return cursor;
+}
+
+/* Returns the number of rows in the tree */
+uint32_t table_count(Table *table)
+{
+    return node_row_count(table, get_page(table->pager, table->root_page_idx));
+}
+
+/* Returns the number of keys in the tree below key, adding up the counts of the children left of the descent */
+uint32_t table_rank(Table *table, const void *key)
+{
+    table->stats.descents++;
+    uint32_t rank = 0;
+    uint32_t page_idx = table->root_page_idx;
+    void *node = get_page(table->pager, page_idx);
+    while (get_node_type(node) == NODE_INTERNAL)
+    {
+        uint32_t child_idx = internal_node_find_child(table, node, key);
+        for (uint32_t i = 0; i < child_idx; i++)
+        {
+            rank += *internal_node_child_count(table, node, i);
+        }
+        page_idx = *internal_node_child(table, node, child_idx);
+        node = get_page(table->pager, page_idx);
+    }
+
+    Cursor *cursor = leaf_node_find(table, page_idx, key);
+    rank += cursor->cell_idx;
+    free(cursor);
+    return rank;
+}
+
+/*
+Returns a cursor at the n'th key (counting from 0) in key order, descending by
+the child counts. If n is past the last key the cursor is at the end of the table
+*/
+Cursor *table_find_nth(Table *table, uint32_t n)
+{
+    table->stats.descents++;
+    uint32_t page_idx = table->root_page_idx;
+    void *node = get_page(table->pager, page_idx);
+    while (get_node_type(node) == NODE_INTERNAL)
+    {
+        uint32_t num_keys = *internal_node_num_keys(node);
+        uint32_t child_idx = 0;
+        while (child_idx < num_keys && n >= *internal_node_child_count(table, node, child_idx))
+        {
+            n -= *internal_node_child_count(table, node, child_idx);
+            child_idx++;
+        }
+        page_idx = *internal_node_child(table, node, child_idx);
+        node = get_page(table->pager, page_idx);
+    }
+
+    Cursor *cursor = (Cursor *)malloc(sizeof(Cursor));
+    cursor->table = table;
+    cursor->page_idx = page_idx;
+    cursor->cell_idx = n;
+    cursor->end_of_table = (n >= *leaf_node_num_cells(node));
+    return cursor;
+}
+
+/*
+Converts the internal nodes under page_idx from the layout without row counts
+(format version 1) by shifting their cells and filling in the counts.
+Returns the number of rows under page_idx
+*/
+uint32_t add_internal_node_counts(Table *table, uint32_t page_idx)
+{
+    void *node = get_page(table->pager, page_idx);
+    if (get_node_type(node) == NODE_LEAF)
+    {
+        return *leaf_node_num_cells(node);
+    }
+
+    uint32_t num_keys = *internal_node_num_keys(node);
+    if (num_keys > table->internal_max_cells)
+    {
+        fprintf(stderr, "Internal node %d has too many keys to add row counts.\n", page_idx);
+        exit(EXIT_FAILURE);
+    }
+
+    // version 1 cells were child then key, right after a header without the right child count
+    uint32_t old_header_size = INTERNAL_NODE_HEADER_SIZE - INTERNAL_NODE_COUNT_SIZE;
+    uint32_t old_cell_size = INTERNAL_NODE_CHILD_SIZE + table->key_size;
+    uint8_t old_node[PAGE_SIZE];
+    memcpy(old_node, node, PAGE_SIZE);
+
+    mark_page_dirty(table->pager, page_idx);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < num_keys; i++)
+    {
+        uint8_t *old_cell = old_node + old_header_size + i * old_cell_size;
+        uint32_t child_page_idx;
+        memcpy(&child_page_idx, old_cell, INTERNAL_NODE_CHILD_SIZE);
+
+        *internal_node_child(table, node, i) = child_page_idx;
+        memcpy(internal_node_key(table, node, i), old_cell + INTERNAL_NODE_CHILD_SIZE, table->key_size);
+        *internal_node_child_count(table, node, i) = add_internal_node_counts(table, child_page_idx);
+        count += *internal_node_child_count(table, node, i);
+    }
+    *internal_node_right_count(node) = add_internal_node_counts(table, *internal_node_right_child(node));
+    return count + *internal_node_right_count(node);
+}
+
+/* Allocates a page holding an empty node of the given type and returns its index */
+static uint32_t new_node(Table *table, NodeType type)
+{
+    uint32_t page_idx = get_unused_page_idx(table->pager);
+    void *node = get_page(table->pager, page_idx);
+    mark_page_dirty(table->pager, page_idx);
+    if (type == NODE_LEAF)
+    {
+        initialize_leaf_node(node);
+    }
+    else
+    {
+        initialize_internal_node(node);
+    }
+    return page_idx;
+}
+
+/*
+Builds one level of internal nodes over the num_children nodes in children,
+writing the new nodes' page indexes back into children. Children are shared
+out evenly, so no node is left with a single child. Returns the node count
+*/
+static uint32_t bulk_load_internal_level(Table *table, uint32_t *children, uint32_t num_children)
+{
+    uint32_t fanout = table->internal_max_cells + 1;
+    uint32_t num_nodes = (num_children + fanout - 1) / fanout;
+    uint32_t next_child = 0;
+
+    for (uint32_t i = 0; i < num_nodes; i++)
+    {
+        uint32_t num_node_children = num_children / num_nodes + (i < num_children % num_nodes ? 1 : 0);
+        uint32_t page_idx = new_node(table, NODE_INTERNAL);
+        void *node = get_page(table->pager, page_idx);
+        *internal_node_num_keys(node) = num_node_children - 1;
+
+        for (uint32_t j = 0; j < num_node_children; j++)
+        {
+            uint32_t child_page_idx = children[next_child++];
+            void *child = get_page(table->pager, child_page_idx);
+            mark_page_dirty(table->pager, child_page_idx);
+            *node_parent(child) = page_idx;
+
+            if (j + 1 < num_node_children)
+            {
+                *internal_node_child(table, node, j) = child_page_idx;
+                *internal_node_child_count(table, node, j) = node_row_count(table, child);
+                memcpy(internal_node_key(table, node, j), get_node_max_key(table, child), table->key_size);
+            }
+            else
+            {
+                *internal_node_right_child(node) = child_page_idx;
+                *internal_node_right_count(node) = node_row_count(table, child);
+            }
+        }
+        children[i] = page_idx; // the level being built never overtakes the one it reads
+    }
+    return num_nodes;
+}
+
+/*
+Builds a tree in table's pager holding num_cells cells, which next_cell writes
+one at a time in key order, and returns its root page index. Leaves are filled
+completely and take consecutive pages, so the leaf chain runs forward through
+the file; internal levels are then built bottom up
+*/
+uint32_t table_bulk_load(Table *table, uint32_t num_cells, BulkLoadNext next_cell, void *source)
+{
+    uint32_t capacity = 16;
+    uint32_t *leaves = malloc(capacity * sizeof(uint32_t));
+    uint32_t num_leaves = 0;
+    uint32_t loaded = 0;
+    void *leaf = NULL;
+
+    do
+    {
+        uint32_t page_idx = new_node(table, NODE_LEAF);
+        if (leaf)
+        {
+            *leaf_node_next_leaf(leaf) = page_idx;
+        }
+        leaf = get_page(table->pager, page_idx);
+        if (num_leaves == capacity)
+        {
+            capacity *= 2;
+            leaves = realloc(leaves, capacity * sizeof(uint32_t));
+        }
+        leaves[num_leaves++] = page_idx;
+
+        uint32_t leaf_cells = 0;
+        while (loaded < num_cells && leaf_cells < table->leaf_max_cells)
+        {
+            next_cell(source, leaf_node_cell(table, leaf, leaf_cells++));
+            loaded++;
+        }
+        *leaf_node_num_cells(leaf) = leaf_cells;
+    } while (loaded < num_cells);
+
+    uint32_t num_nodes = num_leaves;
+    while (num_nodes > 1)
+    {
+        num_nodes = bulk_load_internal_level(table, leaves, num_nodes);
+    }
+    uint32_t root_page_idx = leaves[0];
+    set_node_root(get_page(table->pager, root_page_idx), true);
+    free(leaves);
+    return root_page_idx;
+}
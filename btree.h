@@ -0,0 +1,202 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "db.h"
+#include "pager.h"
+
+// #define size_of_attribute(Struct, Attribute) sizeof(((Struct *)0)->Attribute)
+// const uint32_t ID_SIZE = size_of_attribute(Row, id);
+// const uint32_t USERNAME_SIZE = size_of_attribute(Row, username);
+// const uint32_t EMAIL_SIZE = size_of_attribute(Row, email);
+static const uint32_t ID_SIZE = 4;                          // bytes
+static const uint32_t USERNAME_SIZE = COLUMN_USERNAME_SIZE; // bytes
+static const uint32_t EMAIL_SIZE = COLUMN_EMAIL_SIZE;       // bytes
+static const uint32_t ID_OFFSET = 0;
+static const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
+static const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
+static const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
+
+// Common node header layout
+// Contains: node type, is root, pointer to parent
+static const uint32_t NODE_TYPE_SIZE = sizeof(uint8_t);
+static const uint32_t NODE_TYPE_OFFSET = 0;
+static const uint32_t IS_ROOT_SIZE = sizeof(uint8_t);
+static const uint32_t IS_ROOT_OFFSET = NODE_TYPE_SIZE;
+static const uint32_t PARENT_POINTER_SIZE = sizeof(uint32_t);
+static const uint32_t PARENT_POINTER_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
+static const uint8_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
+
+// Additional headers for leaf nodes
+// Contains: number of key-value pairs (aka cells)
+static const uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
+static const uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
+static const uint32_t LEAF_NODE_NEXT_LEAF_SIZE = sizeof(uint32_t);
+static const uint32_t LEAF_NODE_NEXT_LEAF_OFFSET = LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
+static const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
+                                              LEAF_NODE_NUM_CELLS_SIZE +
+                                              LEAF_NODE_NEXT_LEAF_SIZE;
+
+// Body layout for leaf nodes
+// Leaf nodes contains keys and values (rows), keyed by the row id
+// These constants describe the main table; index trees size their cells from their Table
+static const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
+static const uint32_t LEAF_NODE_KEY_OFFSET = 0;
+static const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
+static const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_SIZE;
+static const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
+static const uint32_t LEAF_NODE_AVAILABLE_CELL_SPACE = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
+static const uint32_t LEAF_NODE_MAX_CELLS = LEAF_NODE_AVAILABLE_CELL_SPACE / LEAF_NODE_CELL_SIZE;
+
+static const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
+static const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+
+/*
+Internal node header layout
+Contains: num_keys, right_child pointer, number of rows under the right child
+*/
+static const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(uint32_t);
+static const uint32_t INTERNAL_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
+static const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(uint32_t);
+static const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
+static const uint32_t INTERNAL_NODE_COUNT_SIZE = sizeof(uint32_t);
+static const uint32_t INTERNAL_NODE_RIGHT_COUNT_OFFSET = INTERNAL_NODE_RIGHT_CHILD_OFFSET + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+static const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
+                                                  INTERNAL_NODE_NUM_KEYS_SIZE +
+                                                  INTERNAL_NODE_RIGHT_CHILD_SIZE +
+                                                  INTERNAL_NODE_COUNT_SIZE;
+
+/*
+Internal node body layout
+The body is an array of cells where each cell contains a child pointer, the
+number of rows (leaf cells) under that child, and a key.
+Every key should be the maximum key contained in the child to its left.
+The counts let rank and position queries descend without visiting the leaves.
+*/
+static const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
+static const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
+static const uint32_t INTERNAL_NODE_CELL_SIZE =
+    INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_COUNT_SIZE + INTERNAL_NODE_KEY_SIZE;
+static const uint32_t INTERNAL_NODE_AVAILABLE_CELL_SPACE = PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE;
+#ifndef INTERNAL_NODE_MAX_CELLS_LIMIT
+#define INTERNAL_NODE_MAX_CELLS_LIMIT 3 // for testing; benchmarks raise it to the page capacity
+#endif
+static const uint32_t INTERNAL_NODE_MAX_CELLS = INTERNAL_NODE_MAX_CELLS_LIMIT;
+// static const uint32_t INTERNAL_NODE_MAX_CELLS = INTERNAL_NODE_AVAILABLE_CELL_SPACE / INTERNAL_NODE_CELL_SIZE;
+
+// Leaves a scan asks the pager to read ahead of the one it is on
+static const uint32_t SCAN_READAHEAD_LEAVES = 16;
+
+// Secondary index keys are a column value followed by the row id
+#define MAX_KEY_SIZE (COLUMN_EMAIL_SIZE + sizeof(uint32_t))
+
+typedef enum
+{
+    NODE_INTERNAL,
+    NODE_LEAF
+} NodeType;
+
+typedef enum
+{
+    KEY_ROW_ID,       // uint32 row id (the main table)
+    KEY_COLUMN_AND_ID // zero-padded column bytes, then the uint32 row id (secondary indexes)
+} KeyType;
+
+/* Counters of the work done on one tree since it was opened or last reset */
+typedef struct
+{
+    uint64_t leaf_splits;
+    uint64_t internal_splits;
+    uint64_t root_splits;   // create_root_node calls: the tree grew a level
+    uint64_t descents;      // root to leaf searches
+    uint64_t cells_shifted; // cells leaf_node_insert_cell moved right to make room
+} TreeStats;
+
+/*
+A B-tree stored in the pager's pages
+Every node of a tree has the same key and value size; the cell sizes and
+capacities follow from them.
+*/
+typedef struct
+{
+    uint32_t root_page_idx; // page index of the root node
+    Pager *pager;
+    KeyType key_type;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t leaf_cell_size;
+    uint32_t leaf_max_cells;
+    uint32_t internal_cell_size;
+    uint32_t internal_max_cells;
+    TreeStats stats;
+} Table;
+
+/* Writes the next cell of a bulk load into cell, from whatever source holds it */
+typedef void (*BulkLoadNext)(void *source, void *cell);
+
+/* Describes a position in a Table */
+typedef struct
+{
+    Table *table;
+    uint32_t page_idx;
+    uint32_t cell_idx;
+    bool end_of_table; // Indicates a position one past the last element
+} Cursor;
+
+Table *new_table(Pager *pager, uint32_t root_page_idx, KeyType key_type, uint32_t key_size, uint32_t value_size);
+int compare_keys(Table *table, const void *a, const void *b);
+
+void print_constants();
+void print_tree(Table *table, uint32_t page_idx, uint32_t indentation_level);
+void print_tree_analysis(Table *table);
+
+/* Node accessors */
+uint32_t *leaf_node_num_cells(void *node);
+void *leaf_node_cell(Table *table, void *node, uint32_t cell_idx);
+void *leaf_node_key(Table *table, void *node, uint32_t cell_idx);
+void *leaf_node_value(Table *table, void *node, uint32_t cell_idx);
+uint32_t *leaf_node_next_leaf(void *node);
+uint32_t *internal_node_cell(Table *table, void *node, uint32_t cell_idx);
+void *internal_node_key(Table *table, void *node, uint32_t cell_idx);
+uint32_t *internal_node_num_keys(void *node);
+uint32_t *internal_node_right_child(void *node);
+uint32_t *internal_node_right_count(void *node);
+uint32_t *internal_node_child(Table *table, void *node, uint32_t child_idx);
+uint32_t *internal_node_child_count(Table *table, void *node, uint32_t child_idx);
+uint32_t *node_parent(void *node);
+NodeType get_node_type(void *node);
+void set_node_type(void *node, NodeType type);
+bool is_node_root(void *node);
+void set_node_root(void *node, bool is_root);
+void initialize_leaf_node(void *node);
+void initialize_internal_node(void *node);
+void *get_node_max_key(Table *table, void *node);
+uint32_t node_row_count(Table *table, void *node);
+
+/* Row (de)serialization */
+void serialize_row(const Row *source, void *destination);
+void deserialize_row(void *source, Row *destination);
+
+/* Cursors */
+Cursor *table_find(Table *table, const void *key);
+Cursor *leaf_node_find(Table *table, uint32_t page_idx, const void *key);
+Cursor *init_cursor_table_start(Table *table);
+uint32_t table_depth(Table *table);
+uint32_t table_count(Table *table);
+uint32_t table_rank(Table *table, const void *key);
+Cursor *table_find_nth(Table *table, uint32_t n);
+void *cursor_value(Cursor *cursor);
+void *cursor_key(Cursor *cursor);
+void advance_cursor(Cursor *cursor);
+void prefetch_next_leaves(Table *table, uint32_t leaf_page_idx);
+
+/* Mutation */
+void leaf_node_insert_cell(Cursor *cursor, const void *key, const void *value);
+void leaf_node_merge_cells(Table *table, uint32_t page_idx, const void *keys, const void *values, uint32_t num_new,
+                           uint32_t *cell_idxs);
+uint32_t add_internal_node_counts(Table *table, uint32_t page_idx);
+uint32_t table_bulk_load(Table *table, uint32_t num_cells, BulkLoadNext next_cell, void *source);
+
+#endif
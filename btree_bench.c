@@ -0,0 +1,461 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "btree.h"
+#include "db.h"
+#include "trace.h"
+#include "workload.h"
+
+/*
+B-tree benchmark: inserts, point lookups and scans through the C API
+
+For each table size a fresh file is loaded three ways: ids in ascending order,
+in random order (also with DB_OPEN_BUFFERED_INSERTS), and Zipfian (ids in the order a skewed stream over a key space
+of 8x the rows first produces them, so a few hot regions fill early and the
+tail arrives scattered). The randomly loaded table is then queried with
+uniform and Zipfian point lookups (hot ids spread over the table), 100-row
+range scans from random ids, and full scans. The mem_ workloads repeat the
+random load and the queries with DB_OPEN_IN_MEMORY, and time reading the
+table into memory at open and writing it back as a sorted snapshot. Last,
+that snapshot is rewritten by VACUUM as plain pages and then compressed
+(DB_OPEN_COMPRESSED), and after each a full scan runs with the file dropped
+from the kernel page cache, so the pair compares bytes read against the CPU
+spent decompressing.
+
+Every operation is timed into a latency histogram. Throughput is operations
+over the wall time of the whole loop, timing included, and CPU time is the
+process's over the same span. Pages touched per operation are get_page calls,
+from db_stats, and file size is the table's page count once flushed, or the
+bytes its compressed pages take.
+
+Page size and internal node fanout are build parameters:
+    make -B btree_bench BENCH_PAGE_SIZE=8192 BENCH_FANOUT=64
+--json prints a single JSON document instead of a table, for comparing runs
+across commits.
+*/
+
+static const char *BENCH_FILE = "btree_bench.db";
+static const char *WARMUP_FILE = "btree_bench.db-warmup";
+static const uint64_t SEED = 1;
+static const double ZIPFIAN_THETA = 0.99;
+static const uint32_t ZIPFIAN_KEY_SPACE_FACTOR = 8; // Zipfian loads draw ids from rows * this
+static const uint32_t RANGE_SCAN_ROWS = 100;
+static const uint32_t FULL_SCANS = 3;
+
+typedef struct
+{
+    const char *workload;
+    uint32_t rows;
+    uint64_t ops;
+    uint64_t elapsed_ns;
+    uint64_t pages_touched; // get_page calls
+    uint64_t page_misses;
+    uint64_t file_bytes;
+    uint64_t cpu_start_ns;
+    uint64_t cpu_ns;
+    LatencyHistogram latency;
+} Result;
+
+typedef struct
+{
+    bool json;
+    uint32_t lookups; // point lookups per table; range scans are lookups / RANGE_SCAN_ROWS
+    uint32_t num_results;
+} Bench;
+
+static uint64_t cpu_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static Database *open_fresh(uint32_t flags)
+{
+    unlink(BENCH_FILE);
+    unlink(WARMUP_FILE);
+    return db_open_with_flags(BENCH_FILE, flags);
+}
+
+static void close_and_remove(Database *db)
+{
+    db_close(db);
+    unlink(BENCH_FILE);
+    unlink(WARMUP_FILE);
+}
+
+/* Starts a result: resets the counters so db_stats covers just this workload */
+static void begin_result(Result *result, Database *db, const char *workload, uint32_t rows)
+{
+    memset(result, 0, sizeof(*result));
+    result->workload = workload;
+    result->rows = rows;
+    histogram_reset(&result->latency);
+    db_reset_stats(db);
+    result->cpu_start_ns = cpu_clock_ns();
+}
+
+static void end_result(Bench *bench, Result *result, Database *db, uint64_t elapsed_ns)
+{
+    DbStats stats;
+    db_stats(db, &stats);
+    result->cpu_ns = cpu_clock_ns() - result->cpu_start_ns;
+    result->elapsed_ns = elapsed_ns;
+    result->ops = result->latency.count;
+    result->pages_touched = stats.page_hits + stats.page_misses;
+    result->page_misses = stats.page_misses;
+    result->file_bytes = stats.file_bytes;
+
+    double ops_per_s = result->ops * 1e9 / result->elapsed_ns;
+    double pages_per_op = (double)result->pages_touched / result->ops;
+    double cpu_ns_per_op = (double)result->cpu_ns / result->ops;
+    if (bench->json)
+    {
+        printf("%s\n    {\"workload\": \"%s\", \"rows\": %u, \"ops\": %llu, \"ops_per_s\": %.0f, "
+               "\"ns_per_op\": {\"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, "
+               "\"max\": %llu}, \"cpu_ns_per_op\": %.1f, \"pages_per_op\": %.2f, \"page_misses\": %llu, "
+               "\"file_bytes\": %llu}",
+               bench->num_results ? "," : "", result->workload, result->rows, (unsigned long long)result->ops,
+               ops_per_s, (double)result->latency.sum / result->ops,
+               (unsigned long long)histogram_percentile(&result->latency, 50),
+               (unsigned long long)histogram_percentile(&result->latency, 90),
+               (unsigned long long)histogram_percentile(&result->latency, 99),
+               (unsigned long long)histogram_percentile(&result->latency, 99.9),
+               (unsigned long long)result->latency.max, cpu_ns_per_op, pages_per_op,
+               (unsigned long long)result->page_misses,
+               (unsigned long long)result->file_bytes);
+    }
+    else
+    {
+        printf("%-18s %9u %12.0f %9llu %9llu %9llu %11.0f %10.2f %12llu\n", result->workload, result->rows, ops_per_s,
+               (unsigned long long)histogram_percentile(&result->latency, 50),
+               (unsigned long long)histogram_percentile(&result->latency, 99),
+               (unsigned long long)histogram_percentile(&result->latency, 99.9), cpu_ns_per_op, pages_per_op,
+               (unsigned long long)result->file_bytes);
+    }
+    fflush(stdout);
+    bench->num_results++;
+}
+
+/* Inserts ids in order, timing each put; buffered inserts are timed up to the end of their last flush */
+static void bench_insert(Bench *bench, const char *workload, const uint32_t *ids, uint32_t rows, uint32_t flags)
+{
+    Database *db = open_fresh(flags);
+    Row row = {0};
+    strcpy(row.username, "user");
+    strcpy(row.email, "user@example.com");
+
+    Result result;
+    begin_result(&result, db, workload, rows);
+    uint64_t start = trace_clock_ns();
+    uint64_t last = start;
+    for (uint32_t i = 0; i < rows; i++)
+    {
+        row.id = ids[i];
+        if (db_put(db, &row) != DB_OK)
+        {
+            fprintf(stderr, "Insert of id %u failed.\n", ids[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (i == rows - 1 && db_flush_inserts(db) != DB_OK)
+        {
+            fprintf(stderr, "Flushing buffered inserts failed.\n");
+            exit(EXIT_FAILURE);
+        }
+        uint64_t now = trace_clock_ns();
+        histogram_record(&result.latency, now - last);
+        last = now;
+    }
+    end_result(bench, &result, db, last - start);
+    close_and_remove(db);
+}
+
+/* Gets lookups ids; zipfian picks hot ranks and spreads them over the table through order */
+static void bench_get(Bench *bench, Database *db, const char *workload, const uint32_t *order, uint32_t rows,
+                      Zipfian *zipfian)
+{
+    Rng rng;
+    rng_seed(&rng, SEED);
+    uint32_t *keys = malloc(bench->lookups * sizeof(uint32_t));
+    for (uint32_t i = 0; i < bench->lookups; i++)
+    {
+        keys[i] = zipfian ? order[zipfian_next(zipfian, &rng)] : rng_below(&rng, rows);
+    }
+
+    Row row;
+    Result result;
+    begin_result(&result, db, workload, rows);
+    uint64_t start = trace_clock_ns();
+    uint64_t last = start;
+    for (uint32_t i = 0; i < bench->lookups; i++)
+    {
+        if (db_get(db, keys[i], &row) != DB_OK)
+        {
+            fprintf(stderr, "Row %u is missing.\n", keys[i]);
+            exit(EXIT_FAILURE);
+        }
+        uint64_t now = trace_clock_ns();
+        histogram_record(&result.latency, now - last);
+        last = now;
+    }
+    end_result(bench, &result, db, last - start);
+    free(keys);
+}
+
+/* Scans num_scans ranges of scan_rows ids from random starts; a full scan is one range over every id */
+static void bench_scan(Bench *bench, Database *db, const char *workload, uint32_t rows, uint32_t num_scans,
+                       uint32_t scan_rows)
+{
+    Rng rng;
+    rng_seed(&rng, SEED);
+    RowView view;
+    Result result;
+    begin_result(&result, db, workload, rows);
+    uint64_t start = trace_clock_ns();
+    uint64_t last = start;
+    for (uint32_t i = 0; i < num_scans; i++)
+    {
+        uint32_t first = scan_rows < rows ? rng_below(&rng, rows - scan_rows + 1) : 0;
+        DbIterator *it = db_scan(db, first, first + scan_rows - 1);
+        uint32_t seen = 0;
+        while (db_iterator_next_view(it, &view))
+        {
+            seen++;
+        }
+        db_iterator_close(it);
+        if (seen != (scan_rows < rows ? scan_rows : rows))
+        {
+            fprintf(stderr, "Scan from %u saw %u rows.\n", first, seen);
+            exit(EXIT_FAILURE);
+        }
+        uint64_t now = trace_clock_ns();
+        histogram_record(&result.latency, now - last);
+        last = now;
+    }
+    end_result(bench, &result, db, last - start);
+}
+
+/* Reopens the table with DB_OPEN_IN_MEMORY, timing how long loading it into the radix tree takes */
+static Database *bench_memory_load(Bench *bench, uint32_t rows)
+{
+    uint64_t cpu_start_ns = cpu_clock_ns();
+    uint64_t start = trace_clock_ns();
+    Database *db = db_open_with_flags(BENCH_FILE, DB_OPEN_IN_MEMORY);
+    uint64_t elapsed_ns = trace_clock_ns() - start;
+
+    Result result;
+    begin_result(&result, db, "mem_load", rows);
+    result.cpu_start_ns = cpu_start_ns;
+    histogram_record(&result.latency, elapsed_ns);
+    end_result(bench, &result, db, elapsed_ns);
+    return db;
+}
+
+/* Times writing the in-memory rows back to the file, after an update so there is a change to write */
+static void bench_memory_save(Bench *bench, Database *db, uint32_t rows)
+{
+    Row row;
+    db_get(db, 0, &row);
+    db_update(db, &row);
+
+    Result result;
+    begin_result(&result, db, "mem_save", rows);
+    uint64_t start = trace_clock_ns();
+    db_sync(db);
+    uint64_t elapsed_ns = trace_clock_ns() - start;
+    histogram_record(&result.latency, elapsed_ns);
+    end_result(bench, &result, db, elapsed_ns);
+}
+
+/* Times VACUUM rewriting the file, compressed if flags ask for it, and reports the new file's size */
+static void bench_vacuum(Bench *bench, const char *workload, uint32_t rows, uint32_t flags)
+{
+    Database *db = db_open_with_flags(BENCH_FILE, flags);
+    Result result;
+    begin_result(&result, db, workload, rows);
+    uint64_t start = trace_clock_ns();
+    if (db_vacuum(db) != DB_OK)
+    {
+        fprintf(stderr, "VACUUM failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t elapsed_ns = trace_clock_ns() - start;
+    histogram_record(&result.latency, elapsed_ns);
+    end_result(bench, &result, db, elapsed_ns);
+    db_close(db);
+}
+
+/* Drops the file from the kernel page cache and the warmup list, reopens it and times one full scan */
+static void bench_cold_scan(Bench *bench, const char *workload, uint32_t rows)
+{
+    int fd = open(BENCH_FILE, O_RDONLY);
+    if (fd == -1 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0)
+    {
+        fprintf(stderr, "Could not drop %s from the page cache.\n", BENCH_FILE);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    unlink(WARMUP_FILE);
+
+    Database *db = db_open(BENCH_FILE);
+    bench_scan(bench, db, workload, rows, 1, rows);
+    db_close(db);
+}
+
+/* Ids in the order a Zipfian stream over rows * ZIPFIAN_KEY_SPACE_FACTOR first produces them */
+static uint32_t *zipfian_load_order(uint32_t rows)
+{
+    uint64_t key_space = (uint64_t)rows * ZIPFIAN_KEY_SPACE_FACTOR;
+    Zipfian zipfian;
+    zipfian_init(&zipfian, key_space, ZIPFIAN_THETA);
+    Rng rng;
+    rng_seed(&rng, SEED);
+
+    uint8_t *seen = calloc(key_space / 8 + 1, 1);
+    uint32_t *ids = malloc(rows * sizeof(uint32_t));
+    for (uint32_t n = 0; n < rows;)
+    {
+        uint64_t id = zipfian_next(&zipfian, &rng);
+        if (!(seen[id / 8] & (1 << (id % 8))))
+        {
+            seen[id / 8] |= 1 << (id % 8);
+            ids[n++] = id;
+        }
+    }
+    free(seen);
+    return ids;
+}
+
+static void bench_size(Bench *bench, uint32_t rows)
+{
+    uint32_t *ids = malloc(rows * sizeof(uint32_t));
+    for (uint32_t i = 0; i < rows; i++)
+    {
+        ids[i] = i;
+    }
+    bench_insert(bench, "insert_sequential", ids, rows, 0);
+
+    uint32_t *zipfian_ids = zipfian_load_order(rows);
+    bench_insert(bench, "insert_zipfian", zipfian_ids, rows, 0);
+    free(zipfian_ids);
+
+    Rng rng;
+    rng_seed(&rng, SEED);
+    shuffle_u32(&rng, ids, rows);
+    bench_insert(bench, "insert_random", ids, rows, 0);
+    bench_insert(bench, "insert_buffered", ids, rows, DB_OPEN_BUFFERED_INSERTS);
+    bench_insert(bench, "mem_insert_random", ids, rows, DB_OPEN_IN_MEMORY);
+
+    // the queries run against a table loaded in random order, as most tables are
+    Database *db = open_fresh(0);
+    Row row = {0};
+    for (uint32_t i = 0; i < rows; i++)
+    {
+        row.id = ids[i];
+        db_put(db, &row);
+    }
+    Zipfian zipfian;
+    zipfian_init(&zipfian, rows, ZIPFIAN_THETA);
+    bench_get(bench, db, "get_uniform", ids, rows, NULL);
+    bench_get(bench, db, "get_zipfian", ids, rows, &zipfian);
+    bench_scan(bench, db, "scan_range_100", rows, bench->lookups / RANGE_SCAN_ROWS, RANGE_SCAN_ROWS);
+    bench_scan(bench, db, "scan_full", rows, FULL_SCANS, rows);
+    db_close(db);
+
+    // the same table and queries in the in-memory engine
+    db = bench_memory_load(bench, rows);
+    bench_get(bench, db, "mem_get_uniform", ids, rows, NULL);
+    bench_get(bench, db, "mem_get_zipfian", ids, rows, &zipfian);
+    bench_scan(bench, db, "mem_scan_range_100", rows, bench->lookups / RANGE_SCAN_ROWS, RANGE_SCAN_ROWS);
+    bench_scan(bench, db, "mem_scan_full", rows, FULL_SCANS, rows);
+    bench_memory_save(bench, db, rows);
+    db_close(db);
+
+    // the saved snapshot, cold, as plain pages and then compressed; the file says which, so reopening needs no flag
+    bench_vacuum(bench, "vacuum", rows, 0);
+    bench_cold_scan(bench, "scan_cold", rows);
+    bench_vacuum(bench, "zip_vacuum", rows, DB_OPEN_COMPRESSED);
+    bench_cold_scan(bench, "zip_scan_cold", rows);
+    unlink(BENCH_FILE);
+    unlink(WARMUP_FILE);
+    free(ids);
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--json] [--lookups n] [rows ...]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+    Bench bench = {.json = false, .lookups = 1000000};
+    uint32_t sizes[32];
+    uint32_t num_sizes = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            bench.json = true;
+        }
+        else if (strcmp(argv[i], "--lookups") == 0 && i + 1 < argc)
+        {
+            bench.lookups = strtoul(argv[++i], NULL, 10);
+        }
+        else if (argv[i][0] != '-' && num_sizes < sizeof(sizes) / sizeof(sizes[0]))
+        {
+            sizes[num_sizes++] = strtoul(argv[i], NULL, 10);
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (num_sizes == 0)
+    {
+        sizes[num_sizes++] = 10000;
+        sizes[num_sizes++] = 100000;
+        sizes[num_sizes++] = 1000000;
+    }
+    if (bench.lookups < RANGE_SCAN_ROWS)
+    {
+        bench.lookups = RANGE_SCAN_ROWS;
+    }
+
+    // internal nodes take the configured fanout unless a page can't hold that many cells
+    uint32_t internal_keys = INTERNAL_NODE_AVAILABLE_CELL_SPACE / INTERNAL_NODE_CELL_SIZE;
+    if (internal_keys > INTERNAL_NODE_MAX_CELLS)
+    {
+        internal_keys = INTERNAL_NODE_MAX_CELLS;
+    }
+    if (bench.json)
+    {
+        printf("{\"page_size\": %u, \"leaf_max_cells\": %u, \"internal_max_keys\": %u, \"lookups\": %u,\n"
+               " \"results\": [",
+               PAGE_SIZE, LEAF_NODE_MAX_CELLS, internal_keys, bench.lookups);
+    }
+    else
+    {
+        printf("page size %u, %u rows per leaf, %u keys per internal node\n", PAGE_SIZE, LEAF_NODE_MAX_CELLS,
+               internal_keys);
+        printf("%-18s %9s %12s %9s %9s %9s %11s %10s %12s\n", "workload", "rows", "ops/s", "p50 ns", "p99 ns",
+               "p99.9 ns", "cpu ns/op", "pages/op", "file bytes");
+    }
+
+    for (uint32_t i = 0; i < num_sizes; i++)
+    {
+        bench_size(&bench, sizes[i]);
+    }
+
+    if (bench.json)
+    {
+        printf("\n]}\n");
+    }
+    return 0;
+}
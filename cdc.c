@@ -0,0 +1,297 @@
+#define _FILE_OFFSET_BITS 64 // 64-bit off_t on 32-bit hosts too
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cdc.h"
+#include "compress.h"
+
+static const size_t CHANGE_LOG_INITIAL_BUFFER_SIZE = 64 * 1024;
+static const uint32_t CHANGE_MIN_BODY_SIZE = 8 + 1 + 1 + 1; // sequence, type, empty name, no values
+
+struct ChangeLog
+{
+    int file_descriptor;
+    uint64_t next_sequence;
+    uint64_t file_length; // bytes in the file; the buffer's records follow them
+    uint8_t *buffer;      // records not committed yet
+    size_t capacity;
+    size_t length;       // bytes buffered
+    size_t record_start; // where the record being written starts
+    size_t count_offset; // its value count
+};
+
+struct ChangeReader
+{
+    int file_descriptor;
+    uint64_t offset;
+    uint64_t from_sequence;
+    uint8_t record[CHANGE_MAX_RECORD_SIZE];
+};
+
+static size_t put_varint(uint8_t *p, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        p[n++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    p[n++] = (uint8_t)value;
+    return n;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *value)
+{
+    *value = 0;
+    for (uint32_t shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *p++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+ChangeLog *open_change_log(const char *path)
+{
+    // sequence numbers carry on from the last whole record; everything from the first that doesn't check out is cut off
+    uint64_t last_sequence = 0, end = 0;
+    ChangeReader *reader = open_change_reader(path, 0);
+    if (reader)
+    {
+        Change change;
+        while (change_reader_next(reader, &change) == CHANGE_READ_OK)
+        {
+            last_sequence = change.sequence;
+        }
+        end = change_reader_offset(reader);
+        close_change_reader(reader);
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, S_IWUSR | S_IRUSR);
+    if (fd == -1 || ftruncate(fd, end) == -1)
+    {
+        fprintf(stderr, "Error opening change log\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ChangeLog *log = calloc(1, sizeof(ChangeLog));
+    log->file_descriptor = fd;
+    log->next_sequence = last_sequence + 1;
+    log->file_length = end;
+    log->capacity = CHANGE_LOG_INITIAL_BUFFER_SIZE;
+    log->buffer = malloc(log->capacity);
+    return log;
+}
+
+void close_change_log(ChangeLog *log)
+{
+    close(log->file_descriptor);
+    free(log->buffer);
+    free(log);
+}
+
+void change_log_begin(ChangeLog *log, ChangeType type, const char *table)
+{
+    // records wait here until committed, however many that is
+    if (log->capacity - log->length < CHANGE_MAX_RECORD_SIZE)
+    {
+        log->capacity *= 2;
+        log->buffer = realloc(log->buffer, log->capacity);
+    }
+    uint8_t *p = log->buffer + log->length;
+    log->record_start = log->length;
+    memcpy(p + 4, &log->next_sequence, sizeof(uint64_t)); // the length goes in front at the end
+    p[12] = type;
+    size_t name_length = strnlen(table, DB_MAX_NAME_LENGTH);
+    p[13] = name_length;
+    memcpy(p + 14, table, name_length);
+    log->count_offset = log->length + 14 + name_length;
+    log->buffer[log->count_offset] = 0;
+    log->length = log->count_offset + 1;
+}
+
+void change_log_int(ChangeLog *log, int64_t value)
+{
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); // small negatives stay short too
+    log->buffer[log->length++] = CHANGE_VALUE_INT;
+    log->length += put_varint(log->buffer + log->length, zigzag);
+    log->buffer[log->count_offset]++;
+}
+
+void change_log_string(ChangeLog *log, const char *s, size_t max_length)
+{
+    size_t length = strnlen(s, max_length < DB_MAX_STRING_LENGTH ? max_length : DB_MAX_STRING_LENGTH);
+    log->buffer[log->length++] = CHANGE_VALUE_STRING;
+    log->length += put_varint(log->buffer + log->length, length);
+    memcpy(log->buffer + log->length, s, length);
+    log->length += length;
+    log->buffer[log->count_offset]++;
+}
+
+void change_log_end(ChangeLog *log)
+{
+    uint8_t *record = log->buffer + log->record_start;
+    uint32_t body_length = log->length - log->record_start - 4;
+    memcpy(record, &body_length, sizeof(body_length));
+    uint32_t checksum = db_crc32(record + 4, body_length);
+    memcpy(log->buffer + log->length, &checksum, sizeof(checksum));
+    log->length += sizeof(checksum);
+    log->next_sequence++;
+}
+
+uint64_t change_log_position(ChangeLog *log)
+{
+    return log->file_length + log->length;
+}
+
+void change_log_commit(ChangeLog *log, uint64_t position)
+{
+    if (position <= log->file_length)
+    {
+        return; // committed already, by a later position
+    }
+    size_t length = position - log->file_length;
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t n = write(log->file_descriptor, log->buffer + written, length - written);
+        if (n == -1 && errno != EINTR)
+        {
+            fprintf(stderr, "Error writing change log\n");
+            exit(EXIT_FAILURE);
+        }
+        written += n == -1 ? 0 : n;
+    }
+    if (fsync(log->file_descriptor) == -1)
+    {
+        fprintf(stderr, "Error syncing change log\n");
+        exit(EXIT_FAILURE);
+    }
+    memmove(log->buffer, log->buffer + length, log->length - length);
+    log->length -= length;
+    log->file_length = position;
+}
+
+ChangeReader *open_change_reader(const char *path, uint64_t from_sequence)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    ChangeReader *reader = malloc(sizeof(ChangeReader));
+    reader->file_descriptor = fd;
+    reader->offset = 0;
+    reader->from_sequence = from_sequence;
+    return reader;
+}
+
+static bool parse_change(const uint8_t *p, uint32_t length, Change *change)
+{
+    const uint8_t *end = p + length;
+    memcpy(&change->sequence, p, sizeof(uint64_t));
+    change->type = (ChangeType)p[8];
+    uint32_t name_length = p[9];
+    p += 10;
+    if (name_length > DB_MAX_NAME_LENGTH || (uint32_t)(end - p) < name_length + 1)
+    {
+        return false;
+    }
+    memcpy(change->table, p, name_length);
+    change->table[name_length] = '\0';
+    p += name_length;
+
+    change->num_values = *p++;
+    if (change->num_values > DB_MAX_TABLE_COLUMNS)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < change->num_values; i++)
+    {
+        ChangeValue *value = &change->values[i];
+        uint64_t n;
+        if (p >= end)
+        {
+            return false;
+        }
+        value->tag = (ChangeValueTag)*p++;
+        p = get_varint(p, end, &n);
+        if (p == NULL)
+        {
+            return false;
+        }
+        if (value->tag == CHANGE_VALUE_INT)
+        {
+            value->number = (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+        }
+        else if (value->tag == CHANGE_VALUE_STRING && n <= DB_MAX_STRING_LENGTH && (uint64_t)(end - p) >= n)
+        {
+            value->length = n;
+            memcpy(value->string, p, n);
+            value->string[n] = '\0';
+            p += n;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return p == end;
+}
+
+/*
+Reads records in file order, skipping those before from_sequence. A record
+still being written, or cut short by a crash, reads as the end, and the next
+call tries the same offset again
+*/
+ChangeReadResult change_reader_next(ChangeReader *reader, Change *change)
+{
+    for (;;)
+    {
+        uint32_t length;
+        if (pread(reader->file_descriptor, &length, sizeof(length), reader->offset) != sizeof(length))
+        {
+            return CHANGE_READ_END;
+        }
+        if (length < CHANGE_MIN_BODY_SIZE || length > CHANGE_MAX_RECORD_SIZE - 8)
+        {
+            return CHANGE_READ_CORRUPT;
+        }
+        ssize_t wanted = length + sizeof(uint32_t);
+        if (pread(reader->file_descriptor, reader->record, wanted, reader->offset + 4) != wanted)
+        {
+            return CHANGE_READ_END;
+        }
+        uint32_t checksum;
+        memcpy(&checksum, reader->record + length, sizeof(checksum));
+        if (checksum != db_crc32(reader->record, length) || !parse_change(reader->record, length, change))
+        {
+            return CHANGE_READ_CORRUPT;
+        }
+        reader->offset += length + 8;
+        if (change->sequence >= reader->from_sequence)
+        {
+            return CHANGE_READ_OK;
+        }
+    }
+}
+
+uint64_t change_reader_offset(ChangeReader *reader)
+{
+    return reader->offset;
+}
+
+void close_change_reader(ChangeReader *reader)
+{
+    close(reader->file_descriptor);
+    free(reader);
+}
@@ -0,0 +1,98 @@
+#ifndef CDC_H
+#define CDC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "db.h"
+
+/*
+Change data capture log for DB_OPEN_CHANGE_LOG
+
+Every change a call makes is appended as one record, numbered from 1 in the
+order the calls were made. Records collect in memory until the database file
+holding their changes is durable, then are committed: written and fsynced
+together. So a crash loses the uncommitted records with the changes, and the
+log never holds a change the database didn't keep.
+
+A record is a uint32 length of its body, the body, then a CRC-32 of the body.
+The body holds a uint64 sequence number, a uint8 ChangeType, the table name
+(uint8 length, then the bytes; empty for the built-in table) and a uint8 count
+of values, each a tag byte and its data: CHANGE_VALUE_INT is a zigzag varint,
+CHANGE_VALUE_STRING a varint length and the bytes. Values are the row's
+columns in order, all of them, so a consumer needs no schema to apply one.
+Integers are in host byte order, as in protocol.h.
+*/
+
+typedef enum
+{
+    CHANGE_INSERT = 1,
+    CHANGE_UPDATE = 2,
+    CHANGE_DELETE = 3 // reserved: no call deletes rows yet
+} ChangeType;
+
+typedef enum
+{
+    CHANGE_VALUE_INT,
+    CHANGE_VALUE_STRING
+} ChangeValueTag;
+
+// Bytes a record may take: framing, sequence, type, name, count, then each value at its longest
+#define CHANGE_MAX_RECORD_SIZE \
+    (4 + 8 + 1 + 1 + DB_MAX_NAME_LENGTH + 1 + DB_MAX_TABLE_COLUMNS * (1 + 2 + DB_MAX_STRING_LENGTH) + 4)
+
+typedef struct ChangeLog ChangeLog;
+
+/* Opens path for appending, creating it if needed; a torn record a crash left at the end is cut off */
+ChangeLog *open_change_log(const char *path);
+void close_change_log(ChangeLog *log); // records not committed are dropped
+
+/* Records are written as begin, then each value in order, then end, which numbers the record */
+void change_log_begin(ChangeLog *log, ChangeType type, const char *table);
+void change_log_int(ChangeLog *log, int64_t value);
+void change_log_string(ChangeLog *log, const char *s, size_t max_length); // s ends at a NUL or max_length
+void change_log_end(ChangeLog *log);
+
+/*
+Positions count bytes from the start of the file, buffered records included.
+Take the position when changes are written out, then commit it once they are
+durable: records up to it are written and fsynced. A position already
+committed, as a later one was since, commits nothing
+*/
+uint64_t change_log_position(ChangeLog *log); // where the records so far end
+void change_log_commit(ChangeLog *log, uint64_t position);
+
+/* A record read back */
+typedef struct
+{
+    ChangeValueTag tag;
+    int64_t number;
+    uint32_t length;
+    char string[DB_MAX_STRING_LENGTH + 1]; // NUL-terminated
+} ChangeValue;
+
+typedef struct
+{
+    uint64_t sequence;
+    ChangeType type;
+    char table[DB_MAX_NAME_LENGTH + 1]; // empty for the built-in table
+    uint32_t num_values;
+    ChangeValue values[DB_MAX_TABLE_COLUMNS];
+} Change;
+
+typedef enum
+{
+    CHANGE_READ_OK,
+    CHANGE_READ_END,    // no whole record past the last one read, yet: a tailing reader tries again later
+    CHANGE_READ_CORRUPT // a whole record failed its checksum or doesn't parse
+} ChangeReadResult;
+
+typedef struct ChangeReader ChangeReader;
+
+/* Opens a log for reading from the first record numbered from_sequence or later; NULL if it can't be opened */
+ChangeReader *open_change_reader(const char *path, uint64_t from_sequence);
+ChangeReadResult change_reader_next(ChangeReader *reader, Change *change);
+uint64_t change_reader_offset(ChangeReader *reader); // bytes into the file where the next record starts
+void close_change_reader(ChangeReader *reader);
+
+#endif
@@ -0,0 +1,112 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cdc.h"
+
+/*
+Tailing reader for change logs (DB_OPEN_CHANGE_LOG)
+
+Prints the records of a change log, one line each: the sequence number, the
+change, the table ("-" for the built-in one) and the row's values. With -n it
+starts from a sequence number, so a consumer that has applied changes up to n
+resumes with -n n+1 instead of starting over. With -f it keeps following the
+log, polling every -p milliseconds for records written since.
+*/
+
+static const char *CHANGE_NAMES[] = {"?", "INSERT", "UPDATE", "DELETE"}; // by ChangeType
+
+static void print_change(const Change *change)
+{
+    uint32_t type = change->type <= CHANGE_DELETE ? change->type : 0;
+    printf("%" PRIu64 " %s %s", change->sequence, CHANGE_NAMES[type], change->table[0] ? change->table : "-");
+    for (uint32_t i = 0; i < change->num_values; i++)
+    {
+        const ChangeValue *value = &change->values[i];
+        if (value->tag == CHANGE_VALUE_INT)
+        {
+            printf(" %" PRId64, value->number);
+        }
+        else
+        {
+            printf(" %s", value->string);
+        }
+    }
+    putchar('\n');
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t from_sequence = 0;
+    bool follow = false;
+    uint32_t poll_ms = 100;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:fp:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            from_sequence = strtoull(optarg, NULL, 10);
+            break;
+        case 'f':
+            follow = true;
+            break;
+        case 'p':
+            poll_ms = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n from_sequence] [-f] [-p poll_ms] changes_file\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 1 || poll_ms == 0)
+    {
+        fprintf(stderr, "Usage: %s [-n from_sequence] [-f] [-p poll_ms] changes_file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // a log that doesn't exist yet is waited for when following
+    const char *path = argv[optind];
+    struct timespec poll_interval = {poll_ms / 1000, (poll_ms % 1000) * 1000000l};
+    ChangeReader *reader;
+    while ((reader = open_change_reader(path, from_sequence)) == NULL)
+    {
+        if (!follow)
+        {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+        nanosleep(&poll_interval, NULL);
+    }
+
+    Change change;
+    for (;;)
+    {
+        ChangeReadResult result = change_reader_next(reader, &change);
+        if (result == CHANGE_READ_OK)
+        {
+            print_change(&change);
+            continue;
+        }
+        if (result == CHANGE_READ_CORRUPT)
+        {
+            fflush(stdout);
+            fprintf(stderr, "Corrupted change record at byte %" PRIu64 ".\n", change_reader_offset(reader));
+            close_change_reader(reader);
+            return EXIT_FAILURE;
+        }
+        if (!follow)
+        {
+            break;
+        }
+        fflush(stdout); // a consumer reading the pipe gets each batch as it arrives
+        nanosleep(&poll_interval, NULL);
+    }
+    close_change_reader(reader);
+    return EXIT_SUCCESS;
+}
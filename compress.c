@@ -0,0 +1,231 @@
+#include <string.h>
+
+#include "compress.h"
+
+static const uint32_t MIN_MATCH = 4;
+static const uint32_t MAX_DISTANCE = 65535;
+static const uint32_t SKIP_SHIFT = 6; // after 64 bytes without a match, try every other position, and so on
+
+#define HASH_BITS 12
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t read64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash32(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Writes what a saturated nibble left of length as bytes of 255 and a remainder */
+static bool put_length(uint8_t **op, const uint8_t *end, uint32_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (*op >= end)
+        {
+            return false;
+        }
+        *(*op)++ = 255;
+    }
+    if (*op >= end)
+    {
+        return false;
+    }
+    *(*op)++ = length;
+    return true;
+}
+
+/* Appends one sequence; a match_length of 0 makes it the closing literals-only one */
+static bool put_sequence(uint8_t **op, const uint8_t *end, const uint8_t *literals, uint32_t num_literals,
+                         uint32_t distance, uint32_t match_length)
+{
+    if (*op >= end)
+    {
+        return false;
+    }
+    uint8_t *token = (*op)++;
+    *token = (num_literals < 15 ? num_literals : 15) << 4;
+    if (num_literals >= 15 && !put_length(op, end, num_literals - 15))
+    {
+        return false;
+    }
+    if ((uint32_t)(end - *op) < num_literals)
+    {
+        return false;
+    }
+    memcpy(*op, literals, num_literals);
+    *op += num_literals;
+    if (match_length == 0)
+    {
+        return true;
+    }
+
+    if (end - *op < 2)
+    {
+        return false;
+    }
+    *(*op)++ = distance & 0xff;
+    *(*op)++ = distance >> 8;
+    uint32_t extra = match_length - MIN_MATCH;
+    *token |= extra < 15 ? extra : 15;
+    return extra < 15 || put_length(op, end, extra - 15);
+}
+
+/*
+Greedy: each position is hashed on its next 4 bytes and checked against the
+last position with the same hash. A stale or colliding entry just fails the
+comparison, so the table needs no clearing beyond zeroing
+*/
+uint32_t compress_page(const void *src, uint32_t size, void *dst, uint32_t capacity)
+{
+    const uint8_t *in = src;
+    uint8_t *op = dst;
+    const uint8_t *end = op + capacity;
+    uint16_t table[1 << HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint32_t ip = 0, anchor = 0;
+    while (ip + MIN_MATCH <= size)
+    {
+        uint32_t sequence = read32(in + ip);
+        uint32_t h = hash32(sequence);
+        uint32_t ref = table[h];
+        table[h] = ip;
+        if (ref >= ip || ip - ref > MAX_DISTANCE || read32(in + ref) != sequence)
+        {
+            ip += 1 + ((ip - anchor) >> SKIP_SHIFT);
+            continue;
+        }
+
+        uint32_t length = MIN_MATCH;
+        while (ip + length + 8 <= size && read64(in + ref + length) == read64(in + ip + length))
+        {
+            length += 8;
+        }
+        while (ip + length < size && in[ref + length] == in[ip + length])
+        {
+            length++;
+        }
+        if (!put_sequence(&op, end, in + anchor, ip - anchor, ip - ref, length))
+        {
+            return 0;
+        }
+        ip += length;
+        anchor = ip;
+    }
+    if (anchor < size && !put_sequence(&op, end, in + anchor, size - anchor, 0, 0))
+    {
+        return 0;
+    }
+    return op - (uint8_t *)dst;
+}
+
+/* Adds the bytes continuing a saturated nibble to length */
+static bool get_length(const uint8_t **ip, const uint8_t *end, uint32_t *length)
+{
+    uint8_t byte;
+    do
+    {
+        if (*ip >= end)
+        {
+            return false;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/* Every length and distance is checked, so a damaged page fails instead of writing out of bounds */
+bool decompress_page(const void *src, uint32_t length, void *dst, uint32_t size)
+{
+    const uint8_t *ip = src;
+    const uint8_t *in_end = ip + length;
+    uint8_t *out = dst;
+    uint8_t *op = out;
+    const uint8_t *out_end = out + size;
+    while (ip < in_end)
+    {
+        uint32_t token = *ip++;
+        uint32_t num_literals = token >> 4;
+        if (num_literals == 15 && !get_length(&ip, in_end, &num_literals))
+        {
+            return false;
+        }
+        if ((uint32_t)(in_end - ip) < num_literals || (uint32_t)(out_end - op) < num_literals)
+        {
+            return false;
+        }
+        memcpy(op, ip, num_literals);
+        op += num_literals;
+        ip += num_literals;
+        if (ip == in_end)
+        {
+            break; // the closing sequence has no match
+        }
+
+        if (in_end - ip < 2)
+        {
+            return false;
+        }
+        uint32_t distance = ip[0] | ip[1] << 8;
+        ip += 2;
+        uint32_t match_length = (token & 15) + MIN_MATCH;
+        if ((token & 15) == 15 && !get_length(&ip, in_end, &match_length))
+        {
+            return false;
+        }
+        if (distance == 0 || distance > (uint32_t)(op - out) || (uint32_t)(out_end - op) < match_length)
+        {
+            return false;
+        }
+
+        const uint8_t *match = op - distance;
+        if (distance >= match_length)
+        {
+            memcpy(op, match, match_length);
+        }
+        else if (distance == 1)
+        {
+            memset(op, *match, match_length); // a run of one byte, usually zeros
+        }
+        else
+        {
+            for (uint32_t i = 0; i < match_length; i++)
+            {
+                op[i] = match[i];
+            }
+        }
+        op += match_length;
+    }
+    return op == out_end;
+}
+
+/* A nibble at a time, so the table is small enough to spell out */
+uint32_t db_crc32(const void *data, size_t length)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    const uint8_t *bytes = data;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ table[crc & 15];
+        crc = (crc >> 4) ^ table[crc & 15];
+    }
+    return ~crc;
+}
@@ -0,0 +1,35 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Page codec for PAGER_COMPRESSED, in the spirit of LZ4's block format
+
+The output is a run of sequences: a token byte whose high nibble counts
+literals and low nibble a match length less 4, either nibble saturating at 15
+and continuing in bytes of 255 until a smaller one; the literals; then a 2-byte
+little-endian distance back into the output. The last sequence has literals
+only. Matches may overlap the bytes they produce, so a zero run costs a few
+bytes however long it is. Inputs are at most 64 KB.
+*/
+
+/* Compresses size bytes into dst; returns the compressed length, or 0 if it would exceed capacity */
+uint32_t compress_page(const void *src, uint32_t size, void *dst, uint32_t capacity);
+
+/* Decompresses length bytes into dst; returns false unless they decode to exactly size bytes */
+bool decompress_page(const void *src, uint32_t length, void *dst, uint32_t size);
+
+/*
+CRC-32 (the zlib one), for the superblock of a compressed file and change log
+records. Prefixed, and hidden from libdb.so, so it never stands in for zlib's
+crc32 in a program linking both
+*/
+#if defined(__GNUC__)
+__attribute__((visibility("hidden")))
+#endif
+uint32_t db_crc32(const void *data, size_t length);
+
+#endif
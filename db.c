@@ -1,1363 +1,2404 @@
-#include <stdbool.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
-
-#define COLUMN_USERNAME_SIZE 32
-#define COLUMN_EMAIL_SIZE 255
-#define TABLE_MAX_PAGES 100
-#define INVALID_PAGE_IDX UINT32_MAX
-
-// #define size_of_attribute(Struct, Attribute) sizeof(((Struct *)0)->Attribute)
-// const uint32_t ID_SIZE = size_of_attribute(Row, id);
-// const uint32_t USERNAME_SIZE = size_of_attribute(Row, username);
-// const uint32_t EMAIL_SIZE = size_of_attribute(Row, email);
-const uint32_t ID_SIZE = 4;        // bytes
-const uint32_t USERNAME_SIZE = 32; // bytes
-const uint32_t EMAIL_SIZE = 255;   // bytes
-const uint32_t ID_OFFSET = 0;
-const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
-const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
-const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
-
-const uint32_t PAGE_SIZE = 4096; // bytes
-const uint32_t ROWS_PER_PAGE = PAGE_SIZE / ROW_SIZE;
-const uint32_t TABLE_MAX_ROWS = ROWS_PER_PAGE * TABLE_MAX_PAGES;
-
-// Common node header layout
-// Contains: node type, is root, pointer to parent
-const uint32_t NODE_TYPE_SIZE = sizeof(uint8_t);
-const uint32_t NODE_TYPE_OFFSET = 0;
-const uint32_t IS_ROOT_SIZE = sizeof(uint8_t);
-const uint32_t IS_ROOT_OFFSET = NODE_TYPE_SIZE;
-const uint32_t PARENT_POINTER_SIZE = sizeof(uint32_t);
-const uint32_t PARENT_POINTER_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
-const uint8_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
-
-// Additional headers for leaf nodes
-// Contains: number of key-value pairs (aka cells)
-const uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
-const uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
-const uint32_t LEAF_NODE_NEXT_LEAF_SIZE = sizeof(uint32_t);
-const uint32_t LEAF_NODE_NEXT_LEAF_OFFSET = LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
-const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
-                                       LEAF_NODE_NUM_CELLS_SIZE +
-                                       LEAF_NODE_NEXT_LEAF_SIZE;
-
-// Body layout for leaf nodes
-// Leaf nodes contains keys and values (rows)
-const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t); // what exactly are we using as keys? the row id?
-const uint32_t LEAF_NODE_KEY_OFFSET = 0;
-const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
-const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_SIZE;
-const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
-const uint32_t LEAF_NODE_AVAILABLE_CELL_SPACE = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-const uint32_t LEAF_NODE_MAX_CELLS = LEAF_NODE_AVAILABLE_CELL_SPACE / LEAF_NODE_CELL_SIZE;
-
-const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
-const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "art.h"
+#include "btree.h"
+#include "cdc.h"
+#include "db.h"
+#include "hash.h"
+#include "memtable.h"
+#include "schema.h"
 
 /*
-Internal node header layout
-Contains: num_keys, right_child pointer
+Header page layout (page 0)
+Contains: magic, format version, root page of the table and of each secondary index,
+meta page of the hash index on id, catalog page of the user tables.
+Index roots are indexed by DbColumn; 0 means the column has no index, and a 0
+catalog page means no user table was ever created.
 */
-const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(uint32_t);
-const uint32_t INTERNAL_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
-const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(uint32_t);
-const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
-const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
-                                           INTERNAL_NODE_NUM_KEYS_SIZE +
-                                           INTERNAL_NODE_RIGHT_CHILD_SIZE;
+#define NUM_COLUMNS 3
+
+// Bytes of a column filter checked with one vector compare before the rest is looked at
+#define FILTER_HEAD_SIZE 16
+
+static const char HEADER_MAGIC[8] = {'s', 'q', 'l', 'c', 'l', 'o', 'n', 'e'};
+static const uint32_t HEADER_MAGIC_OFFSET = 0;
+static const uint32_t HEADER_VERSION_OFFSET = HEADER_MAGIC_OFFSET + sizeof(HEADER_MAGIC);
+static const uint32_t HEADER_TABLE_ROOT_OFFSET = HEADER_VERSION_OFFSET + sizeof(uint32_t);
+static const uint32_t HEADER_INDEX_ROOTS_OFFSET = HEADER_TABLE_ROOT_OFFSET + sizeof(uint32_t);
+static const uint32_t HEADER_ID_HASH_OFFSET = HEADER_INDEX_ROOTS_OFFSET + NUM_COLUMNS * sizeof(uint32_t);
+static const uint32_t HEADER_CATALOG_OFFSET = HEADER_ID_HASH_OFFSET + sizeof(uint32_t);
+static const uint32_t HEADER_PAGE_IDX = 0;
+static const uint32_t FORMAT_VERSION = 2; // 2 added row counts to internal nodes
 
 /*
-Internal node body layout
-The body is an array of cells where each cell contains a child pointer and a key.
-Every key should be the maximum key contained in the child to its left.
+Catalog page layout
+Contains: number of user tables, then for each its root page and its schema as
+write_schema stores it
 */
-const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
-const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
-const uint32_t INTERNAL_NODE_CELL_SIZE =
-    INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
-const uint32_t INTERNAL_NODE_AVAILABLE_CELL_SPACE = PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE;
-const uint32_t INTERNAL_NODE_MAX_CELLS = 3; // for testing
-// const uint32_t INTERNAL_NODE_MAX_CELLS = INTERNAL_NODE_AVAILABLE_CELL_SPACE / INTERNAL_NODE_CELL_SIZE;
+static const uint32_t CATALOG_NUM_TABLES_OFFSET = 0;
+static const uint32_t CATALOG_ENTRIES_OFFSET = CATALOG_NUM_TABLES_OFFSET + sizeof(uint32_t);
 
-// for child pointers, are we storing a pointer, or the page index?
-// i think just pointer, since the Pager will convert index to address
+// A user table's rows must fit this many to a leaf, so its tree keeps some fanout
+static const uint32_t USER_TABLE_MIN_LEAF_CELLS = 4;
 
-void print_constants()
-{
-    printf("ROW_SIZE: %d\n", ROW_SIZE);
-    printf("COMMON_NODE_HEADER_SIZE: %d\n", COMMON_NODE_HEADER_SIZE);
-    printf("LEAF_NODE_HEADER_SIZE: %d\n", LEAF_NODE_HEADER_SIZE);
-    printf("LEAF_NODE_CELL_SIZE: %d\n", LEAF_NODE_CELL_SIZE);
-    printf("LEAF_NODE_AVAILABLE_CELL_SPACE: %d\n", LEAF_NODE_AVAILABLE_CELL_SPACE);
-    printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELLS);
-    printf("INTERNAL_NODE_CELL_SIZE: %d\n", INTERNAL_NODE_CELL_SIZE);
-    printf("INTERNAL_NODE_MAX_CELLS: %d\n", INTERNAL_NODE_MAX_CELLS);
-}
+// VACUUM builds the new file next to the old one, then renames it over it
+static const char VACUUM_SUFFIX[] = "-vacuum";
 
-typedef enum
-{
-    NODE_INTERNAL,
-    NODE_LEAF
-} NodeType;
+// The hot pages to read back on open are listed next to the database file
+static const char WARMUP_SUFFIX[] = "-warmup";
+static const char CHANGE_LOG_SUFFIX[] = "-cdc";
+
+// Pages a backup reads and writes at a time; rate limited backups take smaller
+// chunks so they copy about BACKUP_CHUNKS_PER_SECOND times a second
+static const uint32_t BACKUP_CHUNK_PAGES = 64;
+static const uint32_t BACKUP_CHUNKS_PER_SECOND = 16;
 
 typedef struct
 {
     int file_descriptor;
-    uint32_t file_length;
     uint32_t num_pages;
-    void *pages[TABLE_MAX_PAGES];
-} Pager;
-
-typedef struct
-{
-    uint32_t root_page_idx; // identifies root node?
-    Pager *pager;
-} Table;
-
-typedef struct
-{
-    char *buffer;
-    size_t buffer_length;
-    ssize_t input_length;
-} InputBuffer;
-
-/* Describes a position in a Table */
-typedef struct
-{
+    uint32_t chunk_pages;
+    uint32_t pages_copied; // updated under the database lock
+    uint32_t max_bytes_per_second;
+    bool joined; // the thread has finished and been waited for
+    DbResult result;
+    pthread_t thread;
+} Backup;
+
+struct Database
+{
+    char *filename;
+    char *warmup_filename; // saved at close and checkpoints, loaded on open
+    uint32_t flags; // db_open_with_flags flags, reused when VACUUM opens the new file
     Table *table;
-    uint32_t page_idx;
-    uint32_t cell_idx;
-    bool end_of_table; // Indicates a position one past the last element
-} Cursor;
-
-typedef enum
-{
-    META_COMMAND_SUCCESS,
-    META_COMMAND_UNRECOGNIZED_COMMAND
-} MetaCommandResult;
-
-typedef enum
-{
-    PREPARE_STATEMENT_SUCCESS,
-    PREPARE_STATEMENT_UNRECOGNIZED_COMMAND,
-    PREPARE_STATEMENT_SYNTAX_ERROR
-    // PREPARE_STRING_TOO_LONG,
-} PrepareResult;
-
-typedef enum
-{
-    EXECUTE_STATEMENT_SUCCESS,
-    EXECUTE_STATEMENT_TABLE_FULL,
-    EXECUTE_STATEMENT_ERROR,
-    EXECUTE_DUPLICATE_KEY
-} ExecuteResult;
-typedef enum
-{
-    STATEMENT_INSERT,
-    STATEMENT_SELECT
-} StatementType;
+    Table *indexes[NUM_COLUMNS]; // secondary index per column, NULL if none
+    HashIndex *id_hash;          // id -> leaf page and cell holding the row, NULL if none
+    Memtable *memtable;          // inserts not yet in the table, with DB_OPEN_BUFFERED_INSERTS; else NULL
+    Art *rows;                   // every row, with DB_OPEN_IN_MEMORY; the table is then the last saved copy
+    bool rows_changed;           // rows differ from the table
+    ChangeLog *change_log;       // every durable change, appended to filename-cdc, with DB_OPEN_CHANGE_LOG; else NULL
+
+    // background threads: the flusher (db_start_flusher) and a backup (db_backup_start)
+    uint32_t background_threads; // started and not yet joined; only the caller's thread changes it
+    pthread_mutex_t lock;        // held while pages are modified, written back or copied, if any runs
+    bool flusher_running;
+    bool flusher_stopping;
+    DbFlusherOptions flusher_options;
+    pthread_t flusher;
+    pthread_cond_t flusher_wake;
+    Backup *backup; // the last backup started, NULL if none
+
+    DbTable *tables[DB_MAX_TABLES]; // user tables, in creation order as the catalog lists them
+    uint32_t num_tables;
+    uint32_t open_table_scans; // user table iterators not yet closed; in-memory checkpoints wait for them
+};
+
+struct DbTable
+{
+    DbSchema schema;
+    RowCodec codec;
+    Table *tree; // keyed by encode_key of the first column, valued by the encoded record
+};
+
+struct DbIterator
+{
+    Cursor *cursor; // walks the table, or an index for indexed column scans
+    uint32_t end_id; // last id (inclusive) returned by the iterator
+
+    // column filter of db_scan_column; DB_COLUMN_ID for plain id range scans
+    Database *db;
+    Table *table;
+    DbColumn column;
+    bool prefix;
+    char value[COLUMN_EMAIL_SIZE];
+    uint32_t value_length;
+    uint32_t match_length;              // bytes a value must match: the filter, plus its NUL for equality
+    uint8_t head[FILTER_HEAD_SIZE];     // start of value, then NULs
+    uint32_t head_mask;                 // bit i set if byte i of head must match
+
+    // cells of the leaf at selection_page_idx that passed the filter, for scans without an index
+    uint32_t *selection;
+    uint32_t num_selected;
+    uint32_t next_selected;
+    uint32_t selection_page_idx;
+
+    // with DB_OPEN_IN_MEMORY cursor is NULL and the scan walks db->rows
+    ArtIterator walk;
+    void *next_value; // row at walk.key, NULL once the walk is over
+
+    DbTable *user_table; // table of a db_table_scan, whose end_id is an encoded key; NULL for Rows
+};
+
+static uint32_t *header_version(void *header)
+{
+    return header + HEADER_VERSION_OFFSET;
+}
 
-typedef struct
+static uint32_t *header_table_root(void *header)
 {
-    uint32_t id;
-    char username[COLUMN_USERNAME_SIZE];
-    char email[COLUMN_EMAIL_SIZE];
-} Row;
-typedef struct
-{
-    StatementType type;
-    Row row_to_insert; // only used by insert statement
-} Statement;
+    return header + HEADER_TABLE_ROOT_OFFSET;
+}
 
-/* Returns pointer to num cells in a leaf node */
-uint32_t *leaf_node_num_cells(void *node)
+static uint32_t *header_index_root(void *header, DbColumn column)
 {
-    return node + LEAF_NODE_NUM_CELLS_OFFSET;
+    return header + HEADER_INDEX_ROOTS_OFFSET + column * sizeof(uint32_t);
 }
 
-/* Returns pointer to cell at cell_idx of leaf node */
-void *leaf_node_cell(void *node, uint32_t cell_idx)
+static uint32_t *header_id_hash(void *header)
 {
-    return node + LEAF_NODE_HEADER_SIZE + cell_idx * LEAF_NODE_CELL_SIZE;
+    return header + HEADER_ID_HASH_OFFSET;
 }
 
-/* Returns pointer to key at cell_idx of leaf node */
-uint32_t *leaf_node_key(void *node, uint32_t cell_idx)
+static uint32_t *header_catalog(void *header)
 {
-    return leaf_node_cell(node, cell_idx);
+    return header + HEADER_CATALOG_OFFSET;
 }
 
-/* Returns pointer to value at cell_idx of leaf node */
-void *leaf_node_value(void *node, uint32_t cell_idx)
+static uint32_t column_offset(DbColumn column)
 {
-    return leaf_node_cell(node, cell_idx) + LEAF_NODE_KEY_SIZE;
+    return column == DB_COLUMN_USERNAME ? USERNAME_OFFSET : EMAIL_OFFSET;
 }
 
-uint32_t *leaf_node_next_leaf(void *node)
+static uint32_t column_size(DbColumn column)
 {
-    return node + LEAF_NODE_NEXT_LEAF_OFFSET;
+    return column == DB_COLUMN_USERNAME ? USERNAME_SIZE : EMAIL_SIZE;
 }
 
-uint32_t *internal_node_cell(void *node, uint32_t cell_idx)
+static Table *new_index_table(Pager *pager, uint32_t root_page_idx, DbColumn column)
 {
-    return (uint32_t *)(node + INTERNAL_NODE_HEADER_SIZE + cell_idx * INTERNAL_NODE_CELL_SIZE);
+    // index cells are all key: the column value then the row id
+    return new_table(pager, root_page_idx, KEY_COLUMN_AND_ID, column_size(column) + ID_SIZE, 0);
 }
 
-uint32_t *internal_node_key(void *node, uint32_t cell_idx)
+/* Builds the index key for a column value; value ends at a NUL or at the column size */
+static void make_index_key(Table *index, const char *value, uint32_t id, uint8_t *key)
 {
-    return (void *)internal_node_cell(node, cell_idx) + INTERNAL_NODE_CHILD_SIZE;
+    uint32_t size = index->key_size - ID_SIZE;
+    size_t length = strnlen(value, size);
+    memcpy(key, value, length);
+    memset(key + length, 0, size - length);
+    memcpy(key + size, &id, ID_SIZE);
 }
 
-/* Returns pointer to num keys for internal node */
-uint32_t *internal_node_num_keys(void *node)
+/* Allocates a page holding an empty root leaf and returns its index */
+static uint32_t new_root_leaf(Pager *pager)
 {
-    return (uint32_t *)(node + INTERNAL_NODE_NUM_KEYS_OFFSET);
+    uint32_t page_idx = get_unused_page_idx(pager);
+    void *root_node = get_page(pager, page_idx);
+    mark_page_dirty(pager, page_idx);
+    initialize_leaf_node(root_node);
+    set_node_root(root_node, true);
+    return page_idx;
 }
 
-/* Returns pointer to page index of right child of internal node */
-uint32_t *internal_node_right_child(void *node)
+static void initialize_header(void *header, uint32_t table_root_page_idx)
 {
-    return (uint32_t *)(node + INTERNAL_NODE_RIGHT_CHILD_OFFSET);
+    memset(header, 0, PAGE_SIZE);
+    memcpy(header + HEADER_MAGIC_OFFSET, HEADER_MAGIC, sizeof(HEADER_MAGIC));
+    *header_version(header) = FORMAT_VERSION;
+    *header_table_root(header) = table_root_page_idx;
 }
 
-/* Returns pointer to page index of internal node i'th child */
-uint32_t *internal_node_child(void *node, uint32_t child_idx)
+/*
+Files written before the header page existed keep the table root in page 0.
+Move that root to a new page, repointing its children, and put a header in page 0.
+*/
+static void upgrade_legacy_file(Pager *pager)
 {
-    uint32_t num_keys = *internal_node_num_keys(node);
-    if (child_idx > num_keys)
+    if (pager->num_pages >= TABLE_MAX_PAGES)
     {
-        printf("Tried to access child idx (%d) when there are only (%d) keys\n", child_idx, num_keys);
+        fprintf(stderr, "No free page to upgrade the database file.\n");
         exit(EXIT_FAILURE);
     }
 
-    if (child_idx == num_keys)
+    void *old_root = get_page(pager, HEADER_PAGE_IDX);
+    uint32_t root_page_idx = get_unused_page_idx(pager);
+    void *root = get_page(pager, root_page_idx);
+    mark_page_dirty(pager, root_page_idx);
+    memcpy(root, old_root, PAGE_SIZE);
+
+    if (get_node_type(root) == NODE_INTERNAL)
     {
-        if (*internal_node_right_child(node) == INVALID_PAGE_IDX)
+        Table *table = new_table(pager, root_page_idx, KEY_ROW_ID, LEAF_NODE_KEY_SIZE, LEAF_NODE_VALUE_SIZE);
+        for (uint32_t i = 0; i <= *internal_node_num_keys(root); i++)
         {
-            printf("Tried to access right child of node when it is empty\n");
-            exit(EXIT_FAILURE);
+            uint32_t child_page_idx = *internal_node_child(table, root, i);
+            mark_page_dirty(pager, child_page_idx);
+            *node_parent(get_page(pager, child_page_idx)) = root_page_idx;
         }
-        return internal_node_right_child(node);
-    }
-
-    uint32_t *child = internal_node_cell(node, child_idx);
-    if (*child == INVALID_PAGE_IDX)
-    {
-        printf("Tried to access child %d of node, but was invalid page\n", child_idx);
-        exit(EXIT_FAILURE);
+        free(table);
     }
 
-    return child;
+    mark_page_dirty(pager, HEADER_PAGE_IDX);
+    initialize_header(old_root, root_page_idx);
+    *header_version(old_root) = 1; // its internal nodes still lack row counts
 }
 
-NodeType get_node_type(void *node)
+/* Version 1 internal nodes had no row counts; rewrite every tree's internal nodes with them */
+static void upgrade_version_1(Pager *pager)
 {
-    uint8_t value = *((uint8_t *)node + NODE_TYPE_OFFSET);
-    return (NodeType)value;
-}
+    void *header = get_page(pager, HEADER_PAGE_IDX);
+    Table *table = new_table(pager, *header_table_root(header), KEY_ROW_ID, LEAF_NODE_KEY_SIZE, LEAF_NODE_VALUE_SIZE);
+    add_internal_node_counts(table, table->root_page_idx);
+    free(table);
 
-void set_node_type(void *node, NodeType type)
-{
-    uint8_t value = (uint8_t)type;
-    *(uint8_t *)(node + NODE_TYPE_OFFSET) = value;
-}
+    for (DbColumn column = DB_COLUMN_USERNAME; column < NUM_COLUMNS; column++)
+    {
+        if (*header_index_root(header, column))
+        {
+            Table *index = new_index_table(pager, *header_index_root(header, column), column);
+            add_internal_node_counts(index, index->root_page_idx);
+            free(index);
+        }
+    }
 
-bool is_node_root(void *node)
-{
-    uint8_t is_root = *(uint8_t *)(node + IS_ROOT_OFFSET);
-    return (bool)is_root;
+    mark_page_dirty(pager, HEADER_PAGE_IDX);
+    *header_version(header) = FORMAT_VERSION;
 }
 
-void set_node_root(void *node, bool is_root)
+/* Fills the memtable's filter with the ids in the table */
+static void rebuild_stored_filter(Database *db)
 {
-    uint8_t value = (uint8_t)is_root;
-    *(uint8_t *)(node + IS_ROOT_OFFSET) = value;
+    memtable_reset_filter(db->memtable, table_count(db->table));
+    Cursor *cursor = init_cursor_table_start(db->table);
+    while (!cursor->end_of_table)
+    {
+        memtable_note_stored(db->memtable, *(uint32_t *)cursor_key(cursor));
+        advance_cursor(cursor);
+    }
+    free(cursor);
 }
 
-void initialize_leaf_node(void *node)
+/* Copies every row of the table into db->rows, in key order */
+static void load_rows(Database *db)
 {
-    *leaf_node_num_cells(node) = 0;
-    *leaf_node_next_leaf(node) = 0; // 0 represents no sibling
-    set_node_type(node, NODE_LEAF);
-    set_node_root(node, false);
+    db->rows = new_art(ROW_SIZE);
+    Cursor *cursor = init_cursor_table_start(db->table);
+    while (!cursor->end_of_table)
+    {
+        bool inserted;
+        memcpy(art_insert(db->rows, *(uint32_t *)cursor_key(cursor), &inserted), cursor_value(cursor), ROW_SIZE);
+        advance_cursor(cursor);
+    }
+    free(cursor);
 }
 
-void initialize_internal_node(void *node)
+static Table *new_user_tree(Pager *pager, uint32_t root_page_idx, DbTable *table)
 {
-    set_node_type(node, NODE_INTERNAL);
-    set_node_root(node, false);
-    *internal_node_num_keys(node) = 0;
-    *internal_node_right_child(node) = INVALID_PAGE_IDX; // empty node has no right child
+    return new_table(pager, root_page_idx, KEY_ROW_ID, sizeof(uint32_t), table->codec.record_size);
 }
 
-uint32_t *node_parent(void *node)
+/* Lays out the catalog of db's user tables in page; returns false if they don't fit */
+static bool write_catalog(Database *db, uint8_t *page)
 {
-    return node + PARENT_POINTER_OFFSET;
+    memset(page, 0, PAGE_SIZE);
+    memcpy(page + CATALOG_NUM_TABLES_OFFSET, &db->num_tables, sizeof(uint32_t));
+    uint32_t offset = CATALOG_ENTRIES_OFFSET;
+    for (uint32_t i = 0; i < db->num_tables; i++)
+    {
+        if (PAGE_SIZE - offset < sizeof(uint32_t))
+        {
+            return false;
+        }
+        memcpy(page + offset, &db->tables[i]->tree->root_page_idx, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        uint32_t length = write_schema(&db->tables[i]->schema, page + offset, PAGE_SIZE - offset);
+        if (length == 0)
+        {
+            return false;
+        }
+        offset += length;
+    }
+    return true;
 }
 
-/*
-Get the address of page based on its index
-Allocates memory for page and loads data from file if it doesn't exist in memory yet
-*/
-void *get_page(Pager *pager, uint32_t page_idx)
+/* Rewrites the catalog page of db's file, allocating it along with the first table */
+static void save_catalog(Database *db)
 {
-    if (page_idx >= TABLE_MAX_PAGES)
+    Pager *pager = db->table->pager;
+    void *header = get_page(pager, HEADER_PAGE_IDX);
+    if (*header_catalog(header) == 0)
     {
-        printf("Tried to fetch page idx out of bounds.");
-        exit(EXIT_FAILURE);
+        mark_page_dirty(pager, HEADER_PAGE_IDX);
+        *header_catalog(header) = get_unused_page_idx(pager);
     }
+    uint32_t page_idx = *header_catalog(header);
+    void *page = get_page(pager, page_idx);
+    mark_page_dirty(pager, page_idx);
+    write_catalog(db, page); // callers checked that it fits
+}
 
-    void *page = pager->pages[page_idx];
-    if (page == NULL)
-    {
-        // cache miss, allocate memory for page using PAGE_SIZE
-        page = pager->pages[page_idx] = malloc(PAGE_SIZE);
+/* Opens the user tables listed in the catalog page, compiling each one's codec */
+static void load_catalog(Database *db, uint32_t catalog_page_idx)
+{
+    Pager *pager = db->table->pager;
+    uint8_t *page = get_page(pager, catalog_page_idx);
+    uint32_t num_tables;
+    memcpy(&num_tables, page + CATALOG_NUM_TABLES_OFFSET, sizeof(num_tables));
 
-        // get number of pages
-        uint32_t num_pages = pager->file_length / PAGE_SIZE; // full pages
-        if (pager->file_length % PAGE_SIZE)
+    uint32_t offset = CATALOG_ENTRIES_OFFSET;
+    for (uint32_t i = 0; i < num_tables; i++)
+    {
+        DbTable *table = malloc(sizeof(DbTable));
+        uint32_t root_page_idx = 0, length = 0;
+        if (num_tables <= DB_MAX_TABLES && PAGE_SIZE - offset > sizeof(uint32_t))
         {
-            num_pages += 1; // add 1 for partial page
+            memcpy(&root_page_idx, page + offset, sizeof(uint32_t));
+            offset += sizeof(uint32_t);
+            length = read_schema(page + offset, PAGE_SIZE - offset, &table->schema);
         }
-
-        // Set the file offset to wherever page_idx is
-        // SEEK_SET -> the file offset is set to offset (page_idx * PAGE_SIZE) bytes
-        lseek(pager->file_descriptor, page_idx * PAGE_SIZE, SEEK_SET);
-
-        // Read file into allocated page
-        ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
-
-        // update number of pages if accessing beyond current number of pages
-        if (page_idx >= pager->num_pages)
+        if (length == 0 || root_page_idx == HEADER_PAGE_IDX || root_page_idx >= pager->num_pages ||
+            !compile_codec(&table->schema, &table->codec))
         {
-            pager->num_pages = page_idx + 1;
+            fprintf(stderr, "Catalog page %u is corrupted.\n", catalog_page_idx);
+            exit(EXIT_FAILURE);
         }
+        offset += length;
+        table->tree = new_user_tree(pager, root_page_idx, table);
+        db->tables[db->num_tables++] = table;
     }
-
-    return pager->pages[page_idx];
 }
 
-uint32_t get_node_max_key(Pager *pager, void *node)
+/*
+Open db connection with input file
+- Init pager
+- Create or read the header page
+- Load the table and any secondary indexes
+*/
+Database *db_open(const char *filename)
 {
-    if (get_node_type(node) == NODE_LEAF)
-    {
-        // max key will be the last key in the node
-        return *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
-    }
+    return db_open_with_flags(filename, 0);
+}
 
-    // internal node, recursively get the max key of the right child
-    void *right_child = get_page(pager, *internal_node_right_child(node));
-    return get_node_max_key(pager, right_child);
+static uint32_t pager_flags(uint32_t flags)
+{
+    return ((flags & DB_OPEN_DIRECT_IO) ? PAGER_DIRECT_IO : 0) | ((flags & DB_OPEN_COMPRESSED) ? PAGER_COMPRESSED : 0);
 }
 
-/* Initializes Pager struct */
-Pager *open_pager(const char *filename)
+Database *db_open_with_flags(const char *filename, uint32_t flags)
 {
-    // open file and get fd
-    int fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
-    if (fd == -1)
+    // init pager
+    Pager *pager = open_pager(filename, pager_flags(flags));
+
+    if (pager->num_pages == 0)
+    {
+        // new database file. page 0 is the header and page 1 the root leaf
+        void *header = get_page(pager, HEADER_PAGE_IDX);
+        mark_page_dirty(pager, HEADER_PAGE_IDX);
+        initialize_header(header, new_root_leaf(pager));
+    }
+    else if (memcmp(get_page(pager, HEADER_PAGE_IDX) + HEADER_MAGIC_OFFSET, HEADER_MAGIC, sizeof(HEADER_MAGIC)) != 0)
     {
-        printf("Error opening file\n");
-        exit(EXIT_FAILURE); // error handling
+        upgrade_legacy_file(pager);
     }
 
-    // get file length
-    off_t file_length = lseek(fd, 0, SEEK_END); // get offset of file end?
-    if (file_length == -1)
+    void *header = get_page(pager, HEADER_PAGE_IDX);
+    if (*header_version(header) == 1)
     {
-        printf("Error getting file length\n");
-        exit(EXIT_FAILURE);
+        upgrade_version_1(pager);
     }
-    if (file_length % PAGE_SIZE != 0)
+    else if (*header_version(header) != FORMAT_VERSION)
     {
-        printf("Db file is not whole number of pages. Corrupted file.\n");
+        fprintf(stderr, "Unsupported database file version %d.\n", *header_version(header));
         exit(EXIT_FAILURE);
     }
 
-    // allocate memory and init properties for pager
-    Pager *pager = (Pager *)malloc(sizeof(Pager));
-    pager->file_descriptor = fd;
-    pager->file_length = file_length;
-    pager->num_pages = file_length / PAGE_SIZE;
-    for (int i = 0; i < TABLE_MAX_PAGES; i++)
+    Database *db = calloc(1, sizeof(Database));
+    pthread_mutex_init(&db->lock, NULL);
+    db->filename = strdup(filename);
+    db->warmup_filename = malloc(strlen(filename) + sizeof(WARMUP_SUFFIX));
+    sprintf(db->warmup_filename, "%s%s", filename, WARMUP_SUFFIX);
+    db->flags = flags;
+    db->table = new_table(pager, *header_table_root(header), KEY_ROW_ID, LEAF_NODE_KEY_SIZE, LEAF_NODE_VALUE_SIZE);
+
+    db->indexes[DB_COLUMN_ID] = NULL; // the table itself is keyed by id
+    for (DbColumn column = DB_COLUMN_USERNAME; column < NUM_COLUMNS; column++)
+    {
+        uint32_t root_page_idx = *header_index_root(header, column);
+        db->indexes[column] = root_page_idx ? new_index_table(pager, root_page_idx, column) : NULL;
+    }
+    db->id_hash = *header_id_hash(header) ? open_hash_index(pager, *header_id_hash(header)) : NULL;
+    if (*header_catalog(header))
+    {
+        load_catalog(db, *header_catalog(header));
+    }
+    pager_load_warmup(pager, db->warmup_filename);
+    if (flags & DB_OPEN_IN_MEMORY)
+    {
+        load_rows(db);
+    }
+    else if (flags & DB_OPEN_BUFFERED_INSERTS)
+    {
+        db->memtable = new_memtable(table_count(db->table));
+        rebuild_stored_filter(db);
+    }
+    if (flags & DB_OPEN_CHANGE_LOG)
     {
-        pager->pages[i] = NULL;
+        char change_log_filename[strlen(filename) + sizeof(CHANGE_LOG_SUFFIX)];
+        sprintf(change_log_filename, "%s%s", filename, CHANGE_LOG_SUFFIX);
+        db->change_log = open_change_log(change_log_filename);
     }
 
-    // return address for pager
-    return pager;
+    return db;
 }
 
 /*
-Open db connection with input file
-- Init pager and table
-- Load file into pager
-- Load pager in table
+Locks out background threads while pages are modified. Calls that only read
+pages skip the lock: the flusher touches nothing but dirty pages, a backup
+nothing but snapshot pre-images, and only writers create either. The exception
+is DB_OPEN_IN_MEMORY, where a checkpoint replaces the pager and every tree, so
+calls reading those outside an open user table scan take the lock as well
 */
-Table *open_db(const char *filename)
+static void lock_pages(Database *db)
 {
-    // init pager
-    Pager *pager = open_pager(filename);
+    if (db->background_threads)
+    {
+        pthread_mutex_lock(&db->lock);
+    }
+}
 
-    // since we are loading the db file, num_rows in table depends on how much data is already in the db file
-    // uint32_t num_rows = pager->file_length / ROW_SIZE;
+static void unlock_pages(Database *db)
+{
+    if (db->background_threads)
+    {
+        pthread_mutex_unlock(&db->lock);
+    }
+}
 
-    // init table
-    Table *table = (Table *)malloc(sizeof(Table));
-    table->root_page_idx = 0; // set page 0 to be root
-    table->pager = pager;
+static uint64_t ms_to_ns(uint32_t ms)
+{
+    return ms * 1000000ull;
+}
 
-    if (pager->num_pages == 0)
+/* Lets a waiting API call take the lock between the flusher's batches */
+static void yield_lock(Database *db)
+{
+    pthread_mutex_unlock(&db->lock);
+    sched_yield();
+    pthread_mutex_lock(&db->lock);
+}
+
+// buffered inserts are moved into the table along with the insert path, and in-memory rows saved by VACUUM, further down
+static DbResult flush_memtable(Database *db);
+static DbResult vacuum(Database *db);
+static DbResult save_rows(Database *db);
+
+/* Where the change records logged so far end; commit it once their changes are durable */
+static uint64_t changes_logged(Database *db)
+{
+    return db->change_log ? change_log_position(db->change_log) : 0;
+}
+
+/* In-memory rows are durable only once saved, so while they differ from the file nothing is committed */
+static void commit_changes(Database *db, uint64_t logged)
+{
+    if (db->change_log && !db->rows_changed)
     {
-        // new database file. init page 0 as root and leaf
-        void *root_node = get_page(pager, table->root_page_idx);
-        initialize_leaf_node(root_node);
-        set_node_root(root_node, true);
+        change_log_commit(db->change_log, logged);
     }
-
-    return table;
 }
 
 /*
-Writes PAGE_SIZE bytes from leaf node at pages[page_idx] to file
+Writes every dirty page, max_pages at a time, then fsyncs with the lock
+released so API calls are not held up by the disk. Pages dirtied after their
+batch was written wait for the next round. In-memory rows are saved instead.
+The change log is committed up to the changes made before the first batch, if
+every round got written
 */
-void flush_page(Pager *pager, uint32_t page_idx)
+static void checkpoint(Database *db)
 {
-    int fd = pager->file_descriptor;
-
-    // set file offset
-    off_t offset = page_idx * PAGE_SIZE;
-    lseek(fd, offset, SEEK_SET);
-    if (offset == -1)
+    if (db->rows)
     {
-        printf("Error seeking\n");
-        exit(EXIT_FAILURE);
+        // a backup reads the file being replaced, and user table scans walk its pages, so while
+        // either runs the rows wait for a later checkpoint
+        if (db->rows_changed && db->table->pager->snapshot == NULL && db->open_table_scans == 0)
+        {
+            vacuum(db);
+        }
+        return;
+    }
+    flush_memtable(db);
+    uint64_t logged = changes_logged(db);
+    Pager *pager = db->table->pager;
+    uint32_t max_pages = db->flusher_options.max_pages;
+    if (pager->page_map)
+    {
+        // the page map is written with the fsync, and no page may move until it is durable
+        pager_flush(pager);
+        commit_changes(db, logged);
+        pager_save_warmup(pager, db->warmup_filename);
+        return;
+    }
+    bool written = false;
+    for (uint32_t rounds = pager->num_pages / max_pages + 1; rounds > 0 && !db->flusher_stopping; rounds--)
+    {
+        if (pager_write_back(pager, max_pages, UINT64_MAX) < max_pages)
+        {
+            written = true;
+            break;
+        }
+        yield_lock(db);
     }
 
-    // write bytes to file
-    ssize_t bytes_written = write(fd, pager->pages[page_idx], PAGE_SIZE);
-    if (bytes_written == -1)
+    uint64_t num_writes = pager->num_writes;
+    pthread_mutex_unlock(&db->lock);
+    if (fsync(pager->file_descriptor) == -1)
     {
-        printf("Error writing page to file\n");
+        fprintf(stderr, "Error syncing file\n");
         exit(EXIT_FAILURE);
     }
+    pager_save_warmup(pager, db->warmup_filename); // so a crash restarts warm too
+    pthread_mutex_lock(&db->lock);
+    if (pager->num_synced_writes < num_writes)
+    {
+        pager->num_synced_writes = num_writes;
+    }
+    if (written)
+    {
+        commit_changes(db, logged);
+    }
 }
 
-void close_db(Table *table)
+static void *run_flusher(void *arg)
 {
-    Pager *pager = table->pager;
+    Database *db = arg;
+    DbFlusherOptions *options = &db->flusher_options;
+    uint64_t next_checkpoint_ns = pager_clock_ns() + ms_to_ns(options->checkpoint_ms);
 
-    // flush pages and free memory
-    for (int i = 0; i < pager->num_pages; i++)
+    pthread_mutex_lock(&db->lock);
+    while (!db->flusher_stopping)
     {
-        void *page = pager->pages[i];
-        if (page)
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        uint64_t deadline_ns = deadline.tv_nsec + ms_to_ns(options->interval_ms);
+        deadline.tv_sec += deadline_ns / 1000000000ull;
+        deadline.tv_nsec = deadline_ns % 1000000000ull;
+        pthread_cond_timedwait(&db->flusher_wake, &db->lock, &deadline);
+        if (db->flusher_stopping)
+        {
+            break;
+        }
+        uint64_t now = pager_clock_ns();
+        if (options->checkpoint_ms && now >= next_checkpoint_ns)
+        {
+            checkpoint(db);
+            next_checkpoint_ns = now + ms_to_ns(options->checkpoint_ms);
+        }
+        else if (now >= ms_to_ns(options->min_age_ms))
         {
-            flush_page(pager, i);
-            free(page);
-            pager->pages[i] = NULL;
+            pager_write_back(db->table->pager, options->max_pages, now - ms_to_ns(options->min_age_ms));
         }
     }
-
-    close(pager->file_descriptor); // close file
-
-    free(pager);
-    free(table);
+    pthread_mutex_unlock(&db->lock);
+    return NULL;
 }
 
-/*
-Init InputBuffer object
-*/
-InputBuffer *new_input_buffer()
+DbResult db_start_flusher(Database *db, const DbFlusherOptions *options)
 {
-    InputBuffer *input_buffer = malloc(sizeof(InputBuffer));
-    input_buffer->buffer = NULL;
-    input_buffer->buffer_length = 0;
-    input_buffer->input_length = 0;
-
-    return input_buffer;
-}
-
-void print_prompt() { printf("db > "); }
+    if (db->flusher_running || options->interval_ms == 0 || options->max_pages == 0)
+    {
+        return DB_ERROR;
+    }
 
-void read_input(InputBuffer *input_buffer)
-{
-    ssize_t bytes_read =
-        getline(&(input_buffer->buffer), &(input_buffer->buffer_length), stdin);
+    db->flusher_options = *options;
+    db->flusher_stopping = false;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&db->flusher_wake, &attr);
+    pthread_condattr_destroy(&attr);
 
-    if (bytes_read <= 0)
+    if (pthread_create(&db->flusher, NULL, run_flusher, db) != 0)
     {
-        printf("Error reading input\n");
-        exit(EXIT_FAILURE);
+        pthread_cond_destroy(&db->flusher_wake);
+        return DB_ERROR;
     }
-
-    // Ignore trailing newline
-    input_buffer->input_length = bytes_read - 1;
-    input_buffer->buffer[bytes_read - 1] = 0;
+    db->flusher_running = true;
+    db->background_threads++;
+    return DB_OK;
 }
 
-void close_input_buffer(InputBuffer *input_buffer)
+/* Stops the flusher, if one runs, and returns whether it did */
+static bool stop_flusher(Database *db)
 {
-    free(input_buffer->buffer);
-    free(input_buffer);
-}
+    if (!db->flusher_running)
+    {
+        return false;
+    }
 
-bool StartsWith(const char *a, const char *b)
-{
-    return strncmp(a, b, strlen(b)) == 0;
+    pthread_mutex_lock(&db->lock);
+    db->flusher_stopping = true;
+    pthread_cond_signal(&db->flusher_wake);
+    pthread_mutex_unlock(&db->lock);
+    pthread_join(db->flusher, NULL);
+
+    db->flusher_running = false;
+    db->background_threads--;
+    pthread_cond_destroy(&db->flusher_wake);
+    return true;
 }
 
-void indent(uint32_t level)
+/*
+Copies the snapshot a chunk at a time. Each chunk is read from the file without
+the lock; pages changed since the snapshot began are then swapped for their
+pre-images under it. A compressed file is read under the lock and copied as
+plain pages
+*/
+static void *run_backup(void *arg)
 {
-    for (uint32_t i = 0; i < level; i++)
+    Database *db = arg;
+    Backup *backup = db->backup;
+    Pager *pager = db->table->pager;
+    void *chunk;
+    if (posix_memalign(&chunk, PAGE_SIZE, BACKUP_CHUNK_PAGES * PAGE_SIZE) != 0) // aligned for O_DIRECT files
     {
-        printf("  ");
+        fprintf(stderr, "Error allocating backup buffer\n");
+        exit(EXIT_FAILURE);
     }
-}
-
-void print_tree(Pager *pager, uint32_t page_idx, uint32_t indentation_level)
-{
-    void *node = get_page(pager, page_idx);
-    uint32_t num_keys, child;
+    uint64_t start_ns = pager_clock_ns();
 
-    switch (get_node_type(node))
+    DbResult result = DB_OK;
+    for (uint32_t first = 0; first < backup->num_pages; first += backup->chunk_pages)
     {
-    case (NODE_LEAF):
-        num_keys = *leaf_node_num_cells(node);
-        indent(indentation_level);
-        printf("- leaf (size %d)\n", num_keys);
+        uint32_t count = backup->num_pages - first < backup->chunk_pages ? backup->num_pages - first : backup->chunk_pages;
+        size_t size = (size_t)count * PAGE_SIZE;
+        off_t offset = (off_t)first * PAGE_SIZE;
+        if (pager->page_map == NULL && pread(pager->file_descriptor, chunk, size, offset) != (ssize_t)size)
+        {
+            result = DB_ERROR;
+            break;
+        }
 
-        for (uint32_t i = 0; i < num_keys; i++)
+        pthread_mutex_lock(&db->lock);
+        for (uint32_t i = 0; i < count; i++)
         {
-            indent(indentation_level + 1);
-            printf("- %d\n", *leaf_node_key(node, i));
+            if (pager->page_map)
+            {
+                // compressed pages move when rewritten, so they are read under the lock, and written out plain
+                pager_read_page(pager, first + i, chunk + i * PAGE_SIZE);
+            }
+            pager_snapshot_page(pager, first + i, chunk + i * PAGE_SIZE);
         }
+        backup->pages_copied = first + count;
+        pthread_mutex_unlock(&db->lock);
 
-        break;
-    case (NODE_INTERNAL):
-        num_keys = *internal_node_num_keys(node);
-        indent(indentation_level);
-        printf("- internal (size %d)\n", num_keys);
+        if (pwrite(backup->file_descriptor, chunk, size, offset) != (ssize_t)size)
+        {
+            result = DB_ERROR;
+            break;
+        }
 
-        for (uint32_t i = 0; i < num_keys; i++)
+        if (backup->max_bytes_per_second)
         {
-            child = *internal_node_child(node, i);
-            print_tree(pager, child, indentation_level + 1);
-            indent(indentation_level + 1);
-            printf("- key %d\n", *internal_node_key(node, i));
+            // sleep until the bytes so far fit the rate
+            uint64_t due_ns = start_ns + (uint64_t)(first + count) * PAGE_SIZE * 1000000000ull / backup->max_bytes_per_second;
+            uint64_t now = pager_clock_ns();
+            if (due_ns > now)
+            {
+                struct timespec pause = {(due_ns - now) / 1000000000ull, (due_ns - now) % 1000000000ull};
+                nanosleep(&pause, NULL);
+            }
         }
+    }
 
-        child = *internal_node_right_child(node);
-        print_tree(pager, child, indentation_level + 1);
-        break;
+    if (result == DB_OK && fsync(backup->file_descriptor) == -1)
+    {
+        result = DB_ERROR;
     }
+    close(backup->file_descriptor);
+    free(chunk);
+
+    pthread_mutex_lock(&db->lock);
+    pager_end_snapshot(pager);
+    pthread_mutex_unlock(&db->lock);
+    backup->result = result;
+    return NULL;
 }
 
-MetaCommandResult do_meta_command(InputBuffer *input_buffer, Table *table)
+DbResult db_backup_start(Database *db, const char *path, uint32_t max_bytes_per_second)
 {
-    if (strcmp(input_buffer->buffer, ".exit") == 0)
+    if (db->backup && !db->backup->joined)
     {
-        close_input_buffer(input_buffer);
-        close_db(table);
-        exit(EXIT_SUCCESS);
+        return DB_ERROR;
     }
-    else if (strcmp(input_buffer->buffer, ".constants") == 0)
+    if (save_rows(db) != DB_OK)
     {
-        print_constants();
-        return META_COMMAND_SUCCESS;
+        return DB_TABLE_FULL;
     }
-    else if (strcmp(input_buffer->buffer, ".btree") == 0)
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    if (fd == -1)
     {
-        void *node = get_page(table->pager, table->root_page_idx);
-        print_tree(table->pager, table->root_page_idx, 0);
-        return META_COMMAND_SUCCESS;
+        return DB_ERROR;
     }
-    else
+
+    lock_pages(db);
+    flush_memtable(db);
+    unlock_pages(db);
+
+    free(db->backup);
+    Backup *backup = db->backup = calloc(1, sizeof(Backup));
+    backup->file_descriptor = fd;
+    backup->max_bytes_per_second = max_bytes_per_second;
+    backup->chunk_pages = BACKUP_CHUNK_PAGES;
+    if (max_bytes_per_second && max_bytes_per_second / BACKUP_CHUNKS_PER_SECOND / PAGE_SIZE < BACKUP_CHUNK_PAGES)
+    {
+        uint32_t chunk_pages = max_bytes_per_second / BACKUP_CHUNKS_PER_SECOND / PAGE_SIZE;
+        backup->chunk_pages = chunk_pages > 0 ? chunk_pages : 1;
+    }
+
+    lock_pages(db);
+    backup->num_pages = pager_begin_snapshot(db->table->pager);
+    unlock_pages(db);
+
+    // counted first, so calls made from now on lock out the backup thread
+    db->background_threads++;
+    if (pthread_create(&backup->thread, NULL, run_backup, db) != 0)
     {
-        return META_COMMAND_UNRECOGNIZED_COMMAND;
+        db->background_threads--;
+        pager_end_snapshot(db->table->pager);
+        close(fd);
+        backup->joined = true;
+        backup->result = DB_ERROR;
+        return DB_ERROR;
     }
+    return DB_OK;
 }
 
-/*
-Serialize row by copying row contents into destination byte array
-*/
-void serialize_row(Row *source, void *destination)
+bool db_backup_progress(Database *db, uint32_t *pages_copied, uint32_t *num_pages)
 {
-    memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
-    memcpy(destination + USERNAME_OFFSET, source->username, USERNAME_SIZE);
-    memcpy(destination + EMAIL_OFFSET, source->email, EMAIL_SIZE);
+    if (db->backup == NULL)
+    {
+        return false;
+    }
+    pthread_mutex_lock(&db->lock);
+    *pages_copied = db->backup->pages_copied;
+    *num_pages = db->backup->num_pages;
+    pthread_mutex_unlock(&db->lock);
+    return true;
 }
 
-/*
-Deserialize row by copying destination byte array contents into Row struct
-*/
-void deserialize_row(void *source, Row *destination)
+DbResult db_backup_wait(Database *db)
 {
-    memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
-    memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE);
-    memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);
+    if (db->backup == NULL)
+    {
+        return DB_ERROR;
+    }
+    if (!db->backup->joined)
+    {
+        pthread_join(db->backup->thread, NULL);
+        db->backup->joined = true;
+        db->background_threads--;
+    }
+    return db->backup->result;
 }
-/*
-Parses input and constructs Statement
-*/
-PrepareResult prepare_statement(InputBuffer *input_buffer, Statement *statement)
+
+/* Frees the table, index, hash and user table trees; their pages belong to the pager */
+static void free_trees(Database *db)
 {
-    if (StartsWith(input_buffer->buffer, "SELECT"))
+    for (uint32_t i = 0; i < NUM_COLUMNS; i++)
     {
-        // handle input starting with SELECT
-        statement->type = STATEMENT_SELECT;
-        return PREPARE_STATEMENT_SUCCESS;
+        free(db->indexes[i]);
     }
-
-    if (StartsWith(input_buffer->buffer, "INSERT"))
+    for (uint32_t i = 0; i < db->num_tables; i++)
     {
-        // handle input starting with INSERT
-        statement->type = STATEMENT_INSERT;
-
-        // parse "insert 1 cstack foo@bar.com" -> id, username, email
-        int inputs_matched = sscanf(input_buffer->buffer, "INSERT %d %s %s",
-                                    &(statement->row_to_insert.id),
-                                    statement->row_to_insert.username,
-                                    statement->row_to_insert.email);
+        free(db->tables[i]->tree);
+    }
+    free(db->id_hash);
+    free(db->table);
+}
 
-        if (inputs_matched != 3)
+void db_close(Database *db)
+{
+    if (db->backup)
+    {
+        db_backup_wait(db);
+        free(db->backup);
+        db->backup = NULL;
+    }
+    stop_flusher(db);
+    if (db->memtable)
+    {
+        if (flush_memtable(db) != DB_OK)
         {
-            return PREPARE_STATEMENT_SYNTAX_ERROR;
+            fprintf(stderr, "%u buffered rows did not fit in the file and were lost.\n", memtable_count(db->memtable));
         }
-
-        return PREPARE_STATEMENT_SUCCESS;
+        free_memtable(db->memtable);
+    }
+    if (db->rows)
+    {
+        if (save_rows(db) != DB_OK)
+        {
+            fprintf(stderr, "%u rows did not fit in the file and were not saved.\n", art_count(db->rows));
+        }
+        free_art(db->rows);
+    }
+    uint64_t logged = changes_logged(db);
+    pager_save_warmup(db->table->pager, db->warmup_filename);
+    close_pager(db->table->pager);
+    if (db->change_log)
+    {
+        commit_changes(db, logged);
+        close_change_log(db->change_log);
+    }
+    free_trees(db);
+    for (uint32_t i = 0; i < db->num_tables; i++)
+    {
+        free(db->tables[i]);
     }
+    pthread_mutex_destroy(&db->lock);
+    free(db->filename);
+    free(db->warmup_filename);
+    free(db);
+}
 
-    // all other inputs, return not recognized
-    return PREPARE_STATEMENT_UNRECOGNIZED_COMMAND;
+void db_sync(Database *db)
+{
+    save_rows(db);
+    lock_pages(db);
+    flush_memtable(db);
+    pager_flush(db->table->pager);
+    commit_changes(db, changes_logged(db));
+    unlock_pages(db);
 }
 
-/*
-Convert cursor object to memory address described by cursor
-*/
-void *cursor_value(Cursor *cursor)
+static bool cursor_at_id(Cursor *cursor, uint32_t id)
 {
     Table *table = cursor->table;
-
-    // Get node address //
     void *node = get_page(table->pager, cursor->page_idx);
+    return cursor->cell_idx < *leaf_node_num_cells(node) &&
+           compare_keys(table, leaf_node_key(table, node, cursor->cell_idx), &id) == 0;
+}
+
+/*
+Hash index entries name the leaf page and cell holding a row, packed into one
+uint32 so a hit reads the row without searching the leaf. Table leaves hold far
+fewer than 256 cells, and every page index fits in the 24 bits left, so an
+entry can only name a page that held a leaf of the table: pages are never
+freed or given to another tree
+*/
+static const uint32_t ID_HASH_CELL_BITS = 8;
+#if TABLE_MAX_PAGES > (1 << 24)
+#error "TABLE_MAX_PAGES must fit in the 24 bits id hash locations keep for the page"
+#endif
 
-    return leaf_node_value(node, cursor->cell_idx);
+static uint32_t id_hash_location(Cursor *cursor)
+{
+    return cursor->page_idx << ID_HASH_CELL_BITS | cursor->cell_idx;
 }
 
-/* Advance cursor to next cell */
-void advance_cursor(Cursor *cursor)
+static Cursor *new_cursor(Table *table, uint32_t page_idx, uint32_t cell_idx)
 {
-    uint32_t page_idx = cursor->page_idx;
-    void *node = get_page(cursor->table->pager, page_idx);
-    cursor->cell_idx += 1;
+    Cursor *cursor = malloc(sizeof(Cursor));
+    cursor->table = table;
+    cursor->page_idx = page_idx;
+    cursor->cell_idx = cell_idx;
+    cursor->end_of_table = false;
+    return cursor;
+}
 
-    uint32_t num_cells = *leaf_node_num_cells(node);
-    uint32_t num_pages = cursor->table->pager->num_pages;
+/*
+Returns a cursor at id, or where id would be inserted. With a hash index the
+cell its entry names is checked first, then the rest of that leaf. Entries go
+stale as inserts shift cells and split leaves, so on a miss the tree is
+descended as usual and the entry is corrected
+*/
+static Cursor *seek_id(Database *db, uint32_t id)
+{
+    Table *table = db->table;
+    uint32_t location;
+    bool hashed = db->id_hash && hash_index_find(db->id_hash, id, &location);
+    Cursor *cursor = NULL;
 
-    if (cursor->cell_idx >= num_cells)
+    // the named page was a leaf of the table, and is still part of it; a root that split is internal now
+    if (hashed && get_node_type(get_page(table->pager, location >> ID_HASH_CELL_BITS)) == NODE_LEAF)
     {
-        // go to next leaf node
-        uint32_t next_leaf_idx = *leaf_node_next_leaf(node);
-
-        if (next_leaf_idx == 0)
+        cursor = new_cursor(table, location >> ID_HASH_CELL_BITS, location & ((1u << ID_HASH_CELL_BITS) - 1));
+        if (cursor_at_id(cursor, id))
         {
-            // no more leaf nodes, set end of table to true
-            cursor->end_of_table = true;
+            return cursor;
         }
-        else
+        free(cursor);
+        cursor = leaf_node_find(table, location >> ID_HASH_CELL_BITS, &id);
+        if (!cursor_at_id(cursor, id))
         {
-            cursor->page_idx = next_leaf_idx;
-            cursor->cell_idx = 0;
+            free(cursor);
+            cursor = NULL;
         }
     }
-}
 
-/*
-Retrieves index of an unused page
-For now, unused pages are always at end of database file
-Once deletion is implemented, pages may become recycled
-*/
-uint32_t get_unused_page_idx(Pager *pager)
-{
-    return pager->num_pages;
+    if (cursor == NULL)
+    {
+        cursor = table_find(table, &id);
+    }
+    if (hashed && cursor_at_id(cursor, id))
+    {
+        hash_index_put(db->id_hash, id, id_hash_location(cursor)); // overwrites, so no page is allocated
+    }
+    return cursor;
 }
 
-void create_root_node(Table *table, uint32_t right_child_page_idx)
+/* Hash index entry for id after it was inserted at cursor; a split may have moved it to a new leaf */
+static uint32_t location_of_inserted(Table *table, Cursor *cursor, uint32_t id)
 {
-    // so at this point, the root has been split up and the right child has been made
-    // now we need to create the left child, copy the contents of the root into it, and then
-    // re-init the old root as the new root
+    if (cursor_at_id(cursor, id))
+    {
+        return id_hash_location(cursor);
+    }
 
-    // why table and right child index as an argument?
-    // table is identified by page idx of root, so we need to update that after creating the root
-    // we also need to update the parent pointer of the right child
+    Cursor *found = table_find(table, &id);
+    uint32_t location = id_hash_location(found);
+    free(found);
+    return location;
+}
 
-    /*
-    Handle splitting the root.
-    Old root copied to new page, becomes left child.
-    Address of right child passed in.
-    Re-initialize root page to contain the new root node.
-    New root node points to two children.
-    */
+/* An insert can split every level of a tree and copy its old root, each taking a new page */
+static uint32_t pages_needed_to_insert(Table *table)
+{
+    return table_depth(table) + 1;
+}
 
-    // get current root
-    void *root = get_page(table->pager, table->root_page_idx);
-    void *right_child = get_page(table->pager, right_child_page_idx);
+/* Adds the entry for the row with the given id and column value to index */
+static void index_insert(Table *index, const char *value, uint32_t id)
+{
+    uint8_t key[MAX_KEY_SIZE];
+    make_index_key(index, value, id, key);
 
-    // init a left child node
-    uint32_t left_child_page_idx = get_unused_page_idx(table->pager);
-    void *left_child = get_page(table->pager, left_child_page_idx);
+    Cursor *cursor = table_find(index, key);
+    leaf_node_insert_cell(cursor, key, ""); // index cells carry no value
+    free(cursor);
+}
 
-    if (get_node_type(root) == NODE_INTERNAL)
+/*
+Whether the file has room for the pages num_rows inserts may take: one insert's
+worth in the table, which is all a merge into one leaf needs, and num_rows in
+each index
+*/
+static bool room_to_insert(Database *db, uint32_t num_rows)
+{
+    Table *table = db->table;
+    uint64_t pages_needed = pages_needed_to_insert(table);
+    for (uint32_t i = 0; i < NUM_COLUMNS; i++)
     {
-        initialize_internal_node(right_child);
-        initialize_internal_node(left_child);
+        if (db->indexes[i])
+        {
+            pages_needed += (uint64_t)num_rows * pages_needed_to_insert(db->indexes[i]);
+        }
     }
-
-    /* Left child has data copied from old root */
-    memcpy(left_child, root, PAGE_SIZE);
-    set_node_root(left_child, false);
-
-    if (get_node_type(left_child) == NODE_INTERNAL)
+    if (db->id_hash)
     {
-        /*
-        This code is necessary because:
-        When we move the old root to become the left child, its page index changes
-        (it's no longer at the root page index)
-
-        All the children of this node still have their parent pointers
-        pointing to the old root's page index
-
-        We need to update all these children to point to the
-        new page index of their parent
-        */
+        pages_needed += (uint64_t)num_rows * HASH_PUT_MAX_NEW_PAGES;
+    }
+    return table->pager->num_pages + pages_needed <= TABLE_MAX_PAGES;
+}
 
-        void *child;
-        for (int i = 0; i < *internal_node_num_keys(left_child); i++)
-        {
-            child = get_page(table->pager, *internal_node_child(left_child, i));
-            *node_parent(child) = left_child_page_idx;
-        }
-        child = get_page(table->pager, *internal_node_right_child(left_child));
-        *node_parent(child) = left_child_page_idx;
+/* Adds the hash index and secondary index entries of a row just stored at cursor */
+static void index_inserted(Database *db, Cursor *cursor, const Row *row)
+{
+    if (db->id_hash)
+    {
+        hash_index_put(db->id_hash, row->id, location_of_inserted(db->table, cursor, row->id));
+    }
+    if (db->indexes[DB_COLUMN_USERNAME])
+    {
+        index_insert(db->indexes[DB_COLUMN_USERNAME], row->username, row->id);
     }
+    if (db->indexes[DB_COLUMN_EMAIL])
+    {
+        index_insert(db->indexes[DB_COLUMN_EMAIL], row->email, row->id);
+    }
+}
 
-    /* Root node is a new internal node with one key and two children */
-    initialize_internal_node(root);
-    set_node_root(root, true);
-    *internal_node_num_keys(root) = 1;
+/* Inserts row at cursor, where its id belongs, and adds it to the indexes */
+static void insert_at(Database *db, Cursor *cursor, const Row *row)
+{
+    uint32_t key_to_insert = row->id;
+    uint8_t value[ROW_SIZE];
+    serialize_row(row, value);
+    leaf_node_insert_cell(cursor, &key_to_insert, value);
+    index_inserted(db, cursor, row);
+}
+static DbResult put(Database *db, const Row *row)
+{
+    Table *table = db->table;
+    uint32_t key_to_insert = row->id;
+    if (!room_to_insert(db, 1))
+    {
+        return DB_TABLE_FULL;
+    }
 
-    // set the left child pointer and key
-    *internal_node_child(root, 0) = left_child_page_idx;
-    uint32_t left_child_max_key = get_node_max_key(table->pager, left_child);
-    *internal_node_key(root, 0) = left_child_max_key;
+    // set cursor at the correct cell index within the leaf node to insert
+    Cursor *cursor = table_find(table, &key_to_insert);
+    void *node = get_page(table->pager, cursor->page_idx);
+    uint32_t num_cells = *leaf_node_num_cells(node);
 
-    // set the right child pointer
-    *internal_node_right_child(root) = right_child_page_idx;
+    if (cursor->cell_idx < num_cells &&
+        compare_keys(table, leaf_node_key(table, node, cursor->cell_idx), &key_to_insert) == 0)
+    {
+        free(cursor);
+        return DB_DUPLICATE_KEY;
+    }
 
-    // set parent of left and right child to root
-    *node_parent(left_child) = table->root_page_idx;
-    *node_parent(right_child) = table->root_page_idx;
+    insert_at(db, cursor, row);
+    free(cursor);
+    return DB_OK;
 }
 
-Cursor *leaf_node_find(Table *table, uint32_t page_idx, uint32_t key)
+/* Logs a change to the built-in table, if changes are logged */
+static void log_row(Database *db, ChangeType type, const Row *row)
 {
-    // get leaf node
-    void *node = get_page(table->pager, page_idx);
-
-    // get num cells in leaf node
-    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (db->change_log == NULL)
+    {
+        return;
+    }
+    change_log_begin(db->change_log, type, "");
+    change_log_int(db->change_log, row->id);
+    change_log_string(db->change_log, row->username, USERNAME_SIZE);
+    change_log_string(db->change_log, row->email, EMAIL_SIZE);
+    change_log_end(db->change_log);
+}
 
-    // init two pointers, one at first cell and one past last cell
-    int32_t min_idx = 0;
-    int32_t max_idx = num_cells;
+/*
+Moves the buffered rows into the tree in key order. Each leaf is found once
+per batch: the run of rows that belong in it (ids up to its last key, or all of
+them in the last leaf) is merged in with one pass over the leaf, as many as
+fit. A full leaf takes one row through the usual insert, which splits it, and
+the search starts again. Rows the file has no room for stay buffered, and
+DB_TABLE_FULL is returned. Rows are logged as inserted once merged, with any
+updates they took while buffered
+*/
+static DbResult flush_memtable(Database *db)
+{
+    Memtable *memtable = db->memtable;
+    if (memtable == NULL || memtable_count(memtable) == 0)
+    {
+        return DB_OK;
+    }
 
-    // perform binary search to find the correct cell idx to insert key
-    // printf("DEBUG: Performing binary search with min_idx (%d) and max_idx (%d) initial\n", min_idx, max_idx);
-    while (min_idx < max_idx)
+    Table *table = db->table;
+    memtable_sort(memtable);
+    uint32_t num_rows = memtable_count(memtable);
+    uint32_t keys[table->leaf_max_cells];
+    uint32_t cell_idxs[table->leaf_max_cells];
+    uint8_t *values = malloc(table->leaf_max_cells * ROW_SIZE);
+    uint32_t flushed = 0;
+    DbResult result = DB_OK;
+    while (flushed < num_rows)
     {
-        uint32_t index = (min_idx + max_idx) / 2;
-        uint32_t key_at_index = *(uint32_t *)leaf_node_key(node, index);
-        if (key == key_at_index)
+        const Row *row = memtable_sorted_row(memtable, flushed);
+        Cursor *cursor = table_find(table, &row->id);
+        void *node = get_page(table->pager, cursor->page_idx);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        bool last_leaf = *leaf_node_next_leaf(node) == 0;
+        uint32_t max_key = num_cells ? *(uint32_t *)leaf_node_key(table, node, num_cells - 1) : 0;
+
+        uint32_t run = 0;
+        while (flushed + run < num_rows && num_cells + run < table->leaf_max_cells)
         {
-            min_idx = index;
+            const Row *next = memtable_sorted_row(memtable, flushed + run);
+            if (!last_leaf && next->id > max_key)
+            {
+                break;
+            }
+            keys[run] = next->id;
+            serialize_row(next, values + run * ROW_SIZE);
+            run++;
+        }
+        if (!room_to_insert(db, run ? run : 1))
+        {
+            free(cursor);
+            result = DB_TABLE_FULL;
             break;
         }
-        if (key > key_at_index)
+
+        if (run == 0)
         {
-            min_idx = index + 1;
+            insert_at(db, cursor, row);
+            memtable_note_stored(memtable, row->id);
+            log_row(db, CHANGE_INSERT, row);
+            flushed++;
+            free(cursor);
+            continue;
         }
-        else
+        leaf_node_merge_cells(table, cursor->page_idx, keys, values, run, cell_idxs);
+        for (uint32_t i = 0; i < run; i++)
         {
-            max_idx = index;
+            const Row *merged = memtable_sorted_row(memtable, flushed + i);
+            cursor->cell_idx = cell_idxs[i];
+            index_inserted(db, cursor, merged);
+            memtable_note_stored(memtable, merged->id);
+            log_row(db, CHANGE_INSERT, merged);
         }
+        flushed += run;
+        free(cursor);
     }
+    free(values);
+    memtable_drop_sorted(memtable, flushed);
 
-    // printf("DEBUG: Insert key at idx %d\n", min_index);
-    Cursor *cursor = (Cursor *)malloc(sizeof(Cursor));
-    cursor->table = table;
-    cursor->cell_idx = min_idx;
-    cursor->page_idx = page_idx;
-    cursor->end_of_table = (min_idx == num_cells);
+    if (memtable_filter_full(memtable))
+    {
+        rebuild_stored_filter(db);
+    }
+    return result;
+}
 
-    return cursor;
+/* Moves buffered inserts into the table before something reads the table directly */
+static void flush_buffered(Database *db)
+{
+    if (db->memtable && memtable_count(db->memtable))
+    {
+        lock_pages(db);
+        flush_memtable(db);
+        unlock_pages(db);
+    }
 }
 
-/*
-Return the index of the child within node `which should contain the given key.
-*/
-uint32_t internal_node_find_child(void *node, uint32_t key)
+DbResult db_flush_inserts(Database *db)
 {
-    uint32_t num_keys = *internal_node_num_keys(node);
+    lock_pages(db);
+    DbResult result = flush_memtable(db);
+    unlock_pages(db);
+    return result;
+}
 
-    uint32_t min_index = 0;
-    uint32_t max_index = num_keys; /* there is one more child than key */
-    while (min_index < max_index)
+/* Buffers row in the memtable, flushing it first if it is full */
+static DbResult put_buffered(Database *db, const Row *row)
+{
+    Memtable *memtable = db->memtable;
+    if (memtable_find(memtable, row->id))
     {
-        uint32_t index = (min_index + max_index) / 2;
-        uint32_t key_to_right = *internal_node_key(node, index);
-
-        if (key_to_right >= key)
+        return DB_DUPLICATE_KEY;
+    }
+    if (memtable_may_be_stored(memtable, row->id))
+    {
+        Cursor *cursor = seek_id(db, row->id);
+        bool stored = cursor_at_id(cursor, row->id);
+        free(cursor);
+        if (stored)
         {
-            max_index = index;
+            return DB_DUPLICATE_KEY;
         }
-        else
-        {
+    }
 
-            min_index = index + 1;
+    if (memtable_full(memtable))
+    {
+        DbResult result = flush_memtable(db);
+        if (result != DB_OK)
+        {
+            return result;
         }
     }
-
-    return min_index;
+    memtable_add(memtable, row);
+    return DB_OK;
 }
 
-/* Update key inside internal node */
-void update_internal_node_key(void *node, uint32_t old_key, uint32_t new_key)
+/* Pages a tree of num_cells cells takes, with leaf_cells cells in a leaf and num_children children in an internal node */
+static uint64_t tree_pages(uint64_t num_cells, uint32_t leaf_cells, uint32_t num_children)
 {
-    // find the index inside node where old_key is
-    uint32_t old_child_index = internal_node_find_child(node, old_key);
-
-    if (old_child_index == *internal_node_num_keys(node))
+    uint64_t level = num_cells ? (num_cells + leaf_cells - 1) / leaf_cells : 1;
+    uint64_t pages = level;
+    while (level > 1)
     {
-        // updating key associated with right child
-        return;
+        level = (level + num_children - 1) / num_children;
+        pages += level;
     }
-
-    // update its value
-    *internal_node_key(node, old_child_index) = new_key;
+    return pages;
 }
 
-void print_cells(void *node)
+/*
+Estimates the pages save_rows would write for num_rows rows: the header, a
+table of full leaves, secondary indexes about as half full as inserts leave
+them, a hash index at its load factor, and the user tables copied full with
+their catalog
+*/
+static uint64_t pages_to_save(Database *db, uint64_t num_rows)
 {
-    if (get_node_type(node) == NODE_INTERNAL)
+    Table *table = db->table;
+    uint64_t pages = 1 + tree_pages(num_rows, table->leaf_max_cells, table->internal_max_cells + 1);
+    for (DbColumn column = DB_COLUMN_USERNAME; column < NUM_COLUMNS; column++)
     {
-
-        printf("\ncells of node %p\n", node);
-        uint32_t num_cells = *internal_node_num_keys(node);
-        for (uint32_t i = 0; i < num_cells; i++)
+        Table *index = db->indexes[column];
+        if (index)
         {
-            printf("\tCell {%d} -> child index %d, key %d\n", i, *internal_node_child(node, i), *internal_node_key(node, i));
+            uint32_t num_children = (index->internal_max_cells + 1) / 2;
+            pages += tree_pages(num_rows, (index->leaf_max_cells + 1) / 2, num_children > 2 ? num_children : 2);
         }
-        printf("\tRight child -> child index %d\n", *internal_node_right_child(node));
     }
-    printf("\n");
+    if (db->id_hash)
+    {
+        pages += HASH_CREATE_PAGES + 2 * num_rows / HASH_BUCKET_MAX_ENTRIES;
+    }
+    for (uint32_t i = 0; i < db->num_tables; i++)
+    {
+        Table *tree = db->tables[i]->tree;
+        pages += tree_pages(table_count(tree), tree->leaf_max_cells, tree->internal_max_cells + 1);
+    }
+    pages += db->num_tables > 0; // the catalog
+    return pages;
 }
 
-void internal_node_split_and_insert(Table *table, uint32_t parent_idx, uint32_t child_idx);
+/* Adds row to the in-memory rows. Refused if the rows would no longer fit in the file when saved */
+static DbResult put_in_memory(Database *db, const Row *row)
+{
+    if (pages_to_save(db, art_count(db->rows) + 1) > TABLE_MAX_PAGES)
+    {
+        return DB_TABLE_FULL;
+    }
+    bool inserted;
+    void *value = art_insert(db->rows, row->id, &inserted);
+    if (!inserted)
+    {
+        return DB_DUPLICATE_KEY;
+    }
+    serialize_row(row, value);
+    db->rows_changed = true;
+    return DB_OK;
+}
 
-/*
-Add a new child/key pair to parent that corresponds to child
-note: parent_idx and child_idx are nodes represented by page indexes
-*/
-void internal_node_insert(Table *table, uint32_t parent_idx, uint32_t child_idx)
+static DbResult put_row(Database *db, const Row *row)
 {
-    // get parent and child node
-    void *parent = get_page(table->pager, parent_idx);
-    void *child = get_page(table->pager, child_idx);
+    if (db->memtable)
+    {
+        return put_buffered(db, row); // logged when merged
+    }
+    DbResult result = db->rows ? put_in_memory(db, row) : put(db, row);
+    if (result == DB_OK)
+    {
+        log_row(db, CHANGE_INSERT, row);
+    }
+    return result;
+}
 
-    uint32_t original_num_keys = *internal_node_num_keys(parent);
+DbResult db_put(Database *db, const Row *row)
+{
+    lock_pages(db);
+    DbResult result = put_row(db, row);
+    unlock_pages(db);
+    return result;
+}
 
-    /* Case 1: internal node is full */
-    if (original_num_keys >= INTERNAL_NODE_MAX_CELLS)
+DbResult db_put_batch(Database *db, const Row *rows, uint32_t num_rows, uint32_t *num_inserted)
+{
+    DbResult result = DB_OK;
+    uint32_t i = 0;
+    lock_pages(db);
+    for (; i < num_rows; i++)
     {
-        printf("Inserting into internal node that is full\n");
-        internal_node_split_and_insert(table, parent_idx, child_idx);
-        return;
+        result = put_row(db, &rows[i]);
+        if (result != DB_OK)
+        {
+            break;
+        }
     }
+    unlock_pages(db);
 
-    /* Case 2: internal node is empty */
-    uint32_t right_child_idx = *internal_node_right_child(parent);
-    if (right_child_idx == INVALID_PAGE_IDX)
+    if (num_inserted)
     {
-        // internal node is empty, set the right child
-        printf("Internal node is empty, setting right child\n");
-        *internal_node_right_child(parent) = child_idx;
-        print_cells(parent);
-        return;
+        *num_inserted = i;
     }
+    return result;
+}
 
-    /* Case 3: Internal node is neither empty nor full */
-
-    // get max key of child (this will be inserted as the key)
-    uint32_t max_key = get_node_max_key(table->pager, child);
+/* Returns the stored row with the given id, or NULL. The pointer is into a page, or the in-memory rows */
+static void *find_row(Database *db, uint32_t id)
+{
+    if (db->rows)
+    {
+        return art_find(db->rows, id);
+    }
+    Table *table = db->table;
+    Cursor *cursor = seek_id(db, id);
 
-    // determine where to insert key in parent node
-    uint32_t idx_to_insert = internal_node_find_child(parent, max_key);
+    void *value = NULL;
+    if (cursor_at_id(cursor, id))
+    {
+        value = leaf_node_value(table, get_page(table->pager, cursor->page_idx), cursor->cell_idx);
+    }
 
-    void *right_child = get_page(table->pager, right_child_idx);
-    
-    // update number of keys
-    *internal_node_num_keys(parent) = original_num_keys + 1;
+    free(cursor);
+    return value;
+}
 
-    if (max_key > get_node_max_key(table->pager, right_child))
+DbResult db_get(Database *db, uint32_t id, Row *row)
+{
+    // a lookup through the hash index may correct a stale entry
+    lock_pages(db);
+    Row *buffered = db->memtable ? memtable_find(db->memtable, id) : NULL;
+    if (buffered)
     {
-        // replace right child
-        // move right child/key pair to last child index (original_num_keys)
-        *internal_node_child(parent, original_num_keys) = right_child_idx;
-        *internal_node_key(parent, original_num_keys) = get_node_max_key(table->pager, right_child);
-
-        // set new right child
-        *internal_node_right_child(parent) = child_idx;
+        *row = *buffered;
+        unlock_pages(db);
+        return DB_OK;
     }
-    else
+    void *value = find_row(db, id);
+    if (value != NULL)
     {
-        // make room for new cell
-        for (uint32_t i = original_num_keys; i > idx_to_insert; i--)
-        {
-            void *dest = internal_node_cell(parent, i);
-            void *src = internal_node_cell(parent, i - 1);
-            memcpy(dest, src, INTERNAL_NODE_CELL_SIZE);
-        }
-
-        // insert cell (child and key)
-        *internal_node_child(parent, idx_to_insert) = child_idx;
-        *internal_node_key(parent, idx_to_insert) = max_key;
+        deserialize_row(value, row);
     }
+    unlock_pages(db);
+    return value ? DB_OK : DB_NOT_FOUND;
 }
 
-/*
-Splits node represented by parent_pg_idx
-Then inserts child node into left or right sibling, depending on its max key
-*/
-void internal_node_split_and_insert(Table *table, uint32_t parent_pg_idx, uint32_t child_pg_idx)
+static DbResult update_row(Database *db, const Row *row)
 {
-    // track the node to be split
-    uint32_t old_page_idx = parent_pg_idx;
-    void *old_node = get_page(table->pager, parent_pg_idx);
-    // this key will be updated in the parent after the split
-    uint32_t old_max = get_node_max_key(table->pager, old_node);
-
-    // find the key to add into the node
-    void *child_node = get_page(table->pager, child_pg_idx);
-    uint32_t child_max_key = get_node_max_key(table->pager, child_node);
-
-    // allocate memory for a new node (right sibling)
-    uint32_t new_page_idx = get_unused_page_idx(table->pager);
+    Table *table = db->table;
+    Row *buffered = db->memtable ? memtable_find(db->memtable, row->id) : NULL;
+    if (buffered)
+    {
+        // the same rule as for stored rows, so it doesn't matter whether the row was flushed yet
+        bool changes_index =
+            (db->indexes[DB_COLUMN_USERNAME] && strncmp(buffered->username, row->username, USERNAME_SIZE) != 0) ||
+            (db->indexes[DB_COLUMN_EMAIL] && strncmp(buffered->email, row->email, EMAIL_SIZE) != 0);
+        if (!changes_index)
+        {
+            *buffered = *row; // the insert logged at the merge carries it
+        }
+        return changes_index ? DB_ERROR : DB_OK;
+    }
+    Cursor *cursor = db->rows ? NULL : seek_id(db, row->id);
+    void *value = NULL;
+    if (db->rows)
+    {
+        value = art_find(db->rows, row->id);
+    }
+    else if (cursor_at_id(cursor, row->id))
+    {
+        value = leaf_node_value(table, get_page(table->pager, cursor->page_idx), cursor->cell_idx);
+    }
+    if (value == NULL)
+    {
+        free(cursor);
+        return DB_NOT_FOUND;
+    }
 
-    uint32_t splitting_root = is_node_root(old_node);
+    uint8_t new_value[ROW_SIZE];
+    serialize_row(row, new_value);
 
-    void *parent;
-    void *new_node;
-    if (splitting_root)
+    // index entries can't be removed, so an indexed column has to keep its value
+    for (DbColumn column = DB_COLUMN_USERNAME; column < NUM_COLUMNS; column++)
     {
-        // Handle splitting root
-        create_root_node(table, new_page_idx);
-        parent = get_page(table->pager, table->root_page_idx);
-        // at this point, right child of new root should be empty
+        if (db->indexes[column] &&
+            strncmp(value + column_offset(column), (char *)new_value + column_offset(column), column_size(column)) != 0)
+        {
+            free(cursor);
+            return DB_ERROR;
+        }
+    }
 
-        // the page index of the node to split will change if it was originally the root
-        // so get the updated values
-        old_page_idx = *internal_node_child(parent, 0);
-        old_node = get_page(table->pager, old_page_idx);
+    if (cursor)
+    {
+        mark_page_dirty(table->pager, cursor->page_idx); // before the write, so a backup keeps the old row
     }
     else
     {
-        /* if we are not splitting the root, we cannot insert our
-        newly created sibling node into the old node’s parent right away,
-        because it does not yet contain any keys and therefore will
-        not be placed at the right index among the other key/child pairs
-        which may or may not already be present in the parent node.
-        need to move keys into the sibling node before inserting into the parent. */
+        db->rows_changed = true;
+    }
+    memcpy(value, new_value, ROW_SIZE);
+    free(cursor);
+    log_row(db, CHANGE_UPDATE, row);
+    return DB_OK;
+}
 
-        // parent of the newly split nodes will either be the new root, or the parent of the old node
-        parent = get_page(table->pager, *node_parent(old_node));
+DbResult db_update(Database *db, const Row *row)
+{
+    lock_pages(db);
+    DbResult result = update_row(db, row);
+    unlock_pages(db);
+    return result;
+}
 
-        // why are the two lines below not needed if the old_node is the root?
-        // create_root_node calls get_page on the new_page_idx
-        // create_root_node also calls initialize_internal_node
-        new_node = get_page(table->pager, new_page_idx);
-        initialize_internal_node(new_node);
+static bool has_index(Database *db, DbColumn column)
+{
+    if (column == DB_COLUMN_ID)
+    {
+        return db->id_hash != NULL;
     }
+    return column < NUM_COLUMNS && db->indexes[column] != NULL;
+}
 
-    /* Move the right child + half the keys from old node to sibling node */
-    uint32_t *old_num_keys = internal_node_num_keys(old_node);
+bool db_has_index(Database *db, DbColumn column)
+{
+    lock_pages(db);
+    bool result = has_index(db, column);
+    unlock_pages(db);
+    return result;
+}
 
-    // Move the old node's right child to sibling node
-    uint32_t cur_page_idx = *internal_node_right_child(old_node);
-    void *cur = get_page(table->pager, cur_page_idx);
-    internal_node_insert(table, new_page_idx, cur_page_idx);
-    *node_parent(cur) = new_page_idx;
-    *internal_node_right_child(old_node) = INVALID_PAGE_IDX;
+/* Builds the hash index on id, recording where each row is stored */
+static DbResult create_id_hash(Database *db)
+{
+    Pager *pager = db->table->pager;
+    if (pager->num_pages + HASH_CREATE_PAGES > TABLE_MAX_PAGES)
+    {
+        return DB_TABLE_FULL;
+    }
+    HashIndex *id_hash = open_hash_index(pager, hash_index_create(pager));
 
-    // Move half the keys
-    for (uint32_t i = INTERNAL_NODE_MAX_CELLS - 1; i > INTERNAL_NODE_MAX_CELLS / 2; i--)
+    Cursor *cursor = init_cursor_table_start(db->table);
+    while (!cursor->end_of_table)
     {
-        uint32_t cur_idx = *internal_node_child(old_node, i);
-        void *cur_node = get_page(table->pager, cur_idx);
+        if (pager->num_pages + HASH_PUT_MAX_NEW_PAGES > TABLE_MAX_PAGES)
+        {
+            // the index is not recorded in the header, so the partial index is never used
+            free(cursor);
+            free(id_hash);
+            return DB_TABLE_FULL;
+        }
 
-        // insert pair into sibling
-        internal_node_insert(table, new_page_idx, cur_idx);
+        uint32_t id;
+        memcpy(&id, cursor_key(cursor), ID_SIZE);
+        hash_index_put(id_hash, id, id_hash_location(cursor));
+        advance_cursor(cursor);
+    }
+    free(cursor);
 
-        // update child's parent value to point to sibling
-        *node_parent(cur_node) = new_page_idx;
+    void *header = get_page(pager, HEADER_PAGE_IDX);
+    mark_page_dirty(pager, HEADER_PAGE_IDX);
+    *header_id_hash(header) = id_hash->meta_page_idx;
+    db->id_hash = id_hash;
+    return DB_OK;
+}
 
-        // decrement old node's number of keys
-        // this effectively erases the cells, but without freeing memory
-        (*old_num_keys)--;
+static DbResult create_index(Database *db, DbColumn column)
+{
+    if (column >= NUM_COLUMNS)
+    {
+        return DB_ERROR;
+    }
+    if (has_index(db, column))
+    {
+        return DB_DUPLICATE_KEY;
+    }
+    if (column == DB_COLUMN_ID)
+    {
+        return create_id_hash(db);
     }
 
-    // set the highest key of old node as its right child
-    uint32_t new_right_child_idx = *internal_node_child(old_node, *old_num_keys - 1);
-    *internal_node_right_child(old_node) = new_right_child_idx;
-    (*old_num_keys)--;
-
-    // Insert child node in old node or sibling node depending on value of its max key
-    uint32_t max_after_split = get_node_max_key(table->pager, old_node);
-    uint32_t destination_idx = child_max_key < max_after_split ? old_page_idx : new_page_idx;
+    Pager *pager = db->table->pager;
+    if (pager->num_pages + 1 > TABLE_MAX_PAGES)
+    {
+        return DB_TABLE_FULL;
+    }
+    Table *index = new_index_table(pager, new_root_leaf(pager), column);
 
-    internal_node_insert(table, destination_idx, child_pg_idx);
+    // fill it from the existing rows
+    Cursor *cursor = init_cursor_table_start(db->table);
+    while (!cursor->end_of_table)
+    {
+        if (pager->num_pages + pages_needed_to_insert(index) > TABLE_MAX_PAGES)
+        {
+            // the index is not recorded in the header, so the partial tree is never used
+            free(cursor);
+            free(index);
+            return DB_TABLE_FULL;
+        }
 
-    *node_parent(child_node) = destination_idx;
+        uint32_t id;
+        memcpy(&id, cursor_key(cursor), ID_SIZE);
+        index_insert(index, cursor_value(cursor) + column_offset(column), id);
+        advance_cursor(cursor);
+    }
+    free(cursor);
 
-    // Update original node's key in parent to reflect its new max after the split
-    update_internal_node_key(parent, old_max, get_node_max_key(table->pager, old_node));
+    void *header = get_page(pager, HEADER_PAGE_IDX);
+    mark_page_dirty(pager, HEADER_PAGE_IDX);
+    *header_index_root(header, column) = index->root_page_idx;
+    db->indexes[column] = index;
+    return DB_OK;
+}
 
-    // what is this??
-    if (!splitting_root)
+DbResult db_create_index(Database *db, DbColumn column)
+{
+    // in-memory rows are saved first, so the index is built from a table holding all of them
+    if (save_rows(db) != DB_OK)
     {
-        // update sibling node's parent pointer
-        internal_node_insert(table, *node_parent(old_node), new_page_idx);
-        *node_parent(new_node) = *node_parent(old_node);
+        return DB_TABLE_FULL;
     }
+    lock_pages(db);
+    flush_memtable(db);
+    DbResult result = create_index(db, column);
+    unlock_pages(db);
+    return result;
 }
 
-/*
-Returns a cursor that points to where a key is
-If the key doesn't exist, it points to where it should be inserted
+/* Bulk load source reading a tree's cells through a cursor */
+static void next_cursor_cell(void *source, void *cell)
+{
+    Cursor *cursor = source;
+    Table *table = cursor->table;
+    void *node = get_page(table->pager, cursor->page_idx);
+    memcpy(cell, leaf_node_cell(table, node, cursor->cell_idx), table->leaf_cell_size);
+    advance_cursor(cursor);
+}
 
-page_idx refers to the internal node to search
-*/
-Cursor *internal_node_find(Table *table, uint32_t page_idx, uint32_t key)
+/* Bulk loads the contents of source into copy, an empty table in another pager, and returns copy */
+static Table *copy_tree(Table *source, Table *copy)
+{
+    Cursor *cursor = init_cursor_table_start(source);
+    copy->root_page_idx = table_bulk_load(copy, table_count(source), next_cursor_cell, cursor);
+    free(cursor);
+    return copy;
+}
+
+/* Bulk load source reading the in-memory rows in key order */
+typedef struct
+{
+    ArtIterator walk;
+    void *value; // row at walk.key
+} RowSource;
+
+static void next_row_cell(void *source, void *cell)
+{
+    RowSource *rows = source;
+    memcpy(cell, &rows->walk.key, LEAF_NODE_KEY_SIZE);
+    memcpy(cell + LEAF_NODE_KEY_SIZE, rows->value, ROW_SIZE);
+    rows->value = art_next(&rows->walk);
+}
+
+/* Bulk loads the in-memory rows into table, an empty table in another pager, and returns it */
+static Table *copy_rows(Art *rows, Table *table)
 {
-    void *node = get_page(table->pager, page_idx);
+    RowSource source;
+    source.value = art_seek(&source.walk, rows, 0);
+    table->root_page_idx = table_bulk_load(table, art_count(rows), next_row_cell, &source);
+    return table;
+}
 
-    // find which child of node will contain key
-    uint32_t child_idx = internal_node_find_child(node, key);
+static DbResult vacuum(Database *db)
+{
+    if (flush_memtable(db) != DB_OK)
+    {
+        return DB_TABLE_FULL;
+    }
+    char *vacuum_filename = malloc(strlen(db->filename) + sizeof(VACUUM_SUFFIX));
+    sprintf(vacuum_filename, "%s%s", db->filename, VACUUM_SUFFIX);
+    unlink(vacuum_filename); // left over from an interrupted VACUUM
+
+    // a compressed file stays compressed, and the flag compresses a plain one
+    uint32_t flags = pager_flags(db->flags) | (db->table->pager->page_map ? PAGER_COMPRESSED : 0);
+    Pager *pager = open_pager(vacuum_filename, flags);
+    void *header = get_page(pager, HEADER_PAGE_IDX);
+    mark_page_dirty(pager, HEADER_PAGE_IDX);
+
+    // dense trees never need more pages than the originals, so only the hash index can run out of room.
+    // In-memory rows are written out the same way, but their index trees are stale and get rebuilt
+    Database vacuumed = {.filename = db->filename, .flags = db->flags};
+    Table *table = new_table(pager, 0, KEY_ROW_ID, LEAF_NODE_KEY_SIZE, LEAF_NODE_VALUE_SIZE);
+    vacuumed.table = db->rows ? copy_rows(db->rows, table) : copy_tree(db->table, table);
+    initialize_header(header, vacuumed.table->root_page_idx);
+    DbResult result = DB_OK;
+    for (DbColumn column = DB_COLUMN_ID; column < NUM_COLUMNS; column++)
+    {
+        vacuumed.indexes[column] = NULL;
+        if (db->indexes[column] && db->rows)
+        {
+            if (result == DB_OK)
+            {
+                result = create_index(&vacuumed, column);
+            }
+        }
+        else if (db->indexes[column])
+        {
+            vacuumed.indexes[column] = copy_tree(db->indexes[column], new_index_table(pager, 0, column));
+            *header_index_root(header, column) = vacuumed.indexes[column]->root_page_idx;
+        }
+    }
+    vacuumed.id_hash = NULL;
+    if (result == DB_OK && db->id_hash)
+    {
+        result = create_id_hash(&vacuumed);
+    }
+    if (result != DB_OK)
+    {
+        close_pager(pager);
+        free_trees(&vacuumed);
+        unlink(vacuum_filename);
+        free(vacuum_filename);
+        return DB_TABLE_FULL;
+    }
 
-    // convert child index to page index, then use pg index to get pointer to child
-    uint32_t child_page_idx = *internal_node_child(node, child_idx);
-    void *child = get_page(table->pager, child_page_idx);
+    // user tables are copied as they are; their handles take the new trees once the file is replaced
+    for (uint32_t i = 0; i < db->num_tables; i++)
+    {
+        DbTable *table = malloc(sizeof(DbTable));
+        *table = *db->tables[i];
+        table->tree = copy_tree(db->tables[i]->tree, new_user_tree(pager, 0, table));
+        vacuumed.tables[vacuumed.num_tables++] = table;
+    }
+    if (vacuumed.num_tables)
+    {
+        save_catalog(&vacuumed);
+    }
 
-    if (get_node_type(child) == NODE_INTERNAL)
+    // the new file is durable before it replaces the old one
+    pager_flush(pager);
+    if (rename(vacuum_filename, db->filename) == -1)
     {
-        return internal_node_find(table, child_page_idx, key);
+        fprintf(stderr, "Error replacing database file\n");
+        exit(EXIT_FAILURE);
     }
-    else
+    free(vacuum_filename);
+    unlink(db->warmup_filename); // it names pages of the old layout
+
+    close_pager(db->table->pager);
+    free_trees(db);
+    db->table = vacuumed.table;
+    memcpy(db->indexes, vacuumed.indexes, sizeof(db->indexes));
+    db->id_hash = vacuumed.id_hash;
+    for (uint32_t i = 0; i < db->num_tables; i++)
     {
-        return leaf_node_find(table, child_page_idx, key);
+        db->tables[i]->tree = vacuumed.tables[i]->tree;
+        free(vacuumed.tables[i]);
     }
+    db->rows_changed = false;
+    commit_changes(db, changes_logged(db)); // every change is in the new file
+    return DB_OK;
 }
 
 /*
-Create new node and move half the cells over
-Insert value into one of the two nodes
-Update parent or create a new parent
+With DB_OPEN_IN_MEMORY, writes the rows to the file if they changed since it
+was last written: a sorted snapshot in the normal format, made the way VACUUM
+rewrites the file. Returns DB_TABLE_FULL, leaving the old file in place, if the
+rebuilt indexes don't fit. The rows stay in memory either way
 */
-void leaf_node_split_and_insert(Cursor *cursor, uint32_t key, Row *value)
+static DbResult save_rows(Database *db)
 {
-    // printf("DEBUG: Splitting leaf node\n");
-    void *old_node = get_page(cursor->table->pager, cursor->page_idx);
-    uint32_t old_max = get_node_max_key(cursor->table->pager, old_node);
+    if (db->rows == NULL || !db->rows_changed)
+    {
+        return DB_OK;
+    }
+    // a backup reads the file being replaced
+    if (db->backup)
+    {
+        db_backup_wait(db);
+    }
+    lock_pages(db);
+    DbResult result = vacuum(db);
+    unlock_pages(db);
+    return result;
+}
 
-    // create new leaf node
-    uint32_t new_page_idx = get_unused_page_idx(cursor->table->pager);
-    void *new_node = get_page(cursor->table->pager, new_page_idx);
-    // note that get_page will increment num_pages
+DbResult db_vacuum(Database *db)
+{
+    // background threads work on the old file: let a backup finish, and restart the flusher on the new file
+    if (db->backup)
+    {
+        db_backup_wait(db);
+    }
+    DbFlusherOptions options = db->flusher_options;
+    bool flusher = stop_flusher(db);
+    DbResult result = vacuum(db);
+    if (flusher)
+    {
+        db_start_flusher(db, &options);
+    }
+    return result;
+}
 
-    initialize_leaf_node(new_node);
-    *node_parent(new_node) = *node_parent(old_node); // set parent of new node to be same as old node
+DbIterator *db_scan(Database *db, uint32_t start_id, uint32_t end_id)
+{
+    DbIterator *iterator = malloc(sizeof(DbIterator));
+    iterator->end_id = end_id;
+    iterator->db = db;
+    iterator->column = DB_COLUMN_ID;
+    iterator->selection = NULL;
+    iterator->user_table = NULL;
+    if (db->rows)
+    {
+        // the walk never touches the trees, which a checkpoint may replace while it runs
+        iterator->table = NULL;
+        iterator->cursor = NULL;
+        iterator->next_value = art_seek(&iterator->walk, db->rows, start_id);
+        return iterator;
+    }
+    iterator->table = db->table;
 
-    // update next leaf
-    // have right node point to what left node used to point to
-    *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
-    // have left node point to right node
-    *leaf_node_next_leaf(old_node) = new_page_idx;
+    lock_pages(db);
+    flush_memtable(db);
+    iterator->cursor = seek_id(db, start_id);
+    unlock_pages(db);
 
-    /*
-    Migrate half the values from old node to new node
+    void *node = get_page(db->table->pager, iterator->cursor->page_idx);
+    if (iterator->cursor->cell_idx >= *leaf_node_num_cells(node))
+    {
+        // start_id is past every key in the table
+        iterator->cursor->end_of_table = true;
+    }
 
-    All existing keys plus new key should be divided
-    evenly between old (left) and new (right) nodes.
+    return iterator;
+}
 
-    Starting from the right, move each key to correct position.
-    Keys to the right of the new key will be shifted right to make room for it
-    */
-    for (int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; i--)
+uint32_t db_count(Database *db, uint32_t start_id, uint32_t end_id)
+{
+    if (start_id > end_id)
     {
-        // Determine which node to put cell in
-        void *destination_node;
-        if (i < LEAF_NODE_LEFT_SPLIT_COUNT)
+        return 0;
+    }
+    if (db->rows)
+    {
+        // the radix tree keeps no counts, so a partial range is walked
+        if (start_id == 0 && end_id == UINT32_MAX)
         {
-            destination_node = old_node;
+            return art_count(db->rows);
         }
-        else
+        ArtIterator walk;
+        uint32_t count = 0;
+        for (void *value = art_seek(&walk, db->rows, start_id); value && walk.key <= end_id; value = art_next(&walk))
         {
-            destination_node = new_node;
+            count++;
         }
+        return count;
+    }
+    flush_buffered(db);
 
-        uint32_t index_within_node = i % LEAF_NODE_LEFT_SPLIT_COUNT;
-        void *destination = leaf_node_cell(destination_node, index_within_node);
-        if (i == cursor->cell_idx)
-        {
-            // insert new key and value (row) at cell_idx
-            *(leaf_node_key(destination_node, index_within_node)) = key;
-            serialize_row(value, leaf_node_value(destination_node, index_within_node));
-        }
-        else if (i > cursor->cell_idx)
-        {
-            // shift cells to the right to make room for insert
-            memcpy(destination, leaf_node_cell(old_node, i - 1), LEAF_NODE_CELL_SIZE);
-        }
-        else
+    uint32_t past_end = end_id + 1;
+    uint32_t end_rank = end_id == UINT32_MAX ? table_count(db->table) : table_rank(db->table, &past_end);
+    return end_rank - table_rank(db->table, &start_id);
+}
+
+void db_iterator_skip(DbIterator *iterator, uint32_t n)
+{
+    if (iterator->column != DB_COLUMN_ID || iterator->cursor == NULL)
+    {
+        RowView view;
+        while (n-- > 0 && db_iterator_next_view(iterator, &view))
         {
-            memcpy(destination, leaf_node_cell(old_node, i), LEAF_NODE_CELL_SIZE);
         }
+        return;
+    }
+    if (iterator->cursor->end_of_table || n == 0)
+    {
+        return;
     }
 
-    // update cell counts
-    *leaf_node_num_cells(old_node) = LEAF_NODE_LEFT_SPLIT_COUNT;
-    *leaf_node_num_cells(new_node) = LEAF_NODE_RIGHT_SPLIT_COUNT;
+    Table *table = iterator->table;
+    uint32_t rank = table_rank(table, cursor_key(iterator->cursor));
+    free(iterator->cursor);
+    // past the last row if the addition overflows
+    iterator->cursor = table_find_nth(table, rank + n < rank ? UINT32_MAX : rank + n);
+}
 
-    // update parents
-    if (is_node_root(old_node))
+bool db_iterator_next(DbIterator *iterator, Row *row)
+{
+    RowView view;
+    if (!db_iterator_next_view(iterator, &view))
     {
-        // old node was root and did not have parent node
-        // create parent node and set as new root
-        create_root_node(cursor->table, new_page_idx);
+        return false;
     }
-    else
+
+    row->id = view.id;
+    memcpy(row->username, view.username, COLUMN_USERNAME_SIZE);
+    row->username[COLUMN_USERNAME_SIZE] = '\0';
+    memcpy(row->email, view.email, COLUMN_EMAIL_SIZE);
+    row->email[COLUMN_EMAIL_SIZE] = '\0';
+    return true;
+}
+
+DbIterator *db_scan_column(Database *db, DbColumn column, const char *value, bool prefix)
+{
+    flush_buffered(db);
+    DbIterator *iterator = malloc(sizeof(DbIterator));
+    iterator->end_id = UINT32_MAX;
+    iterator->db = db;
+    iterator->table = db->rows ? NULL : db->table; // as for db_scan
+    iterator->column = column;
+    iterator->prefix = prefix;
+    iterator->selection = NULL;
+    iterator->user_table = NULL;
+    iterator->value_length = strnlen(value, COLUMN_EMAIL_SIZE + 1);
+    if (iterator->value_length > column_size(column) && db->rows)
     {
-        // update key in parent to be new max after split
-        uint32_t parent_idx = *node_parent(old_node);
-        uint32_t new_max = get_node_max_key(cursor->table->pager, old_node);
-        void *parent_node = get_page(cursor->table->pager, parent_idx);
-        update_internal_node_key(parent_node, old_max, new_max);
+        // longer than anything the column can hold, so nothing matches
+        iterator->cursor = NULL;
+        iterator->next_value = NULL;
+        return iterator;
+    }
+    if (iterator->value_length > column_size(column))
+    {
+        iterator->cursor = init_cursor_table_start(db->table);
+        iterator->cursor->end_of_table = true;
+        return iterator;
+    }
+    memcpy(iterator->value, value, iterator->value_length);
+
+    // an equality match also needs the NUL after the value, unless the value fills the column
+    bool needs_nul = !prefix && iterator->value_length < column_size(column);
+    iterator->match_length = iterator->value_length + needs_nul;
+    uint32_t head_length = iterator->match_length < FILTER_HEAD_SIZE ? iterator->match_length : FILTER_HEAD_SIZE;
+    memset(iterator->head, 0, FILTER_HEAD_SIZE);
+    memcpy(iterator->head, value, iterator->value_length < head_length ? iterator->value_length : head_length);
+    iterator->head_mask = (1u << head_length) - 1;
 
-        // insert key/child pointer of new node into internal node
-        internal_node_insert(cursor->table, parent_idx, new_page_idx);
+    if (db->rows)
+    {
+        // in-memory rows have no index trees kept up to date, so every row is checked
+        iterator->cursor = NULL;
+        iterator->next_value = art_seek(&iterator->walk, db->rows, 0);
+        return iterator;
     }
+
+    Table *index = db->indexes[column];
+    if (index == NULL)
+    {
+        iterator->cursor = init_cursor_table_start(db->table);
+        iterator->selection = malloc(db->table->leaf_max_cells * sizeof(uint32_t));
+        iterator->num_selected = 0;
+        iterator->next_selected = 0;
+        return iterator;
+    }
+
+    // matches are contiguous in the index, starting at (value, id 0)
+    uint8_t key[MAX_KEY_SIZE];
+    make_index_key(index, value, 0, key);
+    iterator->cursor = table_find(index, key);
+    void *node = get_page(index->pager, iterator->cursor->page_idx);
+    if (iterator->cursor->cell_idx >= *leaf_node_num_cells(node))
+    {
+        iterator->cursor->end_of_table = true;
+    }
+    return iterator;
 }
 
 /*
-Inserts a key value pair at position represented by cursor into a leaf node
+Whether a stored column value (size bytes, NUL padded) passes the iterator's filter.
+The first FILTER_HEAD_SIZE bytes, terminator included for short values, are
+checked together, so most values are decided by one compare. Every column is at
+least that long, so the load stays inside the cell
 */
-void leaf_node_insert_cell(Cursor *cursor, uint32_t key, Row *value)
+static bool column_matches(DbIterator *iterator, const char *stored, uint32_t size)
 {
-    // get address of node pointed by cursor
-    Pager *pager = cursor->table->pager;
-    void *node = get_page(pager, cursor->page_idx);
-
-    // get number of cells currently in leaf node
-    uint32_t num_cells = *leaf_node_num_cells(node);
-    if (num_cells >= LEAF_NODE_MAX_CELLS)
+#ifdef __SSE2__
+    __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)stored),
+                                   _mm_loadu_si128((const __m128i *)iterator->head));
+    if (((uint32_t)_mm_movemask_epi8(equal) & iterator->head_mask) != iterator->head_mask)
     {
-        // leaf node is full, need to split node
-        leaf_node_split_and_insert(cursor, key, value);
-        return;
+        return false;
     }
-
-    // shift cells over if not inserting at end of node
-    if (cursor->cell_idx < num_cells)
+#else
+    for (uint32_t i = 0; i < FILTER_HEAD_SIZE; i++)
     {
-        for (uint32_t i = num_cells; i > cursor->cell_idx; i--)
+        if ((iterator->head_mask >> i & 1) && (uint8_t)stored[i] != iterator->head[i])
         {
-            // copy cell[i-1] into cell[i]
-            memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), LEAF_NODE_CELL_SIZE); // dest, src, num bytes
+            return false;
         }
     }
+#endif
+    if (iterator->match_length <= FILTER_HEAD_SIZE)
+    {
+        return true;
+    }
 
-    // insert key and value into cell
-    *(uint32_t *)(leaf_node_key(node, cursor->cell_idx)) = key;
-    serialize_row(value, leaf_node_value(node, cursor->cell_idx));
-    // printf("DEBUG: inserted key (%d) and row (%s)\n", key, value->username);
-
-    // increment num cells in leaf node
-    *(leaf_node_num_cells(node)) += 1;
+    uint32_t length = iterator->value_length;
+    return memcmp(stored + FILTER_HEAD_SIZE, iterator->value + FILTER_HEAD_SIZE, length - FILTER_HEAD_SIZE) == 0 &&
+           (iterator->prefix || length == size || stored[length] == '\0');
 }
 
 /*
-Returns a cursor pointing to position of key
-If key does not exist, return position where it should be inserted
+Runs the filter over the cursor's leaf from the cursor on, recording the
+matching cells in the selection vector, then moves the cursor to the next leaf.
+Only the column bytes are read; rows are looked at once they are returned
 */
-Cursor *table_find(Table *table, uint32_t key)
+static void filter_leaf(DbIterator *iterator)
 {
-    // get root node
-    void *node = get_page(table->pager, table->root_page_idx);
+    Cursor *cursor = iterator->cursor;
+    Table *table = iterator->table;
+    void *node = get_page(table->pager, cursor->page_idx);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    uint32_t offset = column_offset(iterator->column);
+    uint32_t size = column_size(iterator->column);
 
-    if (get_node_type(node) == NODE_INTERNAL)
+    uint32_t num_selected = 0;
+    for (uint32_t i = cursor->cell_idx; i < num_cells; i++)
     {
-        return internal_node_find(table, table->root_page_idx, key);
+        // written unconditionally and kept only on a match, so there is no branch to mispredict
+        iterator->selection[num_selected] = i;
+        num_selected += column_matches(iterator, leaf_node_value(table, node, i) + offset, size);
     }
+    iterator->num_selected = num_selected;
+    iterator->next_selected = 0;
+    iterator->selection_page_idx = cursor->page_idx;
 
-    Cursor *cursor = leaf_node_find(table, table->root_page_idx, key);
-    return cursor;
+    uint32_t next_leaf_idx = *leaf_node_next_leaf(node);
+    if (next_leaf_idx == 0)
+    {
+        cursor->end_of_table = true;
+    }
+    else
+    {
+        prefetch_next_leaves(table, cursor->page_idx);
+        cursor->page_idx = next_leaf_idx;
+        cursor->cell_idx = 0;
+    }
 }
 
-/* Initializes a cursor pointing to start of a table */
-Cursor *init_cursor_table_start(Table *table)
+static void fill_view(RowView *view, uint32_t id, void *value)
 {
-    Cursor *cursor = table_find(table, 0); // key of 0 should return cursor pointing to leftmost leaf node
-    void *node = get_page(table->pager, cursor->page_idx);
-    uint32_t num_cells = *leaf_node_num_cells(node);
-    cursor->end_of_table = (num_cells == 0); // start is also end of table if there are no cells
+    view->id = id;
+    view->username = value + USERNAME_OFFSET;
+    view->email = value + EMAIL_OFFSET;
+}
 
-    return cursor;
+/* Next row of a column scan: from the index if the cursor walks one, otherwise by filtering the table */
+static bool column_scan_next(DbIterator *iterator, RowView *view)
+{
+    Cursor *cursor = iterator->cursor;
+    uint32_t size = column_size(iterator->column);
+    uint32_t id;
+
+    if (cursor->table != iterator->table)
+    {
+        if (cursor->end_of_table || !column_matches(iterator, cursor_key(cursor), size))
+        {
+            cursor->end_of_table = true;
+            return false;
+        }
+
+        memcpy(&id, cursor_key(cursor) + size, ID_SIZE);
+        advance_cursor(cursor);
+        // as in db_get, a lookup through the hash index may correct a stale entry
+        lock_pages(iterator->db);
+        void *value = find_row(iterator->db, id);
+        unlock_pages(iterator->db);
+        fill_view(view, id, value);
+        return true;
+    }
+
+    while (iterator->next_selected == iterator->num_selected)
+    {
+        if (cursor->end_of_table)
+        {
+            return false;
+        }
+        filter_leaf(iterator);
+    }
+
+    Table *table = iterator->table;
+    void *node = get_page(table->pager, iterator->selection_page_idx);
+    uint32_t cell_idx = iterator->selection[iterator->next_selected++];
+    memcpy(&id, leaf_node_key(table, node, cell_idx), ID_SIZE);
+    fill_view(view, id, leaf_node_value(table, node, cell_idx));
+    return true;
 }
 
-ExecuteResult execute_insert(Table *table, Statement *statement)
+/* Next row of a scan over the in-memory rows, through the column filter if there is one */
+static bool walk_next(DbIterator *iterator, RowView *view)
 {
-    // for now, table is represented as a single leaf node
-    // instead of inserting at end of leaf node, we need to insert such that order is maintained
+    while (iterator->next_value)
+    {
+        void *value = iterator->next_value;
+        uint32_t id = iterator->walk.key;
+        if (id > iterator->end_id)
+        {
+            iterator->next_value = NULL;
+            return false;
+        }
+        iterator->next_value = art_next(&iterator->walk);
+        if (iterator->column == DB_COLUMN_ID ||
+            column_matches(iterator, value + column_offset(iterator->column), column_size(iterator->column)))
+        {
+            fill_view(view, id, value);
+            return true;
+        }
+    }
+    return false;
+}
 
-    // get addr of root leaf node
-    void *node = get_page(table->pager, table->root_page_idx);
-    uint32_t num_cells = *leaf_node_num_cells(node);
+bool db_iterator_next_view(DbIterator *iterator, RowView *view)
+{
+    Cursor *cursor = iterator->cursor;
+    if (cursor == NULL)
+    {
+        return walk_next(iterator, view);
+    }
+    if (iterator->column != DB_COLUMN_ID)
+    {
+        return column_scan_next(iterator, view);
+    }
+    if (cursor->end_of_table)
+    {
+        return false;
+    }
 
-    Row *row_to_insert = &(statement->row_to_insert);
-    uint32_t key_to_insert = row_to_insert->id;
+    uint32_t id;
+    memcpy(&id, cursor_key(cursor), ID_SIZE);
+    if (id > iterator->end_id)
+    {
+        cursor->end_of_table = true;
+        return false;
+    }
 
-    // set cursor at the correct cell index within the leaf node to insert
-    Cursor *cursor = table_find(table, key_to_insert);
-    // printf("DEBUG: Set cursor at page index (%d), cell index (%d)\n", cursor->page_idx, cursor->cell_idx);
+    // cursor_value only computes an address; nothing in the row body is read yet
+    fill_view(view, id, cursor_value(cursor));
+    advance_cursor(cursor);
+    return true;
+}
 
-    if (cursor->cell_idx < num_cells)
+void db_iterator_close(DbIterator *iterator)
+{
+    if (iterator->user_table)
+    {
+        lock_pages(iterator->db);
+        iterator->db->open_table_scans--;
+        unlock_pages(iterator->db);
+    }
+    free(iterator->selection);
+    free(iterator->cursor);
+    free(iterator);
+}
+
+DbTable *db_table(Database *db, const char *name)
+{
+    for (uint32_t i = 0; i < db->num_tables; i++)
     {
-        uint32_t key_at_cell_idx = *(uint32_t *)leaf_node_key(node, cursor->cell_idx);
-        if (key_at_cell_idx == key_to_insert)
+        if (strcmp(db->tables[i]->schema.name, name) == 0)
         {
-            // key already exists
-            printf("Key (%d) already exists in table\n", key_to_insert);
-            return EXECUTE_DUPLICATE_KEY;
+            return db->tables[i];
         }
     }
+    return NULL;
+}
 
-    // insert cell
-    leaf_node_insert_cell(cursor, key_to_insert, row_to_insert);
+DbTable *db_table_at(Database *db, uint32_t n)
+{
+    return n < db->num_tables ? db->tables[n] : NULL;
+}
 
-    free(cursor);
+const DbSchema *db_table_schema(DbTable *table)
+{
+    return &table->schema;
+}
 
-    return EXECUTE_STATEMENT_SUCCESS;
+uint32_t db_tuple_size(DbTable *table)
+{
+    return table->codec.tuple_size;
 }
 
-void print_row(Row *row)
+uint32_t db_tuple_offset(DbTable *table, uint32_t column)
 {
-    printf("%d %s %s\n", row->id, row->username, row->email);
+    return table->codec.tuple_offsets[column];
 }
 
-ExecuteResult execute_select(Table *table, Statement *statement)
+DbResult db_create_table(Database *db, const DbSchema *schema)
 {
-    // print all rows
-    Row row;
+    DbTable *table = malloc(sizeof(DbTable));
+    table->schema = *schema;
+    if (!compile_codec(&table->schema, &table->codec) ||
+        LEAF_NODE_AVAILABLE_CELL_SPACE / (sizeof(uint32_t) + table->codec.record_size) < USER_TABLE_MIN_LEAF_CELLS)
+    {
+        free(table);
+        return DB_ERROR;
+    }
+    if (db_table(db, table->schema.name))
+    {
+        free(table);
+        return DB_DUPLICATE_KEY;
+    }
+    if (db->num_tables == DB_MAX_TABLES)
+    {
+        free(table);
+        return DB_TABLE_FULL;
+    }
 
-    // init cursor at start of table
-    Cursor *cursor = init_cursor_table_start(table);
+    lock_pages(db);
+    Pager *pager = db->table->pager;
+    uint32_t pages_needed = 1 + (*header_catalog(get_page(pager, HEADER_PAGE_IDX)) == 0); // root, and the catalog
+    bool room = pager->num_pages + pages_needed <= TABLE_MAX_PAGES &&
+                (db->rows == NULL || pages_to_save(db, art_count(db->rows)) + 2 <= TABLE_MAX_PAGES);
+
+    // the root is allocated once the table is known to fit in the catalog as well
+    table->tree = new_user_tree(pager, 0, table);
+    db->tables[db->num_tables++] = table;
+    uint8_t *page = malloc(PAGE_SIZE);
+    room = room && write_catalog(db, page);
+    free(page);
+    if (!room)
+    {
+        db->num_tables--;
+        unlock_pages(db);
+        free(table->tree);
+        free(table);
+        return DB_TABLE_FULL;
+    }
+    table->tree->root_page_idx = new_root_leaf(pager);
+    save_catalog(db);
+    unlock_pages(db);
+    return DB_OK;
+}
 
-    // for each row, deserialize and print
-    while (!(cursor->end_of_table))
+/* Whether the file has room for an insert into table, with in-memory rows still able to be saved next to it */
+static bool room_to_insert_into(Database *db, DbTable *table)
+{
+    uint64_t pages_needed = pages_needed_to_insert(table->tree);
+    if (db->rows && pages_to_save(db, art_count(db->rows)) + pages_needed > TABLE_MAX_PAGES)
     {
-        deserialize_row(cursor_value(cursor), &row);
-        print_row(&row);
-        advance_cursor(cursor);
+        return false;
     }
+    return table->tree->pager->num_pages + pages_needed <= TABLE_MAX_PAGES;
+}
 
+/* Logs a change to a user table, if changes are logged: every column, as the tuple has it */
+static void log_tuple(Database *db, ChangeType type, const DbTable *table, const void *tuple)
+{
+    if (db->change_log == NULL)
+    {
+        return;
+    }
+    change_log_begin(db->change_log, type, table->schema.name);
+    for (uint32_t i = 0; i < table->schema.num_columns; i++)
+    {
+        const DbColumnDef *column = &table->schema.columns[i];
+        const char *value = (const char *)tuple + table->codec.tuple_offsets[i];
+        if (column->type == DB_TYPE_INT)
+        {
+            int32_t n;
+            memcpy(&n, value, sizeof(n));
+            change_log_int(db->change_log, n);
+        }
+        else if (column->type == DB_TYPE_BIGINT)
+        {
+            int64_t n;
+            memcpy(&n, value, sizeof(n));
+            change_log_int(db->change_log, n);
+        }
+        else
+        {
+            change_log_string(db->change_log, value, column->length);
+        }
+    }
+    change_log_end(db->change_log);
+}
+
+DbResult db_table_put(Database *db, DbTable *table, const void *tuple)
+{
+    int32_t key;
+    memcpy(&key, tuple, sizeof(key));
+    uint32_t key_to_insert = encode_key(key);
+    uint8_t record[table->codec.record_size];
+    encode_tuple(&table->codec, tuple, record);
+
+    lock_pages(db);
+    if (!room_to_insert_into(db, table))
+    {
+        unlock_pages(db);
+        return DB_TABLE_FULL;
+    }
+    Cursor *cursor = table_find(table->tree, &key_to_insert);
+    bool duplicate = cursor_at_id(cursor, key_to_insert);
+    if (!duplicate)
+    {
+        leaf_node_insert_cell(cursor, &key_to_insert, record);
+        log_tuple(db, CHANGE_INSERT, table, tuple);
+    }
     free(cursor);
+    unlock_pages(db);
+    return duplicate ? DB_DUPLICATE_KEY : DB_OK;
+}
 
-    return EXECUTE_STATEMENT_SUCCESS;
+DbResult db_table_get(Database *db, DbTable *table, int32_t key, void *tuple)
+{
+    // an in-memory checkpoint replaces the tree
+    lock_pages(db);
+    uint32_t encoded = encode_key(key);
+    Cursor *cursor = table_find(table->tree, &encoded);
+    bool found = cursor_at_id(cursor, encoded);
+    if (found)
+    {
+        decode_tuple(&table->codec, encoded, cursor_value(cursor), tuple);
+    }
+    free(cursor);
+    unlock_pages(db);
+    return found ? DB_OK : DB_NOT_FOUND;
 }
 
-ExecuteResult execute_statement(Table *table, Statement *statement)
+DbIterator *db_table_scan(Database *db, DbTable *table, int32_t first_key, int32_t last_key)
 {
-    switch (statement->type)
+    DbIterator *iterator = malloc(sizeof(DbIterator));
+    iterator->end_id = encode_key(last_key);
+    iterator->db = db;
+    iterator->table = table->tree;
+    iterator->column = DB_COLUMN_ID;
+    iterator->selection = NULL;
+    iterator->user_table = table;
+
+    uint32_t start = encode_key(first_key);
+    lock_pages(db);
+    db->open_table_scans++;
+    iterator->cursor = table_find(table->tree, &start);
+    unlock_pages(db);
+
+    void *node = get_page(table->tree->pager, iterator->cursor->page_idx);
+    if (iterator->cursor->cell_idx >= *leaf_node_num_cells(node))
     {
-    case (STATEMENT_INSERT):
-        return execute_insert(table, statement);
-    case (STATEMENT_SELECT):
-        return execute_select(table, statement);
+        // first_key is past every key in the table
+        iterator->cursor->end_of_table = true;
     }
+    return iterator;
 }
 
-int main(int argc, char *argv[])
+bool db_iterator_next_tuple(DbIterator *iterator, void *tuple)
 {
-    const char *filename = "data.db"; // TODO: replace with command line argument
-    InputBuffer *input_buffer = new_input_buffer();
-    Table *table = open_db(filename);
+    Cursor *cursor = iterator->cursor;
+    if (cursor->end_of_table)
+    {
+        return false;
+    }
 
-    while (true)
+    uint32_t key;
+    memcpy(&key, cursor_key(cursor), sizeof(key));
+    if (key > iterator->end_id)
     {
-        print_prompt();
-        read_input(input_buffer);
+        cursor->end_of_table = true;
+        return false;
+    }
+    decode_tuple(&iterator->user_table->codec, key, cursor_value(cursor), tuple);
+    advance_cursor(cursor);
+    return true;
+}
 
-        // printf("Command: '%s'.\n", input_buffer->buffer);
+void db_print_constants()
+{
+    print_constants();
+}
 
-        if (input_buffer->buffer[0] == '.')
-        {
-            switch (do_meta_command(input_buffer, table))
-            {
-            case (META_COMMAND_SUCCESS):
-                continue;
-            case (META_COMMAND_UNRECOGNIZED_COMMAND):
-                printf("Unrecognized command '%s'.\n", input_buffer->buffer);
-                continue;
-            }
-        }
+void db_print_btree(Database *db)
+{
+    save_rows(db);
+    flush_buffered(db);
+    lock_pages(db);
+    print_tree(db->table, db->table->root_page_idx, 0);
+    unlock_pages(db);
+}
 
-        // prepare result by converting input to Statement
-        Statement statement;
-        switch (prepare_statement(input_buffer, &statement))
+void db_print_analysis(Database *db)
+{
+    save_rows(db);
+    flush_buffered(db);
+    lock_pages(db);
+    printf("table: ");
+    print_tree_analysis(db->table);
+    for (DbColumn column = DB_COLUMN_USERNAME; column < NUM_COLUMNS; column++)
+    {
+        if (has_index(db, column))
         {
-        case (PREPARE_STATEMENT_SUCCESS):
-            break;
-        // case (PREPARE_STRING_TOO_LONG):
-        //     printf("Input string is too long.\n");
-        //     continue;
-        case (PREPARE_STATEMENT_SYNTAX_ERROR):
-            printf("Syntax error in statement '%s'.\n", input_buffer->buffer);
-            continue;
-        case (PREPARE_STATEMENT_UNRECOGNIZED_COMMAND):
-            printf("Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
-            continue;
+            printf("index on %s: ", column == DB_COLUMN_USERNAME ? "username" : "email");
+            print_tree_analysis(db->indexes[column]);
         }
+    }
+    for (uint32_t i = 0; i < db->num_tables; i++)
+    {
+        printf("table %s: ", db->tables[i]->schema.name);
+        print_tree_analysis(db->tables[i]->tree);
+    }
+    unlock_pages(db);
+}
 
-        // execute Statement
-        switch (execute_statement(table, &statement))
+/* Stores the table, its indexes and the user tables in trees (room for NUM_COLUMNS + DB_MAX_TABLES); returns how many */
+static uint32_t all_trees(Database *db, Table **trees)
+{
+    uint32_t num_trees = 0;
+    trees[num_trees++] = db->table;
+    for (DbColumn column = DB_COLUMN_USERNAME; column < NUM_COLUMNS; column++)
+    {
+        if (db->indexes[column])
         {
-        case (EXECUTE_STATEMENT_SUCCESS):
-            printf("Executed.\n");
-            break;
-        case (EXECUTE_STATEMENT_TABLE_FULL):
-            printf("Failed to insert, table is full.\n");
-            continue;
-        case (EXECUTE_DUPLICATE_KEY):
-            printf("Failed to insert, key already exists.\n");
-            continue;
-        case (EXECUTE_STATEMENT_ERROR):
-            printf("Error executing statement, please retry.\n");
+            trees[num_trees++] = db->indexes[column];
         }
     }
-}
\ No newline at end of file
+    for (uint32_t i = 0; i < db->num_tables; i++)
+    {
+        trees[num_trees++] = db->tables[i]->tree;
+    }
+    return num_trees;
+}
+
+void db_stats(Database *db, DbStats *stats)
+{
+    lock_pages(db); // the flusher counts its writes, and an in-memory checkpoint replaces the trees
+    Pager *pager = db->table->pager;
+    memset(stats, 0, sizeof(*stats));
+    stats->page_hits = pager->stats.page_hits;
+    stats->page_misses = pager->stats.page_misses;
+    stats->bytes_read = pager->stats.bytes_read;
+    stats->bytes_written = pager->stats.bytes_written;
+    stats->page_flushes = pager->stats.page_flushes;
+
+    Table *trees[NUM_COLUMNS + DB_MAX_TABLES];
+    uint32_t num_trees = all_trees(db, trees);
+    for (uint32_t i = 0; i < num_trees; i++)
+    {
+        stats->leaf_splits += trees[i]->stats.leaf_splits;
+        stats->internal_splits += trees[i]->stats.internal_splits;
+        stats->root_splits += trees[i]->stats.root_splits;
+        stats->descents += trees[i]->stats.descents;
+        stats->cells_shifted += trees[i]->stats.cells_shifted;
+    }
+    stats->depth = table_depth(db->table);
+    stats->num_pages = pager->num_pages;
+    stats->file_bytes = pager_file_bytes(pager);
+    unlock_pages(db);
+}
+
+void db_reset_stats(Database *db)
+{
+    lock_pages(db); // as for db_stats
+    memset(&db->table->pager->stats, 0, sizeof(PagerStats));
+    Table *trees[NUM_COLUMNS + DB_MAX_TABLES];
+    uint32_t num_trees = all_trees(db, trees);
+    for (uint32_t i = 0; i < num_trees; i++)
+    {
+        memset(&trees[i]->stats, 0, sizeof(TreeStats));
+    }
+    unlock_pages(db);
+}
+
+void db_print_stats(Database *db)
+{
+    DbStats stats;
+    db_stats(db, &stats);
+    struct
+    {
+        const char *name;
+        uint64_t value;
+    } counters[] = {
+        {"page_hits", stats.page_hits},
+        {"page_misses", stats.page_misses},
+        {"bytes_read", stats.bytes_read},
+        {"bytes_written", stats.bytes_written},
+        {"page_flushes", stats.page_flushes},
+        {"leaf_splits", stats.leaf_splits},
+        {"internal_splits", stats.internal_splits},
+        {"root_splits", stats.root_splits},
+        {"descents", stats.descents},
+        {"cells_shifted", stats.cells_shifted},
+        {"depth", stats.depth},
+        {"num_pages", stats.num_pages},
+        {"file_bytes", stats.file_bytes},
+    };
+    for (uint32_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++)
+    {
+        printf("%s %llu\n", counters[i].name, (unsigned long long)counters[i].value);
+    }
+}
+
+void db_print_index(Database *db, DbColumn column)
+{
+    save_rows(db);
+    flush_buffered(db);
+    lock_pages(db);
+    // the hash index on id is not a tree, so it has nothing to print
+    if (column != DB_COLUMN_ID && has_index(db, column))
+    {
+        print_tree(db->indexes[column], db->indexes[column]->root_page_idx, 0);
+    }
+    unlock_pages(db);
+}
@@ -0,0 +1,325 @@
+#ifndef DB_H
+#define DB_H
+
+/*
+Embeddable C API for the database.
+
+Calls operate directly on the B-tree: no statement text is parsed and nothing
+is printed, so services can link libdb.a / libdb.so and skip the REPL entirely.
+Data is written back to the database file by db_sync and db_close.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define COLUMN_USERNAME_SIZE 32
+#define COLUMN_EMAIL_SIZE 255
+
+/* Strings are NUL-terminated; the extra byte holds the terminator */
+typedef struct
+{
+    uint32_t id;
+    char username[COLUMN_USERNAME_SIZE + 1];
+    char email[COLUMN_EMAIL_SIZE + 1];
+} Row;
+
+/*
+Read-only view of a row stored in a page, filled in by db_iterator_next_view.
+Strings are NOT NUL-terminated: each ends at its first NUL byte or after its
+column size, whichever comes first. The pointers stay valid only until the
+next call on the iterator.
+*/
+typedef struct
+{
+    uint32_t id;
+    const char *username; // COLUMN_USERNAME_SIZE bytes
+    const char *email;    // COLUMN_EMAIL_SIZE bytes
+} RowView;
+
+typedef enum
+{
+    DB_OK,
+    DB_NOT_FOUND,
+    DB_DUPLICATE_KEY,
+    DB_TABLE_FULL,
+    DB_ERROR
+} DbResult;
+
+typedef enum
+{
+    DB_COLUMN_ID,
+    DB_COLUMN_USERNAME,
+    DB_COLUMN_EMAIL
+} DbColumn;
+
+typedef struct Database Database;
+typedef struct DbIterator DbIterator;
+
+// db_open_with_flags flags
+#define DB_OPEN_DIRECT_IO 0x1 // bypass the kernel page cache; pages are cached once, in an aligned pool
+// Buffer inserts in memory and move them into the table in key order, a batch at a time. Gets see
+// buffered rows; scans, counts, index builds, syncs, checkpoints and close flush them first
+#define DB_OPEN_BUFFERED_INSERTS 0x2
+// Keep every row in memory, in a radix tree on id, and serve all calls from it. The file is rewritten
+// in the normal format, sorted, by db_sync, checkpoints, db_close and calls that read the trees
+// directly. Column scans check every row, in id order. Takes precedence over DB_OPEN_BUFFERED_INSERTS
+#define DB_OPEN_IN_MEMORY 0x4
+// Store each page of a new file compressed, in as little space as it takes, at a place a page map
+// records. Existing files keep their format whatever the flag, though VACUUM with it compresses one.
+// Overrides DB_OPEN_DIRECT_IO for compressed files, and their backups are written uncompressed
+#define DB_OPEN_COMPRESSED 0x8
+// Append every insert and update a call makes to filename-cdc, one record each, numbered in call order.
+// Records are held in memory and written once their changes are durable: at db_sync, checkpoints,
+// VACUUM and db_close, after the database file's fsync. Buffered inserts are logged when merged into
+// the table, so a crash never leaves the log ahead of the database. cdc.h has the format and a reader
+#define DB_OPEN_CHANGE_LOG 0x10
+
+/* Opens (creating if needed) the database stored in filename */
+Database *db_open(const char *filename);
+Database *db_open_with_flags(const char *filename, uint32_t flags);
+
+/* Flushes all pages to disk and releases the database */
+void db_close(Database *db);
+
+/* Writes modified pages to disk and fsyncs; changes made before it are durable */
+void db_sync(Database *db);
+
+/*
+Background write-back. Every interval_ms the flusher writes up to max_pages
+pages that have been dirty for at least min_age_ms, so pages still being
+filled are left alone. Every checkpoint_ms (0 for never) it writes all dirty
+pages and fsyncs. That bounds how much a crash can lose, and leaves little
+for db_close to write.
+*/
+typedef struct
+{
+    uint32_t interval_ms;
+    uint32_t max_pages;
+    uint32_t min_age_ms;
+    uint32_t checkpoint_ms;
+} DbFlusherOptions;
+
+/*
+Starts the flusher thread; db_close stops it. While it runs, calls that modify
+pages take a lock the flusher holds while writing. The database must still be
+used from one thread at a time. Returns DB_ERROR if the options are invalid or
+a flusher is already running.
+*/
+DbResult db_start_flusher(Database *db, const DbFlusherOptions *options);
+
+/*
+Inserts row keyed by row->id. Returns DB_DUPLICATE_KEY if the id exists
+and DB_TABLE_FULL if the file has no room left for the splits an insert may need.
+*/
+DbResult db_put(Database *db, const Row *row);
+
+/*
+Inserts num_rows rows in order, stopping at the first failure.
+The number of rows inserted is stored in num_inserted when it is not NULL.
+*/
+DbResult db_put_batch(Database *db, const Row *rows, uint32_t num_rows, uint32_t *num_inserted);
+
+/*
+With DB_OPEN_BUFFERED_INSERTS, moves the buffered inserts into the table now.
+Returns DB_TABLE_FULL, leaving the rest buffered, if the file runs out of room
+*/
+DbResult db_flush_inserts(Database *db);
+
+/* Copies the row with the given id into row. Returns DB_NOT_FOUND if absent */
+DbResult db_get(Database *db, uint32_t id, Row *row);
+
+/*
+Replaces the username and email of the row with row->id, in place.
+Returns DB_NOT_FOUND if absent, and DB_ERROR, leaving the row as it was,
+if an indexed column would change: index entries can't be removed yet.
+*/
+DbResult db_update(Database *db, const Row *row);
+
+/*
+Builds a secondary index on the username or email column from the rows already
+in the table; db_put keeps it current from then on. The index is a second B-tree
+in the same file mapping column value to id.
+
+For DB_COLUMN_ID it builds a hash index mapping id to the leaf page holding the
+row, so db_get and the start of db_scan search that leaf directly instead of
+descending the tree. Entries left stale by leaf splits are corrected on use.
+
+Returns DB_DUPLICATE_KEY if the column is already indexed and DB_TABLE_FULL if
+the file has no room for the index.
+*/
+DbResult db_create_index(Database *db, DbColumn column);
+
+bool db_has_index(Database *db, DbColumn column);
+
+/*
+Rewrites the database into a new file with full leaves laid out in key order,
+so a scan reads the file front to back, and rebuilds the indexes. The new file
+is synced and renamed over the old one. Iterators open on db become invalid.
+Returns DB_TABLE_FULL, leaving the database as it was, if the rebuilt hash
+index does not fit.
+*/
+DbResult db_vacuum(Database *db);
+
+/*
+Online backup. db_backup_start copies the database, as it stands at the call,
+to path on a background thread while the database stays in use. A page that
+changes before the backup has copied it is saved first, so the copy is a
+consistent snapshot. The backup reads and writes large sequential chunks, at
+no more than max_bytes_per_second (0 for no limit). Returns DB_ERROR if path
+cannot be created or a backup is still running.
+*/
+DbResult db_backup_start(Database *db, const char *path, uint32_t max_bytes_per_second);
+
+/* Reports the last backup's progress in pages; returns false if none was started */
+bool db_backup_progress(Database *db, uint32_t *pages_copied, uint32_t *num_pages);
+
+/* Waits for the last backup to finish. Returns DB_OK once the copy is durable */
+DbResult db_backup_wait(Database *db);
+
+/*
+Returns an iterator over rows with start_id <= id <= end_id in key order.
+The database must not be modified while the iterator is open.
+*/
+DbIterator *db_scan(Database *db, uint32_t start_id, uint32_t end_id);
+
+/*
+Returns an iterator over rows whose username or email equals value, or starts
+with it when prefix is true. With an index on the column only the matching
+entries are visited, in column order; otherwise every row is checked, in id order.
+*/
+DbIterator *db_scan_column(Database *db, DbColumn column, const char *value, bool prefix);
+
+/*
+Returns the number of rows with start_id <= id <= end_id. Internal nodes store
+the number of rows under each child, so this takes two descents of the tree
+whatever the size of the range.
+*/
+uint32_t db_count(Database *db, uint32_t start_id, uint32_t end_id);
+
+/*
+Skips the next n rows of the iterator. Id range scans jump straight to the row
+n positions ahead using the per-child row counts; column scans step over rows.
+*/
+void db_iterator_skip(DbIterator *iterator, uint32_t n);
+
+/* Copies the next row into row. Returns false once the range is exhausted */
+bool db_iterator_next(DbIterator *iterator, Row *row);
+
+/*
+Like db_iterator_next but points view into the page instead of copying.
+Only the key is read here, so callers that use just the id never touch the row body.
+*/
+bool db_iterator_next_view(DbIterator *iterator, RowView *view);
+
+void db_iterator_close(DbIterator *iterator);
+
+/*
+User tables
+
+Besides the built-in table of Rows, a file holds up to DB_MAX_TABLES tables
+made by db_create_table, each a B-tree in the same file, listed with its schema
+in a catalog page. The first column is the key and must be DB_TYPE_INT.
+
+Their rows are passed as tuples: buffers laid out like a C struct with one
+member per column, in order: int32_t for DB_TYPE_INT, int64_t for
+DB_TYPE_BIGINT, and char[length + 1] for DB_TYPE_CHAR and DB_TYPE_VARCHAR,
+NUL-terminated. db_tuple_size and db_tuple_offset describe the layout. Each
+table compiles its schema into a plan of copies when it is created or opened,
+so coding a row takes a few memcpy calls however many columns it has.
+*/
+#define DB_MAX_TABLES 32
+#define DB_MAX_TABLE_COLUMNS 16
+#define DB_MAX_NAME_LENGTH 31   // table and column names: letters, digits and _, not starting with a digit
+#define DB_MAX_STRING_LENGTH 255
+// Tuples of any table fit in this many bytes: no member takes more than its size plus 7 bytes of padding
+#define DB_MAX_TUPLE_SIZE (DB_MAX_TABLE_COLUMNS * (DB_MAX_STRING_LENGTH + 1 + sizeof(int64_t)))
+
+typedef enum
+{
+    DB_TYPE_INT,    // int32_t
+    DB_TYPE_BIGINT, // int64_t
+    DB_TYPE_CHAR,   // length bytes, stored NUL padded
+    DB_TYPE_VARCHAR // up to length bytes, stored in as many as it holds
+} DbType;
+
+typedef struct
+{
+    char name[DB_MAX_NAME_LENGTH + 1];
+    DbType type;
+    uint32_t length; // most bytes a DB_TYPE_CHAR or DB_TYPE_VARCHAR string holds, at most DB_MAX_STRING_LENGTH
+} DbColumnDef;
+
+typedef struct
+{
+    char name[DB_MAX_NAME_LENGTH + 1];
+    uint32_t num_columns;
+    DbColumnDef columns[DB_MAX_TABLE_COLUMNS];
+} DbSchema;
+
+typedef struct DbTable DbTable;
+
+/*
+Creates an empty table. Returns DB_DUPLICATE_KEY if the name is taken, DB_ERROR
+if the schema is invalid or a row would take more than a quarter of a page, and
+DB_TABLE_FULL if the file or the catalog has no room for it.
+*/
+DbResult db_create_table(Database *db, const DbSchema *schema);
+
+/* Returns the table with the given name, or NULL. Handles stay valid until db_close */
+DbTable *db_table(Database *db, const char *name);
+
+/* Returns the n-th table in creation order, or NULL past the last */
+DbTable *db_table_at(Database *db, uint32_t n);
+
+const DbSchema *db_table_schema(DbTable *table);
+uint32_t db_tuple_size(DbTable *table);
+uint32_t db_tuple_offset(DbTable *table, uint32_t column);
+
+/* Inserts tuple keyed by its first column. Returns DB_DUPLICATE_KEY and DB_TABLE_FULL as db_put does */
+DbResult db_table_put(Database *db, DbTable *table, const void *tuple);
+
+/* Copies the row with the given key into tuple. Returns DB_NOT_FOUND if absent */
+DbResult db_table_get(Database *db, DbTable *table, int32_t key, void *tuple);
+
+/*
+Returns an iterator over the rows with first_key <= key <= last_key in key
+order, read with db_iterator_next_tuple. db_iterator_skip works as for db_scan.
+*/
+DbIterator *db_table_scan(Database *db, DbTable *table, int32_t first_key, int32_t last_key);
+
+/* Copies the next row of a db_table_scan into tuple. Returns false once the range is exhausted */
+bool db_iterator_next_tuple(DbIterator *iterator, void *tuple);
+
+/*
+Engine counters since open, the last db_reset_stats or VACUUM. Page counters
+cover the whole file; tree counters are summed over the table and its
+secondary indexes. depth and num_pages describe the table as it stands.
+*/
+typedef struct
+{
+    uint64_t page_hits;
+    uint64_t page_misses;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t page_flushes;
+    uint64_t leaf_splits;
+    uint64_t internal_splits;
+    uint64_t root_splits;
+    uint64_t descents;
+    uint64_t cells_shifted;
+    uint32_t depth;
+    uint32_t num_pages;
+    uint64_t file_bytes; // pages in the file; less than num_pages pages when compressed, as of the last write
+} DbStats;
+
+void db_stats(Database *db, DbStats *stats);
+void db_reset_stats(Database *db);
+
+/* Debugging aids backing the REPL's meta commands; these print to stdout */
+void db_print_constants();
+void db_print_btree(Database *db);
+void db_print_index(Database *db, DbColumn column);
+void db_print_analysis(Database *db); // fill per tree level, and how the leaf chain runs through the file
+void db_print_stats(Database *db);    // one "name value" line per counter, for people and scrapers alike
+
+#endif
@@ -0,0 +1,313 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+static uint32_t *hash_meta_field(HashIndex *index, uint32_t offset)
+{
+    return get_page(index->pager, index->meta_page_idx) + offset;
+}
+
+static uint32_t *bucket_num_entries(void *bucket)
+{
+    return bucket + HASH_BUCKET_NUM_ENTRIES_OFFSET;
+}
+
+static uint32_t *bucket_overflow(void *bucket)
+{
+    return bucket + HASH_BUCKET_OVERFLOW_OFFSET;
+}
+
+static uint32_t *bucket_keys(void *bucket)
+{
+    return bucket + HASH_BUCKET_HEADER_SIZE;
+}
+
+static uint32_t *bucket_values(void *bucket)
+{
+    return bucket_keys(bucket) + HASH_BUCKET_MAX_ENTRIES;
+}
+
+static uint32_t num_buckets(HashIndex *index)
+{
+    return (1u << *hash_meta_field(index, HASH_LEVEL_OFFSET)) + *hash_meta_field(index, HASH_SPLIT_OFFSET);
+}
+
+/* Buckets below the split point have already been split and use one more bit of the hash */
+static uint32_t bucket_for_key(HashIndex *index, uint32_t key)
+{
+    uint32_t level = *hash_meta_field(index, HASH_LEVEL_OFFSET);
+    uint32_t hash = hash_key(key);
+    uint32_t bucket = hash & ((1u << level) - 1);
+    if (bucket < *hash_meta_field(index, HASH_SPLIT_OFFSET))
+    {
+        bucket = hash & ((2u << level) - 1);
+    }
+    return bucket;
+}
+
+/* Meta page entry holding the index of the directory page that covers bucket */
+static uint32_t *directory_page_entry(HashIndex *index, uint32_t bucket)
+{
+    return hash_meta_field(index, HASH_DIRECTORY_OFFSET + bucket / HASH_BUCKETS_PER_DIRECTORY_PAGE * sizeof(uint32_t));
+}
+
+/* Directory entry holding the page index of bucket's first page */
+static uint32_t *directory_slot(HashIndex *index, uint32_t bucket)
+{
+    uint32_t directory_page_idx = *directory_page_entry(index, bucket);
+    return (uint32_t *)get_page(index->pager, directory_page_idx) + bucket % HASH_BUCKETS_PER_DIRECTORY_PAGE;
+}
+
+static uint32_t new_bucket_page(Pager *pager)
+{
+    uint32_t page_idx = get_unused_page_idx(pager);
+    void *page = get_page(pager, page_idx);
+    mark_page_dirty(pager, page_idx);
+    *bucket_num_entries(page) = 0;
+    *bucket_overflow(page) = 0;
+    return page_idx;
+}
+
+/* Appends bucket as the last one; its directory page is allocated when it starts a new one */
+static void add_bucket(HashIndex *index, uint32_t bucket)
+{
+    if (bucket % HASH_BUCKETS_PER_DIRECTORY_PAGE == 0)
+    {
+        uint32_t directory_page_idx = get_unused_page_idx(index->pager);
+        get_page(index->pager, directory_page_idx);
+        mark_page_dirty(index->pager, directory_page_idx);
+        mark_page_dirty(index->pager, index->meta_page_idx);
+        *directory_page_entry(index, bucket) = directory_page_idx;
+    }
+
+    uint32_t bucket_page_idx = new_bucket_page(index->pager);
+    mark_page_dirty(index->pager, *directory_page_entry(index, bucket));
+    *directory_slot(index, bucket) = bucket_page_idx;
+}
+
+/* Returns the position of key in a bucket page, or where it would be inserted */
+static uint32_t bucket_find(void *bucket, uint32_t key)
+{
+    uint32_t *keys = bucket_keys(bucket);
+    uint32_t min_idx = 0;
+    uint32_t max_idx = *bucket_num_entries(bucket);
+    while (min_idx < max_idx)
+    {
+        uint32_t index = (min_idx + max_idx) / 2;
+        if (keys[index] < key)
+        {
+            min_idx = index + 1;
+        }
+        else
+        {
+            max_idx = index;
+        }
+    }
+    return min_idx;
+}
+
+/* Inserts into a bucket page that has room, keeping keys sorted */
+static void bucket_insert(void *bucket, uint32_t position, uint32_t key, uint32_t value)
+{
+    uint32_t *keys = bucket_keys(bucket);
+    uint32_t *values = bucket_values(bucket);
+    uint32_t num_entries = *bucket_num_entries(bucket);
+
+    memmove(keys + position + 1, keys + position, (num_entries - position) * sizeof(uint32_t));
+    memmove(values + position + 1, values + position, (num_entries - position) * sizeof(uint32_t));
+    keys[position] = key;
+    values[position] = value;
+    *bucket_num_entries(bucket) = num_entries + 1;
+}
+
+/* Adds an entry to the chain starting at page_idx, extending the chain if every page is full */
+static void chain_insert(Pager *pager, uint32_t page_idx, uint32_t key, uint32_t value)
+{
+    while (true)
+    {
+        void *bucket = get_page(pager, page_idx);
+        if (*bucket_num_entries(bucket) < HASH_BUCKET_MAX_ENTRIES)
+        {
+            mark_page_dirty(pager, page_idx);
+            bucket_insert(bucket, bucket_find(bucket, key), key, value);
+            return;
+        }
+
+        if (*bucket_overflow(bucket) == 0)
+        {
+            uint32_t overflow_page_idx = new_bucket_page(pager);
+            mark_page_dirty(pager, page_idx);
+            *bucket_overflow(get_page(pager, page_idx)) = overflow_page_idx;
+        }
+        page_idx = *bucket_overflow(get_page(pager, page_idx));
+    }
+}
+
+/* Links pages after page_idx as its overflow chain */
+static void link_chain(Pager *pager, uint32_t page_idx, uint32_t *pages, uint32_t num_pages)
+{
+    for (uint32_t i = 0; i < num_pages; i++)
+    {
+        mark_page_dirty(pager, page_idx);
+        *bucket_overflow(get_page(pager, page_idx)) = pages[i];
+        page_idx = pages[i];
+    }
+    mark_page_dirty(pager, page_idx);
+    *bucket_overflow(get_page(pager, page_idx)) = 0;
+}
+
+static uint32_t pages_for_entries(uint32_t num_entries)
+{
+    uint32_t num_pages = (num_entries + HASH_BUCKET_MAX_ENTRIES - 1) / HASH_BUCKET_MAX_ENTRIES;
+    return num_pages > 0 ? num_pages : 1;
+}
+
+/*
+Splits the next bucket in linear hashing order: its entries are divided between
+it and a new bucket by one more bit of the hash. The old chain's overflow pages
+are shared out between the two, so a split allocates only the new bucket's page
+*/
+static void split_bucket(HashIndex *index)
+{
+    Pager *pager = index->pager;
+    uint32_t level = *hash_meta_field(index, HASH_LEVEL_OFFSET);
+    uint32_t split = *hash_meta_field(index, HASH_SPLIT_OFFSET);
+    uint32_t high_bit = 1u << level;
+    uint32_t new_bucket = split + high_bit;
+    add_bucket(index, new_bucket);
+
+    // gather the chain's entries and overflow pages, emptying every page
+    uint32_t num_entries = 0, num_overflow_pages = 0, capacity = 1;
+    uint32_t *keys = malloc(capacity * HASH_BUCKET_MAX_ENTRIES * sizeof(uint32_t));
+    uint32_t *values = malloc(capacity * HASH_BUCKET_MAX_ENTRIES * sizeof(uint32_t));
+    uint32_t *overflow_pages = malloc(capacity * sizeof(uint32_t));
+    uint32_t head_page_idx = *directory_slot(index, split);
+    for (uint32_t page_idx = head_page_idx; page_idx != 0;)
+    {
+        void *bucket = get_page(pager, page_idx);
+        if (page_idx != head_page_idx)
+        {
+            if (num_overflow_pages == capacity - 1)
+            {
+                capacity *= 2;
+                keys = realloc(keys, capacity * HASH_BUCKET_MAX_ENTRIES * sizeof(uint32_t));
+                values = realloc(values, capacity * HASH_BUCKET_MAX_ENTRIES * sizeof(uint32_t));
+                overflow_pages = realloc(overflow_pages, capacity * sizeof(uint32_t));
+            }
+            overflow_pages[num_overflow_pages++] = page_idx;
+        }
+
+        uint32_t count = *bucket_num_entries(bucket);
+        memcpy(keys + num_entries, bucket_keys(bucket), count * sizeof(uint32_t));
+        memcpy(values + num_entries, bucket_values(bucket), count * sizeof(uint32_t));
+        num_entries += count;
+
+        mark_page_dirty(pager, page_idx);
+        *bucket_num_entries(bucket) = 0;
+        page_idx = *bucket_overflow(bucket);
+    }
+
+    uint32_t num_moving = 0;
+    for (uint32_t i = 0; i < num_entries; i++)
+    {
+        num_moving += (hash_key(keys[i]) & high_bit) != 0;
+    }
+
+    // size both chains before refilling them so chain_insert never allocates;
+    // pages left over stay on the old chain, empty
+    uint32_t new_head_page_idx = *directory_slot(index, new_bucket);
+    uint32_t new_overflow_pages = pages_for_entries(num_moving) - 1;
+    link_chain(pager, new_head_page_idx, overflow_pages, new_overflow_pages);
+    link_chain(pager, head_page_idx, overflow_pages + new_overflow_pages, num_overflow_pages - new_overflow_pages);
+
+    for (uint32_t i = 0; i < num_entries; i++)
+    {
+        uint32_t page_idx = (hash_key(keys[i]) & high_bit) ? new_head_page_idx : head_page_idx;
+        chain_insert(pager, page_idx, keys[i], values[i]);
+    }
+    free(keys);
+    free(values);
+    free(overflow_pages);
+
+    mark_page_dirty(pager, index->meta_page_idx);
+    if (split + 1 == high_bit)
+    {
+        // every bucket of this level is split: the table has doubled
+        *hash_meta_field(index, HASH_LEVEL_OFFSET) = level + 1;
+        *hash_meta_field(index, HASH_SPLIT_OFFSET) = 0;
+    }
+    else
+    {
+        *hash_meta_field(index, HASH_SPLIT_OFFSET) = split + 1;
+    }
+}
+
+/* Allocates the meta page, first directory page and one empty bucket. Returns the meta page index */
+uint32_t hash_index_create(Pager *pager)
+{
+    uint32_t meta_page_idx = get_unused_page_idx(pager);
+    void *meta = get_page(pager, meta_page_idx);
+    mark_page_dirty(pager, meta_page_idx);
+    memset(meta, 0, PAGE_SIZE);
+
+    HashIndex index = {.pager = pager, .meta_page_idx = meta_page_idx};
+    add_bucket(&index, 0);
+    return meta_page_idx;
+}
+
+HashIndex *open_hash_index(Pager *pager, uint32_t meta_page_idx)
+{
+    HashIndex *index = malloc(sizeof(HashIndex));
+    index->pager = pager;
+    index->meta_page_idx = meta_page_idx;
+    return index;
+}
+
+/* Looks up key, storing its value in value. Returns false if the key is absent */
+bool hash_index_find(HashIndex *index, uint32_t key, uint32_t *value)
+{
+    uint32_t page_idx = *directory_slot(index, bucket_for_key(index, key));
+    while (page_idx != 0)
+    {
+        void *bucket = get_page(index->pager, page_idx);
+        uint32_t position = bucket_find(bucket, key);
+        if (position < *bucket_num_entries(bucket) && bucket_keys(bucket)[position] == key)
+        {
+            *value = bucket_values(bucket)[position];
+            return true;
+        }
+        page_idx = *bucket_overflow(bucket);
+    }
+    return false;
+}
+
+/* Sets the value of key, adding the key if it is absent */
+void hash_index_put(HashIndex *index, uint32_t key, uint32_t value)
+{
+    uint32_t head_page_idx = *directory_slot(index, bucket_for_key(index, key));
+    for (uint32_t page_idx = head_page_idx; page_idx != 0;)
+    {
+        void *bucket = get_page(index->pager, page_idx);
+        uint32_t position = bucket_find(bucket, key);
+        if (position < *bucket_num_entries(bucket) && bucket_keys(bucket)[position] == key)
+        {
+            mark_page_dirty(index->pager, page_idx);
+            bucket_values(bucket)[position] = value;
+            return;
+        }
+        page_idx = *bucket_overflow(bucket);
+    }
+
+    chain_insert(index->pager, head_page_idx, key, value);
+
+    uint32_t num_entries = *hash_meta_field(index, HASH_NUM_ENTRIES_OFFSET) + 1;
+    mark_page_dirty(index->pager, index->meta_page_idx);
+    *hash_meta_field(index, HASH_NUM_ENTRIES_OFFSET) = num_entries;
+
+    // keep buckets at most three quarters full on average
+    if (num_entries * 4 > num_buckets(index) * HASH_BUCKET_MAX_ENTRIES * 3)
+    {
+        split_bucket(index);
+    }
+}
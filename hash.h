@@ -0,0 +1,69 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pager.h"
+
+/*
+Linear hash index stored in pager pages, mapping uint32 keys to uint32 values
+
+Buckets are pages; a full bucket grows a chain of overflow pages. When the
+index passes its load factor one bucket is split, in the fixed linear hashing
+order, so the table grows a bucket at a time and no insert rehashes more than
+one chain. Bucket page indexes are found through directory pages listed in the
+meta page.
+*/
+
+/*
+Meta page layout
+Contains: level, next bucket to split, number of entries, directory page indexes
+*/
+static const uint32_t HASH_LEVEL_OFFSET = 0;
+static const uint32_t HASH_SPLIT_OFFSET = HASH_LEVEL_OFFSET + sizeof(uint32_t);
+static const uint32_t HASH_NUM_ENTRIES_OFFSET = HASH_SPLIT_OFFSET + sizeof(uint32_t);
+static const uint32_t HASH_DIRECTORY_OFFSET = HASH_NUM_ENTRIES_OFFSET + sizeof(uint32_t);
+
+// A directory page is an array of bucket page indexes
+static const uint32_t HASH_BUCKETS_PER_DIRECTORY_PAGE = PAGE_SIZE / sizeof(uint32_t);
+
+/*
+Bucket page layout
+Header: number of entries, next overflow page (0 for none)
+Body: sorted keys, then the values in the same order
+*/
+static const uint32_t HASH_BUCKET_NUM_ENTRIES_OFFSET = 0;
+static const uint32_t HASH_BUCKET_OVERFLOW_OFFSET = HASH_BUCKET_NUM_ENTRIES_OFFSET + sizeof(uint32_t);
+static const uint32_t HASH_BUCKET_HEADER_SIZE = HASH_BUCKET_OVERFLOW_OFFSET + sizeof(uint32_t);
+static const uint32_t HASH_BUCKET_MAX_ENTRIES = (PAGE_SIZE - HASH_BUCKET_HEADER_SIZE) / (2 * sizeof(uint32_t));
+
+// An empty index is a meta page, a directory page and one bucket page
+static const uint32_t HASH_CREATE_PAGES = 3;
+
+// A put can take an overflow page, plus a bucket page and a directory page for the split it triggers
+static const uint32_t HASH_PUT_MAX_NEW_PAGES = 3;
+
+/* Spreads sequential keys over hash buckets and memtable slots (murmur3 finalizer) */
+static inline uint32_t hash_key(uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x85ebca6b;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35;
+    key ^= key >> 16;
+    return key;
+}
+
+typedef struct
+{
+    Pager *pager;
+    uint32_t meta_page_idx;
+} HashIndex;
+
+uint32_t hash_index_create(Pager *pager);
+HashIndex *open_hash_index(Pager *pager, uint32_t meta_page_idx);
+bool hash_index_find(HashIndex *index, uint32_t key, uint32_t *value);
+void hash_index_put(HashIndex *index, uint32_t key, uint32_t value);
+
+#endif
@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "db.h"
+
+/*
+Point lookup benchmark: B-tree descent against the hash index on id
+
+For each table size, rows are inserted in random id order into one database
+with only the B-tree and one with a hash index on id from the start. Random
+gets over the loaded ids are then timed on both, after a warm-up pass so every
+page is in memory and the numbers are steady state.
+
+Build with `make bench`, which raises TABLE_MAX_PAGES and uses the full
+internal node fanout so the trees have realistic depth.
+*/
+
+static const char *BENCH_FILE = "hash_bench.db";
+static const uint32_t LOOKUPS = 1000000;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void shuffle(uint32_t *ids, uint32_t n)
+{
+    for (uint32_t i = n - 1; i > 0; i--)
+    {
+        uint32_t j = rand() % (i + 1);
+        uint32_t tmp = ids[i];
+        ids[i] = ids[j];
+        ids[j] = tmp;
+    }
+}
+
+/* Inserts ids in order, returning the mean ns per insert */
+static double load(Database *db, const uint32_t *ids, uint32_t n)
+{
+    Row row = {0};
+    strcpy(row.username, "user");
+    strcpy(row.email, "user@example.com");
+
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        row.id = ids[i];
+        if (db_put(db, &row) != DB_OK)
+        {
+            fprintf(stderr, "Insert of id %u failed.\n", ids[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return (double)(now_ns() - start) / n;
+}
+
+/* Gets the ids in lookups in order, returning the mean ns per get */
+static double get_all(Database *db, const uint32_t *lookups, uint32_t n)
+{
+    Row row;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (db_get(db, lookups[i], &row) != DB_OK)
+        {
+            fprintf(stderr, "Row %u is missing.\n", lookups[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return (double)(now_ns() - start) / n;
+}
+
+/* Runs one table size, printing insert and get times with and without the hash index */
+static void bench_size(uint32_t num_rows)
+{
+    uint32_t *ids = malloc(num_rows * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_rows; i++)
+    {
+        ids[i] = i;
+    }
+    shuffle(ids, num_rows);
+
+    uint32_t *lookups = malloc(LOOKUPS * sizeof(uint32_t));
+    for (uint32_t i = 0; i < LOOKUPS; i++)
+    {
+        lookups[i] = rand() % num_rows;
+    }
+
+    double put_ns[2], get_ns[2];
+    for (int hashed = 0; hashed < 2; hashed++)
+    {
+        unlink(BENCH_FILE);
+        Database *db = db_open(BENCH_FILE);
+        if (hashed)
+        {
+            db_create_index(db, DB_COLUMN_ID);
+        }
+
+        put_ns[hashed] = load(db, ids, num_rows);
+        get_all(db, lookups, LOOKUPS); // warm-up
+        get_ns[hashed] = get_all(db, lookups, LOOKUPS);
+        db_close(db);
+    }
+    unlink(BENCH_FILE);
+
+    printf("%10u %12.1f %12.1f %12.1f %12.1f %8.2fx\n", num_rows, put_ns[0], put_ns[1], get_ns[0], get_ns[1],
+           get_ns[0] / get_ns[1]);
+    free(ids);
+    free(lookups);
+}
+
+int main(int argc, char *argv[])
+{
+    srand(1);
+    printf("%10s %12s %12s %12s %12s %9s\n", "rows", "btree put", "hash put", "btree get", "hash get", "speedup");
+    printf("%10s %12s %12s %12s %12s %9s\n", "", "ns/op", "ns/op", "ns/op", "ns/op", "get");
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            bench_size(strtoul(argv[i], NULL, 10));
+        }
+        return 0;
+    }
+
+    bench_size(1000);
+    bench_size(10000);
+    bench_size(100000);
+    return 0;
+}
@@ -0,0 +1,348 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "db.h"
+#include "protocol.h"
+
+/*
+Load generator for the database server
+
+First loads ids [0, key_space) with BATCH requests. Then opens several
+connections and keeps a fixed number of requests in flight on each (the
+pipeline depth). A mix of GETs over the loaded ids and PUTs of new ids is sent
+until the requested total completes, then throughput and latency percentiles
+are reported.
+*/
+
+typedef struct
+{
+    int fd;
+    uint64_t *sent_at; // send times of in-flight requests, oldest first (ring)
+    uint32_t ring_head;
+    uint32_t in_flight;
+    uint8_t *input;
+    size_t input_length;
+    size_t input_capacity;
+} ClientConnection;
+
+typedef struct
+{
+    uint32_t connections;
+    uint32_t requests;
+    uint32_t depth;
+    uint32_t read_percent;
+    uint32_t key_space;
+} LoadConfig;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int connect_to(const char *socket_path)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static void write_all(int fd, const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t bytes_written = write(fd, data, length);
+        if (bytes_written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_written <= 0)
+        {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        data += bytes_written;
+        length -= bytes_written;
+    }
+}
+
+static void read_all(int fd, uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t bytes_read = read(fd, data, length);
+        if (bytes_read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes_read <= 0)
+        {
+            fprintf(stderr, "Server closed connection\n");
+            exit(EXIT_FAILURE);
+        }
+        data += bytes_read;
+        length -= bytes_read;
+    }
+}
+
+/* Inserts ids [0, key_space) in BATCH requests so GETs have rows to find */
+static void load_keys(int fd, uint32_t key_space)
+{
+    const uint32_t batch_size = 64;
+    uint8_t *frame = malloc(PROTO_LENGTH_SIZE + 5 + batch_size * PROTO_MAX_ROW_SIZE);
+    uint32_t num_batches = 0;
+
+    for (uint32_t first = 0; first < key_space; first += batch_size)
+    {
+        uint32_t count = key_space - first < batch_size ? key_space - first : batch_size;
+        uint8_t *p = frame + PROTO_LENGTH_SIZE;
+        *p++ = OP_BATCH;
+        p = proto_put_u32(p, count);
+        for (uint32_t id = first; id < first + count; id++)
+        {
+            Row row = {.id = id};
+            snprintf(row.username, sizeof(row.username), "user%u", id);
+            snprintf(row.email, sizeof(row.email), "user%u@example.com", id);
+            p = proto_put_row(p, &row);
+        }
+        proto_put_u32(frame, p - frame - PROTO_LENGTH_SIZE);
+        write_all(fd, frame, p - frame);
+        num_batches++;
+    }
+
+    // each reply is length, status, inserted count
+    uint8_t reply[PROTO_LENGTH_SIZE + 5];
+    for (uint32_t i = 0; i < num_batches; i++)
+    {
+        read_all(fd, reply, sizeof(reply));
+    }
+    free(frame);
+}
+
+/* Appends one randomly chosen request to out and returns the byte after it */
+static uint8_t *encode_request(uint8_t *out, const LoadConfig *config, uint32_t *next_put_id)
+{
+    uint8_t *body = out + PROTO_LENGTH_SIZE;
+    uint8_t *p = body;
+
+    if ((uint32_t)(rand() % 100) < config->read_percent)
+    {
+        *p++ = OP_GET;
+        p = proto_put_u32(p, rand() % config->key_space);
+    }
+    else
+    {
+        Row row = {.id = (*next_put_id)++};
+        snprintf(row.username, sizeof(row.username), "user%u", row.id);
+        snprintf(row.email, sizeof(row.email), "user%u@example.com", row.id);
+        *p++ = OP_PUT;
+        p = proto_put_row(p, &row);
+    }
+
+    proto_put_u32(out, p - body);
+    return p;
+}
+
+/* Sends requests until the connection has depth in flight or the total is reached */
+static void fill_pipeline(ClientConnection *conn, const LoadConfig *config, uint32_t *sent, uint32_t *next_put_id)
+{
+    uint8_t buffer[64 * (PROTO_LENGTH_SIZE + 1 + PROTO_MAX_ROW_SIZE)];
+    uint8_t *p = buffer;
+    uint32_t batched = 0;
+
+    while (conn->in_flight < config->depth && *sent < config->requests)
+    {
+        p = encode_request(p, config, next_put_id);
+        uint32_t slot = (conn->ring_head + conn->in_flight) % config->depth;
+        conn->sent_at[slot] = now_ns();
+        conn->in_flight++;
+        (*sent)++;
+
+        if (++batched == 64)
+        {
+            write_all(conn->fd, buffer, p - buffer);
+            p = buffer;
+            batched = 0;
+        }
+    }
+
+    if (p > buffer)
+    {
+        write_all(conn->fd, buffer, p - buffer);
+    }
+}
+
+/* Reads replies, recording the latency of each. Returns the number completed */
+static uint32_t drain_replies(ClientConnection *conn, const LoadConfig *config, uint64_t *latencies,
+                              uint32_t completed, uint32_t *status_counts)
+{
+    if (conn->input_capacity - conn->input_length < 65536)
+    {
+        conn->input_capacity = conn->input_capacity * 2 + 65536;
+        conn->input = realloc(conn->input, conn->input_capacity);
+    }
+
+    ssize_t bytes_read = read(conn->fd, conn->input + conn->input_length, conn->input_capacity - conn->input_length);
+    if (bytes_read <= 0)
+    {
+        fprintf(stderr, "Server closed connection\n");
+        exit(EXIT_FAILURE);
+    }
+    conn->input_length += bytes_read;
+
+    uint64_t now = now_ns();
+    uint32_t done = 0;
+    size_t offset = 0;
+    while (true)
+    {
+        uint32_t length;
+        const uint8_t *end = conn->input + conn->input_length;
+        const uint8_t *body = proto_get_u32(conn->input + offset, end, &length);
+        if (body == NULL || (size_t)(end - body) < length)
+        {
+            break;
+        }
+
+        status_counts[body[0] <= DB_ERROR ? body[0] : DB_ERROR]++;
+        latencies[completed + done] = now - conn->sent_at[conn->ring_head];
+        conn->ring_head = (conn->ring_head + 1) % config->depth;
+        conn->in_flight--;
+        done++;
+        offset += PROTO_LENGTH_SIZE + length;
+    }
+
+    memmove(conn->input, conn->input + offset, conn->input_length - offset);
+    conn->input_length -= offset;
+    return done;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socket_path = "db.sock";
+    LoadConfig config = {.connections = 4, .requests = 100000, .depth = 32, .read_percent = 90, .key_space = 500};
+
+    int option;
+    while ((option = getopt(argc, argv, "s:c:n:p:r:k:")) != -1)
+    {
+        switch (option)
+        {
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'c':
+            config.connections = atoi(optarg);
+            break;
+        case 'n':
+            config.requests = atoi(optarg);
+            break;
+        case 'p':
+            config.depth = atoi(optarg);
+            break;
+        case 'r':
+            config.read_percent = atoi(optarg);
+            break;
+        case 'k':
+            config.key_space = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-s socket_path] [-c connections] [-n requests] "
+                            "[-p pipeline_depth] [-r read_percent] [-k key_space]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.connections == 0 || config.depth == 0 || config.key_space == 0)
+    {
+        fprintf(stderr, "connections, pipeline depth and key space must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    ClientConnection *conns = calloc(config.connections, sizeof(ClientConnection));
+    struct pollfd *poll_fds = calloc(config.connections, sizeof(struct pollfd));
+    for (uint32_t i = 0; i < config.connections; i++)
+    {
+        conns[i].fd = connect_to(socket_path);
+        conns[i].sent_at = calloc(config.depth, sizeof(uint64_t));
+        poll_fds[i].fd = conns[i].fd;
+        poll_fds[i].events = POLLIN;
+    }
+
+    uint64_t *latencies = malloc(sizeof(uint64_t) * (config.requests ? config.requests : 1));
+    uint32_t status_counts[DB_ERROR + 1] = {0};
+    uint32_t sent = 0, completed = 0;
+    uint32_t next_put_id = config.key_space; // ids below key_space are left for GETs to find
+
+    load_keys(conns[0].fd, config.key_space);
+
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < config.connections; i++)
+    {
+        fill_pipeline(&conns[i], &config, &sent, &next_put_id);
+    }
+
+    while (completed < config.requests)
+    {
+        if (poll(poll_fds, config.connections, -1) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            return EXIT_FAILURE;
+        }
+
+        for (uint32_t i = 0; i < config.connections; i++)
+        {
+            if (poll_fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                completed += drain_replies(&conns[i], &config, latencies, completed, status_counts);
+                fill_pipeline(&conns[i], &config, &sent, &next_put_id);
+            }
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    qsort(latencies, completed, sizeof(uint64_t), compare_u64);
+    uint64_t p50 = completed ? latencies[completed / 2] : 0;
+    uint64_t p99 = completed ? latencies[(uint64_t)completed * 99 / 100] : 0;
+    uint64_t max = completed ? latencies[completed - 1] : 0;
+
+    printf("requests:   %u over %u connections, pipeline depth %u, %u%% reads\n",
+           completed, config.connections, config.depth, config.read_percent);
+    printf("throughput: %.0f requests/s (%.3f s)\n", completed / seconds, seconds);
+    printf("latency:    p50 %.1f us, p99 %.1f us, max %.1f us\n", p50 / 1e3, p99 / 1e3, max / 1e3);
+    printf("status:     ok %u, not found %u, duplicate %u, table full %u, error %u\n",
+           status_counts[DB_OK], status_counts[DB_NOT_FOUND], status_counts[DB_DUPLICATE_KEY],
+           status_counts[DB_TABLE_FULL], status_counts[DB_ERROR]);
+
+    for (uint32_t i = 0; i < config.connections; i++)
+    {
+        close(conns[i].fd);
+        free(conns[i].sent_at);
+        free(conns[i].input);
+    }
+    free(conns);
+    free(poll_fds);
+    free(latencies);
+    return EXIT_SUCCESS;
+}
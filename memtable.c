@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "memtable.h"
+
+// Hash slots per buffered row, so probes stay short
+static const uint32_t MEMTABLE_SLOTS = 2 * MEMTABLE_MAX_ROWS;
+static const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+// Bloom filter sizing: about 1% false positives at capacity, and never less than 1 MB
+static const uint32_t FILTER_BITS_PER_ID = 10;
+static const uint32_t FILTER_HASHES = 7;
+static const uint64_t FILTER_MIN_BITS = 1 << 23;
+
+struct Memtable
+{
+    Row *rows;        // in arrival order
+    uint32_t *slots;  // hash table of indexes into rows
+    uint64_t *sorted; // id << 32 | index into rows, after memtable_sort
+    uint32_t num_rows;
+
+    uint64_t *filter; // Bloom filter of the ids stored in the tree
+    uint64_t filter_bits;
+    uint32_t filter_capacity; // ids the filter holds before it should be rebuilt bigger
+    uint32_t filter_ids;
+};
+
+/* splitmix64 finalizer: two independent 32-bit hashes for the filter's double hashing */
+static uint64_t hash_id_64(uint32_t id)
+{
+    uint64_t z = id + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+Memtable *new_memtable(uint32_t stored_rows)
+{
+    Memtable *memtable = calloc(1, sizeof(Memtable));
+    memtable->rows = malloc(MEMTABLE_MAX_ROWS * sizeof(Row));
+    memtable->slots = malloc(MEMTABLE_SLOTS * sizeof(uint32_t));
+    memset(memtable->slots, 0xff, MEMTABLE_SLOTS * sizeof(uint32_t));
+    memtable->sorted = malloc(MEMTABLE_MAX_ROWS * sizeof(uint64_t));
+    memtable_reset_filter(memtable, stored_rows);
+    return memtable;
+}
+
+void free_memtable(Memtable *memtable)
+{
+    free(memtable->rows);
+    free(memtable->slots);
+    free(memtable->sorted);
+    free(memtable->filter);
+    free(memtable);
+}
+
+uint32_t memtable_count(Memtable *memtable)
+{
+    return memtable->num_rows;
+}
+
+bool memtable_full(Memtable *memtable)
+{
+    return memtable->num_rows == MEMTABLE_MAX_ROWS;
+}
+
+/* The slot holding id, or the empty slot where it would go */
+static uint32_t *find_slot(Memtable *memtable, uint32_t id)
+{
+    uint32_t slot = hash_key(id) & (MEMTABLE_SLOTS - 1);
+    while (memtable->slots[slot] != EMPTY_SLOT && memtable->rows[memtable->slots[slot]].id != id)
+    {
+        slot = (slot + 1) & (MEMTABLE_SLOTS - 1);
+    }
+    return &memtable->slots[slot];
+}
+
+/* The buffered row with the given id, or NULL */
+Row *memtable_find(Memtable *memtable, uint32_t id)
+{
+    uint32_t index = *find_slot(memtable, id);
+    return index == EMPTY_SLOT ? NULL : &memtable->rows[index];
+}
+
+/* Buffers row; its id must not be buffered already, and the memtable must not be full */
+void memtable_add(Memtable *memtable, const Row *row)
+{
+    *find_slot(memtable, row->id) = memtable->num_rows;
+    memtable->rows[memtable->num_rows++] = *row;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Orders the buffered rows by id for memtable_sorted_row */
+void memtable_sort(Memtable *memtable)
+{
+    for (uint32_t i = 0; i < memtable->num_rows; i++)
+    {
+        memtable->sorted[i] = (uint64_t)memtable->rows[i].id << 32 | i;
+    }
+    qsort(memtable->sorted, memtable->num_rows, sizeof(uint64_t), compare_u64);
+}
+
+/* The buffered row with the nth smallest id, as of the last memtable_sort */
+const Row *memtable_sorted_row(Memtable *memtable, uint32_t n)
+{
+    return &memtable->rows[(uint32_t)memtable->sorted[n]];
+}
+
+/* Removes the n rows with the smallest ids, as of the last memtable_sort */
+void memtable_drop_sorted(Memtable *memtable, uint32_t n)
+{
+    memset(memtable->slots, 0xff, MEMTABLE_SLOTS * sizeof(uint32_t));
+    if (n == memtable->num_rows)
+    {
+        memtable->num_rows = 0;
+        return;
+    }
+
+    // the rest are few (a flush stops early only when the table is full), so copy them out
+    uint32_t num_left = memtable->num_rows - n;
+    Row *left = malloc(num_left * sizeof(Row));
+    for (uint32_t i = 0; i < num_left; i++)
+    {
+        left[i] = *memtable_sorted_row(memtable, n + i);
+    }
+    memtable->num_rows = 0;
+    for (uint32_t i = 0; i < num_left; i++)
+    {
+        memtable_add(memtable, &left[i]);
+    }
+    free(left);
+}
+
+/* False if id is certainly not in the tree; true if it may be */
+bool memtable_may_be_stored(Memtable *memtable, uint32_t id)
+{
+    uint64_t hash = hash_id_64(id);
+    uint64_t h1 = (uint32_t)hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    for (uint32_t i = 0; i < FILTER_HASHES; i++)
+    {
+        uint64_t bit = (h1 + i * h2) & (memtable->filter_bits - 1);
+        if (!(memtable->filter[bit / 64] & (1ull << (bit % 64))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Records that id is in the tree */
+void memtable_note_stored(Memtable *memtable, uint32_t id)
+{
+    uint64_t hash = hash_id_64(id);
+    uint64_t h1 = (uint32_t)hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    for (uint32_t i = 0; i < FILTER_HASHES; i++)
+    {
+        uint64_t bit = (h1 + i * h2) & (memtable->filter_bits - 1);
+        memtable->filter[bit / 64] |= 1ull << (bit % 64);
+    }
+    memtable->filter_ids++;
+}
+
+/* Whether the filter holds more ids than it was sized for, so false positives are getting common */
+bool memtable_filter_full(Memtable *memtable)
+{
+    return memtable->filter_ids > memtable->filter_capacity;
+}
+
+/* Empties the filter, sized for twice stored_rows ids so it lasts while the table doubles */
+void memtable_reset_filter(Memtable *memtable, uint32_t stored_rows)
+{
+    uint64_t bits = FILTER_MIN_BITS;
+    while (bits < 2ull * stored_rows * FILTER_BITS_PER_ID)
+    {
+        bits *= 2;
+    }
+    free(memtable->filter);
+    memtable->filter = calloc(bits / 64, sizeof(uint64_t));
+    memtable->filter_bits = bits;
+    memtable->filter_capacity = bits / FILTER_BITS_PER_ID;
+    memtable->filter_ids = 0;
+}
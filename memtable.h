@@ -0,0 +1,45 @@
+#ifndef MEMTABLE_H
+#define MEMTABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+/*
+Insert buffer for DB_OPEN_BUFFERED_INSERTS
+
+Rows are appended to an array and found by id through an open addressing hash
+table, so an insert neither descends the tree nor dirties a leaf. When the
+buffer fills (or anything reads the tree) db.c sorts it and merges the rows
+into the tree in key order, one pass per leaf for all the rows that land in it.
+The more rows a batch has per leaf of the table, the more that saves.
+
+An insert still has to be refused if its id is already in the tree. The
+memtable keeps a Bloom filter of the ids stored in the tree: ids it has never
+seen, as random new ids almost always are, skip the tree lookup. The filter
+is rebuilt from the tree when it fills up, since a Bloom filter can't grow.
+*/
+
+// Rows buffered before a flush; about 19 MB of Row structs
+static const uint32_t MEMTABLE_MAX_ROWS = 1 << 16;
+
+typedef struct Memtable Memtable;
+
+Memtable *new_memtable(uint32_t stored_rows);
+void free_memtable(Memtable *memtable);
+
+uint32_t memtable_count(Memtable *memtable);
+bool memtable_full(Memtable *memtable);
+Row *memtable_find(Memtable *memtable, uint32_t id);
+void memtable_add(Memtable *memtable, const Row *row);
+const Row *memtable_sorted_row(Memtable *memtable, uint32_t n);
+void memtable_sort(Memtable *memtable);
+void memtable_drop_sorted(Memtable *memtable, uint32_t n);
+
+bool memtable_may_be_stored(Memtable *memtable, uint32_t id);
+void memtable_note_stored(Memtable *memtable, uint32_t id);
+bool memtable_filter_full(Memtable *memtable);
+void memtable_reset_filter(Memtable *memtable, uint32_t stored_rows);
+
+#endif
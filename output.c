@@ -0,0 +1,252 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "protocol.h"
+
+static const char *MODE_NAMES[] = {"list", "csv", "tsv", "binary"};
+
+Output *output_open(FILE *stream, size_t capacity)
+{
+    if (capacity < OUTPUT_MAX_ROW_SIZE)
+    {
+        capacity = OUTPUT_MAX_ROW_SIZE;
+    }
+
+    Output *output = malloc(sizeof(Output));
+    output->mode = OUTPUT_LIST;
+    output->stream = stream;
+    output->data = malloc(capacity);
+    output->length = 0;
+    output->capacity = capacity;
+    output->row_start = 0;
+    output->row_fields = 0;
+    return output;
+}
+
+void output_close(Output *output)
+{
+    output_flush(output);
+    free(output->data);
+    free(output);
+}
+
+/* Hands everything buffered so far to the stream */
+void output_flush(Output *output)
+{
+    if (output->length > 0)
+    {
+        fwrite(output->data, 1, output->length, output->stream);
+        output->length = 0;
+    }
+    fflush(output->stream);
+}
+
+const char *output_mode_name(OutputMode mode)
+{
+    return MODE_NAMES[mode];
+}
+
+bool output_parse_mode(const char *name, OutputMode *mode)
+{
+    for (uint32_t i = 0; i < sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]); i++)
+    {
+        if (strcmp(name, MODE_NAMES[i]) == 0)
+        {
+            *mode = (OutputMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void output_begin_row(Output *output)
+{
+    if (output->capacity - output->length < OUTPUT_MAX_ROW_SIZE)
+    {
+        // only whole rows are handed to the stream
+        fwrite(output->data, 1, output->length, output->stream);
+        output->length = 0;
+    }
+
+    output->row_start = output->length;
+    output->row_fields = 0;
+    if (output->mode == OUTPUT_BINARY)
+    {
+        output->length += PROTO_LENGTH_SIZE; // filled in by output_end_row
+    }
+}
+
+/* Writes the separator that goes before every field but the first */
+static void begin_field(Output *output)
+{
+    static const char SEPARATORS[] = {' ', ',', '\t'};
+
+    if (output->row_fields++ > 0 && output->mode != OUTPUT_BINARY)
+    {
+        output->data[output->length++] = SEPARATORS[output->mode];
+    }
+}
+
+/* Writes the decimal digits of a number, after a minus sign if negative */
+static void put_decimal(Output *output, uint64_t magnitude, bool negative)
+{
+    // digits come out least significant first
+    char digits[20];
+    uint32_t num_digits = 0;
+    do
+    {
+        digits[num_digits++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    char *p = output->data + output->length;
+    if (negative)
+    {
+        *p++ = '-';
+    }
+    while (num_digits > 0)
+    {
+        *p++ = digits[--num_digits];
+    }
+    output->length = p - output->data;
+}
+
+void output_u32(Output *output, uint32_t value)
+{
+    begin_field(output);
+
+    if (output->mode == OUTPUT_BINARY)
+    {
+        proto_put_u32((uint8_t *)output->data + output->length, value);
+        output->length += sizeof(value);
+        return;
+    }
+    put_decimal(output, value, false);
+}
+
+void output_i32(Output *output, int32_t value)
+{
+    if (output->mode == OUTPUT_BINARY)
+    {
+        output_u32(output, (uint32_t)value); // the same four bytes
+        return;
+    }
+    begin_field(output);
+    put_decimal(output, value < 0 ? 0 - (uint64_t)value : (uint64_t)value, value < 0);
+}
+
+void output_i64(Output *output, int64_t value)
+{
+    begin_field(output);
+
+    if (output->mode == OUTPUT_BINARY)
+    {
+        memcpy(output->data + output->length, &value, sizeof(value));
+        output->length += sizeof(value);
+        return;
+    }
+    put_decimal(output, value < 0 ? 0 - (uint64_t)value : (uint64_t)value, value < 0);
+}
+
+static bool csv_needs_quotes(const char *s, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r')
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool tsv_needs_escapes(const char *s, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (s[i] == '\t' || s[i] == '\n' || s[i] == '\r' || s[i] == '\\')
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+Writes a string column. s need not be NUL-terminated: it ends at the first NUL
+or after max_length bytes, so it may point straight into a page
+*/
+void output_string(Output *output, const char *s, size_t max_length)
+{
+    begin_field(output);
+
+    const char *nul = memchr(s, '\0', max_length);
+    size_t length = nul ? (size_t)(nul - s) : max_length;
+    char *p = output->data + output->length;
+
+    if (output->mode == OUTPUT_BINARY)
+    {
+        *p++ = (uint8_t)length;
+    }
+    else if (output->mode == OUTPUT_CSV && csv_needs_quotes(s, length))
+    {
+        *p++ = '"';
+        for (size_t i = 0; i < length; i++)
+        {
+            if (s[i] == '"')
+            {
+                *p++ = '"';
+            }
+            *p++ = s[i];
+        }
+        *p++ = '"';
+        output->length = p - output->data;
+        return;
+    }
+    else if (output->mode == OUTPUT_TSV && tsv_needs_escapes(s, length))
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            switch (s[i])
+            {
+            case '\t':
+                *p++ = '\\';
+                *p++ = 't';
+                break;
+            case '\n':
+                *p++ = '\\';
+                *p++ = 'n';
+                break;
+            case '\r':
+                *p++ = '\\';
+                *p++ = 'r';
+                break;
+            case '\\':
+                *p++ = '\\';
+                *p++ = '\\';
+                break;
+            default:
+                *p++ = s[i];
+            }
+        }
+        output->length = p - output->data;
+        return;
+    }
+
+    memcpy(p, s, length);
+    output->length = p + length - output->data;
+}
+
+void output_end_row(Output *output)
+{
+    if (output->mode == OUTPUT_BINARY)
+    {
+        uint32_t body_length = output->length - output->row_start - PROTO_LENGTH_SIZE;
+        proto_put_u32((uint8_t *)output->data + output->row_start, body_length);
+    }
+    else
+    {
+        output->data[output->length++] = '\n';
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "db.h"
+
+/*
+Buffered writer for query results
+
+Rows are formatted by hand into one large buffer that is handed to the stream
+in big chunks, so exports are not limited by per-row printf calls.
+
+  list    id username email, space separated (the REPL default)
+  csv     comma separated, fields quoted as in RFC 4180 when needed
+  tsv     tab separated, with tab, newline, carriage return and backslash escaped
+  binary  records of uint32 length then the fields, using the encoding of
+          protocol.h (uint32 id, uint8 length + bytes for strings); user
+          table integers are their 4 or 8 bytes
+*/
+
+typedef enum
+{
+    OUTPUT_LIST,
+    OUTPUT_CSV,
+    OUTPUT_TSV,
+    OUTPUT_BINARY
+} OutputMode;
+
+typedef struct
+{
+    OutputMode mode;
+    FILE *stream;
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t row_start;    // offset of the row being written, for the binary length prefix
+    uint32_t row_fields; // fields written so far in the current row
+} Output;
+
+// Enough for one row of any table in any mode, even if every string byte needs escaping
+// and quoting, and every column is a 20-digit BIGINT or a full string
+#define OUTPUT_MAX_ROW_SIZE (16 + DB_MAX_TABLE_COLUMNS * (2 * DB_MAX_STRING_LENGTH + 3))
+
+Output *output_open(FILE *stream, size_t capacity);
+void output_close(Output *output);
+void output_flush(Output *output);
+const char *output_mode_name(OutputMode mode);
+bool output_parse_mode(const char *name, OutputMode *mode);
+
+/* Rows are written as begin, then each field in order, then end */
+void output_begin_row(Output *output);
+void output_u32(Output *output, uint32_t value);
+void output_i32(Output *output, int32_t value);
+void output_i64(Output *output, int64_t value);
+void output_string(Output *output, const char *s, size_t max_length);
+void output_end_row(Output *output);
+
+#endif
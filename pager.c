@@ -0,0 +1,1246 @@
+#define _GNU_SOURCE         // O_DIRECT
+#define _FILE_OFFSET_BITS 64 // 64-bit off_t on 32-bit hosts too
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "compress.h"
+#include "pager.h"
+#include "trace.h"
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define PAGER_IO_URING 1
+#endif
+
+/* Byte offset of a page in the file, computed in 64 bits so files can pass 4 GB */
+static off_t page_offset(uint32_t page_idx)
+{
+    return (off_t)page_idx * PAGE_SIZE;
+}
+
+/*
+Frames
+
+By default each page is malloced the first time it is read. With
+PAGER_DIRECT_IO every page has a fixed frame in one arena that is reserved up
+front, so the pool never outgrows TABLE_MAX_PAGES pages and its frames meet the
+alignment O_DIRECT needs. The arena is mapped with huge pages where the system
+has them reserved, and otherwise asks for transparent huge pages, which cuts
+TLB misses when the pool is large. Untouched frames cost no memory.
+*/
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static void *map_arena(size_t size)
+{
+#ifdef MAP_HUGETLB
+    // reserved up front, so this fails rather than faulting later when too few huge pages are free
+    void *huge = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (huge != MAP_FAILED)
+    {
+        return huge;
+    }
+#endif
+
+    void *arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED)
+    {
+        fprintf(stderr, "Error reserving buffer pool\n");
+        exit(EXIT_FAILURE);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(arena, size, MADV_HUGEPAGE);
+#endif
+    return arena;
+}
+
+// whole huge pages, so the same length maps and unmaps either kind of arena
+static size_t arena_size()
+{
+    size_t size = (size_t)TABLE_MAX_PAGES * PAGE_SIZE;
+    return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+static void *new_frame(Pager *pager, uint32_t page_idx)
+{
+    return pager->frames ? pager->frames + (size_t)page_idx * PAGE_SIZE : malloc(PAGE_SIZE);
+}
+
+static void release_frame(Pager *pager, void *frame)
+{
+    if (pager->frames == NULL)
+    {
+        free(frame);
+    }
+}
+
+/*
+Compression
+
+With PAGER_COMPRESSED a new file stores each page compressed (compress.c) in a
+place of its own, which a page map records, instead of at page_idx * PAGE_SIZE.
+Places are whole units of COMPRESSED_UNIT bytes and start with the stored
+length; a page that does not shrink is stored as is, with length PAGE_SIZE. A
+rewritten page stays in its place while it fits and otherwise moves. Places
+given up are reused, by pages or split for smaller ones, only once a synced map
+no longer names them, so a crash never finds a page overwritten by another.
+
+Unit 0 holds a superblock pointing at the map, with a checksum so a torn one is
+rejected. pager_sync writes the map to whichever of two places the previous one
+is not in and fsyncs, so the map and every page it names are durable before the
+superblock points at it, then writes the superblock and fsyncs again. Free
+space is not recorded: opening finds it between the places the map names.
+Compressed pages are not aligned, so O_DIRECT is turned off for them, and
+readahead and warmup read one page at a time.
+*/
+#define COMPRESSED_UNIT 128
+#define LENGTH_BYTES sizeof(uint32_t)
+#define MAX_PLACE_UNITS ((DB_PAGE_SIZE + LENGTH_BYTES + COMPRESSED_UNIT - 1) / COMPRESSED_UNIT)
+
+static const char COMPRESSED_MAGIC[8] = {'s', 'q', 'l', 'c', 'p', 'a', 'c', 'k'};
+
+typedef struct
+{
+    char magic[8];
+    uint32_t page_size;
+    uint32_t num_pages; // entries in the map
+    uint32_t map_unit;
+    uint32_t map_units;
+    uint32_t checksum; // db_crc32 of the fields before it
+} Superblock;
+
+/* A run of units; for a page, unit 0 means it was never written */
+typedef struct
+{
+    uint32_t unit;
+    uint32_t units;
+} Place;
+
+typedef struct
+{
+    uint32_t *units;
+    uint32_t count;
+    uint32_t capacity;
+} UnitStack;
+
+struct PageMap
+{
+    Place *pages;                        // TABLE_MAX_PAGES entries
+    UnitStack free[MAX_PLACE_UNITS + 1]; // free[n]: places of n units ready for reuse
+    Place *released;                     // places given up since the last sync
+    uint32_t num_released;
+    uint32_t released_capacity;
+    Place maps[2]; // where the map was last written, and the one before
+    uint32_t current_map;
+    uint32_t end_unit; // places are appended from here
+    bool changed;      // pages moved since the map was last written
+};
+
+static uint32_t units_for(uint64_t bytes)
+{
+    return (bytes + COMPRESSED_UNIT - 1) / COMPRESSED_UNIT;
+}
+
+static off_t unit_offset(uint32_t unit)
+{
+    return (off_t)unit * COMPRESSED_UNIT;
+}
+
+static void push_unit(UnitStack *stack, uint32_t unit)
+{
+    if (stack->count == stack->capacity)
+    {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->units = realloc(stack->units, stack->capacity * sizeof(uint32_t));
+    }
+    stack->units[stack->count++] = unit;
+}
+
+/* Makes a run of units reusable, as places no bigger than a stored page */
+static void free_units(PageMap *map, uint32_t unit, uint32_t units)
+{
+    while (units > 0)
+    {
+        uint32_t n = units < MAX_PLACE_UNITS ? units : MAX_PLACE_UNITS;
+        push_unit(&map->free[n], unit);
+        unit += n;
+        units -= n;
+    }
+}
+
+/* Holds a place the synced map may still name until the next sync */
+static void release_place(PageMap *map, Place place)
+{
+    if (map->num_released == map->released_capacity)
+    {
+        map->released_capacity = map->released_capacity ? map->released_capacity * 2 : 64;
+        map->released = realloc(map->released, map->released_capacity * sizeof(Place));
+    }
+    map->released[map->num_released++] = place;
+}
+
+static uint32_t append_units(Pager *pager, uint32_t units)
+{
+    PageMap *map = pager->page_map;
+    if (map->end_unit > UINT32_MAX - units)
+    {
+        fprintf(stderr, "Compressed db file is too large.\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t unit = map->end_unit;
+    map->end_unit += units;
+    pager->file_length = unit_offset(map->end_unit);
+    return unit;
+}
+
+/* The smallest free place that fits, split if it is bigger, or new space at the end of the file */
+static uint32_t allocate_units(Pager *pager, uint32_t units)
+{
+    PageMap *map = pager->page_map;
+    for (uint32_t n = units; n <= MAX_PLACE_UNITS; n++)
+    {
+        if (map->free[n].count > 0)
+        {
+            uint32_t unit = map->free[n].units[--map->free[n].count];
+            free_units(map, unit + units, n - units);
+            return unit;
+        }
+    }
+    return append_units(pager, units);
+}
+
+/* Reads the superblock, if the file starts with one. The buffer is aligned so this works with O_DIRECT too */
+static bool read_superblock(int fd, Superblock *superblock)
+{
+    void *block;
+    if (posix_memalign(&block, PAGE_SIZE, PAGE_SIZE) != 0)
+    {
+        fprintf(stderr, "Error allocating superblock buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    bool found = pread(fd, block, PAGE_SIZE, 0) >= (ssize_t)sizeof(Superblock) &&
+                 memcmp(block, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) == 0;
+    if (found)
+    {
+        memcpy(superblock, block, sizeof(Superblock));
+    }
+    free(block);
+    if (found && superblock->checksum != db_crc32(superblock, offsetof(Superblock, checksum)))
+    {
+        fprintf(stderr, "Superblock checksum mismatch. Corrupted file.\n");
+        exit(EXIT_FAILURE);
+    }
+    return found;
+}
+
+static int compare_places(const void *a, const void *b)
+{
+    uint32_t x = ((const Place *)a)->unit, y = ((const Place *)b)->unit;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Reads the map the superblock points at, and frees the gaps between the places it names */
+static PageMap *open_page_map(Pager *pager, const Superblock *superblock)
+{
+    PageMap *map = calloc(1, sizeof(PageMap));
+    map->pages = calloc(TABLE_MAX_PAGES, sizeof(Place));
+    map->maps[0] = (Place){superblock->map_unit, superblock->map_units};
+    size_t map_bytes = (size_t)superblock->num_pages * sizeof(Place);
+    if (map_bytes > unit_offset(superblock->map_units) ||
+        pread(pager->file_descriptor, map->pages, map_bytes, unit_offset(superblock->map_unit)) != (ssize_t)map_bytes)
+    {
+        fprintf(stderr, "Page map is missing or truncated. Corrupted file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Place *used = malloc(((size_t)superblock->num_pages + 2) * sizeof(Place));
+    uint32_t num_used = 0;
+    used[num_used++] = (Place){0, 1}; // the superblock
+    if (superblock->map_units > 0)
+    {
+        used[num_used++] = map->maps[0];
+    }
+    for (uint32_t i = 0; i < superblock->num_pages; i++)
+    {
+        if (map->pages[i].unit != 0)
+        {
+            used[num_used++] = map->pages[i];
+        }
+    }
+    qsort(used, num_used, sizeof(Place), compare_places);
+    uint32_t end = 0;
+    for (uint32_t i = 0; i < num_used; i++)
+    {
+        if (used[i].unit < end)
+        {
+            fprintf(stderr, "Page map has overlapping places. Corrupted file.\n");
+            exit(EXIT_FAILURE);
+        }
+        free_units(map, end, used[i].unit - end);
+        end = used[i].unit + used[i].units;
+    }
+    free(used);
+    map->end_unit = end;
+    pager->file_length = unit_offset(end);
+    return map;
+}
+
+/* Writes the map, makes it and the pages durable, then writes the superblock; pager_sync syncs that too */
+static void write_page_map(Pager *pager)
+{
+    PageMap *map = pager->page_map;
+    Place *place = &map->maps[!map->current_map];
+    size_t map_bytes = (size_t)pager->num_pages * sizeof(Place);
+    if (unit_offset(place->units) < (off_t)map_bytes)
+    {
+        // the map grows with the file, so it gets room to grow before it moves again
+        free_units(map, place->unit, place->units);
+        place->units = units_for(map_bytes + map_bytes / 2);
+        place->unit = append_units(pager, place->units);
+    }
+    Superblock superblock = {.page_size = PAGE_SIZE, .num_pages = pager->num_pages, .map_unit = place->unit,
+                             .map_units = place->units};
+    memcpy(superblock.magic, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC));
+    superblock.checksum = db_crc32(&superblock, offsetof(Superblock, checksum));
+    if (pwrite(pager->file_descriptor, map->pages, map_bytes, unit_offset(place->unit)) != (ssize_t)map_bytes)
+    {
+        fprintf(stderr, "Error writing page map\n");
+        exit(EXIT_FAILURE);
+    }
+    // otherwise a crash could leave a superblock naming a map, or pages, that never reached the disk
+    if (fdatasync(pager->file_descriptor) == -1)
+    {
+        fprintf(stderr, "Error syncing file\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pwrite(pager->file_descriptor, &superblock, sizeof(superblock), 0) != sizeof(superblock))
+    {
+        fprintf(stderr, "Error writing page map\n");
+        exit(EXIT_FAILURE);
+    }
+    map->current_map = !map->current_map;
+    map->changed = false;
+}
+
+static void close_page_map(PageMap *map)
+{
+    for (uint32_t n = 0; n <= MAX_PLACE_UNITS; n++)
+    {
+        free(map->free[n].units);
+    }
+    free(map->released);
+    free(map->pages);
+    free(map);
+}
+
+/* Reads a compressed page into page, or zeros for one never written; returns the bytes read */
+static ssize_t read_compressed(Pager *pager, uint32_t page_idx, void *page)
+{
+    Place place = pager->page_map->pages[page_idx];
+    if (place.unit == 0)
+    {
+        memset(page, 0, PAGE_SIZE);
+        return 0;
+    }
+    // the last place in the file may end past it, since only the stored bytes are written
+    uint8_t stored[MAX_PLACE_UNITS * COMPRESSED_UNIT];
+    ssize_t bytes_read = place.units <= MAX_PLACE_UNITS
+                             ? pread(pager->file_descriptor, stored, unit_offset(place.units), unit_offset(place.unit))
+                             : 0;
+    if (bytes_read == -1)
+    {
+        fprintf(stderr, "Error reading file\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t length = 0;
+    bool intact = bytes_read >= (ssize_t)LENGTH_BYTES;
+    if (intact)
+    {
+        memcpy(&length, stored, LENGTH_BYTES);
+        intact = length <= bytes_read - LENGTH_BYTES;
+    }
+    if (intact && length == PAGE_SIZE)
+    {
+        memcpy(page, stored + LENGTH_BYTES, PAGE_SIZE);
+    }
+    else if (intact)
+    {
+        intact = decompress_page(stored + LENGTH_BYTES, length, page, PAGE_SIZE);
+    }
+    if (!intact)
+    {
+        fprintf(stderr, "Compressed page %u is corrupted.\n", page_idx);
+        exit(EXIT_FAILURE);
+    }
+    return bytes_read;
+}
+
+/* Compresses a page and writes it to its place, moving it if it no longer fits; returns the bytes written */
+static ssize_t write_compressed(Pager *pager, uint32_t page_idx)
+{
+    PageMap *map = pager->page_map;
+    uint8_t stored[MAX_PLACE_UNITS * COMPRESSED_UNIT];
+    uint32_t length = compress_page(pager->pages[page_idx], PAGE_SIZE, stored + LENGTH_BYTES, PAGE_SIZE - 1);
+    if (length == 0)
+    {
+        length = PAGE_SIZE; // does not shrink
+        memcpy(stored + LENGTH_BYTES, pager->pages[page_idx], PAGE_SIZE);
+    }
+    memcpy(stored, &length, LENGTH_BYTES);
+    uint32_t size = LENGTH_BYTES + length;
+
+    Place *place = &map->pages[page_idx];
+    if (unit_offset(place->units) < size)
+    {
+        if (place->unit != 0)
+        {
+            release_place(map, *place);
+        }
+        place->units = units_for(size);
+        place->unit = allocate_units(pager, place->units);
+        map->changed = true;
+    }
+    return pwrite(pager->file_descriptor, stored, size, unit_offset(place->unit));
+}
+
+/*
+Readahead
+
+Scans call pager_prefetch for pages they will need soon. With io_uring the
+read is queued to the kernel into a fresh buffer and the page is installed when
+its completion is reaped, so the scan keeps working while the reads are in
+flight; get_page only waits if it reaches a page whose read has not finished.
+Where io_uring cannot be set up, posix_fadvise asks the kernel to read the page
+into its cache instead, which makes the later read() a memory copy.
+Completions are reaped on the calling thread, so the pager needs no locking.
+*/
+#ifdef PAGER_IO_URING
+static const uint32_t READAHEAD_QUEUE_DEPTH = 32;
+
+struct Readahead
+{
+    int ring_fd;
+    uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+    uint32_t *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+
+    uint32_t in_flight;
+    uint32_t unsubmitted;           // queued reads the kernel has not been told about yet
+    void *buffers[TABLE_MAX_PAGES]; // destination of the read in flight for each page, NULL if none
+};
+
+static Readahead *readahead_open()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = syscall(__NR_io_uring_setup, READAHEAD_QUEUE_DEPTH, &params);
+    if (ring_fd < 0)
+    {
+        return NULL; // not supported, or not permitted in this sandbox
+    }
+
+    Readahead *readahead = calloc(1, sizeof(Readahead));
+    readahead->ring_fd = ring_fd;
+    readahead->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    readahead->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    readahead->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        size_t size = readahead->sq_ring_size > readahead->cq_ring_size ? readahead->sq_ring_size
+                                                                        : readahead->cq_ring_size;
+        readahead->sq_ring_size = readahead->cq_ring_size = size;
+    }
+
+    readahead->sq_ring = mmap(NULL, readahead->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              ring_fd, IORING_OFF_SQ_RING);
+    readahead->cq_ring = single_mmap ? readahead->sq_ring
+                                     : mmap(NULL, readahead->cq_ring_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    readahead->sqes = mmap(NULL, readahead->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                           IORING_OFF_SQES);
+    if (readahead->sq_ring == MAP_FAILED || readahead->cq_ring == MAP_FAILED || readahead->sqes == MAP_FAILED)
+    {
+        fprintf(stderr, "Error mapping io_uring rings\n");
+        exit(EXIT_FAILURE);
+    }
+
+    void *sq = readahead->sq_ring;
+    readahead->sq_head = sq + params.sq_off.head;
+    readahead->sq_tail = sq + params.sq_off.tail;
+    readahead->sq_mask = sq + params.sq_off.ring_mask;
+    readahead->sq_array = sq + params.sq_off.array;
+    void *cq = readahead->cq_ring;
+    readahead->cq_head = cq + params.cq_off.head;
+    readahead->cq_tail = cq + params.cq_off.tail;
+    readahead->cq_mask = cq + params.cq_off.ring_mask;
+    readahead->cqes = cq + params.cq_off.cqes;
+    return readahead;
+}
+
+/* Tells the kernel about queued reads and, if wait is set, blocks until at least one completes */
+static void readahead_enter(Readahead *readahead, bool wait)
+{
+    int submitted = syscall(__NR_io_uring_enter, readahead->ring_fd, readahead->unsubmitted, wait ? 1 : 0,
+                            wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (submitted > 0)
+    {
+        readahead->unsubmitted -= submitted;
+    }
+}
+
+/* Installs the pages of finished reads. A failed or short read leaves the page for get_page to read itself */
+static void readahead_reap(Pager *pager)
+{
+    Readahead *readahead = pager->readahead;
+    uint32_t head = *readahead->cq_head;
+    uint32_t tail = __atomic_load_n(readahead->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &readahead->cqes[head & *readahead->cq_mask];
+        uint32_t page_idx = (uint32_t)cqe->user_data;
+        if (cqe->res == (int32_t)PAGE_SIZE && pager->pages[page_idx] == NULL)
+        {
+            pager->pages[page_idx] = readahead->buffers[page_idx];
+            pager->stats.bytes_read += PAGE_SIZE;
+        }
+        else
+        {
+            release_frame(pager, readahead->buffers[page_idx]);
+        }
+        readahead->buffers[page_idx] = NULL;
+        readahead->in_flight--;
+        head++;
+    }
+    __atomic_store_n(readahead->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Queues a read of page_idx into a new buffer. Returns false if the queue is full */
+static bool readahead_submit(Pager *pager, uint32_t page_idx)
+{
+    Readahead *readahead = pager->readahead;
+    uint32_t tail = *readahead->sq_tail;
+    uint32_t head = __atomic_load_n(readahead->sq_head, __ATOMIC_ACQUIRE);
+    if (readahead->in_flight >= READAHEAD_QUEUE_DEPTH || tail - head > *readahead->sq_mask)
+    {
+        return false;
+    }
+
+    void *buffer = new_frame(pager, page_idx);
+    uint32_t slot = tail & *readahead->sq_mask;
+    struct io_uring_sqe *sqe = &readahead->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = pager->file_descriptor;
+    sqe->off = page_offset(page_idx);
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = PAGE_SIZE;
+    sqe->user_data = page_idx;
+    readahead->sq_array[slot] = slot;
+    __atomic_store_n(readahead->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    readahead->buffers[page_idx] = buffer;
+    readahead->in_flight++;
+    readahead->unsubmitted++;
+    return true;
+}
+
+/* Blocks until the read in flight for page_idx, if any, has completed */
+static void readahead_wait(Pager *pager, uint32_t page_idx)
+{
+    while (pager->readahead->buffers[page_idx] != NULL)
+    {
+        readahead_enter(pager->readahead, true);
+        readahead_reap(pager);
+    }
+}
+
+static void readahead_close(Pager *pager)
+{
+    Readahead *readahead = pager->readahead;
+    while (readahead->in_flight > 0)
+    {
+        readahead_enter(readahead, true);
+        readahead_reap(pager);
+    }
+
+    munmap(readahead->sqes, readahead->sqes_size);
+    if (readahead->cq_ring != readahead->sq_ring)
+    {
+        munmap(readahead->cq_ring, readahead->cq_ring_size);
+    }
+    munmap(readahead->sq_ring, readahead->sq_ring_size);
+    close(readahead->ring_fd);
+    free(readahead);
+}
+#else
+static Readahead *readahead_open()
+{
+    return NULL;
+}
+#endif
+
+/*
+Starts reading page_idx from disk if it is on disk and not yet in memory.
+Returns without waiting; the page is picked up by a later get_page
+*/
+void pager_prefetch(Pager *pager, uint32_t page_idx)
+{
+    if (page_idx >= TABLE_MAX_PAGES || pager->pages[page_idx])
+    {
+        return;
+    }
+    if (pager->page_map)
+    {
+#ifdef POSIX_FADV_WILLNEED
+        Place place = pager->page_map->pages[page_idx];
+        if (place.unit != 0)
+        {
+            posix_fadvise(pager->file_descriptor, unit_offset(place.unit), unit_offset(place.units),
+                          POSIX_FADV_WILLNEED);
+        }
+#endif
+        return;
+    }
+    if (page_idx >= pager->file_length / PAGE_SIZE)
+    {
+        return;
+    }
+
+#ifdef PAGER_IO_URING
+    if (pager->readahead)
+    {
+        readahead_reap(pager);
+        if (pager->readahead->buffers[page_idx] == NULL && pager->pages[page_idx] == NULL &&
+            readahead_submit(pager, page_idx))
+        {
+            readahead_enter(pager->readahead, false);
+        }
+        return;
+    }
+#endif
+
+#ifdef POSIX_FADV_WILLNEED
+    if (pager->direct_io)
+    {
+        return; // the page cache is bypassed, so there is nothing for the kernel to warm
+    }
+    posix_fadvise(pager->file_descriptor, page_offset(page_idx), PAGE_SIZE, POSIX_FADV_WILLNEED);
+#endif
+}
+
+/*
+Get the address of page based on its index
+Allocates memory for page and loads data from file if it doesn't exist in memory yet
+*/
+void *get_page(Pager *pager, uint32_t page_idx)
+{
+    if (page_idx >= TABLE_MAX_PAGES)
+    {
+        fprintf(stderr, "Tried to fetch page idx out of bounds.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pager->accesses[page_idx] != UINT32_MAX)
+    {
+        pager->accesses[page_idx]++;
+    }
+
+    void *page = pager->pages[page_idx];
+#ifdef PAGER_IO_URING
+    if (page == NULL && pager->readahead && pager->readahead->buffers[page_idx])
+    {
+        // prefetched: wait for the read already in flight
+        readahead_wait(pager, page_idx);
+        page = pager->pages[page_idx];
+    }
+#endif
+    if (page == NULL)
+    {
+        // cache miss, allocate memory for page using PAGE_SIZE
+        TRACE_BEGIN(span);
+        pager->stats.page_misses++;
+        page = pager->pages[page_idx] = new_frame(pager, page_idx);
+
+        // Read file into allocated page, from wherever page_idx is
+        // pread leaves the file offset alone, so a background flusher can write meanwhile
+        // a short read means the page lies past the end of the file and is new
+        ssize_t bytes_read = pager->page_map ? read_compressed(pager, page_idx, page)
+                                             : pread(pager->file_descriptor, page, PAGE_SIZE, page_offset(page_idx));
+        if (bytes_read == -1)
+        {
+            fprintf(stderr, "Error reading file\n");
+            exit(EXIT_FAILURE);
+        }
+        pager->stats.bytes_read += bytes_read;
+
+        // update number of pages if accessing beyond current number of pages
+        if (page_idx >= pager->num_pages)
+        {
+            pager->num_pages = page_idx + 1;
+        }
+        TRACE_END(span, "get_page miss");
+    }
+    else
+    {
+        pager->stats.page_hits++;
+    }
+
+    return pager->pages[page_idx];
+}
+
+/*
+Reads page_idx as the file holds it into page, leaving the cache alone. Pages
+of a compressed file move when they are rewritten, so the caller must keep
+writes out meanwhile
+*/
+void pager_read_page(Pager *pager, uint32_t page_idx, void *page)
+{
+    ssize_t bytes_read = pager->page_map ? read_compressed(pager, page_idx, page)
+                                         : pread(pager->file_descriptor, page, PAGE_SIZE, page_offset(page_idx));
+    if (bytes_read == -1)
+    {
+        fprintf(stderr, "Error reading file\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pager->page_map == NULL && bytes_read < (ssize_t)PAGE_SIZE)
+    {
+        memset(page + bytes_read, 0, PAGE_SIZE - bytes_read);
+    }
+}
+
+/* Bytes the pages take in the file, which for a compressed file is its length so far */
+uint64_t pager_file_bytes(Pager *pager)
+{
+    return pager->page_map ? pager->file_length : (uint64_t)pager->num_pages * PAGE_SIZE;
+}
+
+/*
+Initializes Pager struct
+With PAGER_DIRECT_IO, a file system that refuses O_DIRECT (tmpfs, for one)
+falls back to buffered I/O; pages still come from the aligned pool.
+*/
+Pager *open_pager(const char *filename, uint32_t flags)
+{
+    // open file and get fd
+    bool direct_io = false;
+    int fd = -1;
+#ifdef O_DIRECT
+    if (flags & PAGER_DIRECT_IO)
+    {
+        fd = open(filename, O_RDWR | O_CREAT | O_DIRECT, S_IWUSR | S_IRUSR);
+        direct_io = fd != -1;
+        if (fd == -1 && errno != EINVAL)
+        {
+            fprintf(stderr, "Error opening file\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+#endif
+    if (fd == -1)
+    {
+        fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+    }
+    if (fd == -1)
+    {
+        fprintf(stderr, "Error opening file\n");
+        exit(EXIT_FAILURE); // error handling
+    }
+
+    // get file length
+    off_t file_length = lseek(fd, 0, SEEK_END); // get offset of file end?
+    if (file_length == -1)
+    {
+        fprintf(stderr, "Error getting file length\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the flag only picks the format of a new file; an existing one says which it has
+    Superblock superblock = {.page_size = PAGE_SIZE};
+    bool compressed = read_superblock(fd, &superblock) || (file_length == 0 && (flags & PAGER_COMPRESSED));
+    if (compressed && direct_io)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        direct_io = false;
+    }
+    if (compressed)
+    {
+        if (superblock.page_size != PAGE_SIZE)
+        {
+            fprintf(stderr, "Db file was written with %u-byte pages, not %u.\n", superblock.page_size, PAGE_SIZE);
+            exit(EXIT_FAILURE);
+        }
+        if (superblock.num_pages > TABLE_MAX_PAGES)
+        {
+            fprintf(stderr, "Db file has more pages than this build can hold.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (file_length % PAGE_SIZE != 0)
+    {
+        fprintf(stderr, "Db file is not whole number of pages. Corrupted file.\n");
+        exit(EXIT_FAILURE);
+    }
+    else if (file_length / PAGE_SIZE > TABLE_MAX_PAGES)
+    {
+        // pages[] and dirty[] only have room for TABLE_MAX_PAGES, and every flush walks num_pages of them
+        fprintf(stderr, "Db file has more pages than this build can hold.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (file_length / PAGE_SIZE >= INVALID_PAGE_IDX)
+    {
+        fprintf(stderr, "Db file has more pages than a page number can address.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // allocate memory and init properties for pager
+    Pager *pager = (Pager *)malloc(sizeof(Pager));
+    pager->file_descriptor = fd;
+    pager->file_length = file_length;
+    pager->num_pages = compressed ? superblock.num_pages : file_length / PAGE_SIZE;
+    for (int i = 0; i < TABLE_MAX_PAGES; i++)
+    {
+        pager->pages[i] = NULL;
+        pager->dirty[i] = false;
+        pager->accesses[i] = 0;
+    }
+    pager->num_writes = 0;
+    pager->num_synced_writes = 0;
+    pager->write_back_next = 0;
+    memset(&pager->stats, 0, sizeof(pager->stats));
+    pager->snapshot = NULL;
+    pager->frames = (flags & PAGER_DIRECT_IO) ? map_arena(arena_size()) : NULL;
+    pager->direct_io = direct_io;
+    pager->page_map = compressed ? open_page_map(pager, &superblock) : NULL;
+    pager->readahead = compressed ? NULL : readahead_open();
+
+    // return address for pager
+    return pager;
+}
+
+/*
+Writes PAGE_SIZE bytes from leaf node at pages[page_idx] to file, or fewer
+compressed ones to the page's place in a compressed file
+*/
+void flush_page(Pager *pager, uint32_t page_idx)
+{
+    TRACE_BEGIN(span);
+    // write bytes to file at the page's offset
+    ssize_t bytes_written = pager->page_map ? write_compressed(pager, page_idx)
+                                            : pwrite(pager->file_descriptor, pager->pages[page_idx], PAGE_SIZE,
+                                                     page_offset(page_idx));
+    if (bytes_written == -1)
+    {
+        fprintf(stderr, "Error writing page to file\n");
+        exit(EXIT_FAILURE);
+    }
+    pager->num_writes++;
+    pager->stats.page_flushes++;
+    pager->stats.bytes_written += bytes_written;
+    TRACE_END(span, "flush_page");
+}
+
+/* Monotonic time in ns, as recorded for dirty pages; coarse, since it is read on every first change */
+uint64_t pager_clock_ns()
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+Snapshots
+
+A snapshot lets a backup copy the file as it stood when the snapshot began
+while writes carry on. Beginning one writes out every dirty page, so from then
+on the file holds the snapshot wherever a page has not changed since. The
+first change to a page the backup has not copied yet saves the page as it was,
+and the backup takes that pre-image in place of what the file holds.
+*/
+struct Snapshot
+{
+    uint32_t num_pages;
+    bool *copied;     // the backup has taken the page, so later changes need no pre-image
+    void **preimages; // page as of the snapshot, saved on its first change; NULL if unchanged
+};
+
+static void snapshot_preserve(Pager *pager, uint32_t page_idx)
+{
+    Snapshot *snapshot = pager->snapshot;
+    if (page_idx < snapshot->num_pages && !snapshot->copied[page_idx] && snapshot->preimages[page_idx] == NULL)
+    {
+        snapshot->preimages[page_idx] = malloc(PAGE_SIZE);
+        memcpy(snapshot->preimages[page_idx], pager->pages[page_idx], PAGE_SIZE);
+    }
+}
+
+/*
+Records that a cached page is about to be modified
+Must be called before the page contents change so the page is written back
+*/
+void mark_page_dirty(Pager *pager, uint32_t page_idx)
+{
+    if (pager->snapshot)
+    {
+        snapshot_preserve(pager, page_idx);
+    }
+    if (!pager->dirty[page_idx])
+    {
+        pager->dirty_since_ns[page_idx] = pager_clock_ns();
+        pager->dirty[page_idx] = true;
+    }
+}
+
+/*
+Writes every dirty page to disk and waits for the data to be durable
+This is the commit point: rows inserted before the call survive a crash after it
+*/
+void pager_flush(Pager *pager)
+{
+    for (uint32_t i = 0; i < pager->num_pages; i++)
+    {
+        if (pager->pages[i] && pager->dirty[i])
+        {
+            flush_page(pager, i);
+            pager->dirty[i] = false;
+        }
+    }
+    pager_sync(pager);
+}
+
+/*
+Writes up to max_pages pages that have been dirty since before dirty_before_ns,
+without waiting for them to be durable, and returns how many were written.
+Each call picks up from where the last one stopped, so repeated calls cycle
+through the whole file
+*/
+uint32_t pager_write_back(Pager *pager, uint32_t max_pages, uint64_t dirty_before_ns)
+{
+    uint32_t written = 0;
+    for (uint32_t scanned = 0; scanned < pager->num_pages && written < max_pages; scanned++)
+    {
+        uint32_t i = pager->write_back_next;
+        pager->write_back_next = i + 1 < pager->num_pages ? i + 1 : 0;
+        // dirty is checked first: only calls that modify pages set it, so pages being read are not touched
+        if (pager->dirty[i] && pager->dirty_since_ns[i] <= dirty_before_ns)
+        {
+            flush_page(pager, i);
+            pager->dirty[i] = false;
+            written++;
+        }
+    }
+    return written;
+}
+
+/* Starts a snapshot of the file as it stands and returns its length in pages */
+uint32_t pager_begin_snapshot(Pager *pager)
+{
+    for (uint32_t i = 0; i < pager->num_pages; i++)
+    {
+        if (pager->dirty[i])
+        {
+            flush_page(pager, i);
+            pager->dirty[i] = false;
+        }
+    }
+
+    Snapshot *snapshot = malloc(sizeof(Snapshot));
+    snapshot->num_pages = pager->num_pages;
+    snapshot->copied = calloc(snapshot->num_pages, sizeof(bool));
+    snapshot->preimages = calloc(snapshot->num_pages, sizeof(void *));
+    pager->snapshot = snapshot;
+    return snapshot->num_pages;
+}
+
+/*
+Turns page, holding page_idx as read from the file, into its snapshot version,
+and records that the backup has it
+*/
+void pager_snapshot_page(Pager *pager, uint32_t page_idx, void *page)
+{
+    Snapshot *snapshot = pager->snapshot;
+    if (snapshot->preimages[page_idx])
+    {
+        memcpy(page, snapshot->preimages[page_idx], PAGE_SIZE);
+        free(snapshot->preimages[page_idx]);
+        snapshot->preimages[page_idx] = NULL;
+    }
+    snapshot->copied[page_idx] = true;
+}
+
+void pager_end_snapshot(Pager *pager)
+{
+    Snapshot *snapshot = pager->snapshot;
+    for (uint32_t i = 0; i < snapshot->num_pages; i++)
+    {
+        free(snapshot->preimages[i]);
+    }
+    free(snapshot->preimages);
+    free(snapshot->copied);
+    free(snapshot);
+    pager->snapshot = NULL;
+}
+
+/*
+Warmup
+
+A restarted process would otherwise fault its working set back in one
+get_page miss at a time. The warmup file lists the most accessed resident
+pages with their access counts. Loading it reads those pages back in page
+order, one preadv per run of adjacent pages, so a cold cache costs a few large
+sequential reads instead. The file is only a hint: a missing, torn or stale one
+loads nothing, or pages that are then simply cached.
+*/
+static const uint32_t WARMUP_MAGIC = 0x6d726177; // "warm"
+static const uint32_t WARMUP_MAX_PAGES = 16384;  // 64 MB of pages
+static const uint32_t WARMUP_READ_PAGES = 64;    // pages per preadv, well under IOV_MAX
+
+typedef struct
+{
+    uint32_t page_idx;
+    uint32_t accesses;
+} WarmupEntry;
+
+static int compare_accesses_descending(const void *a, const void *b)
+{
+    uint32_t x = ((const WarmupEntry *)a)->accesses, y = ((const WarmupEntry *)b)->accesses;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int compare_page_idx(const void *a, const void *b)
+{
+    uint32_t x = ((const WarmupEntry *)a)->page_idx, y = ((const WarmupEntry *)b)->page_idx;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/*
+Writes the warmup file for the pages now in memory. Counts are read without
+synchronization, so when other threads are reading pages they are approximate
+*/
+void pager_save_warmup(Pager *pager, const char *path)
+{
+    WarmupEntry *entries = malloc(TABLE_MAX_PAGES * sizeof(WarmupEntry));
+    uint32_t num_entries = 0;
+    for (uint32_t i = 0; i < pager->num_pages; i++)
+    {
+        if (pager->pages[i] && pager->accesses[i])
+        {
+            entries[num_entries++] = (WarmupEntry){i, pager->accesses[i]};
+        }
+    }
+    if (num_entries > WARMUP_MAX_PAGES)
+    {
+        qsort(entries, num_entries, sizeof(WarmupEntry), compare_accesses_descending);
+        num_entries = WARMUP_MAX_PAGES;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    if (fd != -1)
+    {
+        uint32_t header[2] = {WARMUP_MAGIC, num_entries};
+        if (write(fd, header, sizeof(header)) != sizeof(header) ||
+            write(fd, entries, num_entries * sizeof(WarmupEntry)) != (ssize_t)(num_entries * sizeof(WarmupEntry)))
+        {
+            ftruncate(fd, 0); // a partial list would be ignored anyway
+        }
+        close(fd);
+    }
+    free(entries);
+}
+
+/* Reads count adjacent pages starting at first into new frames with one preadv; returns how many it got */
+static uint32_t warmup_read_run(Pager *pager, uint32_t first, uint32_t count)
+{
+    if (pager->page_map)
+    {
+        // compressed pages are not laid out in page order, so each is read by itself
+        for (uint32_t i = 0; i < count; i++)
+        {
+            pager->pages[first + i] = new_frame(pager, first + i);
+            pager->stats.bytes_read += read_compressed(pager, first + i, pager->pages[first + i]);
+        }
+        return count;
+    }
+
+    struct iovec iov[WARMUP_READ_PAGES];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        iov[i].iov_base = new_frame(pager, first + i);
+        iov[i].iov_len = PAGE_SIZE;
+    }
+
+    ssize_t bytes_read = preadv(pager->file_descriptor, iov, count, page_offset(first));
+    if (bytes_read > 0)
+    {
+        pager->stats.bytes_read += bytes_read;
+    }
+    uint32_t installed = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (bytes_read >= (ssize_t)((i + 1) * PAGE_SIZE))
+        {
+            pager->pages[first + i] = iov[i].iov_base;
+            installed++;
+        }
+        else
+        {
+            release_frame(pager, iov[i].iov_base); // get_page reads it itself if it is needed
+        }
+    }
+    return installed;
+}
+
+/*
+Loads the pages listed in a warmup file and seeds their access counts with
+half the saved ones, so pages that stop being used age out over restarts.
+Call right after open_pager. Returns the number of pages read
+*/
+uint32_t pager_load_warmup(Pager *pager, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return 0;
+    }
+    uint32_t header[2];
+    struct stat st;
+    if (read(fd, header, sizeof(header)) != sizeof(header) || header[0] != WARMUP_MAGIC ||
+        header[1] > WARMUP_MAX_PAGES || fstat(fd, &st) == -1 ||
+        st.st_size != (off_t)(sizeof(header) + header[1] * sizeof(WarmupEntry)))
+    {
+        close(fd);
+        return 0;
+    }
+    uint32_t num_entries = header[1];
+    WarmupEntry *entries = malloc(num_entries * sizeof(WarmupEntry));
+    ssize_t bytes_read = read(fd, entries, num_entries * sizeof(WarmupEntry));
+    close(fd);
+    if (bytes_read != (ssize_t)(num_entries * sizeof(WarmupEntry)))
+    {
+        free(entries);
+        return 0;
+    }
+
+    qsort(entries, num_entries, sizeof(WarmupEntry), compare_page_idx);
+    uint32_t loaded = 0;
+    uint32_t run_first = 0, run_count = 0;
+    for (uint32_t i = 0; i <= num_entries; i++)
+    {
+        // repeated entries (only a damaged file has them) are skipped like resident pages
+        bool wanted = i < num_entries && entries[i].page_idx < pager->num_pages &&
+                      entries[i].page_idx < TABLE_MAX_PAGES && pager->pages[entries[i].page_idx] == NULL &&
+                      (run_count == 0 || entries[i].page_idx >= run_first + run_count);
+        if (wanted)
+        {
+            pager->accesses[entries[i].page_idx] = entries[i].accesses / 2;
+            if (run_count > 0 && entries[i].page_idx == run_first + run_count && run_count < WARMUP_READ_PAGES)
+            {
+                run_count++;
+                continue;
+            }
+        }
+        if (run_count > 0)
+        {
+            loaded += warmup_read_run(pager, run_first, run_count);
+            run_count = 0;
+        }
+        if (wanted)
+        {
+            run_first = entries[i].page_idx;
+            run_count = 1;
+        }
+    }
+    free(entries);
+    return loaded;
+}
+
+/*
+Waits for every page written so far to be durable. A compressed file gets its
+page map written first, and the places pages moved out of become free after
+*/
+void pager_sync(Pager *pager)
+{
+    if (pager->num_synced_writes == pager->num_writes)
+    {
+        return;
+    }
+    uint64_t num_writes = pager->num_writes;
+    PageMap *map = pager->page_map;
+    if (map && map->changed)
+    {
+        write_page_map(pager);
+    }
+    if (fsync(pager->file_descriptor) == -1)
+    {
+        fprintf(stderr, "Error syncing file\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; map && i < map->num_released; i++)
+    {
+        free_units(map, map->released[i].unit, map->released[i].units);
+    }
+    if (map)
+    {
+        map->num_released = 0;
+    }
+    pager->num_synced_writes = num_writes;
+}
+
+/*
+Retrieves index of an unused page
+For now, unused pages are always at end of database file
+Once deletion is implemented, pages may become recycled
+*/
+uint32_t get_unused_page_idx(Pager *pager)
+{
+    return pager->num_pages;
+}
+
+/* Flushes dirty pages to disk, then releases the pager */
+void close_pager(Pager *pager)
+{
+#ifdef PAGER_IO_URING
+    if (pager->readahead)
+    {
+        readahead_close(pager);
+    }
+#endif
+    pager_flush(pager);
+
+    // free memory
+    for (uint32_t i = 0; i < pager->num_pages; i++)
+    {
+        release_frame(pager, pager->pages[i]);
+        pager->pages[i] = NULL;
+    }
+    if (pager->frames)
+    {
+        munmap(pager->frames, arena_size());
+    }
+    if (pager->page_map)
+    {
+        close_page_map(pager->page_map);
+    }
+
+    close(pager->file_descriptor); // close file
+
+    free(pager);
+}
@@ -0,0 +1,84 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Builds that need bigger files (the benchmarks) override this on the command line
+#ifndef TABLE_MAX_PAGES
+#define TABLE_MAX_PAGES 100
+#endif
+
+/*
+Page numbers are uint32 both on disk and in memory, and INVALID_PAGE_IDX is
+reserved, so a file holds at most 2^32 - 1 pages (16 TiB). Byte offsets into
+the file are 64-bit and come only from page_offset in pager.c.
+*/
+#define INVALID_PAGE_IDX UINT32_MAX
+
+// Benchmarks vary this too. Files are only readable by builds with the same page size,
+// and table leaves must stay under 256 cells (see the hash index locations in db.c)
+#ifndef DB_PAGE_SIZE
+#define DB_PAGE_SIZE 4096
+#endif
+
+static const uint32_t PAGE_SIZE = DB_PAGE_SIZE; // bytes
+
+// open_pager flags
+static const uint32_t PAGER_DIRECT_IO = 1 << 0; // O_DIRECT reads and writes into one aligned pool of frames
+static const uint32_t PAGER_COMPRESSED = 1 << 1; // a new file stores its pages compressed; see pager.c
+
+/* Page I/O counters since open or the last reset; plain increments, read without locking */
+typedef struct
+{
+    uint64_t page_hits;     // get_page calls that found the page in memory
+    uint64_t page_misses;   // get_page calls that read the page from the file
+    uint64_t bytes_read;    // by get_page, readahead and warmup
+    uint64_t bytes_written; // by flush_page
+    uint64_t page_flushes;  // flush_page calls
+} PagerStats;
+
+typedef struct Readahead Readahead;
+typedef struct Snapshot Snapshot;
+typedef struct PageMap PageMap;
+
+typedef struct
+{
+    int file_descriptor;
+    uint64_t file_length; // bytes
+    uint32_t num_pages;
+    void *pages[TABLE_MAX_PAGES];
+    bool dirty[TABLE_MAX_PAGES]; // page differs from its copy on disk
+    uint32_t accesses[TABLE_MAX_PAGES]; // get_page calls, saturating; ranks pages for the warmup file
+    uint64_t dirty_since_ns[TABLE_MAX_PAGES]; // when a dirty page was first changed after its last write
+    uint64_t num_writes;         // pages written so far
+    uint64_t num_synced_writes;  // num_writes as of the last completed fsync
+    uint32_t write_back_next;    // page pager_write_back resumes from
+    PagerStats stats;
+    Snapshot *snapshot;          // pre-images of pages changed since a backup began; NULL when none runs
+    Readahead *readahead;        // io_uring reads in flight; NULL where io_uring is unavailable
+    void *frames;                // PAGER_DIRECT_IO: page i lives at frames + i * PAGE_SIZE; NULL when pages are malloced
+    bool direct_io;              // file opened with O_DIRECT, so the kernel page cache is bypassed
+    PageMap *page_map;           // where each compressed page lives in the file; NULL for a file of plain pages
+} Pager;
+
+Pager *open_pager(const char *filename, uint32_t flags);
+void *get_page(Pager *pager, uint32_t page_idx);
+void pager_prefetch(Pager *pager, uint32_t page_idx);
+void pager_read_page(Pager *pager, uint32_t page_idx, void *page);
+uint64_t pager_file_bytes(Pager *pager);
+void flush_page(Pager *pager, uint32_t page_idx);
+void mark_page_dirty(Pager *pager, uint32_t page_idx);
+void pager_flush(Pager *pager);
+uint32_t pager_write_back(Pager *pager, uint32_t max_pages, uint64_t dirty_before_ns);
+void pager_sync(Pager *pager);
+uint64_t pager_clock_ns();
+uint32_t pager_begin_snapshot(Pager *pager);
+void pager_snapshot_page(Pager *pager, uint32_t page_idx, void *page);
+void pager_end_snapshot(Pager *pager);
+void pager_save_warmup(Pager *pager, const char *path);
+uint32_t pager_load_warmup(Pager *pager, const char *path);
+uint32_t get_unused_page_idx(Pager *pager);
+void close_pager(Pager *pager);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+/*
+Binary request protocol spoken over the server's Unix domain socket.
+
+Every message is a frame: a uint32 length of the bytes that follow, then the body.
+Integers are in host byte order since both ends share a machine.
+
+Request body:  uint8 opcode, payload
+Response body: uint8 status (a DbResult), payload
+
+Requests on a connection are answered in the order they were sent, so a client
+may pipeline many requests before reading any replies.
+
+  opcode  request payload                        response payload
+  PUT     row                                    -
+  GET     uint32 id                              row (status DB_OK only)
+  SCAN    uint32 start, uint32 end, uint32 limit uint32 count, count rows
+  BATCH   uint32 count, count rows               uint32 inserted
+
+A row is uint32 id, uint8 username length, username bytes,
+uint8 email length, email bytes.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "db.h"
+
+typedef enum
+{
+    OP_PUT = 1,
+    OP_GET = 2,
+    OP_SCAN = 3,
+    OP_BATCH = 4
+} Opcode;
+
+#define PROTO_LENGTH_SIZE 4
+#define PROTO_MAX_FRAME (16 * 1024 * 1024)
+#define PROTO_MAX_ROW_SIZE (4 + 1 + COLUMN_USERNAME_SIZE + 1 + COLUMN_EMAIL_SIZE)
+
+static inline uint8_t *proto_put_u32(uint8_t *p, uint32_t value)
+{
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
+
+static inline const uint8_t *proto_get_u32(const uint8_t *p, const uint8_t *end, uint32_t *value)
+{
+    if (p == NULL || end - p < (long)sizeof(*value))
+    {
+        return NULL;
+    }
+    memcpy(value, p, sizeof(*value));
+    return p + sizeof(*value);
+}
+
+static inline uint8_t *proto_put_string(uint8_t *p, const char *s, size_t max_length)
+{
+    size_t length = strnlen(s, max_length);
+    *p++ = (uint8_t)length;
+    memcpy(p, s, length);
+    return p + length;
+}
+
+static inline const uint8_t *proto_get_string(const uint8_t *p, const uint8_t *end, char *s, size_t max_length)
+{
+    if (p == NULL || p >= end || *p > max_length || end - (p + 1) < *p)
+    {
+        return NULL;
+    }
+    size_t length = *p++;
+    memcpy(s, p, length);
+    memset(s + length, 0, max_length + 1 - length);
+    return p + length;
+}
+
+/* Encodes row at p and returns the byte after it; p needs PROTO_MAX_ROW_SIZE bytes */
+static inline uint8_t *proto_put_row(uint8_t *p, const Row *row)
+{
+    p = proto_put_u32(p, row->id);
+    p = proto_put_string(p, row->username, COLUMN_USERNAME_SIZE);
+    return proto_put_string(p, row->email, COLUMN_EMAIL_SIZE);
+}
+
+/* Decodes a row from [p, end). Returns the byte after it, or NULL if malformed */
+static inline const uint8_t *proto_get_row(const uint8_t *p, const uint8_t *end, Row *row)
+{
+    p = proto_get_u32(p, end, &row->id);
+    p = proto_get_string(p, end, row->username, COLUMN_USERNAME_SIZE);
+    return proto_get_string(p, end, row->email, COLUMN_EMAIL_SIZE);
+}
+
+#endif
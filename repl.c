@@ -0,0 +1,1549 @@
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "db.h"
+#include "output.h"
+#include "trace.h"
+
+typedef struct
+{
+    char *buffer;
+    size_t buffer_length;
+    ssize_t input_length;
+} InputBuffer;
+
+typedef enum
+{
+    META_COMMAND_SUCCESS,
+    META_COMMAND_EXIT,
+    META_COMMAND_UNRECOGNIZED_COMMAND
+} MetaCommandResult;
+
+typedef enum
+{
+    PREPARE_STATEMENT_SUCCESS,
+    PREPARE_STATEMENT_UNRECOGNIZED_COMMAND,
+    PREPARE_STATEMENT_SYNTAX_ERROR,
+    PREPARE_STATEMENT_UNKNOWN_TABLE,
+    PREPARE_STRING_TOO_LONG
+} PrepareResult;
+
+typedef enum
+{
+    EXECUTE_STATEMENT_SUCCESS,
+    EXECUTE_STATEMENT_TABLE_FULL,
+    EXECUTE_STATEMENT_ERROR,
+    EXECUTE_DUPLICATE_KEY,
+    EXECUTE_INDEX_EXISTS,
+    EXECUTE_KEY_NOT_FOUND,
+    EXECUTE_INDEXED_COLUMN_CHANGED,
+    EXECUTE_TABLE_EXISTS,
+    EXECUTE_INVALID_TABLE
+} ExecuteResult;
+typedef enum
+{
+    STATEMENT_INSERT,
+    STATEMENT_SELECT,
+    STATEMENT_CREATE_INDEX,
+    STATEMENT_VACUUM,
+    STATEMENT_UPDATE,
+    STATEMENT_CREATE_TABLE
+} StatementType;
+
+#define NUM_STATEMENT_TYPES 6
+
+static const char *STATEMENT_NAMES[] = {"INSERT", "SELECT", "CREATE INDEX", "VACUUM", "UPDATE", "CREATE TABLE"};
+
+/*
+State of one REPL run
+In batch mode the prompt and per-statement acknowledgements are suppressed and
+errors go to stderr, tagged with their line number, followed by a summary at the end.
+*/
+typedef struct
+{
+    bool batch;
+    FILE *input;
+    uint32_t line_number;
+    uint32_t num_statements;
+    uint32_t num_errors;
+    bool timer;                                    // .timer on: print each statement's wall time
+    LatencyHistogram latency[NUM_STATEMENT_TYPES]; // wall time of every statement run, by type
+} Session;
+
+#define MAX_SELECTED_COLUMNS 3
+
+static const char *COLUMN_NAMES[] = {"id", "username", "email"};
+
+static const char *TYPE_NAMES[] = {"INT", "BIGINT", "CHAR", "VARCHAR"}; // by DbType
+
+// .backup copies at most this fast, so queries keep most of the disk
+static const uint32_t BACKUP_BYTES_PER_SECOND = 64 * 1024 * 1024;
+
+/* Filter of a SELECT: WHERE column = value, column LIKE 'prefix%' or id BETWEEN a AND b */
+typedef struct
+{
+    bool present;
+    DbColumn column;
+    bool prefix;
+    uint32_t id;     // value, or first id of the range, when column is id
+    uint32_t end_id; // last id of the range when column is id
+    char value[COLUMN_EMAIL_SIZE + 1];
+} WhereClause;
+
+/* What a SELECT returns: the rows, or one value computed over them */
+typedef enum
+{
+    AGGREGATE_NONE,
+    AGGREGATE_COUNT,
+    AGGREGATE_MIN_ID,
+    AGGREGATE_MAX_ID
+} Aggregate;
+
+typedef struct
+{
+    StatementType type;
+    Row row_to_insert; // only used by insert statement
+    DbColumn columns[MAX_SELECTED_COLUMNS]; // only used by select statement
+    uint32_t num_columns;
+    WhereClause where;      // only used by select statement
+    Aggregate aggregate;    // only used by select statement
+    uint32_t limit;         // only used by select statement; UINT32_MAX for no limit
+    uint32_t offset;        // only used by select statement
+    DbColumn index_column;  // only used by create index statement
+
+    // INSERT INTO and SELECT ... FROM name a user table; the other fields describe the built-in one
+    DbTable *table;                                     // NULL for the built-in table
+    int64_t tuple[DB_MAX_TUPLE_SIZE / sizeof(int64_t)]; // only used by insert into; int64 so BIGINTs are aligned
+    uint32_t table_columns[DB_MAX_TABLE_COLUMNS];       // only used by select from, with num_columns
+    int32_t first_key;                                  // only used by select from
+    int32_t last_key;                                   // only used by select from
+    DbSchema schema;                                    // only used by create table statement
+} Statement;
+
+/*
+Init InputBuffer object
+*/
+InputBuffer *new_input_buffer()
+{
+    InputBuffer *input_buffer = malloc(sizeof(InputBuffer));
+    input_buffer->buffer = NULL;
+    input_buffer->buffer_length = 0;
+    input_buffer->input_length = 0;
+
+    return input_buffer;
+}
+
+void print_prompt(Session *session)
+{
+    if (!session->batch)
+    {
+        printf("db > ");
+    }
+}
+
+/* Reads one line into input_buffer. Returns false at end of input */
+bool read_input(Session *session, InputBuffer *input_buffer)
+{
+    ssize_t bytes_read =
+        getline(&(input_buffer->buffer), &(input_buffer->buffer_length), session->input);
+
+    if (bytes_read <= 0)
+    {
+        return false;
+    }
+    session->line_number++;
+
+    // Ignore trailing newline
+    if (input_buffer->buffer[bytes_read - 1] == '\n')
+    {
+        bytes_read--;
+    }
+    input_buffer->input_length = bytes_read;
+    input_buffer->buffer[bytes_read] = 0;
+    return true;
+}
+
+/* Prints an error: inline on stdout when interactive, on stderr with its line in batch mode */
+void report_error(Session *session, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    session->num_errors++;
+    if (session->batch)
+    {
+        fprintf(stderr, "line %u: ", session->line_number);
+        vfprintf(stderr, format, args);
+    }
+    else
+    {
+        vprintf(format, args);
+    }
+    va_end(args);
+}
+
+void close_input_buffer(InputBuffer *input_buffer)
+{
+    free(input_buffer->buffer);
+    free(input_buffer);
+}
+
+bool StartsWith(const char *a, const char *b)
+{
+    return strncmp(a, b, strlen(b)) == 0;
+}
+
+/* Prints count, mean, percentiles and max of each statement type run so far */
+void print_latency(Session *session)
+{
+    for (uint32_t type = 0; type < NUM_STATEMENT_TYPES; type++)
+    {
+        LatencyHistogram *histogram = &session->latency[type];
+        if (histogram->count == 0)
+        {
+            continue;
+        }
+        printf("%s: %llu run, mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+               STATEMENT_NAMES[type], (unsigned long long)histogram->count,
+               (double)histogram->sum / histogram->count / 1000.0, histogram_percentile(histogram, 50) / 1000.0,
+               histogram_percentile(histogram, 90) / 1000.0, histogram_percentile(histogram, 99) / 1000.0,
+               histogram_percentile(histogram, 99.9) / 1000.0, histogram->max / 1000.0);
+    }
+}
+
+/* Prints the CREATE TABLE statement of each user table */
+void print_schemas(Database *db)
+{
+    DbTable *table;
+    for (uint32_t i = 0; (table = db_table_at(db, i)) != NULL; i++)
+    {
+        const DbSchema *schema = db_table_schema(table);
+        printf("CREATE TABLE %s (", schema->name);
+        for (uint32_t column = 0; column < schema->num_columns; column++)
+        {
+            const DbColumnDef *definition = &schema->columns[column];
+            printf("%s%s %s", column ? ", " : "", definition->name, TYPE_NAMES[definition->type]);
+            if (definition->type == DB_TYPE_CHAR || definition->type == DB_TYPE_VARCHAR)
+            {
+                printf("(%u)", definition->length);
+            }
+        }
+        printf(")\n");
+    }
+}
+
+MetaCommandResult do_meta_command(Session *session, InputBuffer *input_buffer, Database *db, Output *output)
+{
+    if (strcmp(input_buffer->buffer, ".exit") == 0)
+    {
+        return META_COMMAND_EXIT;
+    }
+    else if (strcmp(input_buffer->buffer, ".constants") == 0)
+    {
+        db_print_constants();
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".btree") == 0)
+    {
+        db_print_btree(db);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (StartsWith(input_buffer->buffer, ".btree "))
+    {
+        // .btree username|email prints that column's index
+        const char *name = input_buffer->buffer + strlen(".btree ");
+        for (DbColumn column = DB_COLUMN_USERNAME; column <= DB_COLUMN_EMAIL; column++)
+        {
+            if (strcmp(name, COLUMN_NAMES[column]) == 0)
+            {
+                db_print_index(db, column);
+                return META_COMMAND_SUCCESS;
+            }
+        }
+        return META_COMMAND_UNRECOGNIZED_COMMAND;
+    }
+    else if (strcmp(input_buffer->buffer, ".backup") == 0)
+    {
+        uint32_t pages_copied, num_pages;
+        if (db_backup_progress(db, &pages_copied, &num_pages))
+        {
+            printf("Backup: %u of %u pages copied.\n", pages_copied, num_pages);
+        }
+        else
+        {
+            printf("No backup started.\n");
+        }
+        return META_COMMAND_SUCCESS;
+    }
+    else if (StartsWith(input_buffer->buffer, ".backup "))
+    {
+        // .backup path copies a snapshot in the background; .exit waits for it to finish
+        const char *path = input_buffer->buffer + strlen(".backup ");
+        if (db_backup_start(db, path, BACKUP_BYTES_PER_SECOND) != DB_OK)
+        {
+            printf("Could not start backup to '%s'.\n", path);
+        }
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".stats") == 0)
+    {
+        db_print_stats(db);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".stats reset") == 0)
+    {
+        db_reset_stats(db);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".timer on") == 0 || strcmp(input_buffer->buffer, ".timer off") == 0)
+    {
+        session->timer = strcmp(input_buffer->buffer, ".timer on") == 0;
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".latency") == 0)
+    {
+        print_latency(session);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".latency reset") == 0)
+    {
+        for (uint32_t type = 0; type < NUM_STATEMENT_TYPES; type++)
+        {
+            histogram_reset(&session->latency[type]);
+        }
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".trace off") == 0)
+    {
+        trace_stop();
+        return META_COMMAND_SUCCESS;
+    }
+    else if (StartsWith(input_buffer->buffer, ".trace "))
+    {
+        // .trace file records Chrome trace events of engine work until .trace off or exit
+        const char *path = input_buffer->buffer + strlen(".trace ");
+        if (!trace_start(path))
+        {
+            printf("Could not trace to '%s'.\n", path);
+        }
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".analyze") == 0)
+    {
+        db_print_analysis(db);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".schema") == 0)
+    {
+        print_schemas(db);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strcmp(input_buffer->buffer, ".mode") == 0)
+    {
+        printf("%s\n", output_mode_name(output->mode));
+        return META_COMMAND_SUCCESS;
+    }
+    else if (StartsWith(input_buffer->buffer, ".mode "))
+    {
+        // .mode list|csv|tsv|binary
+        if (!output_parse_mode(input_buffer->buffer + strlen(".mode "), &output->mode))
+        {
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        }
+        return META_COMMAND_SUCCESS;
+    }
+    else
+    {
+        return META_COMMAND_UNRECOGNIZED_COMMAND;
+    }
+}
+
+/* Looks up a column by name; name need not be NUL-terminated */
+bool parse_column(const char *name, size_t length, DbColumn *column)
+{
+    for (uint32_t i = 0; i < sizeof(COLUMN_NAMES) / sizeof(COLUMN_NAMES[0]); i++)
+    {
+        if (strlen(COLUMN_NAMES[i]) == length && strncmp(name, COLUMN_NAMES[i], length) == 0)
+        {
+            *column = (DbColumn)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Parses an unsigned 32 bit number at the start of text, storing where it ends in rest */
+bool parse_u32(const char *text, const char **rest, uint32_t *value)
+{
+    char *end;
+    unsigned long number = strtoul(text, &end, 10);
+    if (end == text || *text == '-' || number > UINT32_MAX)
+    {
+        return false;
+    }
+    *value = number;
+    *rest = end;
+    return true;
+}
+
+/* Parses a signed 32 bit number at the start of text, storing where it ends in rest */
+bool parse_i32(const char *text, const char **rest, int32_t *value)
+{
+    char *end;
+    errno = 0;
+    long number = strtol(text, &end, 10);
+    if (end == text || errno == ERANGE || number < INT32_MIN || number > INT32_MAX)
+    {
+        return false;
+    }
+    *value = number;
+    *rest = end;
+    return true;
+}
+
+/* Copies the table or column name at the start of *text into name, moving *text past it */
+bool parse_name(const char **text, char *name)
+{
+    static const char NAME_CHARACTERS[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+
+    size_t length = strspn(*text, NAME_CHARACTERS);
+    if (length == 0 || length > DB_MAX_NAME_LENGTH)
+    {
+        return false;
+    }
+    memcpy(name, *text, length);
+    name[length] = '\0';
+    *text += length;
+    return true;
+}
+
+/*
+Parses "column = value", "column LIKE 'prefix%'" or "id BETWEEN first AND last" after WHERE
+Values may be quoted with single quotes. Only a trailing % is supported in LIKE
+*/
+PrepareResult prepare_where(const char *clause, WhereClause *where)
+{
+    clause += strspn(clause, " ");
+    size_t name_length = strcspn(clause, " =");
+    if (!parse_column(clause, name_length, &where->column))
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    clause += name_length;
+    clause += strspn(clause, " ");
+
+    if (where->column == DB_COLUMN_ID && StartsWith(clause, "BETWEEN "))
+    {
+        clause += strlen("BETWEEN ");
+        clause += strspn(clause, " ");
+        if (!parse_u32(clause, &clause, &where->id) || !StartsWith(clause, " AND "))
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        clause += strlen(" AND ");
+        clause += strspn(clause, " ");
+        if (!parse_u32(clause, &clause, &where->end_id) || clause[strspn(clause, " ")] != '\0')
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        where->present = true;
+        return PREPARE_STATEMENT_SUCCESS;
+    }
+
+    bool like = false;
+    if (*clause == '=')
+    {
+        clause++;
+    }
+    else if (StartsWith(clause, "LIKE "))
+    {
+        like = true;
+        clause += strlen("LIKE ");
+    }
+    else
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    clause += strspn(clause, " ");
+
+    const char *value = clause;
+    size_t value_length;
+    if (*clause == '\'')
+    {
+        value++;
+        const char *closing_quote = strchr(value, '\'');
+        if (closing_quote == NULL)
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        value_length = closing_quote - value;
+        clause = closing_quote + 1;
+    }
+    else
+    {
+        value_length = strcspn(clause, " ");
+        clause += value_length;
+    }
+    clause += strspn(clause, " ");
+    if (*clause != '\0' || value_length > COLUMN_EMAIL_SIZE)
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+
+    memcpy(where->value, value, value_length);
+    where->value[value_length] = '\0';
+    where->prefix = false;
+    if (like)
+    {
+        char *wildcard = strchr(where->value, '%');
+        if (wildcard && wildcard != where->value + value_length - 1)
+        {
+            // only prefix patterns can use the index
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        if (wildcard)
+        {
+            *wildcard = '\0';
+            where->prefix = true;
+        }
+    }
+
+    if (where->column == DB_COLUMN_ID)
+    {
+        char *end;
+        unsigned long id = strtoul(where->value, &end, 10);
+        if (like || value_length == 0 || *end != '\0' || id > UINT32_MAX)
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        where->id = id;
+        where->end_id = id;
+    }
+
+    where->present = true;
+    return PREPARE_STATEMENT_SUCCESS;
+}
+
+/* Parses "LIMIT count" optionally followed by "OFFSET count" */
+PrepareResult prepare_limit(const char *clause, Statement *statement)
+{
+    clause += strspn(clause, " ");
+    if (!parse_u32(clause, &clause, &statement->limit))
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    clause += strspn(clause, " ");
+    if (StartsWith(clause, "OFFSET "))
+    {
+        clause += strlen("OFFSET ");
+        clause += strspn(clause, " ");
+        if (!parse_u32(clause, &clause, &statement->offset))
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        clause += strspn(clause, " ");
+    }
+    return *clause == '\0' ? PREPARE_STATEMENT_SUCCESS : PREPARE_STATEMENT_SYNTAX_ERROR;
+}
+
+/* Recognizes COUNT(*), MIN(id) and MAX(id) as the whole column list */
+bool parse_aggregate(const char *columns, const char *end, Aggregate *aggregate)
+{
+    static const char *AGGREGATE_NAMES[] = {"COUNT(*)", "MIN(id)", "MAX(id)"};
+
+    while (end > columns && end[-1] == ' ')
+    {
+        end--;
+    }
+    for (uint32_t i = 0; i < sizeof(AGGREGATE_NAMES) / sizeof(AGGREGATE_NAMES[0]); i++)
+    {
+        if (strlen(AGGREGATE_NAMES[i]) == (size_t)(end - columns) && strncmp(columns, AGGREGATE_NAMES[i], end - columns) == 0)
+        {
+            *aggregate = (Aggregate)(AGGREGATE_COUNT + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+Parses the rest of a SELECT on a user table: the column list up to from, then
+"FROM name" and an optional "WHERE key = value" or "WHERE key BETWEEN first AND
+last" on the table's first column. The LIMIT clause was already taken off
+*/
+PrepareResult prepare_select_from(Database *db, char *columns, char *from, Statement *statement)
+{
+    const char *clause = from + strlen(" FROM ");
+    clause += strspn(clause, " ");
+    char name[DB_MAX_NAME_LENGTH + 1];
+    if (!parse_name(&clause, name))
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    statement->table = db_table(db, name);
+    if (statement->table == NULL)
+    {
+        return PREPARE_STATEMENT_UNKNOWN_TABLE;
+    }
+    const DbSchema *schema = db_table_schema(statement->table);
+
+    statement->first_key = INT32_MIN;
+    statement->last_key = INT32_MAX;
+    clause += strspn(clause, " ");
+    if (StartsWith(clause, "WHERE "))
+    {
+        clause += strlen("WHERE ");
+        clause += strspn(clause, " ");
+        size_t name_length = strcspn(clause, " =");
+        if (name_length != strlen(schema->columns[0].name) || strncmp(clause, schema->columns[0].name, name_length) != 0)
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR; // only the key can be searched
+        }
+        clause += name_length;
+        clause += strspn(clause, " ");
+        if (*clause == '=')
+        {
+            clause++;
+            if (!parse_i32(clause, &clause, &statement->first_key))
+            {
+                return PREPARE_STATEMENT_SYNTAX_ERROR;
+            }
+            statement->last_key = statement->first_key;
+        }
+        else if (StartsWith(clause, "BETWEEN "))
+        {
+            clause += strlen("BETWEEN ");
+            if (!parse_i32(clause, &clause, &statement->first_key) || !StartsWith(clause, " AND ") ||
+                !parse_i32(clause + strlen(" AND "), &clause, &statement->last_key))
+            {
+                return PREPARE_STATEMENT_SYNTAX_ERROR;
+            }
+        }
+        else
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        clause += strspn(clause, " ");
+    }
+    if (*clause != '\0')
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+
+    *from = '\0';
+    columns += strspn(columns, " ");
+    if (*columns == '\0' || (*columns == '*' && columns[1 + strspn(columns + 1, " ")] == '\0'))
+    {
+        for (uint32_t column = 0; column < schema->num_columns; column++)
+        {
+            statement->table_columns[column] = column;
+        }
+        statement->num_columns = schema->num_columns;
+        return PREPARE_STATEMENT_SUCCESS;
+    }
+
+    statement->num_columns = 0;
+    while (true)
+    {
+        size_t name_length = strcspn(columns, " ,");
+        uint32_t column = 0;
+        while (column < schema->num_columns && (strlen(schema->columns[column].name) != name_length ||
+                                                strncmp(columns, schema->columns[column].name, name_length) != 0))
+        {
+            column++;
+        }
+        if (column == schema->num_columns || statement->num_columns == DB_MAX_TABLE_COLUMNS)
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        statement->table_columns[statement->num_columns++] = column;
+
+        columns += name_length;
+        columns += strspn(columns, " ");
+        if (*columns == '\0')
+        {
+            return PREPARE_STATEMENT_SUCCESS;
+        }
+        if (*columns != ',')
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        columns++;
+        columns += strspn(columns, " ");
+    }
+}
+
+/*
+Parses what follows SELECT: a column list, empty or "*" for every column,
+otherwise comma separated names such as "id, username", or one of COUNT(*),
+MIN(id) and MAX(id). Then "FROM table" for a user table, an optional WHERE
+clause and an optional LIMIT clause
+*/
+PrepareResult prepare_select(Database *db, char *columns, Statement *statement)
+{
+    statement->where.present = false;
+    statement->aggregate = AGGREGATE_NONE;
+    statement->limit = UINT32_MAX;
+    statement->offset = 0;
+
+    char *limit = strstr(columns, " LIMIT ");
+    if (limit)
+    {
+        PrepareResult result = prepare_limit(limit + strlen(" LIMIT "), statement);
+        if (result != PREPARE_STATEMENT_SUCCESS)
+        {
+            return result;
+        }
+        *limit = '\0'; // the rest is parsed as if the clause were absent
+    }
+
+    char *from = strstr(columns, " FROM ");
+    const char *end = strstr(columns, " WHERE ");
+    if (from && (end == NULL || from < end))
+    {
+        return prepare_select_from(db, columns, from, statement);
+    }
+
+    if (end)
+    {
+        PrepareResult result = prepare_where(end + strlen(" WHERE "), &statement->where);
+        if (result != PREPARE_STATEMENT_SUCCESS)
+        {
+            return result;
+        }
+    }
+    else
+    {
+        end = columns + strlen(columns);
+    }
+
+    columns += strspn(columns, " ");
+    if (columns < end && parse_aggregate(columns, end, &statement->aggregate))
+    {
+        return PREPARE_STATEMENT_SUCCESS;
+    }
+    if (columns >= end || (*columns == '*' && columns + 1 + strspn(columns + 1, " ") >= end))
+    {
+        statement->columns[0] = DB_COLUMN_ID;
+        statement->columns[1] = DB_COLUMN_USERNAME;
+        statement->columns[2] = DB_COLUMN_EMAIL;
+        statement->num_columns = 3;
+        return PREPARE_STATEMENT_SUCCESS;
+    }
+
+    statement->num_columns = 0;
+    while (true)
+    {
+        size_t name_length = strcspn(columns, " ,");
+        DbColumn column;
+        if (!parse_column(columns, name_length, &column) || statement->num_columns == MAX_SELECTED_COLUMNS)
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        statement->columns[statement->num_columns++] = column;
+
+        columns += name_length;
+        columns += strspn(columns, " ");
+        if (columns >= end)
+        {
+            return PREPARE_STATEMENT_SUCCESS;
+        }
+        if (*columns != ',')
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        columns++;
+        columns += strspn(columns, " ");
+    }
+}
+
+/* Parses "CREATE INDEX ON column" for the username or email column */
+PrepareResult prepare_create_index(const char *input, Statement *statement)
+{
+    statement->type = STATEMENT_CREATE_INDEX;
+    if (!StartsWith(input, "CREATE INDEX ON "))
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+
+    const char *name = input + strlen("CREATE INDEX ON ");
+    name += strspn(name, " ");
+    size_t name_length = strcspn(name, " ");
+    if (!parse_column(name, name_length, &statement->index_column) ||
+        name[name_length + strspn(name + name_length, " ")] != '\0')
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    return PREPARE_STATEMENT_SUCCESS;
+}
+
+/* Parses INT, BIGINT, CHAR(length) or VARCHAR(length) at the start of *text, moving *text past it */
+bool parse_type(const char **text, DbColumnDef *column)
+{
+    const char *type = *text;
+    size_t length = strspn(type, "ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+    for (DbType i = DB_TYPE_INT; i <= DB_TYPE_VARCHAR; i++)
+    {
+        if (strlen(TYPE_NAMES[i]) == length && strncmp(type, TYPE_NAMES[i], length) == 0)
+        {
+            column->type = i;
+            column->length = 0;
+            *text += length;
+            if (i != DB_TYPE_CHAR && i != DB_TYPE_VARCHAR)
+            {
+                return true;
+            }
+            // strings take their length in parentheses
+            const char *rest;
+            if (**text != '(' || !parse_u32(*text + 1, &rest, &column->length) || *rest != ')')
+            {
+                return false;
+            }
+            *text = rest + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+Parses "CREATE TABLE name (column TYPE, ...)". Whether the schema is valid, e.g.
+the first column an INT, is left to db_create_table
+*/
+PrepareResult prepare_create_table(const char *input, Statement *statement)
+{
+    statement->type = STATEMENT_CREATE_TABLE;
+    DbSchema *schema = &statement->schema;
+    memset(schema, 0, sizeof(*schema));
+
+    const char *clause = input + strlen("CREATE TABLE ");
+    clause += strspn(clause, " ");
+    if (!parse_name(&clause, schema->name))
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    clause += strspn(clause, " ");
+    if (*clause != '(')
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+
+    do
+    {
+        clause++; // past the ( or ,
+        clause += strspn(clause, " ");
+        if (schema->num_columns == DB_MAX_TABLE_COLUMNS)
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        DbColumnDef *column = &schema->columns[schema->num_columns++];
+        if (!parse_name(&clause, column->name) || *clause != ' ')
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        clause += strspn(clause, " ");
+        if (!parse_type(&clause, column))
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        clause += strspn(clause, " ");
+    } while (*clause == ',');
+
+    if (*clause != ')' || clause[1 + strspn(clause + 1, " ")] != '\0')
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    return PREPARE_STATEMENT_SUCCESS;
+}
+
+/*
+Parses one value of INSERT INTO into its place in the tuple: a number, or a
+string, quoted with single quotes if it holds spaces, commas or parentheses
+*/
+bool parse_value(const char **text, const DbColumnDef *column, uint8_t *destination)
+{
+    const char *value = *text;
+    if (column->type == DB_TYPE_INT || column->type == DB_TYPE_BIGINT)
+    {
+        char *end;
+        errno = 0;
+        long long number = strtoll(value, &end, 10);
+        if (end == value || errno == ERANGE || (column->type == DB_TYPE_INT && (number < INT32_MIN || number > INT32_MAX)))
+        {
+            return false;
+        }
+        if (column->type == DB_TYPE_INT)
+        {
+            int32_t number32 = number;
+            memcpy(destination, &number32, sizeof(number32));
+        }
+        else
+        {
+            int64_t number64 = number;
+            memcpy(destination, &number64, sizeof(number64));
+        }
+        *text = end;
+        return true;
+    }
+
+    size_t length;
+    if (*value == '\'')
+    {
+        value++;
+        const char *closing_quote = strchr(value, '\'');
+        if (closing_quote == NULL)
+        {
+            return false;
+        }
+        length = closing_quote - value;
+        *text = closing_quote + 1;
+    }
+    else
+    {
+        length = strcspn(value, " ,)");
+        *text = value + length;
+        if (length == 0)
+        {
+            return false;
+        }
+    }
+    if (length > column->length)
+    {
+        return false;
+    }
+    memcpy(destination, value, length);
+    destination[length] = '\0';
+    return true;
+}
+
+/* Parses "INSERT INTO name VALUES (value, ...)" with a value for every column of the table */
+PrepareResult prepare_insert_into(Database *db, const char *input, Statement *statement)
+{
+    statement->type = STATEMENT_INSERT;
+    const char *clause = input + strlen("INSERT INTO ");
+    clause += strspn(clause, " ");
+    char name[DB_MAX_NAME_LENGTH + 1];
+    if (!parse_name(&clause, name))
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    clause += strspn(clause, " ");
+    if (!StartsWith(clause, "VALUES"))
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    clause += strlen("VALUES");
+    clause += strspn(clause, " ");
+    if (*clause != '(')
+    {
+        return PREPARE_STATEMENT_SYNTAX_ERROR;
+    }
+    statement->table = db_table(db, name);
+    if (statement->table == NULL)
+    {
+        return PREPARE_STATEMENT_UNKNOWN_TABLE;
+    }
+
+    const DbSchema *schema = db_table_schema(statement->table);
+    uint8_t *tuple = (uint8_t *)statement->tuple;
+    memset(tuple, 0, db_tuple_size(statement->table));
+    for (uint32_t column = 0; column < schema->num_columns; column++)
+    {
+        clause++; // past the ( or ,
+        clause += strspn(clause, " ");
+        if (!parse_value(&clause, &schema->columns[column], tuple + db_tuple_offset(statement->table, column)))
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        clause += strspn(clause, " ");
+        if (*clause != (column + 1 < schema->num_columns ? ',' : ')'))
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+    }
+    return clause[1 + strspn(clause + 1, " ")] == '\0' ? PREPARE_STATEMENT_SUCCESS : PREPARE_STATEMENT_SYNTAX_ERROR;
+}
+
+/*
+Parses input and constructs Statement. User tables named in it are looked up
+in db, so their values can be checked against the schema here
+*/
+PrepareResult prepare_statement(Database *db, InputBuffer *input_buffer, Statement *statement)
+{
+    statement->table = NULL;
+
+    if (StartsWith(input_buffer->buffer, "SELECT"))
+    {
+        // handle input starting with SELECT
+        statement->type = STATEMENT_SELECT;
+        return prepare_select(db, input_buffer->buffer + strlen("SELECT"), statement);
+    }
+
+    if (StartsWith(input_buffer->buffer, "INSERT INTO "))
+    {
+        return prepare_insert_into(db, input_buffer->buffer, statement);
+    }
+
+    if (StartsWith(input_buffer->buffer, "INSERT"))
+    {
+        // handle input starting with INSERT
+        statement->type = STATEMENT_INSERT;
+
+        // parse "insert 1 cstack foo@bar.com" -> id, username, email
+        int inputs_matched = sscanf(input_buffer->buffer, "INSERT %d %s %s",
+                                    &(statement->row_to_insert.id),
+                                    statement->row_to_insert.username,
+                                    statement->row_to_insert.email);
+
+        if (inputs_matched != 3)
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+
+        return PREPARE_STATEMENT_SUCCESS;
+    }
+
+    if (StartsWith(input_buffer->buffer, "UPDATE"))
+    {
+        // "UPDATE 1 cstack foo@bar.com" replaces the username and email of row 1
+        statement->type = STATEMENT_UPDATE;
+        // widths are COLUMN_USERNAME_SIZE and COLUMN_EMAIL_SIZE; a string that goes on past its width is too long
+        int username_end = 0, email_end = 0;
+        int inputs_matched = sscanf(input_buffer->buffer, "UPDATE %d %32s%n %255s%n",
+                                    &(statement->row_to_insert.id),
+                                    statement->row_to_insert.username, &username_end,
+                                    statement->row_to_insert.email, &email_end);
+        if (inputs_matched != 3)
+        {
+            return PREPARE_STATEMENT_SYNTAX_ERROR;
+        }
+        const char *buffer = input_buffer->buffer;
+        if (!isspace((unsigned char)buffer[username_end]) ||
+            (buffer[email_end] != '\0' && !isspace((unsigned char)buffer[email_end])))
+        {
+            return PREPARE_STRING_TOO_LONG;
+        }
+        return PREPARE_STATEMENT_SUCCESS;
+    }
+
+    if (StartsWith(input_buffer->buffer, "CREATE TABLE "))
+    {
+        return prepare_create_table(input_buffer->buffer, statement);
+    }
+
+    if (StartsWith(input_buffer->buffer, "CREATE"))
+    {
+        return prepare_create_index(input_buffer->buffer, statement);
+    }
+
+    if (strcmp(input_buffer->buffer, "VACUUM") == 0)
+    {
+        statement->type = STATEMENT_VACUUM;
+        return PREPARE_STATEMENT_SUCCESS;
+    }
+
+    // all other inputs, return not recognized
+    return PREPARE_STATEMENT_UNRECOGNIZED_COMMAND;
+}
+
+ExecuteResult execute_insert(Database *db, Statement *statement)
+{
+    Row *row_to_insert = &(statement->row_to_insert);
+    DbResult result = statement->table ? db_table_put(db, statement->table, statement->tuple) : db_put(db, row_to_insert);
+
+    switch (result)
+    {
+    case (DB_OK):
+        return EXECUTE_STATEMENT_SUCCESS;
+    case (DB_DUPLICATE_KEY):
+        return EXECUTE_DUPLICATE_KEY;
+    case (DB_TABLE_FULL):
+        return EXECUTE_STATEMENT_TABLE_FULL;
+    default:
+        return EXECUTE_STATEMENT_ERROR;
+    }
+}
+
+ExecuteResult execute_update(Database *db, Statement *statement)
+{
+    switch (db_update(db, &(statement->row_to_insert)))
+    {
+    case (DB_OK):
+        return EXECUTE_STATEMENT_SUCCESS;
+    case (DB_NOT_FOUND):
+        return EXECUTE_KEY_NOT_FOUND;
+    default:
+        return EXECUTE_INDEXED_COLUMN_CHANGED;
+    }
+}
+
+/* Prints the selected columns straight from the page; unselected columns are never read */
+void print_row(Output *output, Statement *statement, RowView *row)
+{
+    output_begin_row(output);
+    for (uint32_t i = 0; i < statement->num_columns; i++)
+    {
+        switch (statement->columns[i])
+        {
+        case (DB_COLUMN_ID):
+            output_u32(output, row->id);
+            break;
+        case (DB_COLUMN_USERNAME):
+            output_string(output, row->username, COLUMN_USERNAME_SIZE);
+            break;
+        case (DB_COLUMN_EMAIL):
+            output_string(output, row->email, COLUMN_EMAIL_SIZE);
+            break;
+        }
+    }
+    output_end_row(output);
+}
+
+/* Returns an iterator over the rows matching the WHERE clause, or every row */
+DbIterator *scan_where(Database *db, WhereClause *where)
+{
+    if (!where->present)
+    {
+        return db_scan(db, 0, UINT32_MAX);
+    }
+    if (where->column == DB_COLUMN_ID)
+    {
+        return db_scan(db, where->id, where->end_id);
+    }
+    // uses the column's index when it has one
+    return db_scan_column(db, where->column, where->value, where->prefix);
+}
+
+void print_value(Output *output, uint32_t value)
+{
+    output_begin_row(output);
+    output_u32(output, value);
+    output_end_row(output);
+}
+
+/*
+Computes COUNT(*), MIN(id) or MAX(id). Over an id range these use the row
+counts in the tree instead of visiting the rows; MIN and MAX print nothing when
+no row matches
+*/
+void execute_aggregate(Database *db, Statement *statement, Output *output)
+{
+    WhereClause *where = &statement->where;
+    RowView row;
+
+    if (!where->present || where->column == DB_COLUMN_ID)
+    {
+        uint32_t start_id = where->present ? where->id : 0;
+        uint32_t end_id = where->present ? where->end_id : UINT32_MAX;
+        uint32_t count = db_count(db, start_id, end_id);
+        if (statement->aggregate == AGGREGATE_COUNT)
+        {
+            print_value(output, count);
+            return;
+        }
+
+        DbIterator *iterator = db_scan(db, start_id, end_id);
+        if (statement->aggregate == AGGREGATE_MAX_ID && count > 0)
+        {
+            db_iterator_skip(iterator, count - 1);
+        }
+        if (db_iterator_next_view(iterator, &row))
+        {
+            print_value(output, row.id);
+        }
+        db_iterator_close(iterator);
+        return;
+    }
+
+    uint32_t count = 0, min_id = UINT32_MAX, max_id = 0;
+    DbIterator *iterator = scan_where(db, where);
+    while (db_iterator_next_view(iterator, &row))
+    {
+        count++;
+        min_id = row.id < min_id ? row.id : min_id;
+        max_id = row.id > max_id ? row.id : max_id;
+    }
+    db_iterator_close(iterator);
+
+    if (statement->aggregate == AGGREGATE_COUNT)
+    {
+        print_value(output, count);
+    }
+    else if (count > 0)
+    {
+        print_value(output, statement->aggregate == AGGREGATE_MIN_ID ? min_id : max_id);
+    }
+}
+
+/* Prints the selected columns of a user table's tuple */
+void print_tuple(Output *output, Statement *statement, const uint8_t *tuple)
+{
+    const DbSchema *schema = db_table_schema(statement->table);
+    output_begin_row(output);
+    for (uint32_t i = 0; i < statement->num_columns; i++)
+    {
+        uint32_t column = statement->table_columns[i];
+        const uint8_t *value = tuple + db_tuple_offset(statement->table, column);
+        switch (schema->columns[column].type)
+        {
+        case (DB_TYPE_INT):
+        {
+            int32_t number;
+            memcpy(&number, value, sizeof(number));
+            output_i32(output, number);
+            break;
+        }
+        case (DB_TYPE_BIGINT):
+        {
+            int64_t number;
+            memcpy(&number, value, sizeof(number));
+            output_i64(output, number);
+            break;
+        }
+        case (DB_TYPE_CHAR):
+        case (DB_TYPE_VARCHAR):
+            output_string(output, (const char *)value, schema->columns[column].length);
+            break;
+        }
+    }
+    output_end_row(output);
+}
+
+ExecuteResult execute_select_from(Database *db, Statement *statement, Output *output)
+{
+    int64_t tuple[DB_MAX_TUPLE_SIZE / sizeof(int64_t)];
+    DbIterator *iterator = db_table_scan(db, statement->table, statement->first_key, statement->last_key);
+    db_iterator_skip(iterator, statement->offset);
+    for (uint32_t i = 0; i < statement->limit && db_iterator_next_tuple(iterator, tuple); i++)
+    {
+        print_tuple(output, statement, (const uint8_t *)tuple);
+    }
+    db_iterator_close(iterator);
+    output_flush(output);
+    return EXECUTE_STATEMENT_SUCCESS;
+}
+
+ExecuteResult execute_select(Database *db, Statement *statement, Output *output)
+{
+    if (statement->table)
+    {
+        return execute_select_from(db, statement, output);
+    }
+    if (statement->aggregate != AGGREGATE_NONE)
+    {
+        execute_aggregate(db, statement, output);
+        output_flush(output);
+        return EXECUTE_STATEMENT_SUCCESS;
+    }
+
+    RowView row;
+    DbIterator *iterator = scan_where(db, &statement->where);
+
+    // an id scan seeks past the offset using the row counts in the tree
+    db_iterator_skip(iterator, statement->offset);
+
+    // for each row up to the limit, print
+    for (uint32_t i = 0; i < statement->limit && db_iterator_next_view(iterator, &row); i++)
+    {
+        print_row(output, statement, &row);
+    }
+
+    db_iterator_close(iterator);
+    output_flush(output);
+
+    return EXECUTE_STATEMENT_SUCCESS;
+}
+
+ExecuteResult execute_create_index(Database *db, Statement *statement)
+{
+    switch (db_create_index(db, statement->index_column))
+    {
+    case (DB_OK):
+        return EXECUTE_STATEMENT_SUCCESS;
+    case (DB_DUPLICATE_KEY):
+        return EXECUTE_INDEX_EXISTS;
+    case (DB_TABLE_FULL):
+        return EXECUTE_STATEMENT_TABLE_FULL;
+    default:
+        return EXECUTE_STATEMENT_ERROR;
+    }
+}
+
+ExecuteResult execute_create_table(Database *db, Statement *statement)
+{
+    switch (db_create_table(db, &statement->schema))
+    {
+    case (DB_OK):
+        return EXECUTE_STATEMENT_SUCCESS;
+    case (DB_DUPLICATE_KEY):
+        return EXECUTE_TABLE_EXISTS;
+    case (DB_TABLE_FULL):
+        return EXECUTE_STATEMENT_TABLE_FULL;
+    default:
+        return EXECUTE_INVALID_TABLE;
+    }
+}
+
+ExecuteResult execute_vacuum(Database *db)
+{
+    return db_vacuum(db) == DB_OK ? EXECUTE_STATEMENT_SUCCESS : EXECUTE_STATEMENT_TABLE_FULL;
+}
+
+ExecuteResult execute_statement(Database *db, Statement *statement, Output *output)
+{
+    switch (statement->type)
+    {
+    case (STATEMENT_INSERT):
+        return execute_insert(db, statement);
+    case (STATEMENT_SELECT):
+        return execute_select(db, statement, output);
+    case (STATEMENT_CREATE_INDEX):
+        return execute_create_index(db, statement);
+    case (STATEMENT_VACUUM):
+        return execute_vacuum(db);
+    case (STATEMENT_UPDATE):
+        return execute_update(db, statement);
+    case (STATEMENT_CREATE_TABLE):
+        return execute_create_table(db, statement);
+    }
+    return EXECUTE_STATEMENT_ERROR;
+}
+
+/* Key of the row an INSERT statement inserts, for error messages */
+int32_t inserted_key(Statement *statement)
+{
+    int32_t key = statement->row_to_insert.id;
+    if (statement->table)
+    {
+        memcpy(&key, statement->tuple, sizeof(key)); // the first column
+    }
+    return key;
+}
+
+void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--batch] [--direct] [--buffered] [--memory] [--compress] [--changes] [--checkpoint ms] [-f script.sql] [filename]\n", program);
+}
+
+/* Closes everything down and returns the process exit status */
+int finish_session(Session *session, InputBuffer *input_buffer, Output *output, Database *db)
+{
+    output_close(output);
+    close_input_buffer(input_buffer);
+    db_close(db);
+    trace_stop(); // after db_close, so its flushes are in the trace
+    if (session->input != stdin)
+    {
+        fclose(session->input);
+    }
+
+    if (session->batch)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%u statements, %u errors\n", session->num_statements, session->num_errors);
+    }
+    return session->batch && session->num_errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    Session session = {.batch = false, .input = stdin};
+    for (uint32_t type = 0; type < NUM_STATEMENT_TYPES; type++)
+    {
+        histogram_reset(&session.latency[type]);
+    }
+    static struct option long_options[] = {
+        {"batch", no_argument, NULL, 'b'},
+        {"file", required_argument, NULL, 'f'},
+        {"direct", no_argument, NULL, 'd'},
+        {"checkpoint", required_argument, NULL, 'c'},
+        {"buffered", no_argument, NULL, 'u'},
+        {"memory", no_argument, NULL, 'm'},
+        {"compress", no_argument, NULL, 'z'},
+        {"changes", no_argument, NULL, 'l'},
+        {NULL, 0, NULL, 0},
+    };
+
+    uint32_t open_flags = 0;
+    // --checkpoint starts a background flusher that trickles out settled pages between checkpoints
+    DbFlusherOptions flusher = {.interval_ms = 10, .max_pages = 16, .min_age_ms = 100, .checkpoint_ms = 0};
+    int option;
+    while ((option = getopt_long(argc, argv, "bdf:c:umzl", long_options, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case 'b':
+            session.batch = true;
+            break;
+        case 'd':
+            open_flags |= DB_OPEN_DIRECT_IO;
+            break;
+        case 'u':
+            open_flags |= DB_OPEN_BUFFERED_INSERTS;
+            break;
+        case 'm':
+            open_flags |= DB_OPEN_IN_MEMORY;
+            break;
+        case 'z':
+            open_flags |= DB_OPEN_COMPRESSED;
+            break;
+        case 'l':
+            open_flags |= DB_OPEN_CHANGE_LOG;
+            break;
+        case 'c':
+            flusher.checkpoint_ms = strtoul(optarg, NULL, 10);
+            if (flusher.checkpoint_ms == 0)
+            {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+            session.batch = true;
+            session.input = fopen(optarg, "r");
+            if (session.input == NULL)
+            {
+                perror(optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind > 1)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *filename = optind < argc ? argv[optind] : "data.db";
+
+    if (session.batch)
+    {
+        // results are consumed by programs, so trade latency for fewer writes
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    }
+
+    InputBuffer *input_buffer = new_input_buffer();
+    Output *output = output_open(stdout, 1 << 20);
+    Database *db = db_open_with_flags(filename, open_flags);
+    if (flusher.checkpoint_ms)
+    {
+        db_start_flusher(db, &flusher);
+    }
+
+    while (true)
+    {
+        print_prompt(&session);
+        if (!read_input(&session, input_buffer))
+        {
+            break;
+        }
+
+        // printf("Command: '%s'.\n", input_buffer->buffer);
+
+        if (session.batch && (input_buffer->input_length == 0 || StartsWith(input_buffer->buffer, "--")))
+        {
+            // blank lines and comments in scripts
+            continue;
+        }
+        session.num_statements++;
+
+        if (input_buffer->buffer[0] == '.')
+        {
+            switch (do_meta_command(&session, input_buffer, db, output))
+            {
+            case (META_COMMAND_SUCCESS):
+                continue;
+            case (META_COMMAND_EXIT):
+                return finish_session(&session, input_buffer, output, db);
+            case (META_COMMAND_UNRECOGNIZED_COMMAND):
+                report_error(&session, "Unrecognized command '%s'.\n", input_buffer->buffer);
+                continue;
+            }
+        }
+
+        // prepare result by converting input to Statement
+        Statement statement;
+        switch (prepare_statement(db, input_buffer, &statement))
+        {
+        case (PREPARE_STATEMENT_SUCCESS):
+            break;
+        case (PREPARE_STRING_TOO_LONG):
+            report_error(&session, "String is too long.\n");
+            continue;
+        case (PREPARE_STATEMENT_SYNTAX_ERROR):
+            report_error(&session, "Syntax error in statement '%s'.\n", input_buffer->buffer);
+            continue;
+        case (PREPARE_STATEMENT_UNRECOGNIZED_COMMAND):
+            report_error(&session, "Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
+            continue;
+        case (PREPARE_STATEMENT_UNKNOWN_TABLE):
+            report_error(&session, "Unknown table in statement '%s'.\n", input_buffer->buffer);
+            continue;
+        }
+
+        // execute Statement
+        TRACE_BEGIN(span);
+        uint64_t start_ns = trace_clock_ns();
+        ExecuteResult result = execute_statement(db, &statement, output);
+        uint64_t elapsed_ns = trace_clock_ns() - start_ns;
+        histogram_record(&session.latency[statement.type], elapsed_ns);
+        TRACE_END(span, STATEMENT_NAMES[statement.type]);
+
+        switch (result)
+        {
+        case (EXECUTE_STATEMENT_SUCCESS):
+            if (!session.batch)
+            {
+                printf("Executed.\n");
+            }
+            break;
+        case (EXECUTE_STATEMENT_TABLE_FULL):
+            report_error(&session, "Failed to insert, table is full.\n");
+            break;
+        case (EXECUTE_DUPLICATE_KEY):
+            if (session.batch)
+            {
+                report_error(&session, "Key (%d) already exists in table\n", inserted_key(&statement));
+            }
+            else
+            {
+                printf("Key (%d) already exists in table\n", inserted_key(&statement));
+                report_error(&session, "Failed to insert, key already exists.\n");
+            }
+            break;
+        case (EXECUTE_INDEX_EXISTS):
+            report_error(&session, "Index on %s already exists.\n", COLUMN_NAMES[statement.index_column]);
+            break;
+        case (EXECUTE_KEY_NOT_FOUND):
+            report_error(&session, "Key (%d) not found.\n", statement.row_to_insert.id);
+            break;
+        case (EXECUTE_INDEXED_COLUMN_CHANGED):
+            report_error(&session, "Failed to update, an indexed column can't change.\n");
+            break;
+        case (EXECUTE_TABLE_EXISTS):
+            report_error(&session, "Table %s already exists.\n", statement.schema.name);
+            break;
+        case (EXECUTE_INVALID_TABLE):
+            report_error(&session, "Failed to create table %s, its schema is invalid.\n", statement.schema.name);
+            break;
+        case (EXECUTE_STATEMENT_ERROR):
+            report_error(&session, "Error executing statement, please retry.\n");
+        }
+        if (session.timer)
+        {
+            printf("Run Time: %.6f s\n", elapsed_ns / 1e9);
+        }
+    }
+
+    // end of input behaves like .exit
+    return finish_session(&session, input_buffer, output, db);
+}
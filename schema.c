@@ -0,0 +1,247 @@
+#include <ctype.h>
+#include <string.h>
+
+#include "schema.h"
+
+/* Names are letters, digits and underscores, not starting with a digit */
+static bool valid_name(const char *name)
+{
+    size_t length = strnlen(name, DB_MAX_NAME_LENGTH + 1);
+    if (length == 0 || length > DB_MAX_NAME_LENGTH || isdigit((unsigned char)name[0]))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Bytes and alignment of a column in the tuple, as a C struct member; false for an invalid column */
+static bool tuple_member(const DbColumnDef *column, uint32_t *size, uint32_t *alignment)
+{
+    switch (column->type)
+    {
+    case DB_TYPE_INT:
+        *size = *alignment = sizeof(int32_t);
+        return true;
+    case DB_TYPE_BIGINT:
+        *size = *alignment = sizeof(int64_t);
+        return true;
+    case DB_TYPE_CHAR:
+    case DB_TYPE_VARCHAR:
+        *size = column->length + 1;
+        *alignment = 1;
+        return column->length > 0 && column->length <= DB_MAX_STRING_LENGTH;
+    }
+    return false;
+}
+
+bool compile_codec(const DbSchema *schema, RowCodec *codec)
+{
+    if (!valid_name(schema->name) || schema->num_columns == 0 || schema->num_columns > DB_MAX_TABLE_COLUMNS ||
+        schema->columns[0].type != DB_TYPE_INT)
+    {
+        return false;
+    }
+
+    memset(codec, 0, sizeof(*codec));
+    uint32_t tuple_offset = 0, max_alignment = 1;
+    uint32_t record_offset = 0, string_bytes = 0;
+    for (uint32_t i = 0; i < schema->num_columns; i++)
+    {
+        const DbColumnDef *column = &schema->columns[i];
+        uint32_t size, alignment;
+        if (!valid_name(column->name) || !tuple_member(column, &size, &alignment))
+        {
+            return false;
+        }
+        for (uint32_t j = 0; j < i; j++)
+        {
+            if (strcmp(schema->columns[j].name, column->name) == 0)
+            {
+                return false;
+            }
+        }
+        tuple_offset = (tuple_offset + alignment - 1) / alignment * alignment;
+        codec->tuple_offsets[i] = tuple_offset;
+        max_alignment = alignment > max_alignment ? alignment : max_alignment;
+        if (i == 0)
+        {
+            // the key is the cell's key, not part of the record
+            tuple_offset += size;
+            continue;
+        }
+
+        CodecOp *last = codec->num_ops ? &codec->ops[codec->num_ops - 1] : NULL;
+        if (column->type == DB_TYPE_INT || column->type == DB_TYPE_BIGINT)
+        {
+            // records are packed, so a column right after the last one in the tuple extends its copy
+            if (last && last->type == CODEC_COPY && last->tuple_offset + last->size == tuple_offset)
+            {
+                last->size += size;
+            }
+            else
+            {
+                codec->ops[codec->num_ops++] = (CodecOp){CODEC_COPY, tuple_offset, record_offset, size};
+            }
+            record_offset += size;
+        }
+        else if (column->type == DB_TYPE_CHAR)
+        {
+            codec->ops[codec->num_ops++] = (CodecOp){CODEC_CHAR, tuple_offset, record_offset, column->length};
+            record_offset += column->length;
+        }
+        else
+        {
+            codec->ops[codec->num_ops++] = (CodecOp){CODEC_VARCHAR, tuple_offset, record_offset, column->length};
+            record_offset += 1;
+            string_bytes += column->length;
+        }
+        tuple_offset += size;
+    }
+    codec->tuple_size = (tuple_offset + max_alignment - 1) / max_alignment * max_alignment;
+    codec->packed_size = record_offset;
+    codec->record_size = record_offset + string_bytes;
+    return true;
+}
+
+void encode_tuple(const RowCodec *codec, const void *tuple, uint8_t *record)
+{
+    const uint8_t *in = tuple;
+    uint8_t *tail = record + codec->packed_size;
+    for (uint32_t i = 0; i < codec->num_ops; i++)
+    {
+        const CodecOp *op = &codec->ops[i];
+        const uint8_t *source = in + op->tuple_offset;
+        uint8_t *destination = record + op->record_offset;
+        switch (op->type)
+        {
+        case CODEC_COPY:
+            memcpy(destination, source, op->size);
+            break;
+        case CODEC_CHAR:
+        {
+            size_t length = strnlen((const char *)source, op->size);
+            memcpy(destination, source, length);
+            memset(destination + length, 0, op->size - length);
+            break;
+        }
+        case CODEC_VARCHAR:
+        {
+            size_t length = strnlen((const char *)source, op->size);
+            *destination = length;
+            memcpy(tail, source, length);
+            tail += length;
+            break;
+        }
+        }
+    }
+    // the whole cell is written, so unused bytes are zeros rather than whatever the buffer held
+    memset(tail, 0, record + codec->record_size - tail);
+}
+
+void decode_tuple(const RowCodec *codec, uint32_t key, const uint8_t *record, void *tuple)
+{
+    uint8_t *out = tuple;
+    int32_t id = decode_key(key);
+    memcpy(out, &id, sizeof(id)); // the key column comes first, at offset 0
+
+    const uint8_t *tail = record + codec->packed_size;
+    for (uint32_t i = 0; i < codec->num_ops; i++)
+    {
+        const CodecOp *op = &codec->ops[i];
+        const uint8_t *source = record + op->record_offset;
+        uint8_t *destination = out + op->tuple_offset;
+        switch (op->type)
+        {
+        case CODEC_COPY:
+            memcpy(destination, source, op->size);
+            break;
+        case CODEC_CHAR:
+            memcpy(destination, source, op->size);
+            destination[op->size] = '\0';
+            break;
+        case CODEC_VARCHAR:
+        {
+            // a damaged length is cut to the column's, so the read stays inside the cell
+            uint32_t length = *source < op->size ? *source : op->size;
+            memcpy(destination, tail, length);
+            destination[length] = '\0';
+            tail += length;
+            break;
+        }
+        }
+    }
+}
+
+static uint8_t *put_name(uint8_t *p, const char *name)
+{
+    size_t length = strnlen(name, DB_MAX_NAME_LENGTH);
+    *p++ = length;
+    memcpy(p, name, length);
+    return p + length;
+}
+
+uint32_t write_schema(const DbSchema *schema, uint8_t *destination, uint32_t capacity)
+{
+    // room for the largest schema, so the size is known before anything is written to destination
+    uint8_t buffer[1 + DB_MAX_NAME_LENGTH + 1 + DB_MAX_TABLE_COLUMNS * (1 + DB_MAX_NAME_LENGTH + 2)];
+    uint8_t *p = put_name(buffer, schema->name);
+    *p++ = schema->num_columns;
+    for (uint32_t i = 0; i < schema->num_columns && i < DB_MAX_TABLE_COLUMNS; i++)
+    {
+        const DbColumnDef *column = &schema->columns[i];
+        p = put_name(p, column->name);
+        *p++ = column->type;
+        *p++ = column->type == DB_TYPE_CHAR || column->type == DB_TYPE_VARCHAR ? column->length : 0;
+    }
+
+    uint32_t size = p - buffer;
+    if (size > capacity)
+    {
+        return 0;
+    }
+    memcpy(destination, buffer, size);
+    return size;
+}
+
+static const uint8_t *get_name(const uint8_t *p, const uint8_t *end, char *name)
+{
+    if (p == NULL || p >= end || *p > DB_MAX_NAME_LENGTH || end - p - 1 < *p)
+    {
+        return NULL;
+    }
+    memcpy(name, p + 1, *p);
+    name[*p] = '\0';
+    return p + 1 + *p;
+}
+
+uint32_t read_schema(const uint8_t *source, uint32_t length, DbSchema *schema)
+{
+    const uint8_t *end = source + length;
+    memset(schema, 0, sizeof(*schema));
+    const uint8_t *p = get_name(source, end, schema->name);
+    if (p == NULL || p >= end || *p > DB_MAX_TABLE_COLUMNS)
+    {
+        return 0;
+    }
+    schema->num_columns = *p++;
+    for (uint32_t i = 0; i < schema->num_columns; i++)
+    {
+        DbColumnDef *column = &schema->columns[i];
+        p = get_name(p, end, column->name);
+        if (p == NULL || end - p < 2)
+        {
+            return 0;
+        }
+        column->type = (DbType)p[0];
+        column->length = p[1];
+        p += 2;
+    }
+    return p - source;
+}
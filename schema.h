@@ -0,0 +1,74 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "db.h"
+
+/*
+Row codecs for user tables
+
+A schema is compiled once, when its table is created or opened, into a plan of
+copies between the tuple (the caller's struct) and the record stored in a leaf
+cell. Encoding and decoding then run that plan and never look at the schema:
+adjacent numeric columns are one memcpy, whatever their number, and only string
+columns take an op of their own.
+
+Record layout: the columns after the key, packed in order with no padding.
+INT is 4 bytes and BIGINT 8, CHAR(n) n bytes padded with NULs, VARCHAR(n) one
+length byte. The bytes of each VARCHAR follow the packed columns, in column
+order, and NULs fill the rest of the cell. The key is the cell's key.
+*/
+
+typedef enum
+{
+    CODEC_COPY,   // numeric columns, the same bytes in tuple and record
+    CODEC_CHAR,   // fixed size string, NUL padded in the record
+    CODEC_VARCHAR // length byte in the packed columns, the bytes after them
+} CodecOpType;
+
+typedef struct
+{
+    uint8_t type;
+    uint16_t tuple_offset;
+    uint16_t record_offset;
+    uint16_t size; // bytes copied, or the column's length for strings
+} CodecOp;
+
+typedef struct
+{
+    uint32_t tuple_size;
+    uint32_t tuple_offsets[DB_MAX_TABLE_COLUMNS];
+    uint32_t packed_size; // where VARCHAR bytes start in the record
+    uint32_t record_size; // the largest record: every VARCHAR at its full length
+    uint32_t num_ops;
+    CodecOp ops[DB_MAX_TABLE_COLUMNS];
+} RowCodec;
+
+/* Checks schema and compiles its codec; returns false if the schema is invalid */
+bool compile_codec(const DbSchema *schema, RowCodec *codec);
+
+void encode_tuple(const RowCodec *codec, const void *tuple, uint8_t *record);
+void decode_tuple(const RowCodec *codec, uint32_t key, const uint8_t *record, void *tuple);
+
+/* Keys are stored with the sign bit flipped, so unsigned order is signed order */
+static inline uint32_t encode_key(int32_t key)
+{
+    return (uint32_t)key ^ 0x80000000u;
+}
+
+static inline int32_t decode_key(uint32_t key)
+{
+    return (int32_t)(key ^ 0x80000000u);
+}
+
+/*
+Schemas as the catalog page stores them: name, uint8 column count, then for
+each column its name, uint8 type and uint8 length. Names are a uint8 length then
+the bytes
+*/
+uint32_t write_schema(const DbSchema *schema, uint8_t *destination, uint32_t capacity); // 0 if over capacity
+uint32_t read_schema(const uint8_t *source, uint32_t length, DbSchema *schema);       // 0 if malformed
+
+#endif
@@ -0,0 +1,568 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "db.h"
+#include "protocol.h"
+
+/*
+Local database server
+
+Serves one database file to many processes over a Unix domain socket using the
+pipelined binary protocol in protocol.h. A single epoll loop owns the database,
+so requests never run concurrently.
+
+Writes are group committed: every write handled in one pass of the event loop
+(or within the commit window given by -w) shares a single db_sync. Responses
+produced while a commit is pending are held back until the commit finishes, so
+a client never observes data that could still be lost.
+*/
+
+#define MAX_EVENTS 64
+#define READ_CHUNK (64 * 1024)
+#define OUTPUT_HIGH_WATER (4 * 1024 * 1024)
+#define SCAN_MAX_ROWS ((PROTO_MAX_FRAME - 16) / PROTO_MAX_ROW_SIZE)
+#define NO_HELD_OUTPUT SIZE_MAX
+
+typedef struct
+{
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+typedef struct
+{
+    int fd;
+    ByteBuffer input;   // bytes received but not yet parsed
+    ByteBuffer output;  // encoded responses
+    size_t output_sent; // bytes of output already written to the socket
+    size_t output_held; // output from this offset waits for the next commit
+    uint32_t events;    // epoll events currently registered
+    bool read_closed;   // peer finished sending
+    bool failed;        // socket error, drop without flushing
+} Connection;
+
+typedef struct
+{
+    Database *db;
+    int epoll_fd;
+    int listen_fd;
+    Connection **connections;
+    uint32_t num_connections;
+    uint32_t connections_capacity;
+    bool commit_pending;
+    uint64_t commit_deadline_ns;
+    uint64_t commit_window_ns;
+} Server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int signal_number)
+{
+    stop_requested = 1;
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void buffer_reserve(ByteBuffer *buffer, size_t extra)
+{
+    if (buffer->length + extra <= buffer->capacity)
+    {
+        return;
+    }
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra)
+    {
+        capacity *= 2;
+    }
+    buffer->data = realloc(buffer->data, capacity);
+    buffer->capacity = capacity;
+}
+
+/* Drops the first count bytes of buffer */
+static void buffer_consume(ByteBuffer *buffer, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    memmove(buffer->data, buffer->data + count, buffer->length - count);
+    buffer->length -= count;
+}
+
+static size_t output_pending(Connection *conn)
+{
+    return conn->output.length - conn->output_sent;
+}
+
+static void update_interest(Server *server, Connection *conn)
+{
+    uint32_t events = 0;
+    if (!conn->read_closed && output_pending(conn) < OUTPUT_HIGH_WATER)
+    {
+        events |= EPOLLIN;
+    }
+
+    size_t sendable = conn->output_held == NO_HELD_OUTPUT ? conn->output.length : conn->output_held;
+    if (sendable > conn->output_sent)
+    {
+        events |= EPOLLOUT;
+    }
+
+    if (events != conn->events)
+    {
+        struct epoll_event event = {.events = events, .data.ptr = conn};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = events;
+    }
+}
+
+/* Starts a response frame and returns its offset so the length can be patched in */
+static size_t begin_response(Server *server, Connection *conn, DbResult status, size_t payload_capacity)
+{
+    buffer_reserve(&conn->output, PROTO_LENGTH_SIZE + 1 + payload_capacity);
+    size_t start = conn->output.length;
+
+    if (server->commit_pending && conn->output_held == NO_HELD_OUTPUT)
+    {
+        conn->output_held = start;
+    }
+
+    conn->output.length += PROTO_LENGTH_SIZE;
+    conn->output.data[conn->output.length++] = (uint8_t)status;
+    return start;
+}
+
+static void end_response(Connection *conn, size_t start)
+{
+    uint32_t body_length = conn->output.length - start - PROTO_LENGTH_SIZE;
+    proto_put_u32(conn->output.data + start, body_length);
+}
+
+/* Records that the database changed; replies from now on wait for the commit */
+static void note_write(Server *server)
+{
+    if (!server->commit_pending)
+    {
+        server->commit_pending = true;
+        server->commit_deadline_ns = now_ns() + server->commit_window_ns;
+    }
+}
+
+/* Executes one request frame body and appends its response. Returns false if malformed */
+static bool handle_request(Server *server, Connection *conn, const uint8_t *body, uint32_t length)
+{
+    const uint8_t *end = body + length;
+    const uint8_t *p = body + 1;
+    size_t start;
+
+    switch (body[0])
+    {
+    case (OP_PUT):
+    {
+        Row row;
+        if (proto_get_row(p, end, &row) == NULL)
+        {
+            return false;
+        }
+
+        DbResult result = db_put(server->db, &row);
+        if (result == DB_OK)
+        {
+            note_write(server);
+        }
+        end_response(conn, begin_response(server, conn, result, 0));
+        return true;
+    }
+    case (OP_GET):
+    {
+        uint32_t id;
+        if (proto_get_u32(p, end, &id) == NULL)
+        {
+            return false;
+        }
+
+        Row row;
+        DbResult result = db_get(server->db, id, &row);
+        start = begin_response(server, conn, result, PROTO_MAX_ROW_SIZE);
+        if (result == DB_OK)
+        {
+            conn->output.length = proto_put_row(conn->output.data + conn->output.length, &row) - conn->output.data;
+        }
+        end_response(conn, start);
+        return true;
+    }
+    case (OP_SCAN):
+    {
+        uint32_t start_id, end_id, limit;
+        p = proto_get_u32(p, end, &start_id);
+        p = proto_get_u32(p, end, &end_id);
+        p = proto_get_u32(p, end, &limit);
+        if (p == NULL)
+        {
+            return false;
+        }
+        if (limit > SCAN_MAX_ROWS)
+        {
+            limit = SCAN_MAX_ROWS;
+        }
+
+        start = begin_response(server, conn, DB_OK, 4);
+        size_t count_offset = conn->output.length;
+        conn->output.length += 4;
+
+        uint32_t count = 0;
+        Row row;
+        DbIterator *iterator = db_scan(server->db, start_id, end_id);
+        while (count < limit && db_iterator_next(iterator, &row))
+        {
+            buffer_reserve(&conn->output, PROTO_MAX_ROW_SIZE);
+            conn->output.length = proto_put_row(conn->output.data + conn->output.length, &row) - conn->output.data;
+            count++;
+        }
+        db_iterator_close(iterator);
+
+        proto_put_u32(conn->output.data + count_offset, count);
+        end_response(conn, start);
+        return true;
+    }
+    case (OP_BATCH):
+    {
+        uint32_t count;
+        p = proto_get_u32(p, end, &count);
+        if (p == NULL || count > length / 7) // an encoded row is at least 7 bytes
+        {
+            return false;
+        }
+
+        Row *rows = malloc(sizeof(Row) * (count ? count : 1));
+        for (uint32_t i = 0; i < count && p != NULL; i++)
+        {
+            p = proto_get_row(p, end, &rows[i]);
+        }
+        if (p == NULL)
+        {
+            free(rows);
+            return false;
+        }
+
+        uint32_t inserted = 0;
+        DbResult result = db_put_batch(server->db, rows, count, &inserted);
+        free(rows);
+        if (inserted > 0)
+        {
+            note_write(server);
+        }
+
+        start = begin_response(server, conn, result, 4);
+        conn->output.length = proto_put_u32(conn->output.data + conn->output.length, inserted) - conn->output.data;
+        end_response(conn, start);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+/* Executes every complete frame in the input buffer, pausing if output backs up */
+static void process_input(Server *server, Connection *conn)
+{
+    size_t offset = 0;
+    while (!conn->failed && output_pending(conn) < OUTPUT_HIGH_WATER)
+    {
+        uint32_t length;
+        const uint8_t *end = conn->input.data + conn->input.length;
+        const uint8_t *body = proto_get_u32(conn->input.data + offset, end, &length);
+        if (body == NULL)
+        {
+            break;
+        }
+        if (length == 0 || length > PROTO_MAX_FRAME)
+        {
+            conn->failed = true;
+            break;
+        }
+        if ((size_t)(end - body) < length)
+        {
+            break;
+        }
+
+        if (!handle_request(server, conn, body, length))
+        {
+            conn->failed = true;
+            break;
+        }
+        offset += PROTO_LENGTH_SIZE + length;
+    }
+
+    buffer_consume(&conn->input, offset);
+}
+
+static void read_connection(Server *server, Connection *conn)
+{
+    size_t total = 0;
+    while (total < 16 * READ_CHUNK)
+    {
+        buffer_reserve(&conn->input, READ_CHUNK);
+        ssize_t bytes_read = read(conn->fd, conn->input.data + conn->input.length, READ_CHUNK);
+        if (bytes_read > 0)
+        {
+            conn->input.length += bytes_read;
+            total += bytes_read;
+            continue;
+        }
+        if (bytes_read == 0)
+        {
+            conn->read_closed = true;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            conn->failed = true;
+        }
+        break;
+    }
+
+    process_input(server, conn);
+}
+
+/* Writes whatever output is not held back by a pending commit */
+static void flush_connection(Connection *conn)
+{
+    size_t sendable = conn->output_held == NO_HELD_OUTPUT ? conn->output.length : conn->output_held;
+    while (!conn->failed && conn->output_sent < sendable)
+    {
+        ssize_t bytes_written = send(conn->fd, conn->output.data + conn->output_sent,
+                                     sendable - conn->output_sent, MSG_NOSIGNAL);
+        if (bytes_written < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                conn->failed = true;
+            }
+            break;
+        }
+        conn->output_sent += bytes_written;
+    }
+
+    // drop what has been sent so the buffer does not grow without bound
+    buffer_consume(&conn->output, conn->output_sent);
+    if (conn->output_held != NO_HELD_OUTPUT)
+    {
+        conn->output_held -= conn->output_sent;
+    }
+    conn->output_sent = 0;
+}
+
+static void close_connection(Server *server, uint32_t idx)
+{
+    Connection *conn = server->connections[idx];
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->input.data);
+    free(conn->output.data);
+    free(conn);
+    server->connections[idx] = server->connections[--server->num_connections];
+}
+
+static void accept_connections(Server *server)
+{
+    while (true)
+    {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+        {
+            return;
+        }
+
+        Connection *conn = calloc(1, sizeof(Connection));
+        conn->fd = fd;
+        conn->output_held = NO_HELD_OUTPUT;
+        conn->events = EPOLLIN;
+
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = conn};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+        if (server->num_connections == server->connections_capacity)
+        {
+            server->connections_capacity = server->connections_capacity ? server->connections_capacity * 2 : 16;
+            server->connections = realloc(server->connections, sizeof(Connection *) * server->connections_capacity);
+        }
+        server->connections[server->num_connections++] = conn;
+    }
+}
+
+/* Makes pending writes durable and releases the responses waiting on them */
+static void commit(Server *server)
+{
+    db_sync(server->db);
+    server->commit_pending = false;
+    for (uint32_t i = 0; i < server->num_connections; i++)
+    {
+        server->connections[i]->output_held = NO_HELD_OUTPUT;
+    }
+}
+
+static int open_listen_socket(const char *socket_path)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path too long\n");
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(socket_path); // remove a socket left behind by a previous run
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1)
+    {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void run(Server *server)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!stop_requested)
+    {
+        int timeout_ms = -1;
+        if (server->commit_pending)
+        {
+            uint64_t now = now_ns();
+            timeout_ms = now >= server->commit_deadline_ns
+                             ? 0
+                             : (int)((server->commit_deadline_ns - now + 999999) / 1000000);
+        }
+
+        int num_events = epoll_wait(server->epoll_fd, events, MAX_EVENTS, timeout_ms);
+        for (int i = 0; i < num_events; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                accept_connections(server);
+                continue;
+            }
+
+            Connection *conn = events[i].data.ptr;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                read_connection(server, conn);
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                flush_connection(conn);
+                process_input(server, conn); // resume input paused by a full output buffer
+            }
+        }
+
+        if (server->commit_pending && now_ns() >= server->commit_deadline_ns)
+        {
+            commit(server);
+        }
+
+        for (uint32_t i = 0; i < server->num_connections;)
+        {
+            Connection *conn = server->connections[i];
+            flush_connection(conn);
+            bool done = conn->read_closed && conn->input.length == 0 && conn->output.length == 0;
+            if (conn->failed || done)
+            {
+                close_connection(server, i);
+                continue;
+            }
+            update_interest(server, conn);
+            i++;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = "data.db";
+    const char *socket_path = "db.sock";
+    uint64_t commit_window_us = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "d:s:w:")) != -1)
+    {
+        switch (option)
+        {
+        case 'd':
+            filename = optarg;
+            break;
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'w':
+            commit_window_us = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d db_file] [-s socket_path] [-w commit_window_us]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Server server = {0};
+    server.commit_window_ns = commit_window_us * 1000;
+    server.listen_fd = open_listen_socket(socket_path);
+    if (server.listen_fd == -1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction action = {.sa_handler = handle_stop_signal};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    server.db = db_open(filename);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event);
+
+    run(&server);
+
+    // finish in-flight work before exiting
+    if (server.commit_pending)
+    {
+        commit(&server);
+    }
+    while (server.num_connections > 0)
+    {
+        flush_connection(server.connections[0]);
+        close_connection(&server, 0);
+    }
+    free(server.connections);
+
+    close(server.listen_fd);
+    unlink(socket_path);
+    close(server.epoll_fd);
+    db_close(server.db);
+    return EXIT_SUCCESS;
+}
@@ -1,20 +1,37 @@
+import ctypes
+import json
+import os
+import random
+import signal
+import socket
+import struct
 import subprocess
+import time
 import unittest
-import os
 
 MAX_ROWS = 1400
+TABLE_MAX_PAGES = 100
 MAX_ROWS_IN_LEAF = 13
 MAX_KEYS_IN_INTERNAL = 3
 # MAX_KEYS_IN_INTERNAL = 510
 MAX_USERNAME_LENGTH = 32
 MAX_EMAIL_LENGTH = 255
 
+
+def remove_database(path):
+    # closing a database also saves the list of its hot pages next to it, and its change log if it keeps one
+    os.remove(path)
+    for suffix in ["-warmup", "-cdc"]:
+        if os.path.exists(path + suffix):
+            os.remove(path + suffix)
+
+
 class TestDatabase(unittest.TestCase):
     @classmethod
     def setUpClass(cls):
-        # Compile with shell=True to properly execute gcc command
+        # Build with shell=True to properly execute make command
         process = subprocess.Popen(
-            "gcc db.c",
+            "make",
             shell=True,
             stdout=subprocess.PIPE,
             stderr=subprocess.PIPE
@@ -26,11 +43,11 @@ class TestDatabase(unittest.TestCase):
             raise Exception(f"Compilation failed: {stderr.decode()}")
 
     def tearDown(self):
-        os.remove("data.db")
+        remove_database("data.db")
 
     def run_script(self, commands):
         process = subprocess.Popen(
-            ["./a.out"],
+            ["./db"],
             stdin=subprocess.PIPE,
             stdout=subprocess.PIPE,
             stderr=subprocess.PIPE,
@@ -155,7 +172,7 @@ class TestDatabase(unittest.TestCase):
             "LEAF_NODE_CELL_SIZE: 295",
             "LEAF_NODE_AVAILABLE_CELL_SPACE: 4082",
             "LEAF_NODE_MAX_CELLS: 13",
-            "INTERNAL_NODE_CELL_SIZE: 8",
+            "INTERNAL_NODE_CELL_SIZE: 12",
             f"INTERNAL_NODE_MAX_CELLS: {MAX_KEYS_IN_INTERNAL}",
             "db > "
         ])
@@ -524,5 +541,1257 @@ class TestDatabase(unittest.TestCase):
 
         self.assertEqual(result[-1 * len(expected):], expected)
 
+    def test_batch_mode_script(self):
+        with open("script.sql", "w") as f:
+            f.write("-- load two users\n"
+                    "INSERT 1 user1 person1@example.com\n"
+                    "\n"
+                    "INSERT 1 user1 person1@example.com\n"
+                    "INSERT 2 user2 person2@example.com\n"
+                    "SELECT\n")
+        try:
+            process = subprocess.run(["./db", "-f", "script.sql", "data.db"], capture_output=True, text=True)
+        finally:
+            os.remove("script.sql")
+
+        self.assertEqual(process.stdout.splitlines(), [
+            "1 user1 person1@example.com",
+            "2 user2 person2@example.com",
+        ])
+        self.assertEqual(process.stderr.splitlines(), [
+            "line 4: Key (1) already exists in table",
+            "4 statements, 1 errors",
+        ])
+        self.assertEqual(process.returncode, 1)
+
+    def test_end_of_input_saves_data(self):
+        # no .exit: end of input should close the database like .exit does
+        process = subprocess.run(["./db", "--batch"], input="INSERT 1 user1 person1@example.com\n",
+                                 capture_output=True, text=True)
+        self.assertEqual(process.returncode, 0)
+
+        result = self.run_script(["SELECT", ".exit"])
+        self.assertEqual(result, ["db > 1 user1 person1@example.com", "Executed.", "db > "])
+
+    def test_select_projection(self):
+        result = self.run_script([
+            "INSERT 1 user1 person1@example.com",
+            "INSERT 2 user2 person2@example.com",
+            "SELECT id",
+            "SELECT email,id",
+            "SELECT *",
+            "SELECT id, password",
+            ".exit",
+        ])
+        self.assertEqual(result, [
+            "db > Executed.",
+            "db > Executed.",
+            "db > 1",
+            "2",
+            "Executed.",
+            "db > person1@example.com 1",
+            "person2@example.com 2",
+            "Executed.",
+            "db > 1 user1 person1@example.com",
+            "2 user2 person2@example.com",
+            "Executed.",
+            "db > Syntax error in statement 'SELECT id, password'.",
+            "db > ",
+        ])
+
+    def test_secondary_index(self):
+        self.run_script([
+            "INSERT 1 alice alice@example.com",
+            "INSERT 2 bob bob@example.com",
+            "INSERT 3 alicia alicia@corp.com",
+            "CREATE INDEX ON email",
+            "INSERT 4 al al@example.com",
+            ".exit",
+        ])
+        # the index is stored in the file and kept current by later inserts
+        result = self.run_script([
+            "INSERT 5 bo bo@example.com",
+            "CREATE INDEX ON email",
+            "SELECT WHERE email = 'bob@example.com'",
+            "SELECT id WHERE email LIKE 'al%'",
+            "SELECT id WHERE username LIKE 'al%'",
+            "SELECT WHERE id = 5",
+            ".btree email",
+            ".exit",
+        ])
+        self.assertEqual(result, [
+            "db > Executed.",
+            "db > Index on email already exists.",
+            "db > 2 bob bob@example.com",
+            "Executed.",
+            # index order: by email, then id
+            "db > 4",
+            "1",
+            "3",
+            "Executed.",
+            # no index on username: table order
+            "db > 1",
+            "3",
+            "4",
+            "Executed.",
+            "db > 5 bo bo@example.com",
+            "Executed.",
+            "db > - leaf (size 5)",
+            "  - al@example.com (4)",
+            "  - alice@example.com (1)",
+            "  - alicia@corp.com (3)",
+            "  - bo@example.com (5)",
+            "  - bob@example.com (2)",
+            "db > ",
+        ])
+
+    def test_update(self):
+        self.run_script([
+            "INSERT 1 alice alice@example.com",
+            "INSERT 2 bob bob@example.com",
+            "CREATE INDEX ON email",
+            "UPDATE 1 alicia alice@example.com",
+            "UPDATE 2 bob robert@example.com",
+            "UPDATE 3 carol carol@example.com",
+            ".exit",
+        ])
+        result = self.run_script(["SELECT", "SELECT id WHERE email = 'alice@example.com'", ".exit"])
+        self.assertEqual(result, [
+            "db > 1 alicia alice@example.com",
+            "2 bob bob@example.com",
+            "Executed.",
+            "db > 1",
+            "Executed.",
+            "db > ",
+        ])
+
+        script = "\n".join([
+            "UPDATE 2 bob robert@example.com",
+            "UPDATE 3 c c@d",
+            "UPDATE 1 " + "a" * 33 + " alice@example.com",
+            "UPDATE 1 alicia " + "e" * 256,
+            "UPDATE 1 " + "a" * 40,
+            "UPDATE 1 " + "a" * 32 + " alice@example.com",
+        ]) + "\n"
+        process = subprocess.run(["./db", "--batch"], input=script, capture_output=True, text=True)
+        self.assertEqual(process.stderr.splitlines(), [
+            "line 1: Failed to update, an indexed column can't change.",
+            "line 2: Key (3) not found.",
+            "line 3: String is too long.",
+            "line 4: String is too long.",
+            "line 5: String is too long.",
+            "6 statements, 5 errors",
+        ])
+
+    def test_count_min_max_and_offset(self):
+        commands = [f"INSERT {i} user{i} user{i}@example.com" for i in range(0, 60, 2)]
+        commands += [
+            "SELECT COUNT(*)",
+            "SELECT COUNT(*) WHERE id BETWEEN 9 AND 21",
+            "SELECT COUNT(*) WHERE username LIKE 'user1%'",
+            "SELECT MIN(id)",
+            "SELECT MAX(id)",
+            "SELECT MAX(id) WHERE id BETWEEN 0 AND 35",
+            "SELECT MIN(id) WHERE id BETWEEN 61 AND 70",
+            "SELECT id LIMIT 3 OFFSET 25",
+            "SELECT id, username WHERE id BETWEEN 10 AND 20 LIMIT 2 OFFSET 4",
+            "SELECT id LIMIT 2",
+            ".exit",
+        ]
+        result = self.run_script(commands)
+        self.assertEqual(result[30:], [
+            "db > 30",
+            "Executed.",
+            "db > 6",
+            "Executed.",
+            "db > 5",
+            "Executed.",
+            "db > 0",
+            "Executed.",
+            "db > 58",
+            "Executed.",
+            "db > 34",
+            "Executed.",
+            # no matching rows, so no value
+            "db > Executed.",
+            "db > 50",
+            "52",
+            "54",
+            "Executed.",
+            "db > 18 user18",
+            "20 user20",
+            "Executed.",
+            "db > 0",
+            "2",
+            "Executed.",
+            "db > ",
+        ])
+
+    def test_rejects_file_with_more_pages_than_the_build_holds(self):
+        # as a build with a larger TABLE_MAX_PAGES could leave it
+        with open("data.db", "wb") as f:
+            f.truncate((TABLE_MAX_PAGES + 1) * 4096)
+        process = subprocess.run(["./db"], input="SELECT\n.exit\n", capture_output=True, text=True)
+        self.assertNotEqual(process.returncode, 0)
+        self.assertEqual(process.stdout, "")
+        self.assertEqual(process.stderr, "Db file has more pages than this build can hold.\n")
+
+    def test_stats_counts_engine_work(self):
+        # descending ids land at the front of each leaf, so every insert shifts the cells after it
+        commands = [f"INSERT {i} user{i} user{i}@example.com" for i in range(30, 0, -1)]
+        commands += [".stats", ".stats reset", ".stats"]
+        commands += ["CREATE TABLE scores (id INT)"] + [f"INSERT INTO scores VALUES ({i})" for i in range(3)]
+        commands += [".stats", ".exit"]
+        result = self.run_script(commands)
+
+        def counters(lines):
+            return {name: int(value) for name, value in (line.replace("db > ", "").split() for line in lines)}
+
+        before = counters(result[30:43])
+        self.assertEqual(before["descents"], 30)
+        self.assertEqual(before["leaf_splits"], 3)
+        self.assertEqual(before["root_splits"], 1)
+        self.assertEqual(before["internal_splits"], 0)
+        self.assertGreater(before["cells_shifted"], 0)
+        self.assertGreater(before["page_hits"], before["page_misses"])
+        self.assertEqual(before["depth"], 2)
+        self.assertEqual(before["num_pages"], 6)  # header, root and four leaves
+
+        after = counters(result[43:56])  # .stats reset prints nothing
+        self.assertEqual(after["descents"], 0)
+        self.assertEqual(after["leaf_splits"], 0)
+        self.assertEqual(after["page_hits"], 0)
+        self.assertEqual(after["depth"], 2)
+
+        # user tables count too
+        tables = counters(result[60:73])
+        self.assertEqual(tables["descents"], 3)
+
+    def test_timer_latency_and_trace(self):
+        commands = [".trace trace.json", ".timer on"]
+        commands += [f"INSERT {i} user{i} user{i}@example.com" for i in range(60, 0, -1)]
+        commands += [".timer off", "SELECT WHERE id = 5", ".latency", ".exit"]
+        result = self.run_script(commands)
+
+        self.assertEqual(sum(line.startswith("Run Time: ") for line in result), 60)
+        self.assertTrue(result[-3].startswith("db > INSERT: 60 run, mean "))
+        self.assertTrue(result[-2].startswith("SELECT: 1 run, mean "))
+
+        with open("trace.json") as f:
+            events = json.load(f)["traceEvents"]
+        os.remove("trace.json")
+        names = {event["name"] for event in events}
+        for name in ["INSERT", "SELECT", "table_find", "leaf_node_split_and_insert",
+                     "internal_node_split_and_insert", "get_page miss", "flush_page"]:
+            self.assertIn(name, names)
+        # engine spans nest inside the statement that ran them
+        insert = next(event for event in events if event["name"] == "INSERT")
+        find = next(event for event in events if event["name"] == "table_find")
+        self.assertLessEqual(insert["ts"], find["ts"])
+        self.assertLessEqual(find["ts"] + find["dur"], insert["ts"] + insert["dur"])
+
+    def test_vacuum_repacks_leaves_in_order(self):
+        ids = random.Random(5).sample(range(1000), 200)
+        commands = ["CREATE INDEX ON username", "CREATE INDEX ON id"]
+        commands += [f"INSERT {i} user{i} user{i}@example.com" for i in ids]
+        commands += [".analyze", "VACUUM", ".analyze", ".exit"]
+        result = self.run_script(commands)
+
+        def leaf_chain(lines):
+            return [line for line in lines if "leaf chain" in line]
+
+        vacuum = result.index("db > Executed.", 202)
+        self.assertNotIn(" 0 backward", leaf_chain(result[:vacuum])[0])
+        # rows sit in full leaves on consecutive pages, and so do the index entries
+        self.assertEqual(result[vacuum + 1:], [
+            "db > table: depth 3, 200 rows",
+            "  level 0: 1 internal, 3 keys, 100.0% full",
+            "  level 1: 4 internal, 12 keys, 100.0% full",
+            "  level 2: 16 leaves, 200 cells, 96.2% full",
+            "  leaf chain: 15 sequential, 0 forward jumps, 0 backward",
+            "index on username: depth 2, 200 rows",
+            "  level 0: 1 internal, 1 keys, 33.3% full",
+            "  level 1: 2 leaves, 200 cells, 88.5% full",
+            "  leaf chain: 1 sequential, 0 forward jumps, 0 backward",
+            "db > ",
+        ])
+
+        # the rebuilt file replaces the old one and takes further inserts
+        result = self.run_script([
+            "INSERT 1000 user1000 user1000@example.com",
+            "SELECT COUNT(*)",
+            f"SELECT WHERE username = 'user{ids[3]}'",
+            f"SELECT WHERE id = {ids[4]}",
+            "SELECT id LIMIT 3",
+            ".exit",
+        ])
+        first = sorted(ids)[:3]
+        self.assertEqual(result, [
+            "db > Executed.",
+            "db > 201",
+            "Executed.",
+            f"db > {ids[3]} user{ids[3]} user{ids[3]}@example.com",
+            "Executed.",
+            f"db > {ids[4]} user{ids[4]} user{ids[4]}@example.com",
+            "Executed.",
+            f"db > {first[0]}",
+            f"{first[1]}",
+            f"{first[2]}",
+            "Executed.",
+            "db > ",
+        ])
+        self.assertFalse(os.path.exists("data.db-vacuum"))
+
+    def test_opens_version_1_file(self):
+        # version 1 internal nodes had no row counts: child then key in each cell
+        header = b"sqlclone" + struct.pack("=III", 1, 1, 0)
+        root = struct.pack("=BBIII", 0, 1, 0, 1, 3) + struct.pack("=II", 2, 1)
+
+        def leaf(ids, next_leaf):
+            cells = b"".join(struct.pack("=I", i) + struct.pack("=I32s255s", i, f"user{i}".encode(), b"e") for i in ids)
+            return struct.pack("=BBIII", 1, 0, 1, len(ids), next_leaf) + cells
+
+        with open("data.db", "wb") as f:
+            for page in [header, root, leaf([1], 3), leaf([5, 6], 0)]:
+                f.write(page.ljust(4096, b"\0"))
+
+        result = self.run_script(["SELECT COUNT(*)", "INSERT 3 user3 e", "SELECT id LIMIT 2 OFFSET 1", ".exit"])
+        self.assertEqual(result, [
+            "db > 3",
+            "Executed.",
+            "db > Executed.",
+            "db > 3",
+            "5",
+            "Executed.",
+            "db > ",
+        ])
+
+    def test_opens_file_without_header_page(self):
+        # files from before the header page hold the root leaf in page 0
+        row = struct.pack("=I32s255s", 7, b"user7", b"person7@example.com")
+        page = struct.pack("=BBIII", 1, 1, 0, 1, 0) + struct.pack("=I", 7) + row
+        with open("data.db", "wb") as f:
+            f.write(page.ljust(4096, b"\0"))
+
+        result = self.run_script(["INSERT 8 user8 person8@example.com", "SELECT", ".exit"])
+        self.assertEqual(result, [
+            "db > Executed.",
+            "db > 7 user7 person7@example.com",
+            "8 user8 person8@example.com",
+            "Executed.",
+            "db > ",
+        ])
+
+    def test_csv_and_tsv_modes(self):
+        result = self.run_script([
+            'INSERT 1 a,b c"d@example.com',
+            ".mode csv",
+            "SELECT",
+            ".mode tsv",
+            "SELECT",
+            ".mode",
+            ".mode xml",
+            ".exit",
+        ])
+        self.assertEqual(result, [
+            "db > Executed.",
+            "db > db > 1,\"a,b\",\"c\"\"d@example.com\"",
+            "Executed.",
+            "db > db > 1\ta,b\tc\"d@example.com",
+            "Executed.",
+            "db > tsv",
+            "db > Unrecognized command '.mode xml'.",
+            "db > ",
+        ])
+
+    def test_binary_mode(self):
+        script = ("INSERT 7 user7 person7@example.com\n"
+                  "INSERT 8 user8 person8@example.com\n"
+                  ".mode binary\n"
+                  "SELECT\n")
+        process = subprocess.run(["./db", "--batch"], input=script.encode(), capture_output=True)
+
+        records = []
+        data = process.stdout
+        while data:
+            (length,) = struct.unpack_from("=I", data)
+            body, data = data[4:4 + length], data[4 + length:]
+            (row_id, username_length) = struct.unpack_from("=IB", body)
+            username = body[5:5 + username_length]
+            email = body[6 + username_length:]
+            self.assertEqual(body[5 + username_length], len(email))
+            records.append((row_id, username, email))
+
+        self.assertEqual(records, [
+            (7, b"user7", b"person7@example.com"),
+            (8, b"user8", b"person8@example.com"),
+        ])
+
+    def test_create_table(self):
+        result = self.run_script([
+            "CREATE TABLE scores (id INT, name VARCHAR(20), total BIGINT, code CHAR(4))",
+            "CREATE TABLE scores (id INT)",
+            "CREATE TABLE wide (name VARCHAR(8))",
+            "INSERT INTO scores VALUES (3, 'carol c', -9000000000, abcd)",
+            "INSERT INTO scores VALUES (-5, bob, 12, x)",
+            "INSERT INTO scores VALUES (3, dup, 1, x)",
+            "INSERT INTO missing VALUES (1)",
+            "INSERT INTO scores VALUES (1, bob, 1, toolong)",
+            "INSERT 1 user1 user1@email.com",
+            ".exit",
+        ])
+        self.assertEqual(result, [
+            "db > Executed.",
+            "db > Table scores already exists.",
+            "db > Failed to create table wide, its schema is invalid.",
+            "db > Executed.",
+            "db > Executed.",
+            "db > Key (3) already exists in table",
+            "Failed to insert, key already exists.",
+            "db > Unknown table in statement 'INSERT INTO missing VALUES (1)'.",
+            "db > Syntax error in statement 'INSERT INTO scores VALUES (1, bob, 1, toolong)'.",
+            "db > Executed.",
+            "db > ",
+        ])
+
+        # the catalog is read back on open, and VACUUM copies the table
+        result = self.run_script([
+            ".schema",
+            "SELECT * FROM scores",
+            "SELECT total, name FROM scores WHERE id = 3",
+            "VACUUM",
+            "SELECT id FROM scores WHERE id BETWEEN -10 AND 0",
+            "SELECT",
+            ".exit",
+        ])
+        self.assertEqual(result, [
+            "db > CREATE TABLE scores (id INT, name VARCHAR(20), total BIGINT, code CHAR(4))",
+            "db > -5 bob 12 x",
+            "3 carol c -9000000000 abcd",
+            "Executed.",
+            "db > -9000000000 carol c",
+            "Executed.",
+            "db > Executed.",
+            "db > -5",
+            "Executed.",
+            "db > 1 user1 user1@email.com",
+            "Executed.",
+            "db > ",
+        ])
+
+    def test_change_log(self):
+        script = "\n".join([
+            "INSERT 1 alice alice@example.com",
+            "INSERT 1 again again@example.com",
+            "UPDATE 1 alicia alicia@example.com",
+            "UPDATE 9 nobody nobody@example.com",
+            "CREATE TABLE scores (id INT, name VARCHAR(20), total BIGINT, code CHAR(4))",
+            "INSERT INTO scores VALUES (-5, 'carol c', -9000000000, abcd)",
+        ]) + "\n"
+        subprocess.run(["./db", "--batch", "--changes"], input=script, capture_output=True, text=True)
+
+        # failed calls change nothing and log nothing
+        process = subprocess.run(["./cdctail", "data.db-cdc"], capture_output=True, text=True)
+        self.assertEqual(process.stdout.splitlines(), [
+            "1 INSERT - 1 alice alice@example.com",
+            "2 UPDATE - 1 alicia alicia@example.com",
+            "3 INSERT scores -5 carol c -9000000000 abcd",
+        ])
+
+        # a torn record at the end is cut off when the log is reopened, and numbering carries on
+        with open("data.db-cdc", "rb+") as f:
+            f.truncate(os.path.getsize("data.db-cdc") - 3)
+        subprocess.run(["./db", "--batch", "--changes"], input="INSERT 2 bob bob@example.com\n",
+                       capture_output=True, text=True)
+        process = subprocess.run(["./cdctail", "-n", "2", "data.db-cdc"], capture_output=True, text=True)
+        self.assertEqual(process.stdout.splitlines(), [
+            "2 UPDATE - 1 alicia alicia@example.com",
+            "3 INSERT - 2 bob bob@example.com",
+        ])
+
+
+class Row(ctypes.Structure):
+    _fields_ = [
+        ("id", ctypes.c_uint32),
+        ("username", ctypes.c_char * (MAX_USERNAME_LENGTH + 1)),
+        ("email", ctypes.c_char * (MAX_EMAIL_LENGTH + 1)),
+    ]
+
+
+class RowView(ctypes.Structure):
+    _fields_ = [
+        ("id", ctypes.c_uint32),
+        ("username", ctypes.c_void_p),
+        ("email", ctypes.c_void_p),
+    ]
+
+
+class FlusherOptions(ctypes.Structure):
+    _fields_ = [
+        ("interval_ms", ctypes.c_uint32),
+        ("max_pages", ctypes.c_uint32),
+        ("min_age_ms", ctypes.c_uint32),
+        ("checkpoint_ms", ctypes.c_uint32),
+    ]
+
+
+class Score(ctypes.Structure):
+    # the tuple of a table created with (id INT, name VARCHAR(20), total BIGINT, code CHAR(4))
+    _fields_ = [
+        ("id", ctypes.c_int32),
+        ("name", ctypes.c_char * 21),
+        ("total", ctypes.c_int64),
+        ("code", ctypes.c_char * 5),
+    ]
+
+
+class ColumnDef(ctypes.Structure):
+    _fields_ = [
+        ("name", ctypes.c_char * 32),
+        ("type", ctypes.c_int),
+        ("length", ctypes.c_uint32),
+    ]
+
+
+class Schema(ctypes.Structure):
+    _fields_ = [
+        ("name", ctypes.c_char * 32),
+        ("num_columns", ctypes.c_uint32),
+        ("columns", ColumnDef * 16),
+    ]
+
+
+class TestLibrary(unittest.TestCase):
+    DB_OK, DB_NOT_FOUND, DB_DUPLICATE_KEY, DB_TABLE_FULL, DB_ERROR = 0, 1, 2, 3, 4
+    DB_OPEN_DIRECT_IO, DB_OPEN_BUFFERED_INSERTS, DB_OPEN_IN_MEMORY = 0x1, 0x2, 0x4
+    DB_OPEN_COMPRESSED, DB_OPEN_CHANGE_LOG = 0x8, 0x10
+
+    @classmethod
+    def setUpClass(cls):
+        process = subprocess.Popen(
+            "make libdb.so",
+            shell=True,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE
+        )
+        stdout, stderr = process.communicate()
+        if process.returncode != 0:
+            raise Exception(f"Compilation failed: {stderr.decode()}")
+
+        lib = ctypes.CDLL("./libdb.so")
+        lib.db_open.restype = ctypes.c_void_p
+        lib.db_open.argtypes = [ctypes.c_char_p]
+        lib.db_open_with_flags.restype = ctypes.c_void_p
+        lib.db_open_with_flags.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+        lib.db_close.argtypes = [ctypes.c_void_p]
+        lib.db_put.argtypes = [ctypes.c_void_p, ctypes.POINTER(Row)]
+        lib.db_put_batch.argtypes = [ctypes.c_void_p, ctypes.POINTER(Row), ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint32)]
+        lib.db_get.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(Row)]
+        lib.db_scan.restype = ctypes.c_void_p
+        lib.db_scan.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint32]
+        lib.db_iterator_next.restype = ctypes.c_bool
+        lib.db_iterator_next.argtypes = [ctypes.c_void_p, ctypes.POINTER(Row)]
+        lib.db_iterator_next_view.restype = ctypes.c_bool
+        lib.db_iterator_next_view.argtypes = [ctypes.c_void_p, ctypes.POINTER(RowView)]
+        lib.db_create_index.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        lib.db_print_index.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        lib.db_scan_column.restype = ctypes.c_void_p
+        lib.db_scan_column.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_bool]
+        lib.db_iterator_close.argtypes = [ctypes.c_void_p]
+        lib.db_count.restype = ctypes.c_uint32
+        lib.db_count.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint32]
+        lib.db_iterator_skip.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+        lib.db_start_flusher.argtypes = [ctypes.c_void_p, ctypes.POINTER(FlusherOptions)]
+        lib.db_vacuum.argtypes = [ctypes.c_void_p]
+        lib.db_sync.argtypes = [ctypes.c_void_p]
+        lib.db_update.argtypes = [ctypes.c_void_p, ctypes.POINTER(Row)]
+        lib.db_flush_inserts.argtypes = [ctypes.c_void_p]
+        lib.open_pager.restype = ctypes.c_void_p
+        lib.open_pager.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+        lib.pager_load_warmup.restype = ctypes.c_uint32
+        lib.pager_load_warmup.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        lib.close_pager.argtypes = [ctypes.c_void_p]
+        lib.db_backup_start.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint32]
+        lib.db_backup_progress.restype = ctypes.c_bool
+        lib.db_backup_progress.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint32), ctypes.POINTER(ctypes.c_uint32)]
+        lib.db_backup_wait.argtypes = [ctypes.c_void_p]
+        lib.db_create_table.argtypes = [ctypes.c_void_p, ctypes.POINTER(Schema)]
+        lib.db_table.restype = ctypes.c_void_p
+        lib.db_table.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        lib.db_tuple_size.restype = ctypes.c_uint32
+        lib.db_tuple_size.argtypes = [ctypes.c_void_p]
+        lib.db_table_put.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+        lib.db_table_get.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int32, ctypes.c_void_p]
+        lib.db_table_scan.restype = ctypes.c_void_p
+        lib.db_table_scan.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int32, ctypes.c_int32]
+        lib.db_iterator_next_tuple.restype = ctypes.c_bool
+        lib.db_iterator_next_tuple.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        cls.lib = lib
+
+    def tearDown(self):
+        remove_database("data.db")
+
+    def make_row(self, i):
+        return Row(i, f"user{i}".encode(), f"user{i}@example.com".encode())
+
+    def scan(self, db, start, end):
+        it = self.lib.db_scan(db, start, end)
+        row = Row()
+        ids = []
+        while self.lib.db_iterator_next(it, ctypes.byref(row)):
+            ids.append(row.id)
+        self.lib.db_iterator_close(it)
+        return ids
+
+    def test_put_get_and_scan(self):
+        db = self.lib.db_open(b"data.db")
+        for i in [18, 7, 10, 29, 23, 4, 14, 30, 15, 26, 22, 19, 2, 1, 21, 11]:
+            self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(i))), self.DB_OK)
+        self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(7))), self.DB_DUPLICATE_KEY)
+
+        row = Row()
+        self.assertEqual(self.lib.db_get(db, 22, ctypes.byref(row)), self.DB_OK)
+        self.assertEqual((row.id, row.username, row.email), (22, b"user22", b"user22@example.com"))
+        self.assertEqual(self.lib.db_get(db, 5, ctypes.byref(row)), self.DB_NOT_FOUND)
+
+        self.assertEqual(self.scan(db, 10, 22), [10, 11, 14, 15, 18, 19, 21, 22])
+        self.assertEqual(self.scan(db, 31, 100), [])
+        self.lib.db_close(db)
+
+    def test_iterator_view_matches_copy(self):
+        db = self.lib.db_open(b"data.db")
+        rows = (Row * 20)(*[self.make_row(i) for i in range(20)])
+        self.lib.db_put_batch(db, rows, 20, None)
+
+        it = self.lib.db_scan(db, 5, 9)
+        view = RowView()
+        seen = []
+        while self.lib.db_iterator_next_view(it, ctypes.byref(view)):
+            username = ctypes.string_at(view.username, 32).split(b"\0")[0]
+            seen.append((view.id, username))
+        self.lib.db_iterator_close(it)
+        self.lib.db_close(db)
+
+        self.assertEqual(seen, [(i, f"user{i}".encode()) for i in range(5, 10)])
+
+    def test_random_inserts_with_index(self):
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.lib.db_create_index(db, 2), self.DB_OK)  # DB_COLUMN_EMAIL
+
+        ids = random.Random(3).sample(range(5000), 500)
+        inserted = []
+        for i in ids:
+            row = Row(i, f"user{i % 7}".encode(), f"user{i % 97}@example.com".encode())
+            if self.lib.db_put(db, ctypes.byref(row)) != self.DB_OK:
+                break
+            inserted.append(i)
+
+        row = Row()
+        for i in inserted:
+            self.assertEqual(self.lib.db_get(db, i, ctypes.byref(row)), self.DB_OK)
+
+        it = self.lib.db_scan_column(db, 2, b"user5@example.com", False)
+        found = []
+        while self.lib.db_iterator_next(it, ctypes.byref(row)):
+            found.append(row.id)
+        self.lib.db_iterator_close(it)
+        self.lib.db_close(db)
+
+        self.assertEqual(found, sorted(i for i in inserted if i % 97 == 5))
+
+    def test_column_filter_lengths(self):
+        # values around the 16 byte head compared at once, and ones filling the column
+        names = ["a" * n for n in (14, 15, 16, 17, 31, 32)] + ["a" * 15 + "b", "a" * 16 + "b", ""]
+        db = self.lib.db_open(b"data.db")
+        for i, name in enumerate(names * 4):
+            self.lib.db_put(db, ctypes.byref(Row(i, name.encode(), b"e")))
+
+        def ids(value, prefix):
+            it = self.lib.db_scan_column(db, 1, value.encode(), prefix)
+            row = Row()
+            found = []
+            while self.lib.db_iterator_next(it, ctypes.byref(row)):
+                found.append(row.id)
+            self.lib.db_iterator_close(it)
+            return sorted(found)
+
+        filters = [(value, prefix) for value in names + ["a" * 33, "a" * 16 + "c"] for prefix in (False, True)]
+        scanned = [ids(value, prefix) for value, prefix in filters]
+        self.assertEqual(self.lib.db_create_index(db, 1), self.DB_OK)  # DB_COLUMN_USERNAME
+        indexed = [ids(value, prefix) for value, prefix in filters]
+        self.lib.db_close(db)
+
+        expected = [sorted(i for i, name in enumerate(names * 4) if name.startswith(value) if prefix or name == value)
+                    for value, prefix in filters]
+        self.assertEqual(scanned, expected)
+        self.assertEqual(indexed, expected)
+
+    def test_counts_and_skip_after_random_inserts(self):
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.lib.db_create_index(db, 1), self.DB_OK)  # DB_COLUMN_USERNAME
+        inserted = []
+        for i in random.Random(7).sample(range(3000), 400):
+            if self.lib.db_put(db, ctypes.byref(self.make_row(i))) != self.DB_OK:
+                break
+            inserted.append(i)
+        self.lib.db_close(db)
+
+        # counts are stored in the file, so check them after reopening
+        db = self.lib.db_open(b"data.db")
+        inserted.sort()
+        self.assertEqual(self.lib.db_count(db, 0, 0xFFFFFFFF), len(inserted))
+        rng = random.Random(8)
+        for _ in range(50):
+            start, end = sorted(rng.sample(range(3100), 2))
+            expected = [i for i in inserted if start <= i <= end]
+            self.assertEqual(self.lib.db_count(db, start, end), len(expected))
+
+            skip = rng.randrange(len(expected) + 2)
+            it = self.lib.db_scan(db, start, end)
+            self.lib.db_iterator_skip(it, skip)
+            row = Row()
+            ids = []
+            while self.lib.db_iterator_next(it, ctypes.byref(row)):
+                ids.append(row.id)
+            self.lib.db_iterator_close(it)
+            self.assertEqual(ids, expected[skip:])
+        self.lib.db_close(db)
+
+    def test_direct_io_round_trip(self):
+        ids = random.Random(3).sample(range(1000), 150)
+        db = self.lib.db_open_with_flags(b"data.db", self.DB_OPEN_DIRECT_IO)
+        for i in ids:
+            self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(i))), self.DB_OK)
+        self.lib.db_close(db)
+
+        # pages written with O_DIRECT read back through the page cache, and the other way round
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), sorted(ids))
+        self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(1000))), self.DB_OK)
+        self.lib.db_close(db)
+
+        db = self.lib.db_open_with_flags(b"data.db", self.DB_OPEN_DIRECT_IO)
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), sorted(ids) + [1000])
+        row = Row()
+        self.assertEqual(self.lib.db_get(db, ids[0], ctypes.byref(row)), self.DB_OK)
+        self.assertEqual(row.username, f"user{ids[0]}".encode())
+        self.lib.db_close(db)
+
+    def test_hash_index_on_id(self):
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(2500))), self.DB_OK)
+        self.assertEqual(self.lib.db_create_index(db, 0), self.DB_OK)  # DB_COLUMN_ID
+        self.assertEqual(self.lib.db_create_index(db, 0), self.DB_DUPLICATE_KEY)
+        self.lib.db_print_index(db, 0)  # prints nothing: the hash index is not a tree
+
+        # random order splits leaves under existing entries, leaving them stale
+        inserted = [2500]
+        for i in random.Random(5).sample(range(5000), 500):
+            if i == 2500:
+                continue
+            if self.lib.db_put(db, ctypes.byref(self.make_row(i))) != self.DB_OK:
+                break
+            inserted.append(i)
+        self.lib.db_close(db)
+
+        db = self.lib.db_open(b"data.db")
+        row = Row()
+        for i in inserted:
+            self.assertEqual(self.lib.db_get(db, i, ctypes.byref(row)), self.DB_OK)
+            self.assertEqual(row.id, i)
+        self.assertEqual(self.lib.db_get(db, 5000, ctypes.byref(row)), self.DB_NOT_FOUND)
+        self.assertEqual(self.scan(db, 1000, 2000), sorted(i for i in inserted if 1000 <= i <= 2000))
+        self.lib.db_close(db)
+
+    def test_put_batch_persists(self):
+        rows = (Row * 40)(*[self.make_row(i) for i in range(40)])
+        inserted = ctypes.c_uint32()
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.lib.db_put_batch(db, rows, 40, ctypes.byref(inserted)), self.DB_OK)
+        self.assertEqual(inserted.value, 40)
+        self.lib.db_close(db)
+
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), list(range(40)))
+        self.lib.db_close(db)
+
+    def test_change_log_holds_only_durable_changes(self):
+        subprocess.run(["make", "cdctail"], capture_output=True, check=True)
+        child = os.fork()
+        if child == 0:
+            # rows 0-4 are merged and made durable by db_sync. Row 5 stays buffered, and the updates log more
+            # than the log's 64 KB buffer, but none of it is durable when the process dies
+            db = self.lib.db_open_with_flags(b"data.db", self.DB_OPEN_BUFFERED_INSERTS | self.DB_OPEN_CHANGE_LOG)
+            for i in range(6):
+                self.lib.db_put(db, self.make_row(i))
+                if i == 4:
+                    self.lib.db_sync(db)
+            for i in range(300):
+                updated = Row(0, b"renamed", f"{i:0{MAX_EMAIL_LENGTH}}".encode())
+                self.lib.db_update(db, ctypes.byref(updated))
+            os.kill(os.getpid(), signal.SIGKILL)
+        os.waitpid(child, 0)
+
+        process = subprocess.run(["./cdctail", "data.db-cdc"], capture_output=True, text=True)
+        self.assertEqual(process.stdout.splitlines(),
+                         [f"{i + 1} INSERT - {i} user{i} user{i}@example.com" for i in range(5)])
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), list(range(5)))
+        row = Row()
+        self.assertEqual(self.lib.db_get(db, 0, ctypes.byref(row)), self.DB_OK)
+        self.assertEqual(row.username, b"user0")
+        self.lib.db_close(db)
+
+    def test_buffered_inserts(self):
+        ids = list(range(0, 600, 2))
+        random.Random(7).shuffle(ids)
+        db = self.lib.db_open_with_flags(b"data.db", self.DB_OPEN_BUFFERED_INSERTS)
+        for i in ids[:150]:
+            self.assertEqual(self.lib.db_put(db, self.make_row(i)), self.DB_OK)
+        # buffered rows are found, and duplicates of them refused, before anything is flushed
+        row = Row()
+        self.assertEqual(self.lib.db_get(db, ids[0], ctypes.byref(row)), self.DB_OK)
+        self.assertEqual(row.email, f"user{ids[0]}@example.com".encode())
+        self.assertEqual(self.lib.db_put(db, self.make_row(ids[0])), self.DB_DUPLICATE_KEY)
+        self.assertEqual(self.lib.db_get(db, 1, ctypes.byref(row)), self.DB_NOT_FOUND)
+
+        # a scan flushes them; later rows merge into the leaves they landed in
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), sorted(ids[:150]))
+        self.assertEqual(self.lib.db_put(db, self.make_row(ids[0])), self.DB_DUPLICATE_KEY)
+        for i in ids[150:]:
+            self.assertEqual(self.lib.db_put(db, self.make_row(i)), self.DB_OK)
+        updated = Row(ids[-1], b"renamed", b"renamed@example.com")
+        self.assertEqual(self.lib.db_update(db, ctypes.byref(updated)), self.DB_OK)
+        self.assertEqual(self.lib.db_count(db, 0, 0xFFFFFFFF), len(ids))
+        self.assertEqual(self.lib.db_flush_inserts(db), self.DB_OK)
+        self.assertEqual(self.lib.db_put(db, self.make_row(1)), self.DB_OK)
+        self.lib.db_close(db)
+
+        # closing flushed the last row; the tree's counts agree with its rows
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), sorted(ids + [1]))
+        self.assertEqual(self.lib.db_count(db, 100, 199), 50)
+        self.assertEqual(self.lib.db_get(db, ids[-1], ctypes.byref(row)), self.DB_OK)
+        self.assertEqual(row.username, b"renamed")
+        self.lib.db_close(db)
+
+    def test_in_memory_engine(self):
+        ids = list(range(0, 400, 2))
+        random.Random(11).shuffle(ids)
+        db = self.lib.db_open_with_flags(b"data.db", self.DB_OPEN_IN_MEMORY)
+        for i in ids:
+            self.assertEqual(self.lib.db_put(db, self.make_row(i)), self.DB_OK)
+        self.assertEqual(self.lib.db_put(db, self.make_row(ids[0])), self.DB_DUPLICATE_KEY)
+        updated = Row(ids[1], b"renamed", b"renamed@example.com")
+        self.assertEqual(self.lib.db_update(db, ctypes.byref(updated)), self.DB_OK)
+
+        row = Row()
+        self.assertEqual(self.lib.db_get(db, ids[1], ctypes.byref(row)), self.DB_OK)
+        self.assertEqual(row.username, b"renamed")
+        self.assertEqual(self.lib.db_get(db, 1, ctypes.byref(row)), self.DB_NOT_FOUND)
+        self.assertEqual(self.scan(db, 101, 150), list(range(102, 151, 2)))
+        self.assertEqual(self.lib.db_count(db, 101, 150), 25)
+        it = self.lib.db_scan(db, 0, 0xFFFFFFFF)
+        self.lib.db_iterator_skip(it, 10)
+        self.assertTrue(self.lib.db_iterator_next(it, ctypes.byref(row)))
+        self.assertEqual(row.id, 20)
+        self.lib.db_iterator_close(it)
+
+        # creating an index saves the rows first; later rows are indexed when they are next saved
+        self.assertEqual(self.lib.db_create_index(db, 2), self.DB_OK)  # DB_COLUMN_EMAIL
+        self.assertEqual(self.lib.db_put(db, self.make_row(1)), self.DB_OK)
+        it = self.lib.db_scan_column(db, 2, b"user1", True)
+        found = []
+        while self.lib.db_iterator_next(it, ctypes.byref(row)):
+            found.append(row.id)
+        self.lib.db_iterator_close(it)
+        self.assertEqual(found, sorted([1] + [i for i in ids if str(i).startswith("1")]))  # in id order
+
+        # rows are refused once a save would no longer fit in the file, so every accepted row is saved
+        accepted = [1]
+        for i in range(401, 2000, 2):
+            result = self.lib.db_put(db, self.make_row(i))
+            if result != self.DB_OK:
+                self.assertEqual(result, self.DB_TABLE_FULL)
+                break
+            accepted.append(i)
+        self.assertLess(len(accepted), 800)
+        self.lib.db_close(db)
+
+        # the paged engine reads the saved snapshot, index included
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), sorted(ids + accepted))
+        it = self.lib.db_scan_column(db, 2, b"renamed@example.com", False)
+        self.assertTrue(self.lib.db_iterator_next(it, ctypes.byref(row)))
+        self.assertEqual(row.id, ids[1])
+        self.lib.db_iterator_close(it)
+        self.lib.db_close(db)
+
+    def test_compressed_pages(self):
+        ids = list(range(150))
+        random.Random(5).shuffle(ids)
+        for path, flags in [(b"plain.db", 0), (b"data.db", self.DB_OPEN_COMPRESSED)]:
+            db = self.lib.db_open_with_flags(path, flags)
+            for i in ids:
+                self.assertEqual(self.lib.db_put(db, self.make_row(i)), self.DB_OK)
+            self.lib.db_close(db)
+        plain_size = os.path.getsize("plain.db")
+        remove_database("plain.db")
+        self.assertLess(os.path.getsize("data.db") * 8, plain_size)
+
+        # the file says it is compressed, so no flag is needed; rewritten pages move as they grow
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), list(range(150)))
+        for i in range(0, 150, 3):
+            updated = Row(i, f"renamed{i}".encode(), f"someone.else.entirely{i}@example.com".encode())
+            self.assertEqual(self.lib.db_update(db, ctypes.byref(updated)), self.DB_OK)
+        self.lib.db_sync(db)
+        self.assertEqual(self.lib.db_backup_start(db, b"backup.db", 0), self.DB_OK)
+        self.assertEqual(self.lib.db_backup_wait(db), self.DB_OK)
+        self.assertEqual(self.lib.db_vacuum(db), self.DB_OK)
+        self.lib.db_close(db)
+        self.assertLess(os.path.getsize("data.db") * 8, plain_size)
+
+        # backups are written as plain pages
+        self.assertEqual(os.path.getsize("backup.db") % 4096, 0)
+        for path in [b"data.db", b"backup.db"]:
+            db = self.lib.db_open(path)
+            row = Row()
+            self.assertEqual(self.lib.db_get(db, 9, ctypes.byref(row)), self.DB_OK)
+            self.assertEqual(row.email, b"someone.else.entirely9@example.com")
+            self.assertEqual(self.lib.db_get(db, 10, ctypes.byref(row)), self.DB_OK)
+            self.assertEqual(row.email, b"user10@example.com")
+            self.assertEqual(self.lib.db_count(db, 0, 0xFFFFFFFF), 150)
+            self.lib.db_close(db)
+        remove_database("backup.db")
+
+        # a superblock that fails its checksum, as a torn write would leave it, is refused
+        with open("data.db", "r+b") as f:
+            f.seek(12)
+            f.write(b"\xff")
+        process = subprocess.run(["./db"], input="SELECT\n.exit\n", capture_output=True, text=True)
+        self.assertNotEqual(process.returncode, 0)
+        self.assertEqual(process.stderr, "Superblock checksum mismatch. Corrupted file.\n")
+
+    def test_user_table_tuples(self):
+        DB_TYPE_INT, DB_TYPE_BIGINT, DB_TYPE_CHAR, DB_TYPE_VARCHAR = 0, 1, 2, 3
+        schema = Schema(b"scores", 4)
+        for i, column in enumerate([(b"id", DB_TYPE_INT, 0), (b"name", DB_TYPE_VARCHAR, 20),
+                                    (b"total", DB_TYPE_BIGINT, 0), (b"code", DB_TYPE_CHAR, 4)]):
+            schema.columns[i] = ColumnDef(*column)
+
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.lib.db_create_table(db, ctypes.byref(schema)), self.DB_OK)
+        self.assertEqual(self.lib.db_create_table(db, ctypes.byref(schema)), self.DB_DUPLICATE_KEY)
+        schema.name, schema.columns[0].type = b"bad", DB_TYPE_BIGINT  # the key must be an INT
+        self.assertEqual(self.lib.db_create_table(db, ctypes.byref(schema)), self.DB_ERROR)
+
+        # tuples are laid out like the C struct, so ctypes' layout matches
+        table = self.lib.db_table(db, b"scores")
+        self.assertEqual(self.lib.db_tuple_size(table), ctypes.sizeof(Score))
+        keys = list(range(-300, 300))
+        random.Random(7).shuffle(keys)
+        for key in keys:
+            score = Score(key, b"n" * (abs(key) % 21), key * 10**10, b"c%d" % (key % 10))
+            self.assertEqual(self.lib.db_table_put(db, table, ctypes.byref(score)), self.DB_OK)
+        self.assertEqual(self.lib.db_table_put(db, table, ctypes.byref(Score(5))), self.DB_DUPLICATE_KEY)
+        self.lib.db_close(db)
+
+        db = self.lib.db_open(b"data.db")
+        table = self.lib.db_table(db, b"scores")
+        score = Score()
+        self.assertEqual(self.lib.db_table_get(db, table, -299, ctypes.byref(score)), self.DB_OK)
+        self.assertEqual((score.id, score.name, score.total, score.code), (-299, b"n" * 5, -2990000000000, b"c1"))
+        self.assertEqual(self.lib.db_table_get(db, table, 300, ctypes.byref(score)), self.DB_NOT_FOUND)
+
+        it = self.lib.db_table_scan(db, table, -20, 20)
+        self.lib.db_iterator_skip(it, 30)
+        seen = []
+        while self.lib.db_iterator_next_tuple(it, ctypes.byref(score)):
+            seen.append((score.id, score.total))
+        self.lib.db_iterator_close(it)
+        self.assertEqual(seen, [(key, key * 10**10) for key in range(10, 21)])
+        self.lib.db_close(db)
+
+    def test_flusher_checkpoints_while_open(self):
+        db = self.lib.db_open(b"data.db")
+        options = FlusherOptions(interval_ms=1, max_pages=4, min_age_ms=0, checkpoint_ms=20)
+        self.assertEqual(self.lib.db_start_flusher(db, ctypes.byref(options)), self.DB_OK)
+        self.assertEqual(self.lib.db_start_flusher(db, ctypes.byref(options)), self.DB_ERROR)  # already running
+
+        def on_disk():
+            # a copy of the file as it stands, without db_sync or db_close
+            with open("data.db", "rb") as src, open("copy.db", "wb") as dst:
+                dst.write(src.read())
+            copy = self.lib.db_open(b"copy.db")
+            ids = self.scan(copy, 0, 0xFFFFFFFF)
+            self.lib.db_close(copy)
+            remove_database("copy.db")
+            return ids
+
+        ids = random.Random(9).sample(range(1000), 150)
+        for i in ids[:100]:
+            self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(i))), self.DB_OK)
+        time.sleep(0.2)
+        self.assertEqual(on_disk(), sorted(ids[:100]))
+
+        # the flusher follows VACUUM to the new file
+        self.assertEqual(self.lib.db_vacuum(db), self.DB_OK)
+        for i in ids[100:]:
+            self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(i))), self.DB_OK)
+        time.sleep(0.2)
+        self.assertEqual(on_disk(), sorted(ids))
+        self.lib.db_close(db)
+
+    def test_backup_is_a_snapshot(self):
+        ids = random.Random(11).sample(range(2000), 200)
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.lib.db_create_index(db, 2), self.DB_OK)  # DB_COLUMN_EMAIL
+        for i in ids[:100]:
+            self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(i))), self.DB_OK)
+
+        # slow enough that the inserts and the sync below land while it copies
+        self.assertEqual(self.lib.db_backup_start(db, b"backup.db", 1024 * 1024), self.DB_OK)
+        self.assertEqual(self.lib.db_backup_start(db, b"other.db", 0), self.DB_ERROR)  # one is running
+        for i in ids[100:]:
+            self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(i))), self.DB_OK)
+        self.lib.db_sync(db)
+        copied, total = ctypes.c_uint32(), ctypes.c_uint32()
+        self.assertTrue(self.lib.db_backup_progress(db, ctypes.byref(copied), ctypes.byref(total)))
+        self.assertLess(copied.value, total.value)
+
+        self.assertEqual(self.lib.db_backup_wait(db), self.DB_OK)
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), sorted(ids))
+        self.lib.db_close(db)
+
+        backup = self.lib.db_open(b"backup.db")
+        self.assertEqual(self.scan(backup, 0, 0xFFFFFFFF), sorted(ids[:100]))
+        it = self.lib.db_scan_column(backup, 2, f"user{ids[7]}@".encode(), True)
+        row = Row()
+        self.assertTrue(self.lib.db_iterator_next(it, ctypes.byref(row)))
+        self.assertEqual(row.id, ids[7])
+        self.lib.db_iterator_close(it)
+        self.lib.db_close(backup)
+        remove_database("backup.db")
+
+    def test_warmup_file_reloads_hot_pages(self):
+        db = self.lib.db_open(b"data.db")
+        for i in range(100):
+            self.assertEqual(self.lib.db_put(db, ctypes.byref(self.make_row(i))), self.DB_OK)
+        self.lib.db_close(db)
+
+        with open("data.db-warmup", "rb") as f:
+            magic, count = struct.unpack("=II", f.read(8))
+            entries = [struct.unpack("=II", f.read(8)) for _ in range(count)]
+        num_pages = os.path.getsize("data.db") // 4096
+        self.assertEqual(count, num_pages)  # everything was touched and fits
+        self.assertEqual(sorted(page for page, _ in entries), list(range(num_pages)))
+        self.assertTrue(all(accesses > 0 for _, accesses in entries))
+
+        # a fresh pager has nothing cached, so every listed page is read
+        pager = self.lib.open_pager(b"data.db", 0)
+        self.assertEqual(self.lib.pager_load_warmup(pager, b"data.db-warmup"), num_pages)
+        self.lib.close_pager(pager)
+
+        # a damaged file is ignored
+        with open("data.db-warmup", "r+b") as f:
+            f.truncate(12)
+        pager = self.lib.open_pager(b"data.db", 0)
+        self.assertEqual(self.lib.pager_load_warmup(pager, b"data.db-warmup"), 0)
+        self.lib.close_pager(pager)
+        db = self.lib.db_open(b"data.db")
+        self.assertEqual(self.scan(db, 0, 0xFFFFFFFF), list(range(100)))
+        self.lib.db_close(db)
+
+
+class TestWorkload(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        process = subprocess.Popen(
+            "make db ycsb",
+            shell=True,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE
+        )
+        stdout, stderr = process.communicate()
+        if process.returncode != 0:
+            raise Exception(f"Compilation failed: {stderr.decode()}")
+
+    def test_ycsb_trace_replays(self):
+        def generate(*args):
+            return subprocess.run(["./ycsb", "generate", *args], capture_output=True, text=True, check=True).stdout
+
+        trace = generate("-w", "F", "-r", "300", "-n", "2000", "-s", "3")
+        self.assertEqual(trace, generate("-w", "F", "-r", "300", "-n", "2000", "-s", "3"))
+        self.assertNotEqual(trace, generate("-w", "F", "-r", "300", "-n", "2000", "-s", "4"))
+        with open("trace.txt", "w") as f:
+            f.write(trace)
+        try:
+            reports = [subprocess.run(["./ycsb", "run", "--json", *args, "trace.txt"], capture_output=True,
+                                      text=True, check=True).stdout
+                       for args in (["-t", "2"], ["--repl", "./db"])]
+
+            # a file that already exists is left alone rather than replaced by the run's database
+            with open("kept.db", "w") as f:
+                f.write("keep")
+            result = subprocess.run(["./ycsb", "run", "--db", "kept.db", "trace.txt"], capture_output=True, text=True)
+            self.assertNotEqual(result.returncode, 0)
+            self.assertIn("kept.db already exists", result.stderr)
+            with open("kept.db") as f:
+                self.assertEqual(f.read(), "keep")
+        finally:
+            os.remove("trace.txt")
+            if os.path.exists("kept.db"):
+                os.remove("kept.db")
+
+        for report in map(json.loads, reports):
+            ops = report["ops"]
+            self.assertEqual(set(ops), {"read", "rmw"})
+            self.assertEqual(ops["read"]["count"] + ops["rmw"]["count"], 2000)
+            self.assertEqual(ops["read"]["count"], trace.count("\nread "))
+            self.assertEqual(report["not_found"], 0)
+            self.assertEqual(sum(point["ops_per_s"] > 0 for point in report["timeline"]), len(report["timeline"]))
+
+
+class TestLargeFile(unittest.TestCase):
+    PAGE_SIZE = 4096
+    PAGES_PER_4GB = (1 << 32) // 4096
+    FILE = "large.db"
+
+    @classmethod
+    def setUpClass(cls):
+        # the default build caps files at 100 pages, so build the pager alone with room past 4 GB
+        process = subprocess.Popen(
+            f"cc -O2 -shared -fPIC -DTABLE_MAX_PAGES={cls.PAGES_PER_4GB + 100000} pager.c compress.c trace.c -o libpager_large.so",
+            shell=True,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE
+        )
+        stdout, stderr = process.communicate()
+        if process.returncode != 0:
+            raise Exception(f"Compilation failed: {stderr.decode()}")
+
+        lib = ctypes.CDLL("./libpager_large.so")
+        lib.open_pager.restype = ctypes.c_void_p
+        lib.open_pager.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+        lib.get_page.restype = ctypes.c_void_p
+        lib.get_page.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+        lib.mark_page_dirty.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+        lib.close_pager.argtypes = [ctypes.c_void_p]
+        cls.lib = lib
+
+    @classmethod
+    def tearDownClass(cls):
+        os.remove("libpager_large.so")
+
+    def tearDown(self):
+        os.remove(self.FILE)
+
+    def marker(self, page_idx):
+        return f"page {page_idx}".encode().ljust(self.PAGE_SIZE, b".")
+
+    def test_pages_past_4gb_land_at_their_offsets(self):
+        pages = [1, self.PAGES_PER_4GB - 1, self.PAGES_PER_4GB, self.PAGES_PER_4GB + 99999]
+        pager = self.lib.open_pager(self.FILE.encode(), 0)
+        for page_idx in pages:
+            page = self.lib.get_page(pager, page_idx)
+            self.lib.mark_page_dirty(pager, page_idx)
+            ctypes.memmove(page, self.marker(page_idx), self.PAGE_SIZE)
+        self.lib.close_pager(pager)
+
+        # the file is sparse: only the written pages take space
+        self.assertEqual(os.path.getsize(self.FILE), (pages[-1] + 1) * self.PAGE_SIZE)
+        fd = os.open(self.FILE, os.O_RDWR)
+        for page_idx in pages:
+            self.assertEqual(os.pread(fd, self.PAGE_SIZE, page_idx * self.PAGE_SIZE), self.marker(page_idx))
+        written_behind = self.PAGES_PER_4GB + 12345
+        os.pwrite(fd, self.marker(written_behind), written_behind * self.PAGE_SIZE)
+        os.close(fd)
+
+        pager = self.lib.open_pager(self.FILE.encode(), 0)
+        for page_idx in pages + [written_behind]:
+            self.assertEqual(ctypes.string_at(self.lib.get_page(pager, page_idx), self.PAGE_SIZE), self.marker(page_idx))
+        self.assertEqual(ctypes.string_at(self.lib.get_page(pager, 2), self.PAGE_SIZE), bytes(self.PAGE_SIZE))
+        self.lib.close_pager(pager)
+
+
+class TestServer(unittest.TestCase):
+    OP_PUT, OP_GET, OP_SCAN, OP_BATCH = 1, 2, 3, 4
+    SOCKET_PATH = "test.sock"
+
+    @classmethod
+    def setUpClass(cls):
+        process = subprocess.Popen(
+            "make dbserver db",
+            shell=True,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE
+        )
+        stdout, stderr = process.communicate()
+        if process.returncode != 0:
+            raise Exception(f"Compilation failed: {stderr.decode()}")
+
+    def setUp(self):
+        self.server = subprocess.Popen(["./dbserver", "-d", "data.db", "-s", self.SOCKET_PATH])
+        for _ in range(100):
+            if os.path.exists(self.SOCKET_PATH):
+                break
+            time.sleep(0.01)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(self.SOCKET_PATH)
+
+    def tearDown(self):
+        self.sock.close()
+        if self.server.poll() is None:
+            self.server.send_signal(signal.SIGTERM)
+            self.server.wait()
+        remove_database("data.db")
+
+    def frame(self, body):
+        return struct.pack("=I", len(body)) + body
+
+    def row(self, i):
+        username, email = f"user{i}".encode(), f"user{i}@example.com".encode()
+        return struct.pack("=IB", i, len(username)) + username + struct.pack("=B", len(email)) + email
+
+    def recv_exact(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            self.assertTrue(chunk)
+            data += chunk
+        return data
+
+    def recv_frame(self):
+        (length,) = struct.unpack("=I", self.recv_exact(4))
+        return self.recv_exact(length)
+
+    def test_pipelined_requests(self):
+        requests = [
+            self.frame(struct.pack("=B", self.OP_PUT) + self.row(2)),
+            self.frame(struct.pack("=B", self.OP_PUT) + self.row(2)),
+            self.frame(struct.pack("=BI", self.OP_BATCH, 2) + self.row(1) + self.row(3)),
+            self.frame(struct.pack("=BI", self.OP_GET, 3)),
+            self.frame(struct.pack("=BI", self.OP_GET, 9)),
+            self.frame(struct.pack("=BIII", self.OP_SCAN, 0, 2, 10)),
+        ]
+        # every request is written before any reply is read
+        self.sock.sendall(b"".join(requests))
+
+        self.assertEqual(self.recv_frame(), bytes([0]))
+        self.assertEqual(self.recv_frame(), bytes([2]))
+        self.assertEqual(self.recv_frame(), bytes([0]) + struct.pack("=I", 2))
+        self.assertEqual(self.recv_frame(), bytes([0]) + self.row(3))
+        self.assertEqual(self.recv_frame(), bytes([1]))
+        self.assertEqual(self.recv_frame(), bytes([0]) + struct.pack("=I", 2) + self.row(1) + self.row(2))
+
+    def test_writes_are_committed_to_file(self):
+        self.sock.sendall(self.frame(struct.pack("=B", self.OP_PUT) + self.row(7)))
+        self.assertEqual(self.recv_frame(), bytes([0]))
+
+        # the reply is only sent after the commit, so the row is on disk already
+        process = subprocess.run(["./db"], input="SELECT\n.exit\n", capture_output=True, text=True)
+        self.assertEqual(process.stdout.splitlines()[0], "db > 7 user7 user7@example.com")
+
 if __name__ == '__main__':
     unittest.main()
\ No newline at end of file
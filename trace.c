@@ -0,0 +1,170 @@
+#define _GNU_SOURCE // gettid
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+bool trace_active = false;
+
+// the flusher and backup threads write spans too, so events are written under a lock
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file = NULL;
+static uint64_t trace_start_ns;
+static bool trace_first_event;
+
+uint64_t trace_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Starts writing spans to path, replacing a trace already recording. Returns false if path can't be opened */
+bool trace_start(const char *path)
+{
+#ifdef DB_NO_TRACE
+    return false;
+#else
+    trace_stop();
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    trace_file = file;
+    trace_start_ns = trace_clock_ns();
+    trace_first_event = true;
+    fprintf(trace_file, "{\"traceEvents\":[");
+    trace_active = true;
+    pthread_mutex_unlock(&trace_lock);
+    return true;
+#endif
+}
+
+/* Writes a complete event for work that began at start_ns and ends now */
+void trace_span(const char *name, uint64_t start_ns)
+{
+    uint64_t end_ns = trace_clock_ns();
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file && start_ns >= trace_start_ns)
+    {
+        fprintf(trace_file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld}",
+                trace_first_event ? "" : ",", name, (start_ns - trace_start_ns) / 1000.0,
+                (end_ns - start_ns) / 1000.0, (int)getpid(), (long)syscall(SYS_gettid));
+        trace_first_event = false;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* Finishes and closes the trace file, if one is recording */
+void trace_stop()
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file)
+    {
+        trace_active = false;
+        fprintf(trace_file, "\n]}\n");
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* Values below HISTOGRAM_SUB_BUCKETS have a bucket each; above, each power of two has HISTOGRAM_SUB_BUCKETS */
+static uint32_t bucket_of(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+    {
+        return value;
+    }
+    uint32_t exponent = 63 - __builtin_clzll(value);
+    uint32_t sub_bucket = (value >> (exponent - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+/* Smallest value that falls in bucket */
+static uint64_t bucket_floor(uint32_t bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    uint32_t exponent = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKET_BITS - 1;
+    uint64_t sub_bucket = bucket % HISTOGRAM_SUB_BUCKETS;
+    return (HISTOGRAM_SUB_BUCKETS + sub_bucket) << (exponent - HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+void histogram_reset(LatencyHistogram *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->min = UINT64_MAX;
+}
+
+void histogram_record(LatencyHistogram *histogram, uint64_t value)
+{
+    histogram->counts[bucket_of(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value < histogram->min)
+    {
+        histogram->min = value;
+    }
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+/* Adds the values recorded in from to into, e.g. to combine per-thread histograms */
+void histogram_merge(LatencyHistogram *into, const LatencyHistogram *from)
+{
+    for (uint32_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        into->counts[bucket] += from->counts[bucket];
+    }
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->min < into->min)
+    {
+        into->min = from->min;
+    }
+    if (from->max > into->max)
+    {
+        into->max = from->max;
+    }
+}
+
+/*
+Returns a value that percentile percent of the recorded values are at or below:
+the top of the bucket holding that rank, capped at the largest value recorded
+*/
+uint64_t histogram_percentile(const LatencyHistogram *histogram, double percentile)
+{
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += histogram->counts[bucket];
+        if (seen >= rank)
+        {
+            uint64_t top = bucket + 1 < HISTOGRAM_BUCKETS ? bucket_floor(bucket + 1) - 1 : UINT64_MAX;
+            return top < histogram->max ? top : histogram->max;
+        }
+    }
+    return histogram->max;
+}
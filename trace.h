@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Timing instrumentation
+
+Spans: TRACE_BEGIN and TRACE_END bracket a piece of engine work. While a trace
+is being recorded (trace_start) each span is written as a Chrome trace event,
+so a file can be opened in chrome://tracing or Perfetto to see where the time
+of one slow statement went. When no trace is recording a span costs one
+predictable branch; building with -DDB_NO_TRACE removes spans entirely.
+
+Histograms: log-linear latency histograms in the style of HdrHistogram. Each
+power of two is split into HISTOGRAM_SUB_BUCKETS linear buckets, so any
+recorded value is known to within about 6% whatever its magnitude.
+*/
+
+#ifdef DB_NO_TRACE
+#define TRACE_BEGIN(span)
+#define TRACE_END(span, name)
+#else
+extern bool trace_active; // a trace file is open
+
+#define TRACE_BEGIN(span) uint64_t span = trace_active ? trace_clock_ns() : 0
+#define TRACE_END(span, name)           \
+    do                                  \
+    {                                   \
+        if (span)                       \
+        {                               \
+            trace_span((name), (span)); \
+        }                               \
+    } while (0)
+#endif
+
+uint64_t trace_clock_ns();
+bool trace_start(const char *path);
+void trace_span(const char *name, uint64_t start_ns);
+void trace_stop();
+
+#define HISTOGRAM_SUB_BUCKET_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+} LatencyHistogram;
+
+void histogram_reset(LatencyHistogram *histogram);
+void histogram_record(LatencyHistogram *histogram, uint64_t value);
+void histogram_merge(LatencyHistogram *into, const LatencyHistogram *from);
+uint64_t histogram_percentile(const LatencyHistogram *histogram, double percentile);
+
+#endif
@@ -0,0 +1,89 @@
+#include <math.h>
+
+#include "workload.h"
+
+/* splitmix64: fast, and every seed (0 included) gives a full-period stream */
+void rng_seed(Rng *rng, uint64_t seed)
+{
+    rng->state = seed;
+}
+
+uint64_t rng_next(Rng *rng)
+{
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, n), by multiplying instead of taking a modulo */
+uint64_t rng_below(Rng *rng, uint64_t n)
+{
+    return (uint64_t)(((unsigned __int128)rng_next(rng) * n) >> 64);
+}
+
+/* Uniform in [0, 1) */
+double rng_double(Rng *rng)
+{
+    return (rng_next(rng) >> 11) * (1.0 / (1ull << 53));
+}
+
+void shuffle_u32(Rng *rng, uint32_t *values, uint32_t n)
+{
+    for (uint32_t i = n - 1; i > 0; i--)
+    {
+        uint32_t j = rng_below(rng, i + 1);
+        uint32_t tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+}
+
+static double zeta(uint64_t n, double theta)
+{
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++)
+    {
+        sum += 1 / pow(i, theta);
+    }
+    return sum;
+}
+
+/* Prepares draws over ranks [0, n); takes time linear in n, once */
+void zipfian_init(Zipfian *zipfian, uint64_t n, double theta)
+{
+    zipfian->n = n;
+    zipfian->theta = theta;
+    zipfian->alpha = 1 / (1 - theta);
+    zipfian->zetan = zeta(n, theta);
+    zipfian->eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zipfian->zetan);
+}
+
+uint64_t zipfian_next(Zipfian *zipfian, Rng *rng)
+{
+    double u = rng_double(rng);
+    double uz = u * zipfian->zetan;
+    if (uz < 1)
+    {
+        return 0;
+    }
+    if (uz < 1 + pow(0.5, zipfian->theta))
+    {
+        return 1;
+    }
+    uint64_t rank = zipfian->n * pow(zipfian->eta * u - zipfian->eta + 1, zipfian->alpha);
+    return rank < zipfian->n ? rank : zipfian->n - 1;
+}
+
+/* FNV-1a over the 8 bytes of value, as YCSB's ScrambledZipfianGenerator hashes ranks */
+uint64_t scramble_u64(uint64_t value)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (int i = 0; i < 8; i++)
+    {
+        hash ^= value & 0xff;
+        hash *= 0x100000001b3ull;
+        value >>= 8;
+    }
+    return hash;
+}
@@ -0,0 +1,40 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+
+/*
+Key generators for the benchmarks
+
+Every generator draws from an explicitly seeded Rng, so a run can be repeated
+exactly. Zipfian follows Gray et al., "Quickly Generating Billion-Record
+Synthetic Databases": rank 0 is the most popular, and theta (0.99 in YCSB)
+sets the skew. scramble_u64 spreads ranks over the key space, so the
+popular keys are not all next to each other.
+*/
+
+typedef struct
+{
+    uint64_t state;
+} Rng;
+
+typedef struct
+{
+    uint64_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} Zipfian;
+
+void rng_seed(Rng *rng, uint64_t seed);
+uint64_t rng_next(Rng *rng);
+uint64_t rng_below(Rng *rng, uint64_t n);
+double rng_double(Rng *rng);
+void shuffle_u32(Rng *rng, uint32_t *values, uint32_t n);
+
+void zipfian_init(Zipfian *zipfian, uint64_t n, double theta);
+uint64_t zipfian_next(Zipfian *zipfian, Rng *rng);
+uint64_t scramble_u64(uint64_t value);
+
+#endif
@@ -0,0 +1,856 @@
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "db.h"
+#include "trace.h"
+#include "workload.h"
+
+/*
+YCSB-style workloads: generate a trace, then replay it
+
+    ycsb generate [-w A-F] [-r records] [-n operations] [-s seed] [-o trace]
+    ycsb run [-t threads] [-i interval_ms] [--json] [--db file] [--repl program] trace
+    ycsb script trace
+
+A trace is a text file: a header naming the workload, record count and seed,
+then one operation per line ("read 12", "update 12", "insert 1000",
+"scan 12 57", "rmw 12"). The same seed always gives the same trace, so a trace
+can be kept and replayed against later commits.
+
+The mixes and key distributions are YCSB's core workloads:
+    A  50% read, 50% update                 Zipfian
+    B  95% read, 5% update                  Zipfian
+    C  100% read                            Zipfian
+    D  95% read, 5% insert                  latest (recent inserts are hot)
+    E  95% scan of 1-100 rows, 5% insert    Zipfian start ids
+    F  50% read, 50% read-modify-write      Zipfian
+Zipfian keys are scrambled so the hot ids are spread over the table. Records
+0..records-1 are loaded in a shuffled order before the operations run, and
+inserts append ids from records up.
+
+run replays a trace in-process through the C API. With -t threads each thread
+takes every threads-th operation. The Database is used by one thread at a
+time, so the threads take turns on a lock, and an operation's latency includes
+its wait: what a client would see queueing for the engine. --repl feeds the
+same operations as statements to the REPL (e.g. --repl ./db) with .timer on,
+and times each operation from the REPL's Run Time lines. That covers
+statement parsing and output, not the pipe. The run builds its database in
+--db (ycsb.db by default) and removes it at the end, so that file must not
+exist beforehand.
+
+Both report throughput for each interval (-i, 1000 ms by default) and latency
+percentiles for each operation type. script prints the statements --repl runs.
+Through the REPL, times have its microsecond resolution and load time is not
+measured. With threads, a read of an id whose insert belongs to another thread
+that has not got to it yet finds nothing; these are counted as not found.
+*/
+
+typedef enum
+{
+    OP_READ,
+    OP_UPDATE,
+    OP_INSERT,
+    OP_SCAN,
+    OP_READ_MODIFY_WRITE
+} OpType;
+
+#define NUM_OP_TYPES 5
+
+static const char *OP_NAMES[] = {"read", "update", "insert", "scan", "rmw"};
+
+typedef enum
+{
+    KEYS_UNIFORM,
+    KEYS_ZIPFIAN,
+    KEYS_LATEST
+} KeyDistribution;
+
+typedef struct
+{
+    char name;
+    double proportions[NUM_OP_TYPES]; // by OpType
+    KeyDistribution keys;
+} WorkloadSpec;
+
+static const WorkloadSpec WORKLOADS[] = {
+    {'A', {0.5, 0.5, 0, 0, 0}, KEYS_ZIPFIAN},    {'B', {0.95, 0.05, 0, 0, 0}, KEYS_ZIPFIAN},
+    {'C', {1, 0, 0, 0, 0}, KEYS_ZIPFIAN},        {'D', {0.95, 0, 0.05, 0, 0}, KEYS_LATEST},
+    {'E', {0, 0, 0.05, 0.95, 0}, KEYS_ZIPFIAN},  {'F', {0.5, 0, 0, 0, 0.5}, KEYS_ZIPFIAN},
+};
+
+static const double ZIPFIAN_THETA = 0.99;
+static const uint32_t MAX_SCAN_LENGTH = 100;
+static const uint32_t LOAD_BATCH_ROWS = 1024;
+static const char *DEFAULT_DB_FILE = "ycsb.db";
+
+typedef struct
+{
+    uint8_t type;
+    uint32_t key;
+    uint32_t scan_length;
+} Op;
+
+typedef struct
+{
+    char workload;
+    uint32_t records;
+    uint64_t seed;
+    Op *ops;
+    uint32_t num_ops;
+    uint32_t capacity;
+} Trace;
+
+/* Latencies and completions of one replaying thread, merged when the run ends */
+typedef struct
+{
+    LatencyHistogram latency[NUM_OP_TYPES];
+    uint64_t *interval_ops; // operations finished in each interval since the start
+    uint32_t num_intervals;
+    uint64_t not_found; // reads and updates of ids not inserted yet, by another thread
+} Recorder;
+
+typedef struct
+{
+    Database *db;
+    const Trace *trace;
+    uint32_t thread;
+    uint32_t num_threads;
+    uint64_t start_ns;
+    uint64_t interval_ns;
+    Recorder recorder;
+} Worker;
+
+// the Database is used from one thread at a time
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fail(const char *message, const char *detail)
+{
+    fprintf(stderr, "%s%s\n", message, detail ? detail : "");
+    exit(EXIT_FAILURE);
+}
+
+static const WorkloadSpec *find_workload(char name)
+{
+    for (uint32_t i = 0; i < sizeof(WORKLOADS) / sizeof(WORKLOADS[0]); i++)
+    {
+        if (WORKLOADS[i].name == name)
+        {
+            return &WORKLOADS[i];
+        }
+    }
+    return NULL;
+}
+
+static void trace_append(Trace *trace, Op op)
+{
+    if (trace->num_ops == trace->capacity)
+    {
+        trace->capacity = trace->capacity ? trace->capacity * 2 : 1024;
+        trace->ops = realloc(trace->ops, trace->capacity * sizeof(Op));
+    }
+    trace->ops[trace->num_ops++] = op;
+}
+
+static OpType choose_op(const WorkloadSpec *spec, Rng *rng)
+{
+    double u = rng_double(rng);
+    for (uint32_t type = 0; type < NUM_OP_TYPES; type++)
+    {
+        if (u < spec->proportions[type])
+        {
+            return type;
+        }
+        u -= spec->proportions[type];
+    }
+    return OP_READ; // rounding left u just past the last proportion
+}
+
+/* An id among the inserted ones, [0, inserted) */
+static uint32_t choose_key(const WorkloadSpec *spec, Zipfian *zipfian, Rng *rng, uint32_t inserted)
+{
+    switch (spec->keys)
+    {
+    case (KEYS_UNIFORM):
+        return rng_below(rng, inserted);
+    case (KEYS_ZIPFIAN):
+        return scramble_u64(zipfian_next(zipfian, rng)) % inserted;
+    case (KEYS_LATEST):
+        return inserted - 1 - zipfian_next(zipfian, rng) % inserted;
+    }
+    return 0;
+}
+
+static Trace generate(const WorkloadSpec *spec, uint32_t records, uint32_t operations, uint64_t seed)
+{
+    Trace trace = {.workload = spec->name, .records = records, .seed = seed};
+    Rng rng;
+    rng_seed(&rng, seed);
+    // ranks are drawn over the loaded records; inserts during the run only widen the modulo
+    Zipfian zipfian;
+    zipfian_init(&zipfian, records, ZIPFIAN_THETA);
+
+    uint32_t inserted = records;
+    for (uint32_t i = 0; i < operations; i++)
+    {
+        Op op = {.type = choose_op(spec, &rng)};
+        if (op.type == OP_INSERT)
+        {
+            op.key = inserted++;
+        }
+        else
+        {
+            op.key = choose_key(spec, &zipfian, &rng, inserted);
+        }
+        if (op.type == OP_SCAN)
+        {
+            op.scan_length = 1 + rng_below(&rng, MAX_SCAN_LENGTH);
+        }
+        trace_append(&trace, op);
+    }
+    return trace;
+}
+
+static void write_trace(FILE *file, const Trace *trace)
+{
+    fprintf(file, "ycsb %c records %u seed %llu\n", trace->workload, trace->records,
+            (unsigned long long)trace->seed);
+    for (uint32_t i = 0; i < trace->num_ops; i++)
+    {
+        const Op *op = &trace->ops[i];
+        if (op->type == OP_SCAN)
+        {
+            fprintf(file, "%s %u %u\n", OP_NAMES[op->type], op->key, op->scan_length);
+        }
+        else
+        {
+            fprintf(file, "%s %u\n", OP_NAMES[op->type], op->key);
+        }
+    }
+}
+
+static Trace read_trace(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fail("Unable to open trace ", path);
+    }
+
+    Trace trace = {0};
+    unsigned long long seed;
+    char line[128];
+    if (fgets(line, sizeof(line), file) == NULL ||
+        sscanf(line, "ycsb %c records %u seed %llu", &trace.workload, &trace.records, &seed) != 3)
+    {
+        fail("Not a trace: ", path);
+    }
+    trace.seed = seed;
+
+    uint32_t line_number = 1;
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        char name[16];
+        Op op = {0};
+        int fields = sscanf(line, "%15s %u %u", name, &op.key, &op.scan_length);
+        bool known = false;
+        for (uint32_t type = 0; type < NUM_OP_TYPES && !known; type++)
+        {
+            if (strcmp(name, OP_NAMES[type]) == 0)
+            {
+                op.type = type;
+                known = true;
+            }
+        }
+        if (!known || fields != (op.type == OP_SCAN ? 3 : 2))
+        {
+            fprintf(stderr, "%s:%u: ", path, line_number);
+            fail("Unrecognized operation: ", line);
+        }
+        trace_append(&trace, op);
+    }
+    fclose(file);
+    return trace;
+}
+
+/* Records 0..records-1 in the order they are loaded; a function of the seed alone */
+static uint32_t *load_order(const Trace *trace)
+{
+    uint32_t *ids = malloc((trace->records ? trace->records : 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < trace->records; i++)
+    {
+        ids[i] = i;
+    }
+    if (trace->records > 1)
+    {
+        Rng rng;
+        rng_seed(&rng, ~trace->seed); // a different stream from the one the operations came from
+        shuffle_u32(&rng, ids, trace->records);
+    }
+    return ids;
+}
+
+/* Fills in the row an insert or update writes; version tells the values of one id apart */
+static void make_row(Row *row, uint32_t id, uint32_t version)
+{
+    memset(row, 0, sizeof(*row));
+    row->id = id;
+    snprintf(row->username, sizeof(row->username), "user%u", id);
+    snprintf(row->email, sizeof(row->email), "user%u.%u@example.com", id, version);
+}
+
+static void load(Database *db, const Trace *trace)
+{
+    uint32_t *ids = load_order(trace);
+    Row *rows = malloc(LOAD_BATCH_ROWS * sizeof(Row));
+    for (uint32_t first = 0; first < trace->records; first += LOAD_BATCH_ROWS)
+    {
+        uint32_t count = trace->records - first < LOAD_BATCH_ROWS ? trace->records - first : LOAD_BATCH_ROWS;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            make_row(&rows[i], ids[first + i], 0);
+        }
+        if (db_put_batch(db, rows, count, NULL) != DB_OK)
+        {
+            fail("Load failed: the table is full", NULL);
+        }
+    }
+    free(rows);
+    free(ids);
+}
+
+/* Runs the operation at index i of the trace; returns false if its id was absent */
+static bool execute_op(Database *db, const Op *op, uint32_t i)
+{
+    Row row;
+    switch (op->type)
+    {
+    case (OP_READ):
+        return db_get(db, op->key, &row) == DB_OK;
+    case (OP_UPDATE):
+        make_row(&row, op->key, i + 1);
+        return db_update(db, &row) == DB_OK;
+    case (OP_INSERT):
+        make_row(&row, op->key, 0);
+        if (db_put(db, &row) == DB_TABLE_FULL)
+        {
+            fail("Insert failed: the table is full", NULL);
+        }
+        return true;
+    case (OP_SCAN):
+    {
+        RowView view;
+        DbIterator *it = db_scan(db, op->key, UINT32_MAX);
+        uint32_t seen = 0;
+        while (seen < op->scan_length && db_iterator_next_view(it, &view))
+        {
+            seen++;
+        }
+        db_iterator_close(it);
+        return true;
+    }
+    case (OP_READ_MODIFY_WRITE):
+        if (db_get(db, op->key, &row) != DB_OK)
+        {
+            return false;
+        }
+        snprintf(row.email, sizeof(row.email), "user%u.%u@example.com", op->key, i + 1);
+        return db_update(db, &row) == DB_OK;
+    }
+    return false;
+}
+
+static void recorder_init(Recorder *recorder)
+{
+    memset(recorder, 0, sizeof(*recorder));
+    for (uint32_t type = 0; type < NUM_OP_TYPES; type++)
+    {
+        histogram_reset(&recorder->latency[type]);
+    }
+}
+
+/* Makes room for counts up to interval, zeroing the new ones */
+static void recorder_grow(Recorder *recorder, uint32_t interval)
+{
+    if (interval < recorder->num_intervals)
+    {
+        return;
+    }
+    uint32_t num_intervals = interval + 1 > recorder->num_intervals * 2 ? interval + 1 : recorder->num_intervals * 2;
+    recorder->interval_ops = realloc(recorder->interval_ops, num_intervals * sizeof(uint64_t));
+    memset(recorder->interval_ops + recorder->num_intervals, 0,
+           (num_intervals - recorder->num_intervals) * sizeof(uint64_t));
+    recorder->num_intervals = num_intervals;
+}
+
+/* Counts one operation of type that took latency_ns and finished in the given interval */
+static void recorder_add(Recorder *recorder, OpType type, uint64_t latency_ns, uint32_t interval)
+{
+    histogram_record(&recorder->latency[type], latency_ns);
+    recorder_grow(recorder, interval);
+    recorder->interval_ops[interval]++;
+}
+
+static void recorder_merge(Recorder *into, const Recorder *from)
+{
+    for (uint32_t type = 0; type < NUM_OP_TYPES; type++)
+    {
+        histogram_merge(&into->latency[type], &from->latency[type]);
+    }
+    if (from->num_intervals)
+    {
+        recorder_grow(into, from->num_intervals - 1);
+    }
+    for (uint32_t interval = 0; interval < from->num_intervals; interval++)
+    {
+        into->interval_ops[interval] += from->interval_ops[interval];
+    }
+    into->not_found += from->not_found;
+}
+
+static void *replay_thread(void *arg)
+{
+    Worker *worker = arg;
+    const Trace *trace = worker->trace;
+    for (uint32_t i = worker->thread; i < trace->num_ops; i += worker->num_threads)
+    {
+        const Op *op = &trace->ops[i];
+        uint64_t begin_ns = trace_clock_ns();
+        pthread_mutex_lock(&engine_lock);
+        bool found = execute_op(worker->db, op, i);
+        pthread_mutex_unlock(&engine_lock);
+        uint64_t end_ns = trace_clock_ns();
+        if (!found)
+        {
+            worker->recorder.not_found++;
+        }
+        recorder_add(&worker->recorder, op->type, end_ns - begin_ns, (end_ns - worker->start_ns) / worker->interval_ns);
+    }
+    return NULL;
+}
+
+/* The run starts from an empty database and removes it afterwards, so it won't take over a file that exists */
+static void check_db_files_absent(const char *path)
+{
+    char warmup[1024];
+    snprintf(warmup, sizeof(warmup), "%s-warmup", path);
+    if (access(path, F_OK) == 0 || access(warmup, F_OK) == 0)
+    {
+        fail(path, " already exists; run needs --db to name a new file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void remove_db_files(const char *path)
+{
+    char warmup[1024];
+    snprintf(warmup, sizeof(warmup), "%s-warmup", path);
+    unlink(path);
+    unlink(warmup);
+}
+
+/* Loads and replays trace in-process; returns the run's wall time */
+static uint64_t replay_in_process(const Trace *trace, const char *path, uint32_t num_threads, uint64_t interval_ns,
+                                  Recorder *total, uint64_t *load_ns)
+{
+    Database *db = db_open(path);
+    uint64_t start_ns = trace_clock_ns();
+    load(db, trace);
+    *load_ns = trace_clock_ns() - start_ns;
+
+    Worker *workers = calloc(num_threads, sizeof(Worker));
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    start_ns = trace_clock_ns();
+    for (uint32_t t = 0; t < num_threads; t++)
+    {
+        workers[t] = (Worker){.db = db, .trace = trace, .thread = t, .num_threads = num_threads,
+                              .start_ns = start_ns, .interval_ns = interval_ns};
+        recorder_init(&workers[t].recorder);
+        pthread_create(&threads[t], NULL, replay_thread, &workers[t]);
+    }
+    for (uint32_t t = 0; t < num_threads; t++)
+    {
+        pthread_join(threads[t], NULL);
+        recorder_merge(total, &workers[t].recorder);
+        free(workers[t].recorder.interval_ops);
+    }
+    uint64_t elapsed_ns = trace_clock_ns() - start_ns;
+
+    free(threads);
+    free(workers);
+    db_close(db);
+    remove_db_files(path);
+    return elapsed_ns;
+}
+
+static void write_row_statement(FILE *file, const char *verb, uint32_t id, uint32_t version)
+{
+    Row row;
+    make_row(&row, id, version);
+    fprintf(file, "%s %u %s %s\n", verb, id, row.username, row.email);
+}
+
+/* Writes the REPL statements that load the records, then run each operation with .timer on */
+static void write_script(FILE *file, const Trace *trace)
+{
+    fprintf(file, "-- ycsb %c records %u seed %llu\n", trace->workload, trace->records,
+            (unsigned long long)trace->seed);
+    uint32_t *ids = load_order(trace);
+    for (uint32_t i = 0; i < trace->records; i++)
+    {
+        write_row_statement(file, "INSERT", ids[i], 0);
+    }
+    free(ids);
+
+    fprintf(file, ".timer on\n");
+    for (uint32_t i = 0; i < trace->num_ops; i++)
+    {
+        const Op *op = &trace->ops[i];
+        switch (op->type)
+        {
+        case (OP_READ):
+            fprintf(file, "SELECT WHERE id = %u\n", op->key);
+            break;
+        case (OP_UPDATE):
+            write_row_statement(file, "UPDATE", op->key, i + 1);
+            break;
+        case (OP_INSERT):
+            write_row_statement(file, "INSERT", op->key, 0);
+            break;
+        case (OP_SCAN):
+            fprintf(file, "SELECT WHERE id BETWEEN %u AND %u LIMIT %u\n", op->key, UINT32_MAX, op->scan_length);
+            break;
+        case (OP_READ_MODIFY_WRITE):
+            fprintf(file, "SELECT WHERE id = %u\n", op->key);
+            write_row_statement(file, "UPDATE", op->key, i + 1);
+            break;
+        }
+    }
+}
+
+/*
+Replays trace through the REPL at program, one process running the script.
+Operations are timed from the Run Time lines .timer prints, so the intervals
+are in statement time; returns the sum of it
+*/
+static uint64_t replay_through_repl(const Trace *trace, const char *path, const char *program, uint64_t interval_ns,
+                                    Recorder *total)
+{
+    char script_path[] = "ycsb-script-XXXXXX";
+    int script_fd = mkstemp(script_path);
+    if (script_fd == -1)
+    {
+        fail("Unable to create the script file", NULL);
+    }
+    FILE *script = fdopen(script_fd, "w");
+    write_script(script, trace);
+    fclose(script);
+
+    int output[2];
+    if (pipe(output) == -1)
+    {
+        fail("Unable to create a pipe", NULL);
+    }
+    pid_t child = fork();
+    if (child == 0)
+    {
+        dup2(output[1], STDOUT_FILENO);
+        close(output[0]);
+        close(output[1]);
+        execl(program, program, "-f", script_path, path, (char *)NULL);
+        perror(program);
+        _exit(127);
+    }
+    close(output[1]);
+
+    // each operation prints one Run Time line, except read-modify-write, which prints two
+    FILE *repl = fdopen(output[0], "r");
+    char line[512];
+    uint32_t i = 0;
+    uint32_t statements_left = 0;
+    uint64_t op_ns = 0;
+    uint64_t elapsed_ns = 0;
+    double seconds;
+    while (i < trace->num_ops && fgets(line, sizeof(line), repl))
+    {
+        if (sscanf(line, "Run Time: %lf s", &seconds) != 1)
+        {
+            continue; // rows printed by a read or scan
+        }
+        const Op *op = &trace->ops[i];
+        if (statements_left == 0)
+        {
+            statements_left = op->type == OP_READ_MODIFY_WRITE ? 2 : 1;
+            op_ns = 0;
+        }
+        op_ns += seconds * 1e9;
+        if (--statements_left == 0)
+        {
+            elapsed_ns += op_ns;
+            recorder_add(total, op->type, op_ns, elapsed_ns / interval_ns);
+            i++;
+        }
+    }
+    while (fgets(line, sizeof(line), repl))
+    {
+    }
+    fclose(repl);
+    waitpid(child, NULL, 0);
+    unlink(script_path);
+    remove_db_files(path);
+    if (i < trace->num_ops)
+    {
+        fail("The REPL stopped before the last operation", NULL);
+    }
+    return elapsed_ns;
+}
+
+static void print_report(const Trace *trace, const Recorder *recorder, bool json, const char *mode,
+                         uint32_t num_threads, uint64_t load_ns, uint64_t elapsed_ns, uint64_t interval_ns)
+{
+    uint64_t ops = 0;
+    for (uint32_t type = 0; type < NUM_OP_TYPES; type++)
+    {
+        ops += recorder->latency[type].count;
+    }
+    double ops_per_s = elapsed_ns ? ops * 1e9 / elapsed_ns : 0;
+
+    // the last interval is usually partial, so its rate is over the time it covered; it also
+    // takes operations that finished right at the end, which land just past it
+    uint32_t num_intervals = elapsed_ns ? (elapsed_ns + interval_ns - 1) / interval_ns : 1;
+    uint64_t *interval_ops = calloc(num_intervals, sizeof(uint64_t));
+    for (uint32_t interval = 0; interval < recorder->num_intervals; interval++)
+    {
+        interval_ops[interval < num_intervals ? interval : num_intervals - 1] += recorder->interval_ops[interval];
+    }
+
+    if (json)
+    {
+        printf("{\"workload\": \"%c\", \"records\": %u, \"operations\": %u, \"seed\": %llu, \"mode\": \"%s\", "
+               "\"threads\": %u,\n \"load_s\": %.6f, \"run_s\": %.6f, \"ops_per_s\": %.0f, \"not_found\": %llu,\n"
+               " \"timeline\": [",
+               trace->workload, trace->records, trace->num_ops, (unsigned long long)trace->seed, mode, num_threads,
+               load_ns / 1e9, elapsed_ns / 1e9, ops_per_s, (unsigned long long)recorder->not_found);
+    }
+    else
+    {
+        printf("workload %c: %u records, %u operations, seed %llu, %s, %u thread%s\n", trace->workload,
+               trace->records, trace->num_ops, (unsigned long long)trace->seed, mode, num_threads,
+               num_threads == 1 ? "" : "s");
+        if (load_ns)
+        {
+            printf("load %.3f s; ", load_ns / 1e9);
+        }
+        printf("run %.3f s, %.0f ops/s, %llu not found\n", elapsed_ns / 1e9, ops_per_s,
+               (unsigned long long)recorder->not_found);
+        printf("%10s %12s\n", "time s", "ops/s");
+    }
+    for (uint32_t interval = 0; interval < num_intervals; interval++)
+    {
+        uint64_t begin_ns = interval * interval_ns;
+        uint64_t end_ns = begin_ns + interval_ns < elapsed_ns ? begin_ns + interval_ns : elapsed_ns;
+        double rate = end_ns > begin_ns ? interval_ops[interval] * 1e9 / (end_ns - begin_ns) : 0;
+        if (json)
+        {
+            printf("%s{\"t\": %.3f, \"ops_per_s\": %.0f}", interval ? ", " : "", end_ns / 1e9, rate);
+        }
+        else
+        {
+            printf("%10.3f %12.0f\n", end_ns / 1e9, rate);
+        }
+    }
+
+    free(interval_ops);
+
+    if (json)
+    {
+        printf("],\n \"ops\": {");
+    }
+    else
+    {
+        printf("%-8s %10s %10s %10s %10s %10s %10s %10s\n", "op", "count", "mean ns", "p50 ns", "p90 ns", "p99 ns",
+               "p99.9 ns", "max ns");
+    }
+    bool first = true;
+    for (uint32_t type = 0; type < NUM_OP_TYPES; type++)
+    {
+        const LatencyHistogram *histogram = &recorder->latency[type];
+        if (histogram->count == 0)
+        {
+            continue;
+        }
+        double mean = (double)histogram->sum / histogram->count;
+        unsigned long long p50 = histogram_percentile(histogram, 50);
+        unsigned long long p90 = histogram_percentile(histogram, 90);
+        unsigned long long p99 = histogram_percentile(histogram, 99);
+        unsigned long long p999 = histogram_percentile(histogram, 99.9);
+        if (json)
+        {
+            printf("%s\n  \"%s\": {\"count\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+                   "\"p999\": %llu, \"max\": %llu}",
+                   first ? "" : ",", OP_NAMES[type], (unsigned long long)histogram->count, mean, p50, p90, p99, p999,
+                   (unsigned long long)histogram->max);
+        }
+        else
+        {
+            printf("%-8s %10llu %10.0f %10llu %10llu %10llu %10llu %10llu\n", OP_NAMES[type],
+                   (unsigned long long)histogram->count, mean, p50, p90, p99, p999,
+                   (unsigned long long)histogram->max);
+        }
+        first = false;
+    }
+    if (json)
+    {
+        printf("\n}}\n");
+    }
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s generate [-w A-F] [-r records] [-n operations] [-s seed] [-o trace]\n"
+            "       %s run [-t threads] [-i interval_ms] [--json] [--db file] [--repl program] trace\n"
+            "       %s script trace\n",
+            program, program, program);
+}
+
+static int generate_command(int argc, char *argv[])
+{
+    char name = 'A';
+    uint32_t records = 100000;
+    uint32_t operations = 1000000;
+    uint64_t seed = 1;
+    const char *output = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "w:r:n:s:o:")) != -1)
+    {
+        switch (option)
+        {
+        case 'w':
+            name = optarg[0] >= 'a' && optarg[0] <= 'z' ? optarg[0] - 'a' + 'A' : optarg[0];
+            break;
+        case 'r':
+            records = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            operations = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            return EXIT_FAILURE;
+        }
+    }
+    const WorkloadSpec *spec = find_workload(name);
+    if (spec == NULL || records == 0 || optind != argc)
+    {
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = output ? fopen(output, "w") : stdout;
+    if (file == NULL)
+    {
+        fail("Unable to write ", output);
+    }
+    Trace trace = generate(spec, records, operations, seed);
+    write_trace(file, &trace);
+    if (output)
+    {
+        fclose(file);
+    }
+    free(trace.ops);
+    return EXIT_SUCCESS;
+}
+
+static int run_command(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        {"json", no_argument, NULL, 'j'},
+        {"db", required_argument, NULL, 'd'},
+        {"repl", required_argument, NULL, 'p'},
+        {NULL, 0, NULL, 0},
+    };
+    uint32_t num_threads = 1;
+    uint64_t interval_ms = 1000;
+    bool json = false;
+    const char *path = DEFAULT_DB_FILE;
+    const char *repl = NULL;
+    int option;
+    while ((option = getopt_long(argc, argv, "t:i:", long_options, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case 't':
+            num_threads = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            interval_ms = strtoull(optarg, NULL, 10);
+            break;
+        case 'j':
+            json = true;
+            break;
+        case 'd':
+            path = optarg;
+            break;
+        case 'p':
+            repl = optarg;
+            break;
+        default:
+            return EXIT_FAILURE;
+        }
+    }
+    // one REPL process runs the statements in order, so it has no threads to spread them over
+    if (num_threads == 0 || interval_ms == 0 || optind != argc - 1 || (repl && num_threads != 1))
+    {
+        return EXIT_FAILURE;
+    }
+
+    check_db_files_absent(path);
+    Trace trace = read_trace(argv[optind]);
+    Recorder recorder;
+    recorder_init(&recorder);
+    uint64_t interval_ns = interval_ms * 1000000;
+    uint64_t load_ns = 0;
+    uint64_t elapsed_ns = repl ? replay_through_repl(&trace, path, repl, interval_ns, &recorder)
+                               : replay_in_process(&trace, path, num_threads, interval_ns, &recorder, &load_ns);
+    print_report(&trace, &recorder, json, repl ? "repl" : "in-process", num_threads, load_ns, elapsed_ns, interval_ns);
+    free(recorder.interval_ops);
+    free(trace.ops);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    int result = EXIT_FAILURE;
+    if (argc >= 2 && strcmp(argv[1], "generate") == 0)
+    {
+        result = generate_command(argc - 1, argv + 1);
+    }
+    else if (argc >= 2 && strcmp(argv[1], "run") == 0)
+    {
+        result = run_command(argc - 1, argv + 1);
+    }
+    else if (argc == 3 && strcmp(argv[1], "script") == 0)
+    {
+        Trace trace = read_trace(argv[2]);
+        write_script(stdout, &trace);
+        free(trace.ops);
+        result = EXIT_SUCCESS;
+    }
+    if (result != EXIT_SUCCESS)
+    {
+        print_usage(argv[0]);
+    }
+    return result;
+}